@@ -0,0 +1,127 @@
+/*
+ * $Id$
+ *
+    Copyright (c) 2016-2020 Chung, Hyung-Hwan. All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+    IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WAfRRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+    NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+    THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * hio-standby is started by a process pool made with hio_dev_pro_openpool().
+ * it blocks reading descriptor 3 until the pool sends a command and then
+ * executes the command in place, keeping the standard input, output and
+ * error set up by the pool. it exits without doing anything if the pool
+ * closes the descriptor first. the message is:
+ *   length(4, BE), env-mode('E' or 'I'), argv strings, '\0', env strings, '\0'
+ * each string is terminated by '\0'. 'I' keeps the inherited environment.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define CTLFD 3
+
+static int read_all (int fd, void* buf, size_t len)
+{
+	/* 1 when len bytes are read, 0 on end of input before any byte, -1 otherwise */
+	unsigned char* ptr = (unsigned char*)buf;
+	size_t total = 0;
+
+	while (total < len)
+	{
+		ssize_t n = read(fd, ptr + total, len - total);
+		if (n <= -1)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (n == 0) return (total == 0)? 0: -1;
+		total += n;
+	}
+
+	return 1;
+}
+
+static size_t count_strs (char* ptr, char* end, char** next)
+{
+	size_t count = 0;
+
+	while (ptr < end && *ptr != '\0')
+	{
+		while (ptr < end && *ptr != '\0') ptr++;
+		ptr++;
+		count++;
+	}
+
+	*next = ptr + 1; /* skip the terminating '\0' */
+	return count;
+}
+
+int main (int argc, char* argv[])
+{
+	unsigned char lb[4];
+	size_t len, nargs, nenvs, i;
+	char* buf, * ptr, * envptr, * end;
+	char** xargv, ** xenvp;
+	int n;
+
+	n = read_all(CTLFD, lb, sizeof(lb));
+	if (n == 0) return 0; /* the pool is closed */
+	if (n <= -1) return 128;
+
+	len = ((size_t)lb[0] << 24) | ((size_t)lb[1] << 16) | ((size_t)lb[2] << 8) | lb[3];
+	if (len < 3) return 128;
+
+	buf = malloc(len);
+	if (!buf || read_all(CTLFD, buf, len) <= 0 || buf[len - 1] != '\0') return 128;
+	close (CTLFD);
+
+	end = buf + len;
+	nargs = count_strs(buf + 1, end, &envptr);
+	if (nargs <= 0 || envptr >= end) return 128;
+	nenvs = count_strs(envptr, end, &ptr);
+	if (ptr > end) return 128;
+
+	xargv = malloc((nargs + nenvs + 2) * sizeof(*xargv));
+	if (!xargv) return 128;
+	xenvp = xargv + nargs + 1;
+
+	for (ptr = buf + 1, i = 0; i < nargs; i++)
+	{
+		xargv[i] = ptr;
+		while (*ptr != '\0') ptr++;
+		ptr++;
+	}
+	xargv[i] = NULL;
+
+	for (ptr = envptr, i = 0; i < nenvs; i++)
+	{
+		xenvp[i] = ptr;
+		while (*ptr != '\0') ptr++;
+		ptr++;
+	}
+	xenvp[i] = NULL;
+
+	if (buf[0] == 'E') execve (xargv[0], xargv, xenvp);
+	else execv (xargv[0], xargv);
+	return 128;
+}
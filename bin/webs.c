@@ -16,10 +16,21 @@
 struct arg_info_t
 {
 	const char* logopt;
+	const char* alogpath;
+	const char* mtrpath;
+	const char* dnsaddr;
+	const char* dns_ttl_max;
+	const char* dns_cache_max;
+	const char* client_conn_max;
+	const char* client_req_rate;
+	const char* client_req_burst;
+	const char* cgi_prefork;
+	const char* cgi_prefork_helper;
 	const char* laddrs;
 	const char* docroot;
 	int file_list_dir;
 	int file_load_index_page;
+	int proxy;
 };
 typedef struct arg_info_t arg_info_t;
 
@@ -38,19 +49,14 @@ typedef struct buff_t buff_t;
 
 /* ------------------------------------------------------------------------- */
 
-static void untar_write_status_code (int fd, int code)
+static void untar_write_status_code (hio_dev_thr_iopair_t* iop, int code)
 {
-	switch (code)
+	static hio_svc_htts_thr_hdr_t hdrs[] =
 	{
-		case 200:
-			write (fd, "Status: 200\r\n\r\n", 15);
-			break;
+		{ "Content-Length", "0" }
+	};
 
-		case 500:
-		default:
-			write (fd, "Status: 500\r\n\r\n", 15);
-			break;
-	}
+	hio_svc_htts_thr_writereshdr (iop, code, hdrs, HIO_COUNTOF(hdrs));
 }
 
 static void untar (hio_svc_htts_t* htts, hio_dev_thr_iopair_t* iop, hio_svc_htts_thr_func_info_t* tfi, void* ctx)
@@ -69,14 +75,14 @@ static void untar (hio_svc_htts_t* htts, hio_dev_thr_iopair_t* iop, hio_svc_htts
 	wfp = fdopen(iop->wfd, "w");
 	if (!wfp)
 	{
-		untar_write_status_code (iop->wfd, 500);
+		untar_write_status_code (iop, 500);
 		goto done;
 	}
 
 	tar = hio_tar_open(hio, 0);
 	if (!tar)
 	{
-		untar_write_status_code (iop->wfd, 500);
+		untar_write_status_code (iop, 500);
 		goto done;
 	}
 
@@ -89,13 +95,13 @@ static void untar (hio_svc_htts_t* htts, hio_dev_thr_iopair_t* iop, hio_svc_htts
 
 		if (hio_tar_xfeed(tar, buf, n) <= -1)
 		{
-			untar_write_status_code (iop->wfd, 500);
+			untar_write_status_code (iop, 500);
 			goto done;
 		}
 	}
 
 	hio_tar_endxfeed (tar);
-	untar_write_status_code (iop->wfd, 200);
+	untar_write_status_code (iop, 200);
 
 done:
 	if (tar)
@@ -111,6 +117,22 @@ done:
 
 /* ------------------------------------------------------------------------- */
 
+static int options (hio_svc_htts_t* htts, hio_svc_htts_task_t* task, hio_htre_t* req, void* ctx)
+{
+	/* TODO: write proper handler for preflight */
+	if (hio_svc_htts_task_startreshdr(task, HIO_HTTP_STATUS_OK, HIO_NULL, 0) <= -1 ||
+	    hio_svc_htts_task_addreshdr(task, "Content-Length", "0") <= -1 ||
+	    hio_svc_htts_task_addreshdr(task, "Access-Control-Allow-Origin", "*") <= -1 ||
+	    hio_svc_htts_task_addreshdr(task, "Access-Control-Allow-Methods", "*") <= -1 ||
+	    hio_svc_htts_task_addreshdr(task, "Access-Control-Allow-Headers", "*") <= -1 ||
+	    hio_svc_htts_task_addreshdr(task, "Access-Control-Allow-Credentials", "true") <= -1 ||
+	    hio_svc_htts_task_endreshdr(task) <= -1 ||
+	    hio_svc_htts_task_endbody(task) <= -1) return -1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static hio_oow_t write_all_to_fd (int fd, const hio_uint8_t* ptr, hio_oow_t len)
 {
 	hio_oow_t rem = len;
@@ -333,10 +355,16 @@ static int process_http_request (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_
 	    ((proto_len = 8) && hio_comp_bcstr_limited(qpath, "https://", 8, 1) == 0))
 	{
 		const hio_bch_t* tmp;
+
+		if (ext->ai->proxy && proto_len == 7)
+		{
+			/* relay the request to the upstream in the absolute form of the request target */
+			if (hio_svc_htts_doprxy(htts, csck, req, HIO_NULL, 0, htts_task_on_kill) <= -1) goto oops;
+			return 0;
+		}
+
 		tmp = hio_find_bchar_in_bcstr(qpath + proto_len, '/');
 		if (tmp) qpath = tmp; /* skip http://domain.name */
-
-		/* TODO: support proxy .... */
 	}
 
 	if (mth == HIO_HTTP_OTHER && hio_comp_bcstr(hio_htre_getqmethodname(req), "UNTAR", 1) == 0 && hio_comp_bcstr(qpath_ext, ".tar", 0) == 0)
@@ -344,16 +372,17 @@ static int process_http_request (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_
 		/* don't care about the path for now. TODO: make this secure and reasonable */
 		if (hio_svc_htts_dothr(htts, csck, req, untar, HIO_NULL, 0, htts_task_on_kill) <= -1) goto oops;
 	}
+	else if (ext->ai->mtrpath && mth == HIO_HTTP_GET && hio_comp_bcstr(qpath, ext->ai->mtrpath, 0) == 0)
+	{
+		if (hio_svc_htts_dometrics(htts, csck, req, htts_task_on_kill) <= -1) goto oops;
+	}
 	else if (mth == HIO_HTTP_OPTIONS)
 	{
-/* TODO: write proper handler for preflight */
-		//if (hio_svc_htts_dofun(htts, csck, req, options, HIO_NULL, 0) <= -1) goto oops;
-		const hio_bch_t* msg = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\nAccess-Control-Allow-Origin: *\r\nAccess-Control-Allow-Methods: *\r\nAccess-Control-Allow-Headers: *\r\nAccess-Control-Allow-Credentials: true\r\n\r\n";
-		hio_dev_sck_write(csck, msg, strlen(msg), HIO_NULL, HIO_NULL);
+		if (hio_svc_htts_dofun(htts, csck, req, options, HIO_NULL, 0, htts_task_on_kill) <= -1) goto oops;
 	}
 	else if (hio_comp_bcstr(qpath_ext, ".cgi", 0) == 0)
 	{
-		if (hio_svc_htts_docgi(htts, csck, req, ext->ai->docroot, qpath, 0, htts_task_on_kill) <= -1) goto oops;
+		if (hio_svc_htts_docgi(htts, csck, req, ext->ai->docroot, qpath, HIO_SVC_HTTS_CGI_PREFORK, htts_task_on_kill) <= -1) goto oops;
 	}
 	else if (hio_comp_bcstr(qpath_ext, ".php", 0) == 0 || hio_comp_bcstr(qpath_ext, ".ant", 0) == 0 /*|| hio_comp_bcstr_limited(qpath, "http://", 7, 1) == 0*/)
 	{
@@ -372,7 +401,7 @@ static int process_http_request (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_
 	{
 		/* TODO: proper mime-type */
 		/* TODO: make HIO_SVC_HTTS_FILE_DIR a cli option */
-		if (hio_svc_htts_dofile(htts, csck, req, ext->ai->docroot, qpath, HIO_NULL, 0, htts_task_on_kill, &fcbs) <= -1) goto oops;
+		if (hio_svc_htts_dofile(htts, csck, req, ext->ai->docroot, qpath, HIO_NULL, HIO_SVC_HTTS_FILE_PRECOMPRESSED, htts_task_on_kill, &fcbs) <= -1) goto oops;
 	}
 #if 0
 	else
@@ -429,6 +458,25 @@ int webs_start (hio_t* hio, const arg_info_t* ai)
 		hio_oow_t ov;
 		ov = 200;
 		hio_svc_htts_setoption (webs, HIO_SVC_HTTS_TASK_CGI_MAX, &ov);
+		ov = 8;
+		hio_svc_htts_setoption (webs, HIO_SVC_HTTS_TASK_THR_MAX, &ov);
+		ov = ai->cgi_prefork? strtoul(ai->cgi_prefork, HIO_NULL, 10): 4;
+		hio_svc_htts_setoption (webs, HIO_SVC_HTTS_TASK_CGI_PREFORK, &ov);
+		ov = 32;
+		hio_svc_htts_setoption (webs, HIO_SVC_HTTS_TASK_FCGI_CONN_MAX, &ov);
+		ov = 1024;
+		hio_svc_htts_setoption (webs, HIO_SVC_HTTS_FILE_CACHE_MAX, &ov);
+		ov = 16 * 1024 * 1024;
+		hio_svc_htts_setoption (webs, HIO_SVC_HTTS_FILE_MEMCACHE_MAX, &ov);
+		ov = 1024;
+		hio_svc_htts_setoption (webs, HIO_SVC_HTTS_RES_COMPRESS_MIN, &ov);
+	}
+
+	if (ai->cgi_prefork_helper && hio_svc_htts_setoption(webs, HIO_SVC_HTTS_TASK_CGI_PREFORK_HELPER, &ai->cgi_prefork_helper) <= -1)
+	{
+		fprintf (stderr, "ERROR: unable to set cgi prefork helper %s - %s\n", ai->cgi_prefork_helper, hio_geterrbmsg(hio));
+		hio_svc_htts_stop (webs);
+		return -1;
 	}
 
 	if (hio_svc_htts_enablefcgic(webs, &fcgic_tmout) <= -1)
@@ -438,6 +486,71 @@ int webs_start (hio_t* hio, const arg_info_t* ai)
 		return -1;
 	}
 
+	if (ai->dnsaddr)
+	{
+		/* the proxy resolves the host names in the request targets */
+		hio_skad_t dnsaddr;
+		hio_ntime_t send_tmout, reply_tmout;
+
+		HIO_INIT_NTIME (&send_tmout, 1, 0);
+		HIO_INIT_NTIME (&reply_tmout, 2, 0);
+		if (hio_bcstrtoskad(hio, ai->dnsaddr, &dnsaddr) <= -1 ||
+		    hio_svc_htts_enablednc(webs, &dnsaddr, &send_tmout, &reply_tmout, 3) <= -1)
+		{
+			fprintf (stderr, "ERROR: unable to use dns server %s - %s\n", ai->dnsaddr, hio_geterrbmsg(hio));
+			hio_svc_htts_stop (webs);
+			return -1;
+		}
+
+		if (ai->dns_ttl_max)
+		{
+			hio_ntime_t ttl;
+			HIO_INIT_NTIME (&ttl, strtoul(ai->dns_ttl_max, HIO_NULL, 10), 0);
+			hio_svc_htts_setoption (webs, HIO_SVC_HTTS_TASK_PRXY_DNS_TTL_MAX, &ttl);
+		}
+		if (ai->dns_cache_max)
+		{
+			hio_oow_t ov;
+			ov = strtoul(ai->dns_cache_max, HIO_NULL, 10);
+			hio_svc_htts_setoption (webs, HIO_SVC_HTTS_TASK_PRXY_DNS_CACHE_MAX, &ov);
+		}
+	}
+
+	if (ai->client_conn_max)
+	{
+		hio_oow_t ov;
+		ov = strtoul(ai->client_conn_max, HIO_NULL, 10);
+		hio_svc_htts_setoption (webs, HIO_SVC_HTTS_CLIENT_CONN_MAX, &ov);
+	}
+	if (ai->client_req_rate)
+	{
+		hio_oow_t ov;
+		ov = strtoul(ai->client_req_rate, HIO_NULL, 10);
+		hio_svc_htts_setoption (webs, HIO_SVC_HTTS_CLIENT_REQ_RATE, &ov);
+	}
+	if (ai->client_req_burst)
+	{
+		hio_oow_t ov;
+		ov = strtoul(ai->client_req_burst, HIO_NULL, 10);
+		hio_svc_htts_setoption (webs, HIO_SVC_HTTS_CLIENT_REQ_BURST, &ov);
+	}
+
+	if (ai->alogpath)
+	{
+		hio_svc_htts_alog_cfg_t alog;
+
+		HIO_MEMSET (&alog, 0, HIO_SIZEOF(alog));
+		alog.path = ai->alogpath;
+		alog.rotate_size = 64 * 1024 * 1024;
+		alog.rotate_interval = 24 * 60 * 60;
+		if (hio_svc_htts_openalog(webs, &alog) <= -1)
+		{
+			fprintf (stderr, "ERROR: unable to open access log %s - %s\n", ai->alogpath, hio_geterrbmsg(hio));
+			hio_svc_htts_stop (webs);
+			return -1;
+		}
+	}
+
 	ext = hio_svc_htts_getxtn(webs);
 	ext->ai = ai;
 
@@ -593,6 +706,17 @@ static int process_args (int argc, char* argv[], arg_info_t* ai)
 		{ "file-no-list-dir", '\0' },
 		{ "file-no-load-index-page", '\0'},
 		{ ":log",             'l' },
+		{ ":access-log",      '\0' },
+		{ ":metrics",         '\0' },
+		{ "proxy",            '\0' },
+		{ ":proxy-dns",       '\0' },
+		{ ":proxy-dns-ttl-max", '\0' },
+		{ ":proxy-dns-cache-max", '\0' },
+		{ ":client-conn-max", '\0' },
+		{ ":client-req-rate", '\0' },
+		{ ":client-req-burst", '\0' },
+		{ ":cgi-prefork",     '\0' },
+		{ ":cgi-prefork-helper", '\0' },
 		{ HIO_NULL, '\0'}
 	};
 	static hio_bopt_t opt =
@@ -634,6 +758,61 @@ static int process_args (int argc, char* argv[], arg_info_t* ai)
 					ai->file_load_index_page = 0;
 					break;
 				}
+				else if (strcasecmp(opt.lngopt, "access-log") == 0)
+				{
+					ai->alogpath = opt.arg;
+					break;
+				}
+				else if (strcasecmp(opt.lngopt, "metrics") == 0)
+				{
+					ai->mtrpath = opt.arg;
+					break;
+				}
+				else if (strcasecmp(opt.lngopt, "proxy") == 0)
+				{
+					ai->proxy = 1;
+					break;
+				}
+				else if (strcasecmp(opt.lngopt, "proxy-dns") == 0)
+				{
+					ai->dnsaddr = opt.arg;
+					break;
+				}
+				else if (strcasecmp(opt.lngopt, "proxy-dns-ttl-max") == 0)
+				{
+					ai->dns_ttl_max = opt.arg;
+					break;
+				}
+				else if (strcasecmp(opt.lngopt, "proxy-dns-cache-max") == 0)
+				{
+					ai->dns_cache_max = opt.arg;
+					break;
+				}
+				else if (strcasecmp(opt.lngopt, "client-conn-max") == 0)
+				{
+					ai->client_conn_max = opt.arg;
+					break;
+				}
+				else if (strcasecmp(opt.lngopt, "client-req-rate") == 0)
+				{
+					ai->client_req_rate = opt.arg;
+					break;
+				}
+				else if (strcasecmp(opt.lngopt, "client-req-burst") == 0)
+				{
+					ai->client_req_burst = opt.arg;
+					break;
+				}
+				else if (strcasecmp(opt.lngopt, "cgi-prefork") == 0)
+				{
+					ai->cgi_prefork = opt.arg;
+					break;
+				}
+				else if (strcasecmp(opt.lngopt, "cgi-prefork-helper") == 0)
+				{
+					ai->cgi_prefork_helper = opt.arg;
+					break;
+				}
 				goto print_usage;
 
 
@@ -1071,6 +1071,16 @@ hio_dns_msg_t* hio_svc_dnc_resolve (hio_svc_dnc_t* dnc, const hio_bch_t* qname,
 	return reqmsg;
 }
 
+void* hio_svc_dnc_getmsgxtn (hio_svc_dnc_t* dnc, hio_dns_msg_t* msg)
+{
+	return (void*)(dnc_dns_msg_getxtn(msg) + 1);
+}
+
+void* hio_svc_dnc_getresolvemsgxtn (hio_svc_dnc_t* dnc, hio_dns_msg_t* reqmsg)
+{
+	return (void*)(dnc_dns_msg_resolve_getxtn(reqmsg) + 1);
+}
+
 int hio_svc_dnc_checkclientcookie (hio_svc_dnc_t* dnc, hio_dns_msg_t* reqmsg, hio_dns_pkt_info_t* respi)
 {
 	hio_uint8_t xb[HIO_DNS_COOKIE_CLIENT_LEN];
@@ -26,6 +26,11 @@
 #include <hio-sck.h>
 #include "hio-prv.h"
 
+typedef struct fcgic_pool_t fcgic_pool_t;
+typedef struct fcgic_member_t fcgic_member_t;
+
+#define FCGIC_POOL_BKT_SIZE (64) /* must be a power of 2 */
+
 struct hio_svc_fcgic_t
 {
 	HIO_SVC_HEADER;
@@ -33,23 +38,81 @@ struct hio_svc_fcgic_t
 	int stopping;
 	hio_svc_fcgic_tmout_t tmout;
 
-	hio_svc_fcgic_conn_t* conns;
+	struct
+	{
+		hio_oow_t conn_max; /* 0 for no limit */
+		hio_oow_t sess_max; /* 0 for as many as a connection can carry */
+		hio_oow_t max_fails;
+		hio_ntime_t fail_timeout;
+	} option;
+
+	fcgic_pool_t* pool_bkt[FCGIC_POOL_BKT_SIZE];
+	hio_svc_fcgic_upstream_t* upstreams;
 };
 
 #if 0
 #define CONN_SESS_CAPA_MAX (4)
 #define CONN_SESS_INC  (2)
 #else
-#define CONN_SESS_CAPA_MAX (65536)
+#define CONN_SESS_CAPA_MAX (65535) /* the request id is 16-bit wide and 0 is reserved */
 #define CONN_SESS_INC  (64)
 #endif
 
+/* connections to the same fastcgi server */
+struct fcgic_pool_t
+{
+	hio_skad_t addr;
+	int no_mpx; /* the server replied with HIO_FCGI_CANT_MPX_CONN */
+	hio_oow_t nconns;
+	hio_svc_fcgic_conn_t* conns;
+	hio_oow_t nsess; /* number of outstanding requests over all connections */
+
+	hio_oow_t nfails; /* number of consecutive failures */
+	hio_ntime_t down_until; /* upstreams skip the server until this time once nfails reaches option.max_fails */
+
+	fcgic_pool_t* next; /* next pool in the same bucket */
+};
+
+/* server in an upstream group */
+struct fcgic_member_t
+{
+	fcgic_pool_t* pool;
+	hio_oow_t weight;
+	hio_intmax_t cw; /* current weight for smooth weighted round robin */
+	hio_oow_t nreqs;
+	hio_dev_sck_t* probe;
+};
+
+struct hio_svc_fcgic_upstream_t
+{
+	hio_svc_fcgic_t* fcgic;
+	hio_svc_fcgic_upstream_cfg_t cfg;
+	hio_oow_t start; /* position to begin the search at for even distribution among equals */
+	hio_tmridx_t probe_tmridx;
+
+	hio_oow_t nmembers;
+	fcgic_member_t* members;
+
+	hio_svc_fcgic_upstream_t* prev;
+	hio_svc_fcgic_upstream_t* next;
+};
+
+struct fcgic_probe_xtn_t
+{
+	hio_svc_fcgic_upstream_t* ups;
+	fcgic_member_t* member;
+	int ok;
+	hio_oow_t len;
+	hio_uint8_t hdr[HIO_SIZEOF(hio_fcgi_record_header_t)];
+};
+typedef struct fcgic_probe_xtn_t fcgic_probe_xtn_t;
+
 struct hio_svc_fcgic_conn_t
 {
 	HIO_CFMB_HEADER;
 
 	hio_svc_fcgic_t* fcgic;
-	hio_skad_t addr;
+	fcgic_pool_t* pool;
 	hio_dev_sck_t* dev;
 	int connected;
 
@@ -57,6 +120,7 @@ struct hio_svc_fcgic_conn_t
 	{
 		hio_svc_fcgic_sess_t** ptr;
 		hio_oow_t capa;
+		hio_oow_t count; /* number of sessions not in the free list */
 		hio_svc_fcgic_sess_t* free;
 	} sess;
 
@@ -65,7 +129,8 @@ struct hio_svc_fcgic_conn_t
 		enum
 		{
 			R_AWAITING_HEADER,
-			R_AWAITING_BODY
+			R_AWAITING_CONTENT,
+			R_AWAITING_PADDING
 		} state;
 
 		hio_uint8_t   type;
@@ -73,11 +138,12 @@ struct hio_svc_fcgic_conn_t
 		hio_uint16_t  content_len;
 		hio_uint8_t   padding_len;
 
-		hio_uint32_t body_len; /* content_len+ padding_len */
-		hio_uint8_t buf[65792]; /* TODO: make it smaller by fireing on_read more frequently? */
-		hio_oow_t len; /* current bufferred length */
-	} r; /* space to parse incoming reply header */
+		hio_uint8_t hdr[HIO_SIZEOF(hio_fcgi_record_header_t)];
+		hio_uint8_t erb[HIO_SIZEOF(hio_fcgi_end_request_body_t)];
+		hio_oow_t len; /* bytes of the header, the content or the padding processed so far */
+	} r; /* state to parse incoming records. the content is passed to on_read() as it arrives */
 
+	hio_svc_fcgic_conn_t* prev;
 	hio_svc_fcgic_conn_t* next;
 };
 
@@ -89,6 +155,37 @@ typedef struct fcgic_sck_xtn_t fcgic_sck_xtn_t;
 
 static int make_connection_socket (hio_svc_fcgic_t* fcigc, hio_svc_fcgic_conn_t* conn);
 static void release_session (hio_svc_fcgic_sess_t* sess);
+static void free_session (hio_svc_fcgic_sess_t* sess);
+static void destroy_connection (hio_svc_fcgic_conn_t* conn);
+
+/* ------------------------------------------------------------------------ */
+
+static void mark_server_failure (hio_svc_fcgic_t* fcgic, fcgic_pool_t* pool)
+{
+	pool->nfails++;
+	if (fcgic->option.max_fails > 0 && pool->nfails >= fcgic->option.max_fails)
+	{
+		hio_ntime_t now;
+
+		/* passive failure detection. the server is tried again after the timeout */
+		hio_gettime (fcgic->hio, &now);
+		HIO_ADD_NTIME (&pool->down_until, &now, &fcgic->option.fail_timeout);
+		if (pool->nfails == fcgic->option.max_fails)
+			HIO_DEBUG1 (fcgic->hio, "FCGIC - marking server %p down\n", pool);
+	}
+}
+
+static void mark_server_success (fcgic_pool_t* pool)
+{
+	pool->nfails = 0;
+}
+
+static int is_server_down (hio_svc_fcgic_t* fcgic, fcgic_pool_t* pool, const hio_ntime_t* now)
+{
+	return fcgic->option.max_fails > 0 && pool->nfails >= fcgic->option.max_fails && HIO_CMP_NTIME(now, &pool->down_until) < 0;
+}
+
+/* ------------------------------------------------------------------------ */
 
 static void sck_on_disconnect (hio_dev_sck_t* sck)
 {
@@ -100,16 +197,26 @@ static void sck_on_disconnect (hio_dev_sck_t* sck)
 	if (conn)
 	{
 		hio_oow_t i;
+		int failed;
+
+		/* a connection failure or a disconnection in the middle of a request */
+		failed = !conn->connected;
+
+		conn->dev = HIO_NULL;
 		for (i = 0; i < conn->sess.capa; i++)
 		{
 			hio_svc_fcgic_sess_t* sess;
 			sess = conn->sess.ptr[i];
-			if (sess && sess->active)
-			{
-				release_session (sess); /* TODO: is this correct?? */
-			}
+			if (sess->inflight) failed = 1;
+			if (sess->active) release_session (sess); /* TODO: is this correct?? */
+			else if (sess->inflight) free_session (sess); /* no more records for the aborted request */
 		}
-		conn->dev = HIO_NULL;
+
+		if (failed) mark_server_failure (conn->fcgic, conn->pool);
+
+		/* a dead connection is not reused. a new connection is made upon demand */
+		sck_xtn->conn = HIO_NULL;
+		destroy_connection (conn);
 	}
 }
 
@@ -120,9 +227,15 @@ static void sck_on_connect (hio_dev_sck_t* sck)
 
 /* printf ("FCGIC SOCKET CONNECTED >>>>>>>>>>>>>>>>>>>>>>>>>>\n"); */
 
+	conn->connected = 1;
+
 	/* reinitialize the input parsing information */
-	HIO_MEMSET (&conn->r, 0, HIO_SIZEOF(conn->r));
 	conn->r.state = R_AWAITING_HEADER;
+	conn->r.type = 0;
+	conn->r.id = 0;
+	conn->r.content_len = 0;
+	conn->r.padding_len = 0;
+	conn->r.len = 0;
 
 	if (!HIO_IS_NEG_NTIME(&conn->fcgic->tmout.r))
 		hio_dev_sck_timedread (sck, 1, &conn->fcgic->tmout.r);
@@ -134,6 +247,7 @@ static int sck_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrctx, con
 	 *  hio_svc_fcgic_beginrequest()
 	 *  hio_svc_fcgic_writeparam()
 	 *  hio_svc_fcgic_writestdin()
+	 *  abort_request()
 	 */
 	hio_svc_fcgic_sess_t* sess = (hio_svc_fcgic_sess_t*)((hio_oow_t)wrctx & ~(hio_oow_t)0x3);
 	hio_oow_t type = ((hio_oow_t)wrctx & 0x3);
@@ -141,9 +255,13 @@ static int sck_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrctx, con
 	{
 		HIO_FCGI_BEGIN_REQUEST,
 		HIO_FCGI_PARAMS,
-		HIO_FCGI_STDIN
+		HIO_FCGI_STDIN,
+		HIO_FCGI_ABORT_REQUEST
 	};
 
+	/* the session may have been untied before the pending write completes */
+	if (rqtype[type] == HIO_FCGI_ABORT_REQUEST || !sess->active) return 0;
+
 	if (wrlen > 0)
 	{
 		HIO_ASSERT (sess->conn->hio, wrlen >= HIO_SIZEOF(hio_fcgi_record_header_t));
@@ -154,6 +272,12 @@ static int sck_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrctx, con
 	return 0;
 }
 
+static HIO_INLINE hio_svc_fcgic_sess_t* get_session (hio_svc_fcgic_conn_t* conn, hio_uint16_t id)
+{
+	/* management records use 0 for requestId. the session id is requestId - 1 */
+	return (id >= 1 && id <= conn->sess.capa)? conn->sess.ptr[id - 1]: HIO_NULL;
+}
+
 static int sck_on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t dlen, const hio_skad_t* srcaddr)
 {
 	fcgic_sck_xtn_t* sck_xtn = hio_dev_sck_getxtn(sck);
@@ -187,7 +311,7 @@ static int sck_on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t dlen,
 
 				reqlen = HIO_SIZEOF(*h) - conn->r.len;
 				cplen = (dlen > reqlen)? reqlen: dlen;
-				HIO_MEMCPY (&conn->r.buf[conn->r.len], data, cplen);
+				HIO_MEMCPY (&conn->r.hdr[conn->r.len], data, cplen);
 				conn->r.len += cplen;
 
 				data += cplen;
@@ -201,18 +325,14 @@ static int sck_on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t dlen,
 				}
 
 				/* header complted */
-				h = (hio_fcgi_record_header_t*)conn->r.buf;
+				h = (hio_fcgi_record_header_t*)conn->r.hdr;
 				conn->r.type = h->type;
 				conn->r.id = hio_ntoh16(h->id);
 				conn->r.content_len = hio_ntoh16(h->content_len);
 				conn->r.padding_len = h->padding_len;
 
-				conn->r.state = R_AWAITING_BODY;
-				conn->r.body_len = conn->r.content_len + conn->r.padding_len;
-				conn->r.len = 0; /* reset to 0 to use the buffer to hold body */
-
-				/* the expected body length must not be too long */
-				HIO_ASSERT (hio, conn->r.body_len <= HIO_SIZEOF(conn->r.buf));
+				conn->r.state = R_AWAITING_CONTENT;
+				conn->r.len = 0; /* reset to 0 to count the content bytes */
 
 				if (conn->r.type == HIO_FCGI_END_REQUEST && conn->r.content_len < HIO_SIZEOF(hio_fcgi_end_request_body_t))
 				{
@@ -222,63 +342,92 @@ static int sck_on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t dlen,
 					goto done;
 				}
 
-				if (conn->r.content_len == 0) goto got_body;
+				if (conn->r.content_len == 0) goto content_done;
 			}
-			else /* R_AWAITING_BODY */
+			else if (conn->r.state == R_AWAITING_CONTENT)
 			{
 				hio_svc_fcgic_sess_t* sess;
 
-				reqlen = conn->r.body_len - conn->r.len;
+				reqlen = conn->r.content_len - conn->r.len;
 				cplen = (dlen > reqlen)? reqlen: dlen;
-				HIO_MEMCPY (&conn->r.buf[conn->r.len], data, cplen);
-				conn->r.len += cplen;
 
+				if (conn->r.type == HIO_FCGI_STDOUT)
+				{
+					/* pass the content as it arrives instead of waiting for the whole record.
+					 * look up the session for every chunk as on_read() may untie it */
+					sess = get_session(conn, conn->r.id);
+					if (sess && sess->active) sess->on_read (sess, data, cplen, sess->ctx); /* TODO: tell between stdout and stderr */
+				}
+				else if (conn->r.type == HIO_FCGI_END_REQUEST && conn->r.len < HIO_SIZEOF(conn->r.erb))
+				{
+					hio_oow_t erblen = HIO_SIZEOF(conn->r.erb) - conn->r.len;
+					if (erblen > cplen) erblen = cplen;
+					HIO_MEMCPY (&conn->r.erb[conn->r.len], data, erblen);
+				}
+				/* TODO: log stderr to a file?? or handle it differently according to options given - discard or write to file */
+				/* other records are discarded */
+
+				conn->r.len += cplen;
 				data += cplen;
 				dlen -= cplen;
 
-				if (conn->r.len < conn->r.body_len)
+				if (conn->r.len < conn->r.content_len)
 				{
 					HIO_ASSERT (hio, dlen == 0);
 					break;
 				}
 
-			got_body:
-				/* get session by session id */
-				sess = (conn->r.id >= 1 && conn->r.id <= conn->sess.capa)? conn->sess.ptr[conn->r.id - 1]: HIO_NULL;
-
-				if (!sess || !sess->active)
-				{
-					/* discard the record. no associated session or inactive session */
-					goto back_to_header;
-				}
-
-				/* the complete body is in conn->r.buf */
+			content_done:
 				if (conn->r.type == HIO_FCGI_END_REQUEST)
 				{
-					hio_fcgi_end_request_body_t* erb = (hio_fcgi_end_request_body_t*)conn->r.buf;
-
-					if (erb->proto_status != HIO_FCGI_REQUEST_COMPLETE)
+					sess = get_session(conn, conn->r.id);
+					if (sess && sess->active)
 					{
-						/* error */
-						hio_uint32_t app_status = hio_ntoh32(erb->app_status);
+						hio_fcgi_end_request_body_t* erb = (hio_fcgi_end_request_body_t*)conn->r.erb;
+
+						if (erb->proto_status != HIO_FCGI_REQUEST_COMPLETE)
+						{
+							/* error */
+							hio_uint32_t app_status = hio_ntoh32(erb->app_status);
+
+							/* send one request at a time to this server from now on */
+							if (erb->proto_status == HIO_FCGI_CANT_MPX_CONN) conn->pool->no_mpx = 1;
+							else if (erb->proto_status == HIO_FCGI_OVERLOADED) mark_server_failure (conn->fcgic, conn->pool);
+						}
+						else mark_server_success (conn->pool);
+						sess->inflight = 0;
+
+						/* zero length to indicate the end of input */
+						sess->on_read (sess, conn->r.erb, 0, sess->ctx);
+					}
+					else if (sess && sess->inflight)
+					{
+						/* the request id of an aborted request is reusable upon its end */
+						free_session (sess);
 					}
-					conn->r.content_len = 0; /* to indicate the end of input*/
 				}
-				else if (conn->r.content_len == 0 || conn->r.type != HIO_FCGI_STDOUT)
+
+				conn->r.state = R_AWAITING_PADDING;
+				conn->r.len = 0;
+				if (conn->r.padding_len == 0) goto back_to_header;
+			}
+			else /* R_AWAITING_PADDING */
+			{
+				reqlen = conn->r.padding_len - conn->r.len;
+				cplen = (dlen > reqlen)? reqlen: dlen;
+				conn->r.len += cplen;
+				data += cplen;
+				dlen -= cplen;
+
+				if (conn->r.len < conn->r.padding_len)
 				{
-					/* discard the record */
-					/* TODO: log stderr to a file?? or handle it differently according to options given - discard or write to file */
-					/* TODO: logging */
-					goto back_to_header;
+					HIO_ASSERT (hio, dlen == 0);
+					break;
 				}
 
-				HIO_ASSERT (hio, conn->r.content_len <= conn->r.len);
-				sess->on_read (sess, conn->r.buf, conn->r.content_len, sess->ctx); /* TODO: tell between stdout and stderr */
-
 			back_to_header:
 				conn->r.state = R_AWAITING_HEADER;
 				conn->r.len = 0;
-				conn->r.body_len = 0;
 				conn->r.content_len = 0;
 				conn->r.padding_len = 0;
 			}
@@ -298,7 +447,7 @@ static int make_connection_socket (hio_svc_fcgic_t* fcgic, hio_svc_fcgic_conn_t*
 	fcgic_sck_xtn_t* sck_xtn;
 
 	HIO_MEMSET (&mi, 0, HIO_SIZEOF(mi));
-	if (hio_get_stream_sck_type_from_skad(&conn->addr, &mi.type) <= -1)
+	if (hio_get_stream_sck_type_from_skad(&conn->pool->addr, &mi.type) <= -1)
 	{
 		hio_seterrnum (hio, HIO_EINVAL);
 		return -1;
@@ -316,7 +465,7 @@ static int make_connection_socket (hio_svc_fcgic_t* fcgic, hio_svc_fcgic_conn_t*
 	sck_xtn->conn = conn;
 
 	HIO_MEMSET (&ci, 0, HIO_SIZEOF(ci));
-	ci.remoteaddr = conn->addr;
+	ci.remoteaddr = conn->pool->addr;
 	ci.connect_tmout = fcgic->tmout.c;
 
 	if (hio_dev_sck_connect(sck, &ci) <= -1)
@@ -332,31 +481,55 @@ static int make_connection_socket (hio_svc_fcgic_t* fcgic, hio_svc_fcgic_conn_t*
 	return 0;
 }
 
-static hio_svc_fcgic_conn_t* get_connection (hio_svc_fcgic_t* fcgic, const hio_skad_t* fcgis_addr)
+static hio_oow_t hash_skad (const hio_skad_t* addr)
+{
+	/* hio_equal_skads() considers the family, the port and the ip address only */
+	hio_oow_t hv;
+	hio_uint8_t ipad[16];
+	hio_oow_t iplen;
+	int tmp;
+
+	tmp = hio_skad_get_family(addr);
+	HIO_HASH_BYTES (hv, &tmp, HIO_SIZEOF(tmp));
+	tmp = hio_skad_get_port(addr);
+	HIO_HASH_MORE_BYTES (hv, &tmp, HIO_SIZEOF(tmp));
+	iplen = hio_skad_get_ipad_bytes(addr, ipad, HIO_SIZEOF(ipad));
+	HIO_HASH_MORE_BYTES (hv, ipad, iplen);
+
+	return hv;
+}
+
+static fcgic_pool_t* get_pool (hio_svc_fcgic_t* fcgic, const hio_skad_t* fcgis_addr)
 {
 	hio_t* hio = fcgic->hio;
-	hio_svc_fcgic_conn_t* conn = fcgic->conns;
+	fcgic_pool_t* pool;
+	hio_oow_t b;
 
-	/* TODO: speed up? how many conns would be configured? sequential search may be ok here */
-	while (conn)
+	b = hash_skad(fcgis_addr) & (FCGIC_POOL_BKT_SIZE - 1);
+	for (pool = fcgic->pool_bkt[b]; pool; pool = pool->next)
 	{
-		if (hio_equal_skads(&conn->addr, fcgis_addr, 1))
-		{
-			if (!conn->sess.free || conn->sess.capa <= (CONN_SESS_CAPA_MAX - CONN_SESS_INC))
-			{
-				/* the connection has room for more sessions */
-				if (!conn->dev) make_connection_socket(fcgic, conn); /* conn->dev will still be null if connection fails*/
-				return conn;
-			}
-		}
-		conn = conn->next;
+		if (hio_equal_skads(&pool->addr, fcgis_addr, 1)) return pool;
 	}
 
+	pool = (fcgic_pool_t*)hio_callocmem(hio, HIO_SIZEOF(*pool));
+	if (HIO_UNLIKELY(!pool)) return HIO_NULL;
+
+	pool->addr = *fcgis_addr;
+	pool->next = fcgic->pool_bkt[b];
+	fcgic->pool_bkt[b] = pool;
+	return pool;
+}
+
+static hio_svc_fcgic_conn_t* make_connection (hio_svc_fcgic_t* fcgic, fcgic_pool_t* pool)
+{
+	hio_t* hio = fcgic->hio;
+	hio_svc_fcgic_conn_t* conn;
+
 	conn = hio_callocmem(hio, HIO_SIZEOF(*conn));
 	if (HIO_UNLIKELY(!conn)) return HIO_NULL;
 
 	conn->fcgic = fcgic;
-	conn->addr = *fcgis_addr;
+	conn->pool = pool;
 	conn->sess.capa = 0;
 	conn->sess.free = HIO_NULL;
 
@@ -366,12 +539,50 @@ static hio_svc_fcgic_conn_t* get_connection (hio_svc_fcgic_t* fcgic, const hio_s
 		return HIO_NULL;
 	}
 
-	conn->next = fcgic->conns;
-	fcgic->conns = conn;
+	conn->next = pool->conns;
+	if (pool->conns) pool->conns->prev = conn;
+	pool->conns = conn;
+	pool->nconns++;
 
 	return conn;
 }
 
+static hio_svc_fcgic_conn_t* get_connection (hio_svc_fcgic_t* fcgic, fcgic_pool_t* pool)
+{
+	hio_t* hio = fcgic->hio;
+	hio_svc_fcgic_conn_t* conn, * best = HIO_NULL;
+	hio_oow_t sess_max;
+
+	sess_max = pool->no_mpx? 1: fcgic->option.sess_max;
+	if (sess_max <= 0 || sess_max > CONN_SESS_CAPA_MAX) sess_max = CONN_SESS_CAPA_MAX;
+
+	/* choose the least loaded connection that has room for another session */
+	for (conn = pool->conns; conn; conn = conn->next)
+	{
+		if (conn->sess.count >= sess_max) continue;
+		if (!conn->sess.free && conn->sess.capa > CONN_SESS_CAPA_MAX - CONN_SESS_INC) continue;
+
+		if (!best || conn->sess.count < best->sess.count)
+		{
+			best = conn;
+			if (best->sess.count <= 0) return best; /* idle connection */
+		}
+	}
+
+	/* prefer a new connection to multiplexing over a busy one unless the limit is reached */
+	if (fcgic->option.conn_max <= 0 || pool->nconns < fcgic->option.conn_max)
+	{
+		conn = make_connection(fcgic, pool);
+		if (conn) return conn;
+
+		mark_server_failure (fcgic, pool);
+		if (!best) return HIO_NULL;
+	}
+
+	if (!best) hio_seterrbfmt (hio, HIO_EBUSY, "too many fcgi sessions");
+	return best;
+}
+
 static int destroy_connection_memory (hio_t* hio, hio_cfmb_t* cfmb)
 {
 	hio_svc_fcgic_conn_t* conn = (hio_svc_fcgic_conn_t*)cfmb;
@@ -390,36 +601,56 @@ static int destroy_connection_memory (hio_t* hio, hio_cfmb_t* cfmb)
 	return 0;
 }
 
+static void destroy_connection (hio_svc_fcgic_conn_t* conn)
+{
+	fcgic_pool_t* pool = conn->pool;
+
+	if (conn->dev)
+	{
+		struct fcgic_sck_xtn_t* sck_xtn;
+		sck_xtn = hio_dev_sck_getxtn(conn->dev);
+		sck_xtn->conn = HIO_NULL;
+		hio_dev_sck_halt (conn->dev);
+		conn->dev = HIO_NULL;
+	}
+
+	if (conn->prev) conn->prev->next = conn->next;
+	else pool->conns = conn->next;
+	if (conn->next) conn->next->prev = conn->prev;
+	pool->nconns--;
+
+	/* delay destruction of conn->session.ptr and conn */
+	hio_addcfmb (conn->fcgic->hio, (hio_cfmb_t*)conn, HIO_NULL, destroy_connection_memory);
+}
+
 static void free_connections (hio_svc_fcgic_t* fcgic)
 {
 	hio_t* hio = fcgic->hio;
-	hio_svc_fcgic_conn_t* conn = fcgic->conns;
-	hio_svc_fcgic_conn_t* next;
+	hio_oow_t i;
 
-	while (conn)
+	for (i = 0; i < FCGIC_POOL_BKT_SIZE; i++)
 	{
-		next = conn->next;
-		if (conn->dev)
+		fcgic_pool_t* pool, * next;
+
+		pool = fcgic->pool_bkt[i];
+		while (pool)
 		{
-			struct fcgic_sck_xtn_t* sck_xtn;
-			sck_xtn = hio_dev_sck_getxtn(conn->dev);
-			sck_xtn->conn = HIO_NULL;
-			hio_dev_sck_halt (conn->dev);
+			next = pool->next;
+			while (pool->conns) destroy_connection (pool->conns);
+			hio_freemem (hio, pool);
+			pool = next;
 		}
-
-		/* delay destruction of conn->session.ptr and conn */
-		hio_addcfmb (hio, (hio_cfmb_t*)conn, HIO_NULL, destroy_connection_memory);
-		conn = next;
+		fcgic->pool_bkt[i] = HIO_NULL;
 	}
 }
 
-static hio_svc_fcgic_sess_t* new_session (hio_svc_fcgic_t* fcgic, const hio_skad_t* fcgis_addr, hio_svc_fcgic_on_read_t on_read, hio_svc_fcgic_on_write_t on_write, hio_svc_fcgic_on_untie_t on_untie, void* ctx)
+static hio_svc_fcgic_sess_t* new_session (hio_svc_fcgic_t* fcgic, fcgic_pool_t* pool, hio_svc_fcgic_on_read_t on_read, hio_svc_fcgic_on_write_t on_write, hio_svc_fcgic_on_untie_t on_untie, void* ctx)
 {
 	hio_t* hio = fcgic->hio;
 	hio_svc_fcgic_conn_t* conn;
 	hio_svc_fcgic_sess_t* sess;
 
-	conn = get_connection(fcgic, fcgis_addr);
+	conn = get_connection(fcgic, pool);
 	if (HIO_UNLIKELY(!conn)) return HIO_NULL;
 
 	if (!conn->sess.free)
@@ -459,11 +690,14 @@ static hio_svc_fcgic_sess_t* new_session (hio_svc_fcgic_t* fcgic, const hio_skad
 
 	sess = conn->sess.free;
 	conn->sess.free = sess->next;
+	conn->sess.count++;
+	conn->pool->nsess++;
 
 	sess->on_read = on_read;
 	sess->on_write = on_write;
 	sess->on_untie = on_untie;
 	sess->active = 1;
+	sess->inflight = 0;
 	sess->ctx = ctx;
 	HIO_ASSERT (hio, sess->conn == conn);
 	HIO_ASSERT (hio, sess->conn->fcgic == fcgic);
@@ -471,12 +705,52 @@ static hio_svc_fcgic_sess_t* new_session (hio_svc_fcgic_t* fcgic, const hio_skad
 	return sess;
 }
 
+static void free_session (hio_svc_fcgic_sess_t* sess)
+{
+	hio_svc_fcgic_conn_t* conn = sess->conn;
+
+	sess->inflight = 0;
+	sess->next = conn->sess.free;
+	conn->sess.free = sess;
+	conn->sess.count--;
+	conn->pool->nsess--;
+}
+
+static int abort_request (hio_svc_fcgic_sess_t* sess)
+{
+	hio_fcgi_record_header_t h;
+	hio_iovec_t iov;
+	void* wrctx;
+
+	HIO_MEMSET (&h, 0, HIO_SIZEOF(h));
+	h.version = HIO_FCGI_VERSION;
+	h.type = HIO_FCGI_ABORT_REQUEST;
+	h.id = hio_hton16(sess->sid + 1);
+
+	iov.iov_ptr = &h;
+	iov.iov_len = HIO_SIZEOF(h);
+
+	HIO_ASSERT (sess->conn->hio, ((hio_oow_t)sess & 3) == 0);
+	wrctx = (void*)((hio_oow_t)sess | 3);  /* see the sck_on_write()  */
+	return hio_dev_sck_writev(sess->conn->dev, &iov, 1, wrctx, HIO_NULL);
+}
+
 static void release_session (hio_svc_fcgic_sess_t* sess)
 {
+	hio_svc_fcgic_conn_t* conn = sess->conn;
+
 	if (sess->on_untie) sess->on_untie (sess, sess->ctx);
 	sess->active = 0;
-	sess->next = sess->conn->sess.free;
-	sess->conn->sess.free = sess;
+
+	if (sess->inflight && conn->dev)
+	{
+		/* the server may still send records for this request. the request id
+		 * can't be given to a new session until HIO_FCGI_END_REQUEST arrives */
+		if (abort_request(sess) <= -1) hio_dev_sck_halt (conn->dev);
+		return;
+	}
+
+	free_session (sess);
 }
 
 hio_svc_fcgic_t* hio_svc_fcgic_start (hio_t* hio, const hio_svc_fcgic_tmout_t* tmout)
@@ -493,6 +767,10 @@ hio_svc_fcgic_t* hio_svc_fcgic_start (hio_t* hio, const hio_svc_fcgic_tmout_t* t
 	HIO_INIT_NTIME(&fcgic->tmout.w, -1, 0);
 
 	if (tmout) fcgic->tmout = *tmout;
+	fcgic->option.conn_max = 0;
+	fcgic->option.sess_max = 0;
+	fcgic->option.max_fails = 1;
+	HIO_INIT_NTIME (&fcgic->option.fail_timeout, 10, 0);
 
 	HIO_SVCL_APPEND_SVC (&hio->actsvc, (hio_svc_t*)fcgic);
 	HIO_DEBUG1 (hio, "FCGIC - STARTED SERVICE %p\n", fcgic);
@@ -510,6 +788,7 @@ void hio_svc_fcgic_stop (hio_svc_fcgic_t* fcgic)
 	HIO_DEBUG1 (hio, "FCGIC - STOPPING SERVICE %p\n", fcgic);
 	fcgic->stopping = 1;
 
+	while (fcgic->upstreams) hio_svc_fcgic_closeupstream (fcgic->upstreams);
 	free_connections (fcgic);
 
 	HIO_SVCL_UNLINK_SVC (fcgic);
@@ -518,10 +797,66 @@ void hio_svc_fcgic_stop (hio_svc_fcgic_t* fcgic)
 	HIO_DEBUG1 (hio, "FCGIC - STOPPED SERVICE %p\n", fcgic);
 }
 
+int hio_svc_fcgic_getoption (hio_svc_fcgic_t* fcgic, hio_svc_fcgic_option_t id, void* value)
+{
+	switch (id)
+	{
+		case HIO_SVC_FCGIC_CONN_MAX:
+			*(hio_oow_t*)value = fcgic->option.conn_max;
+			return 0;
+
+		case HIO_SVC_FCGIC_SESS_MAX:
+			*(hio_oow_t*)value = fcgic->option.sess_max;
+			return 0;
+
+		case HIO_SVC_FCGIC_MAX_FAILS:
+			*(hio_oow_t*)value = fcgic->option.max_fails;
+			return 0;
+
+		case HIO_SVC_FCGIC_FAIL_TIMEOUT:
+			*(hio_ntime_t*)value = fcgic->option.fail_timeout;
+			return 0;
+	}
+
+	hio_seterrnum (fcgic->hio, HIO_EINVAL);
+	return -1;
+}
+
+int hio_svc_fcgic_setoption (hio_svc_fcgic_t* fcgic, hio_svc_fcgic_option_t id, const void* value)
+{
+	/* the new limits don't affect the existing connections and sessions */
+	switch (id)
+	{
+		case HIO_SVC_FCGIC_CONN_MAX:
+			fcgic->option.conn_max = *(const hio_oow_t*)value;
+			return 0;
+
+		case HIO_SVC_FCGIC_SESS_MAX:
+			fcgic->option.sess_max = *(const hio_oow_t*)value;
+			return 0;
+
+		case HIO_SVC_FCGIC_MAX_FAILS:
+			fcgic->option.max_fails = *(const hio_oow_t*)value;
+			return 0;
+
+		case HIO_SVC_FCGIC_FAIL_TIMEOUT:
+			fcgic->option.fail_timeout = *(const hio_ntime_t*)value;
+			return 0;
+	}
+
+	hio_seterrnum (fcgic->hio, HIO_EINVAL);
+	return -1;
+}
+
 hio_svc_fcgic_sess_t* hio_svc_fcgic_tie (hio_svc_fcgic_t* fcgic, const hio_skad_t* addr, hio_svc_fcgic_on_read_t on_read, hio_svc_fcgic_on_write_t on_write, hio_svc_fcgic_on_untie_t on_untie, void* ctx)
 {
+	fcgic_pool_t* pool;
+
 	/* TODO: reference counting for safety?? */
-	return new_session(fcgic, addr, on_read, on_write, on_untie, ctx);
+	pool = get_pool(fcgic, addr);
+	if (HIO_UNLIKELY(!pool)) return HIO_NULL;
+
+	return new_session(fcgic, pool, on_read, on_write, on_untie, ctx);
 }
 
 void hio_svc_fcgic_untie (hio_svc_fcgic_sess_t* sess)
@@ -565,7 +900,10 @@ int hio_svc_fcgic_beginrequest (hio_svc_fcgic_sess_t* sess)
 
 	HIO_ASSERT (sess->conn->hio, ((hio_oow_t)sess & 3) == 0);
 	wrctx = (void*)((hio_oow_t)sess | 0);  /* see the sck_on_write()  */
-	return hio_dev_sck_writev(sess->conn->dev, iov, 2, wrctx, HIO_NULL);
+	if (hio_dev_sck_writev(sess->conn->dev, iov, 2, wrctx, HIO_NULL) <= -1) return -1;
+
+	sess->inflight = 1;
+	return 0;
 }
 
 int hio_svc_fcgic_writeparam (hio_svc_fcgic_sess_t* sess, const void* key, hio_iolen_t ksz, const void* val, hio_iolen_t vsz)
@@ -682,3 +1020,309 @@ int hio_svc_fcgic_writestdin (hio_svc_fcgic_sess_t* sess, const void* data, hio_
 	wrctx = (void*)((hio_oow_t)sess | 2);  /* see the sck_on_write()  */
 	return hio_dev_sck_writev(sess->conn->dev, iov, (size > 0? 2: 1), wrctx, HIO_NULL);
 }
+
+/* ------------------------------------------------------------------------ */
+
+static void schedule_probe (hio_svc_fcgic_upstream_t* ups);
+
+static void probe_on_disconnect (hio_dev_sck_t* sck)
+{
+	fcgic_probe_xtn_t* pxtn = hio_dev_sck_getxtn(sck);
+
+	if (pxtn->ups)
+	{
+		fcgic_pool_t* pool = pxtn->member->pool;
+
+		if (pxtn->ok)
+		{
+			if (pool->nfails > 0) HIO_DEBUG1 (pxtn->ups->fcgic->hio, "FCGIC - health check passed for server %p\n", pool);
+			mark_server_success (pool);
+		}
+		else
+		{
+			mark_server_failure (pxtn->ups->fcgic, pool);
+		}
+		pxtn->member->probe = HIO_NULL;
+	}
+}
+
+static void probe_on_connect (hio_dev_sck_t* sck)
+{
+	fcgic_probe_xtn_t* pxtn = hio_dev_sck_getxtn(sck);
+	hio_iovec_t iov[2];
+	hio_fcgi_record_header_t h;
+	static hio_uint8_t name[] = { 15, 0, 'F','C','G','I','_','M','P','X','S','_','C','O','N','N','S' };
+
+	/* ask for a management record. a healthy server answers with HIO_FCGI_GET_VALUES_RESULT */
+	HIO_MEMSET (&h, 0, HIO_SIZEOF(h));
+	h.version = HIO_FCGI_VERSION;
+	h.type = HIO_FCGI_GET_VALUES;
+	h.id = HIO_CONST_HTON16(0);
+	h.content_len = hio_hton16(HIO_SIZEOF(name));
+
+	iov[0].iov_ptr = &h;
+	iov[0].iov_len = HIO_SIZEOF(h);
+	iov[1].iov_ptr = name;
+	iov[1].iov_len = HIO_SIZEOF(name);
+
+	if (hio_dev_sck_writev(sck, iov, 2, HIO_NULL, HIO_NULL) <= -1 ||
+	    hio_dev_sck_timedread(sck, 1, &pxtn->ups->cfg.probe_tmout) <= -1) hio_dev_sck_halt (sck);
+}
+
+static int probe_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrctx, const hio_skad_t* dstaddr)
+{
+	return 0;
+}
+
+static int probe_on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t dlen, const hio_skad_t* srcaddr)
+{
+	fcgic_probe_xtn_t* pxtn = hio_dev_sck_getxtn(sck);
+
+	if (dlen > 0)
+	{
+		hio_oow_t cplen;
+
+		cplen = HIO_SIZEOF(pxtn->hdr) - pxtn->len;
+		if (cplen > dlen) cplen = dlen;
+		HIO_MEMCPY (&pxtn->hdr[pxtn->len], data, cplen);
+		pxtn->len += cplen;
+		if (pxtn->len < HIO_SIZEOF(pxtn->hdr)) return 0;
+
+		pxtn->ok = (((hio_fcgi_record_header_t*)pxtn->hdr)->version == HIO_FCGI_VERSION);
+	}
+
+	/* done with a record header, an error, a timeout or EOF */
+	hio_dev_sck_halt (sck);
+	return 0;
+}
+
+static void probe_server (hio_svc_fcgic_upstream_t* ups, fcgic_member_t* member)
+{
+	hio_t* hio = ups->fcgic->hio;
+	hio_dev_sck_t* sck;
+	hio_dev_sck_make_t mi;
+	hio_dev_sck_connect_t ci;
+	fcgic_probe_xtn_t* pxtn;
+
+	HIO_MEMSET (&mi, 0, HIO_SIZEOF(mi));
+	if (hio_get_stream_sck_type_from_skad(&member->pool->addr, &mi.type) <= -1) return;
+	mi.options = HIO_DEV_SCK_MAKE_LENIENT;
+	mi.on_write = probe_on_write;
+	mi.on_read = probe_on_read;
+	mi.on_connect = probe_on_connect;
+	mi.on_disconnect = probe_on_disconnect;
+
+	sck = hio_dev_sck_make(hio, HIO_SIZEOF(*pxtn), &mi);
+	if (HIO_UNLIKELY(!sck)) return;
+
+	pxtn = hio_dev_sck_getxtn(sck);
+	HIO_MEMSET (pxtn, 0, HIO_SIZEOF(*pxtn));
+	pxtn->ups = ups;
+	pxtn->member = member;
+
+	HIO_MEMSET (&ci, 0, HIO_SIZEOF(ci));
+	ci.remoteaddr = member->pool->addr;
+	ci.connect_tmout = ups->cfg.probe_tmout;
+
+	if (hio_dev_sck_connect(sck, &ci) <= -1)
+	{
+		pxtn->ups = HIO_NULL;
+		hio_dev_sck_halt (sck);
+		mark_server_failure (ups->fcgic, member->pool);
+		return;
+	}
+
+	member->probe = sck;
+}
+
+static void run_probes (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	hio_svc_fcgic_upstream_t* ups = (hio_svc_fcgic_upstream_t*)job->ctx;
+	hio_oow_t i;
+
+	for (i = 0; i < ups->nmembers; i++)
+	{
+		/* skip a server whose previous check hasn't finished */
+		if (!ups->members[i].probe) probe_server (ups, &ups->members[i]);
+	}
+
+	schedule_probe (ups);
+}
+
+static void schedule_probe (hio_svc_fcgic_upstream_t* ups)
+{
+	if (ups->probe_tmridx == HIO_TMRIDX_INVALID && HIO_IS_POS_NTIME(&ups->cfg.probe_interval))
+	{
+		if (hio_schedtmrjobafter(ups->fcgic->hio, &ups->cfg.probe_interval, run_probes, &ups->probe_tmridx, ups) <= -1)
+			HIO_DEBUG1 (ups->fcgic->hio, "FCGIC - unable to schedule health checks - %js\n", hio_geterrmsg(ups->fcgic->hio));
+	}
+}
+
+hio_svc_fcgic_upstream_t* hio_svc_fcgic_openupstream (hio_svc_fcgic_t* fcgic, const hio_svc_fcgic_server_t* servers, hio_oow_t nservers, const hio_svc_fcgic_upstream_cfg_t* cfg)
+{
+	hio_t* hio = fcgic->hio;
+	hio_svc_fcgic_upstream_t* ups;
+	hio_oow_t i;
+
+	if (nservers <= 0)
+	{
+		hio_seterrbfmt (hio, HIO_EINVAL, "no fcgi servers given");
+		return HIO_NULL;
+	}
+
+	ups = (hio_svc_fcgic_upstream_t*)hio_callocmem(hio, HIO_SIZEOF(*ups) + HIO_SIZEOF(*ups->members) * nservers);
+	if (HIO_UNLIKELY(!ups)) return HIO_NULL;
+
+	ups->fcgic = fcgic;
+	ups->probe_tmridx = HIO_TMRIDX_INVALID;
+	ups->nmembers = nservers;
+	ups->members = (fcgic_member_t*)(ups + 1);
+	if (cfg) ups->cfg = *cfg;
+	else ups->cfg.lb = HIO_SVC_FCGIC_LB_ROUND_ROBIN;
+	if (!HIO_IS_POS_NTIME(&ups->cfg.probe_tmout)) HIO_INIT_NTIME (&ups->cfg.probe_tmout, 3, 0);
+
+	for (i = 0; i < nservers; i++)
+	{
+		/* the pool is shared with other upstreams and hio_svc_fcgic_tie() for the same address.
+		 * it stays until the service stops. */
+		ups->members[i].pool = get_pool(fcgic, &servers[i].addr);
+		if (HIO_UNLIKELY(!ups->members[i].pool))
+		{
+			hio_freemem (hio, ups);
+			return HIO_NULL;
+		}
+		ups->members[i].weight = (servers[i].weight <= 0)? 1: servers[i].weight;
+	}
+
+	ups->next = fcgic->upstreams;
+	if (fcgic->upstreams) fcgic->upstreams->prev = ups;
+	fcgic->upstreams = ups;
+
+	schedule_probe (ups);
+	return ups;
+}
+
+void hio_svc_fcgic_closeupstream (hio_svc_fcgic_upstream_t* ups)
+{
+	hio_svc_fcgic_t* fcgic = ups->fcgic;
+	hio_oow_t i;
+
+	if (ups->probe_tmridx != HIO_TMRIDX_INVALID)
+	{
+		hio_deltmrjob (fcgic->hio, ups->probe_tmridx);
+		ups->probe_tmridx = HIO_TMRIDX_INVALID;
+	}
+
+	for (i = 0; i < ups->nmembers; i++)
+	{
+		if (ups->members[i].probe)
+		{
+			fcgic_probe_xtn_t* pxtn = hio_dev_sck_getxtn(ups->members[i].probe);
+			pxtn->ups = HIO_NULL;
+			hio_dev_sck_halt (ups->members[i].probe);
+		}
+	}
+
+	/* the sessions made via the upstream belong to the pools. they are not affected */
+	if (ups->prev) ups->prev->next = ups->next;
+	else fcgic->upstreams = ups->next;
+	if (ups->next) ups->next->prev = ups->prev;
+
+	hio_freemem (fcgic->hio, ups);
+}
+
+static fcgic_member_t* pick_member (hio_svc_fcgic_upstream_t* ups, const hio_uint8_t* tried)
+{
+	hio_svc_fcgic_t* fcgic = ups->fcgic;
+	fcgic_member_t* best = HIO_NULL, * m;
+	hio_intmax_t total = 0;
+	hio_ntime_t now;
+	hio_oow_t i, j;
+
+	hio_gettime (fcgic->hio, &now);
+
+	for (j = 0; j < ups->nmembers; j++)
+	{
+		i = (ups->start + j) % ups->nmembers;
+		m = &ups->members[i];
+		if (tried[i] || is_server_down(fcgic, m->pool, &now)) continue;
+
+		if (ups->cfg.lb == HIO_SVC_FCGIC_LB_LEAST_OUTSTANDING)
+		{
+			/* the fewest outstanding requests relative to the weight. a slow server
+			 * accumulates outstanding requests and receives less traffic */
+			if (!best || (m->pool->nsess + 1) * best->weight < (best->pool->nsess + 1) * m->weight) best = m;
+		}
+		else
+		{
+			/* smooth weighted round robin */
+			m->cw += m->weight;
+			total += m->weight;
+			if (!best || m->cw > best->cw) best = m;
+		}
+	}
+
+	if (best)
+	{
+		if (ups->cfg.lb == HIO_SVC_FCGIC_LB_LEAST_OUTSTANDING) ups->start = (best - ups->members) + 1;
+		else best->cw -= total;
+		return best;
+	}
+
+	/* all servers are down. try the one to come back earliest rather than failing */
+	for (i = 0; i < ups->nmembers; i++)
+	{
+		m = &ups->members[i];
+		if (tried[i]) continue;
+		if (!best || HIO_CMP_NTIME(&m->pool->down_until, &best->pool->down_until) < 0) best = m;
+	}
+	return best;
+}
+
+hio_svc_fcgic_sess_t* hio_svc_fcgic_tieupstream (hio_svc_fcgic_upstream_t* ups, hio_svc_fcgic_on_read_t on_read, hio_svc_fcgic_on_write_t on_write, hio_svc_fcgic_on_untie_t on_untie, void* ctx)
+{
+	hio_t* hio = ups->fcgic->hio;
+	hio_uint8_t tried_buf[64], * tried;
+	hio_svc_fcgic_sess_t* sess = HIO_NULL;
+	fcgic_member_t* m;
+
+	tried = (ups->nmembers <= HIO_COUNTOF(tried_buf))? tried_buf: (hio_uint8_t*)hio_allocmem(hio, ups->nmembers);
+	if (HIO_UNLIKELY(!tried)) return HIO_NULL;
+	HIO_MEMSET (tried, 0, ups->nmembers);
+
+	/* move on to another server if a connection can't be made */
+	while ((m = pick_member(ups, tried)))
+	{
+		sess = new_session(ups->fcgic, m->pool, on_read, on_write, on_untie, ctx);
+		if (sess)
+		{
+			m->nreqs++;
+			break;
+		}
+		tried[m - ups->members] = 1;
+	}
+
+	if (tried != tried_buf) hio_freemem (hio, tried);
+	return sess;
+}
+
+int hio_svc_fcgic_getupstreamstat (hio_svc_fcgic_upstream_t* ups, hio_oow_t idx, hio_svc_fcgic_server_stat_t* stat)
+{
+	fcgic_member_t* m;
+	hio_ntime_t now;
+
+	if (idx >= ups->nmembers)
+	{
+		hio_seterrnum (ups->fcgic->hio, HIO_EINVAL);
+		return -1;
+	}
+
+	m = &ups->members[idx];
+	hio_gettime (ups->fcgic->hio, &now);
+
+	stat->down = is_server_down(ups->fcgic, m->pool, &now);
+	stat->outstanding = m->pool->nsess;
+	stat->nfails = m->pool->nfails;
+	stat->nreqs = m->nreqs;
+	return 0;
+}
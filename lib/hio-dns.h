@@ -550,6 +550,18 @@ HIO_EXPORT int hio_svc_dnc_checkclientcookie (
 	hio_dns_pkt_info_t* respi
 );
 
+/* return the extension area of the size requested with hio_svc_dnc_sendmsg() or hio_svc_dnc_sendreq() */
+HIO_EXPORT void* hio_svc_dnc_getmsgxtn (
+	hio_svc_dnc_t*      dnc,
+	hio_dns_msg_t*      msg
+);
+
+/* return the extension area of the size requested with hio_svc_dnc_resolve() */
+HIO_EXPORT void* hio_svc_dnc_getresolvemsgxtn (
+	hio_svc_dnc_t*      dnc,
+	hio_dns_msg_t*      reqmsg
+);
+
 /* ---------------------------------------------------------------- */
 
 HIO_EXPORT hio_dns_pkt_info_t* hio_dns_make_pkt_info (
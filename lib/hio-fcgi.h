@@ -114,6 +114,58 @@ struct hio_svc_fcgic_tmout_t
 	hio_ntime_t w;
 };
 
+enum hio_svc_fcgic_option_t
+{
+	/* maximum number of connections to a single fastcgi server. hio_oow_t. 0 for no limit.
+	 * a new request goes to an idle connection or a new connection below the limit.
+	 * the least loaded connection is shared beyond the limit */
+	HIO_SVC_FCGIC_CONN_MAX,
+	/* maximum number of requests multiplexed over a connection. hio_oow_t. 0 for no limit */
+	HIO_SVC_FCGIC_SESS_MAX,
+	/* number of consecutive failures to mark a server down. hio_oow_t. 0 disables it */
+	HIO_SVC_FCGIC_MAX_FAILS,
+	/* time for upstreams to skip a server marked down. hio_ntime_t */
+	HIO_SVC_FCGIC_FAIL_TIMEOUT
+};
+typedef enum hio_svc_fcgic_option_t hio_svc_fcgic_option_t;
+
+/* ---------------------------------------------------------------- */
+
+typedef struct hio_svc_fcgic_upstream_t hio_svc_fcgic_upstream_t;
+
+enum hio_svc_fcgic_lb_t
+{
+	/* weighted round robin */
+	HIO_SVC_FCGIC_LB_ROUND_ROBIN,
+	/* the server with the fewest outstanding requests relative to its weight */
+	HIO_SVC_FCGIC_LB_LEAST_OUTSTANDING
+};
+typedef enum hio_svc_fcgic_lb_t hio_svc_fcgic_lb_t;
+
+struct hio_svc_fcgic_server_t
+{
+	hio_skad_t addr;
+	hio_oow_t  weight; /* 0 is treated as 1 */
+};
+typedef struct hio_svc_fcgic_server_t hio_svc_fcgic_server_t;
+
+struct hio_svc_fcgic_upstream_cfg_t
+{
+	hio_svc_fcgic_lb_t lb;
+	hio_ntime_t probe_interval; /* interval of active health checks. not positive to disable them */
+	hio_ntime_t probe_tmout; /* time allowed for a health check. 3 seconds if not positive */
+};
+typedef struct hio_svc_fcgic_upstream_cfg_t hio_svc_fcgic_upstream_cfg_t;
+
+struct hio_svc_fcgic_server_stat_t
+{
+	int       down;        /**< the server is skipped for failures */
+	hio_oow_t outstanding; /**< number of requests in progress including those not made via the upstream */
+	hio_oow_t nfails;      /**< number of consecutive failures */
+	hio_oow_t nreqs;       /**< number of requests sent via the upstream */
+};
+typedef struct hio_svc_fcgic_server_stat_t hio_svc_fcgic_server_stat_t;
+
 /* ---------------------------------------------------------------- */
 
 typedef struct hio_svc_fcgic_sess_t hio_svc_fcgic_sess_t;
@@ -141,6 +193,7 @@ typedef void (*hio_svc_fcgic_on_untie_t) (
 struct hio_svc_fcgic_sess_t
 {
 	int active;
+	int inflight; /* the request began but HIO_FCGI_END_REQUEST hasn't been received */
 	hio_oow_t sid;
 	hio_svc_fcgic_conn_t* conn;
 	hio_svc_fcgic_on_read_t on_read;
@@ -166,6 +219,18 @@ HIO_EXPORT void hio_svc_fcgic_stop (
 	hio_svc_fcgic_t* fcgic
 );
 
+HIO_EXPORT int hio_svc_fcgic_getoption (
+	hio_svc_fcgic_t*       fcgic,
+	hio_svc_fcgic_option_t id,
+	void*                  value
+);
+
+HIO_EXPORT int hio_svc_fcgic_setoption (
+	hio_svc_fcgic_t*       fcgic,
+	hio_svc_fcgic_option_t id,
+	const void*            value
+);
+
 #if defined(HIO_HAVE_INLINE)
 static HIO_INLINE hio_t* hio_svc_fcgis_gethio(hio_svc_fcgis_t* svc) { return hio_svc_gethio((hio_svc_t*)svc); }
 static HIO_INLINE hio_t* hio_svc_fcgic_gethio(hio_svc_fcgic_t* svc) { return hio_svc_gethio((hio_svc_t*)svc); }
@@ -187,6 +252,37 @@ HIO_EXPORT void hio_svc_fcgic_untie (
 	hio_svc_fcgic_sess_t* sess
 );
 
+/**
+ * The hio_svc_fcgic_openupstream() function creates a group of fastcgi servers
+ * for hio_svc_fcgic_tieupstream() to distribute requests over. A server is skipped
+ * for HIO_SVC_FCGIC_FAIL_TIMEOUT after HIO_SVC_FCGIC_MAX_FAILS consecutive failures
+ * in connecting, in the middle of a request or in a health check.
+ */
+HIO_EXPORT hio_svc_fcgic_upstream_t* hio_svc_fcgic_openupstream (
+	hio_svc_fcgic_t*                    fcgic,
+	const hio_svc_fcgic_server_t*       servers,
+	hio_oow_t                           nservers,
+	const hio_svc_fcgic_upstream_cfg_t* cfg
+);
+
+HIO_EXPORT void hio_svc_fcgic_closeupstream (
+	hio_svc_fcgic_upstream_t* ups
+);
+
+HIO_EXPORT hio_svc_fcgic_sess_t* hio_svc_fcgic_tieupstream (
+	hio_svc_fcgic_upstream_t* ups,
+	hio_svc_fcgic_on_read_t   on_read,
+	hio_svc_fcgic_on_write_t  on_write,
+	hio_svc_fcgic_on_untie_t  on_untie,
+	void*                     ctx
+);
+
+HIO_EXPORT int hio_svc_fcgic_getupstreamstat (
+	hio_svc_fcgic_upstream_t*    ups,
+	hio_oow_t                    idx, /**< server index */
+	hio_svc_fcgic_server_stat_t* stat
+);
+
 HIO_EXPORT int hio_svc_fcgic_beginrequest (
    hio_svc_fcgic_sess_t* sess
 );
@@ -41,7 +41,11 @@ enum hio_htrd_errnum_t
 	HIO_HTRD_ENOMEM,
 	HIO_HTRD_EBADRE,
 	HIO_HTRD_EBADHDR,
-	HIO_HTRD_ESUSPENDED
+	HIO_HTRD_ESUSPENDED,
+
+	HIO_HTRD_ELINETOOLONG, /**< the initial line is longer than the limit */
+	HIO_HTRD_EHDRTOOLARGE, /**< the header block is too large or has too many fields */
+	HIO_HTRD_EBODYTOOLARGE /**< the content body is larger than the limit */
 };
 
 typedef enum hio_htrd_errnum_t hio_htrd_errnum_t;
@@ -63,6 +67,20 @@ enum hio_htrd_option_t
 
 typedef enum hio_htrd_option_t hio_htrd_option_t;
 
+/**
+ * The hio_htrd_limit_t type defines the upper limits applied while
+ * feeding a request or a response. A zero field imposes no limit.
+ * hio_htrd_feed() fails before buffering the octets beyond a limit.
+ */
+struct hio_htrd_limit_t
+{
+	hio_oow_t line_max;      /**< length of the initial line excluding CRLF */
+	hio_oow_t hdr_max;       /**< length of the header block or the trailers excluding CRLFs */
+	hio_oow_t hdr_count_max; /**< number of header lines */
+	hio_oow_t body_max;      /**< length of the content body */
+};
+typedef struct hio_htrd_limit_t hio_htrd_limit_t;
+
 typedef struct hio_htrd_recbs_t hio_htrd_recbs_t;
 
 struct hio_htrd_recbs_t
@@ -80,6 +98,7 @@ struct hio_htrd_t
 	int flags;
 
 	hio_htrd_recbs_t recbs;
+	hio_htrd_limit_t limit;
 
 	struct
 	{
@@ -89,7 +108,9 @@ struct hio_htrd_t
 
 			int crlf; /* crlf status */
 			hio_oow_t plen; /* raw request length excluding crlf */
+			hio_oow_t lines; /* number of header lines seen including the initial line */
 			hio_oow_t need; /* number of octets needed for contents */
+			hio_oow_t clen; /* number of content octets pushed */
 
 			struct
 			{
@@ -162,6 +183,16 @@ HIO_EXPORT void hio_htrd_setoption (
 	hio_bitmask_t mask
 );
 
+HIO_EXPORT void hio_htrd_getlimit (
+	hio_htrd_t*       htrd,
+	hio_htrd_limit_t* limit
+);
+
+HIO_EXPORT void hio_htrd_setlimit (
+	hio_htrd_t*             htrd,
+	const hio_htrd_limit_t* limit
+);
+
 HIO_EXPORT const hio_htrd_recbs_t* hio_htrd_getrecbs (
 	hio_htrd_t* htrd
 );
@@ -94,6 +94,89 @@ enum hio_http_method_t
 };
 typedef enum hio_http_method_t hio_http_method_t;
 
+/**
+ * The hio_http_hdr_t type defines ids for well-known header names.
+ * Keep the enumerators sorted by name case-insensitively.
+ */
+enum hio_http_hdr_t
+{
+	HIO_HTTP_HDR_OTHER,
+
+	HIO_HTTP_HDR_ACCEPT,
+	HIO_HTTP_HDR_ACCEPT_CHARSET,
+	HIO_HTTP_HDR_ACCEPT_ENCODING,
+	HIO_HTTP_HDR_ACCEPT_LANGUAGE,
+	HIO_HTTP_HDR_ACCEPT_RANGES,
+	HIO_HTTP_HDR_ACCESS_CONTROL_ALLOW_CREDENTIALS,
+	HIO_HTTP_HDR_ACCESS_CONTROL_ALLOW_HEADERS,
+	HIO_HTTP_HDR_ACCESS_CONTROL_ALLOW_METHODS,
+	HIO_HTTP_HDR_ACCESS_CONTROL_ALLOW_ORIGIN,
+	HIO_HTTP_HDR_ACCESS_CONTROL_EXPOSE_HEADERS,
+	HIO_HTTP_HDR_ACCESS_CONTROL_MAX_AGE,
+	HIO_HTTP_HDR_ACCESS_CONTROL_REQUEST_HEADERS,
+	HIO_HTTP_HDR_ACCESS_CONTROL_REQUEST_METHOD,
+	HIO_HTTP_HDR_AGE,
+	HIO_HTTP_HDR_ALLOW,
+	HIO_HTTP_HDR_AUTHORIZATION,
+	HIO_HTTP_HDR_CACHE_CONTROL,
+	HIO_HTTP_HDR_CONNECTION,
+	HIO_HTTP_HDR_CONTENT_DISPOSITION,
+	HIO_HTTP_HDR_CONTENT_ENCODING,
+	HIO_HTTP_HDR_CONTENT_LANGUAGE,
+	HIO_HTTP_HDR_CONTENT_LENGTH,
+	HIO_HTTP_HDR_CONTENT_LOCATION,
+	HIO_HTTP_HDR_CONTENT_RANGE,
+	HIO_HTTP_HDR_CONTENT_SECURITY_POLICY,
+	HIO_HTTP_HDR_CONTENT_TYPE,
+	HIO_HTTP_HDR_COOKIE,
+	HIO_HTTP_HDR_DATE,
+	HIO_HTTP_HDR_ETAG,
+	HIO_HTTP_HDR_EXPECT,
+	HIO_HTTP_HDR_EXPIRES,
+	HIO_HTTP_HDR_FORWARDED,
+	HIO_HTTP_HDR_FROM,
+	HIO_HTTP_HDR_HOST,
+	HIO_HTTP_HDR_IF_MATCH,
+	HIO_HTTP_HDR_IF_MODIFIED_SINCE,
+	HIO_HTTP_HDR_IF_NONE_MATCH,
+	HIO_HTTP_HDR_IF_RANGE,
+	HIO_HTTP_HDR_IF_UNMODIFIED_SINCE,
+	HIO_HTTP_HDR_KEEP_ALIVE,
+	HIO_HTTP_HDR_LAST_MODIFIED,
+	HIO_HTTP_HDR_LINK,
+	HIO_HTTP_HDR_LOCATION,
+	HIO_HTTP_HDR_MAX_FORWARDS,
+	HIO_HTTP_HDR_ORIGIN,
+	HIO_HTTP_HDR_PRAGMA,
+	HIO_HTTP_HDR_PROXY_AUTHENTICATE,
+	HIO_HTTP_HDR_PROXY_AUTHORIZATION,
+	HIO_HTTP_HDR_PROXY_CONNECTION,
+	HIO_HTTP_HDR_RANGE,
+	HIO_HTTP_HDR_REFERER,
+	HIO_HTTP_HDR_RETRY_AFTER,
+	HIO_HTTP_HDR_SERVER,
+	HIO_HTTP_HDR_SET_COOKIE,
+	HIO_HTTP_HDR_STATUS,
+	HIO_HTTP_HDR_STRICT_TRANSPORT_SECURITY,
+	HIO_HTTP_HDR_TE,
+	HIO_HTTP_HDR_TRAILER,
+	HIO_HTTP_HDR_TRANSFER_ENCODING,
+	HIO_HTTP_HDR_UPGRADE,
+	HIO_HTTP_HDR_USER_AGENT,
+	HIO_HTTP_HDR_VARY,
+	HIO_HTTP_HDR_VIA,
+	HIO_HTTP_HDR_WWW_AUTHENTICATE,
+	HIO_HTTP_HDR_X_FORWARDED_FOR,
+	HIO_HTTP_HDR_X_FORWARDED_HOST,
+	HIO_HTTP_HDR_X_FORWARDED_PROTO,
+	HIO_HTTP_HDR_X_HTTP_METHOD_OVERRIDE,
+	HIO_HTTP_HDR_X_REAL_IP,
+	HIO_HTTP_HDR_X_REQUESTED_WITH,
+
+	HIO_HTTP_HDR_COUNT /* not an id. the number of ids including HIO_HTTP_HDR_OTHER */
+};
+typedef enum hio_http_hdr_t hio_http_hdr_t;
+
 enum hio_http_status_t
 {
 	HIO_HTTP_STATUS_CONTINUE              = 100,
@@ -144,6 +227,8 @@ typedef enum hio_http_status_t hio_http_status_t;
 /* header and contents of request/response */
 typedef struct hio_htre_t hio_htre_t;
 typedef struct hio_htre_hdrval_t hio_htre_hdrval_t;
+typedef struct hio_htre_hdr_t hio_htre_hdr_t;
+typedef struct hio_htre_hdrtab_t hio_htre_hdrtab_t;
 
 enum hio_htre_state_t
 {
@@ -166,6 +251,52 @@ struct hio_htre_hdrval_t
 	hio_htre_hdrval_t* next;
 };
 
+/**
+ * The hio_htre_hdr_t type defines a header field entry. The name and the
+ * value point to the memory holding the field. The entry for the first
+ * occurrence of a name links the values of all the fields with the name.
+ */
+struct hio_htre_hdr_t
+{
+	/* the value of this field. it must be the first member as a value
+	 * pointer is converted back to the entry holding it */
+	hio_htre_hdrval_t  val;
+	const hio_bch_t*   name;
+	hio_oow_t          nlen;
+	hio_oow_t          hash; /* meaningful for HIO_HTTP_HDR_OTHER only */
+	hio_http_hdr_t     id;
+	/* the last value for the name. set in the first entry of a name only */
+	hio_htre_hdrval_t* tail;
+};
+
+/**
+ * The hio_htre_hdrtab_t type defines a table of header fields kept in
+ * the order of arrival. A well-known name is mapped to the first entry
+ * of the name by its id. Other names are mapped by a small open-addressed
+ * index. The entry array and the index start with the storage embedded
+ * in #hio_htre_t and move to the heap only when they get full.
+ */
+struct hio_htre_hdrtab_t
+{
+	hio_htre_hdr_t* ent;
+	hio_oow_t       count;
+	hio_oow_t       capa;
+
+	/* each slot holds an entry index plus 1. 0 for an empty slot */
+	hio_uint16_t    byid[HIO_HTTP_HDR_COUNT];
+	hio_uint16_t*   idx;
+	hio_oow_t       idxcapa; /* power of 2 */
+	hio_oow_t       nnames; /* number of names in idx */
+	hio_oow_t       nids; /* number of names in byid */
+
+	/* embedded storage. HIO_NULL if there is none */
+	hio_htre_hdr_t* ient;
+	hio_uint16_t*   iidx;
+};
+
+#define HIO_HTRE_HDR_INLINE_CAPA 24
+#define HIO_HTRE_HDR_INLINE_IDXCAPA 64
+
 struct hio_htre_t
 {
 	hio_t* hio;
@@ -233,8 +364,10 @@ struct hio_htre_t
 	} attr;
 
 	/* header table */
-	hio_htb_t hdrtab;
-	hio_htb_t trailers;
+	hio_htre_hdrtab_t hdrtab;
+	hio_htre_hdrtab_t trailers;
+	hio_htre_hdr_t hdrent[HIO_HTRE_HDR_INLINE_CAPA];
+	hio_uint16_t hdridx[HIO_HTRE_HDR_INLINE_IDXCAPA];
 
 	/* content octets */
 	hio_becs_t content;
@@ -269,6 +402,11 @@ struct hio_htre_t
 #define hio_htre_getscodestr(re) ((re)->u.s.code.str)
 #define hio_htre_getsmesg(re) ((re)->u.s.mesg)
 
+/* get the id of the name that a value belongs to. it is valid for the first
+ * value of a name like the one given to a header walker or returned by
+ * hio_htre_getheaderval() */
+#define hio_htre_gethdrvalid(val) (((const hio_htre_hdr_t*)(val))->id)
+
 #define hio_htre_getcontent(re)     (&(re)->content)
 #define hio_htre_getcontentbcs(re)  HIO_BECS_BCS(&(re)->content)
 #define hio_htre_getcontentptr(re)  HIO_BECS_PTR(&(re)->content)
@@ -308,6 +446,44 @@ HIO_EXPORT const hio_htre_hdrval_t* hio_htre_gettrailerval (
 	const hio_bch_t* key
 );
 
+/**
+ * The hio_htre_getheaderbyid() function is the same as
+ * hio_htre_getheaderval() except that it finds a well-known header
+ * by id without comparing the name.
+ */
+HIO_EXPORT const hio_htre_hdrval_t* hio_htre_getheaderbyid (
+	const hio_htre_t* re,
+	hio_http_hdr_t    id
+);
+
+HIO_EXPORT const hio_htre_hdrval_t* hio_htre_gettrailerbyid (
+	const hio_htre_t* re,
+	hio_http_hdr_t    id
+);
+
+/**
+ * The hio_htre_addheader() function adds a header field to @a re. The name
+ * must be null-terminated and both @a name and @a vptr are remembered as
+ * they are without copying. A name is compared case-insensitively.
+ * @return the entry for the first occurrence of the name on success,
+ *         #HIO_NULL on failure.
+ */
+HIO_EXPORT const hio_htre_hdr_t* hio_htre_addheader (
+	hio_htre_t*      re,
+	const hio_bch_t* name,
+	hio_oow_t        nlen,
+	const hio_bch_t* vptr,
+	hio_oow_t        vlen
+);
+
+HIO_EXPORT const hio_htre_hdr_t* hio_htre_addtrailer (
+	hio_htre_t*      re,
+	const hio_bch_t* name,
+	hio_oow_t        nlen,
+	const hio_bch_t* vptr,
+	hio_oow_t        vlen
+);
+
 HIO_EXPORT int hio_htre_walkheaders (
 	hio_htre_t*              re,
 	hio_htre_header_walker_t walker,
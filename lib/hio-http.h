@@ -30,6 +30,7 @@
 #include <hio-htre.h>
 #include <hio-thr.h>
 #include <hio-fcgi.h>
+#include <hio-dns.h>
 
 /** \file
  * This file provides basic data types and functions for the http protocol.
@@ -79,11 +80,122 @@ typedef enum hio_perenc_http_option_t hio_perenc_bcstr_option_t;
 enum hio_svc_htts_option_t
 {
         HIO_SVC_HTTS_TASK_MAX,
-        HIO_SVC_HTTS_TASK_CGI_MAX
+        HIO_SVC_HTTS_TASK_CGI_MAX,
+        /* number of pooled worker threads for thread tasks. hio_oow_t. 0 creates a thread per task */
+        HIO_SVC_HTTS_TASK_THR_MAX,
+        /* maximum number of thread tasks waiting for a pooled worker. hio_oow_t. 503 is sent beyond it */
+        HIO_SVC_HTTS_TASK_THR_QUEUE_MAX,
+        /* number of standby helpers kept for cgi tasks with HIO_SVC_HTTS_CGI_PREFORK. hio_oow_t. 0 disables it */
+        HIO_SVC_HTTS_TASK_CGI_PREFORK,
+        /* path to the standby helper program. const hio_bch_t*. HIO_NULL for hio-standby under the libexec directory */
+        HIO_SVC_HTTS_TASK_CGI_PREFORK_HELPER,
+        /* maximum number of connections to a fastcgi server. hio_oow_t. 0 for no limit. see HIO_SVC_FCGIC_CONN_MAX */
+        HIO_SVC_HTTS_TASK_FCGI_CONN_MAX,
+        /* maximum number of fastcgi requests multiplexed over a connection. hio_oow_t. 0 for no limit */
+        HIO_SVC_HTTS_TASK_FCGI_SESS_MAX,
+        /* maximum number of idle keep-alive connections kept per upstream by the proxy task. hio_oow_t. 0 disables reuse */
+        HIO_SVC_HTTS_TASK_PRXY_IDLE_MAX,
+        /* lifetime of an upstream connection after which it is no longer reused. hio_ntime_t */
+        HIO_SVC_HTTS_TASK_PRXY_CONN_MAX_AGE,
+        /* time for which an upstream connection is kept idle in the pool before getting closed. hio_ntime_t.
+         * keep it shorter than the keep-alive timeout of the upstream. 0 for no limit other than the age */
+        HIO_SVC_HTTS_TASK_PRXY_IDLE_TIMEOUT,
+        /* upper limit of the time to cache an upstream host name resolved. hio_ntime_t. 0 disables caching */
+        HIO_SVC_HTTS_TASK_PRXY_DNS_TTL_MAX,
+        /* maximum number of upstream host names cached. hio_oow_t. a name resolved beyond it isn't cached
+         * unless an expired entry makes room for it */
+        HIO_SVC_HTTS_TASK_PRXY_DNS_CACHE_MAX,
+        /* bytes of a request body buffered in memory by hio_svc_htts_task_addreqbody(). hio_oow_t.
+         * the body is moved to a temporary file beyond it. 0 for no limit */
+        HIO_SVC_HTTS_TASK_REQ_BODY_MEM_MAX,
+
+        /* maximum number of open files kept by the file task for reuse. hio_oow_t. 0 disables caching */
+        HIO_SVC_HTTS_FILE_CACHE_MAX,
+        /* interval to verify a cached file against the file system. hio_ntime_t */
+        HIO_SVC_HTTS_FILE_CACHE_TTL,
+        /* total bytes of the in-memory responses of small cached files. hio_oow_t. 0 disables it */
+        HIO_SVC_HTTS_FILE_MEMCACHE_MAX,
+        /* maximum size of a file whose response can be held in memory. hio_oow_t */
+        HIO_SVC_HTTS_FILE_MEMCACHE_FILE_MAX,
+        /* minimum response size to compress on the fly if the client accepts gzip. hio_oow_t. 0 disables it */
+        HIO_SVC_HTTS_RES_COMPRESS_MIN,
+        /* compression level between 1 and 9. int */
+        HIO_SVC_HTTS_RES_COMPRESS_LEVEL,
+
+        /* the following limits apply to the clients accepted after the change.
+         * a client exceeding any of them is disconnected without a response */
+
+        /* maximum length of a request line. hio_oow_t. 0 for no limit */
+        HIO_SVC_HTTS_REQ_LINE_MAX,
+        /* maximum length of a request header block or trailers. hio_oow_t. 0 for no limit */
+        HIO_SVC_HTTS_REQ_HDR_MAX,
+        /* maximum number of request header lines. hio_oow_t. 0 for no limit */
+        HIO_SVC_HTTS_REQ_HDR_COUNT_MAX,
+        /* maximum length of a request body. hio_oow_t. 0 for no limit */
+        HIO_SVC_HTTS_REQ_BODY_MAX,
+        /* time allowed for a request header to complete since its first octet. hio_ntime_t. 0 for no limit */
+        HIO_SVC_HTTS_REQ_HDR_TIMEOUT,
+        /* minimum average rate of a request body in bytes per second. hio_oow_t. 0 disables it.
+         * the time the server stops reading the client for backpressure is not counted */
+        HIO_SVC_HTTS_REQ_BODY_RATE_MIN,
+
+        /* maximum number of concurrent connections from a client ip address. hio_oow_t. 0 for no limit.
+         * a connection beyond it is closed upon accept */
+        HIO_SVC_HTTS_CLIENT_CONN_MAX,
+        /* requests per second allowed to a client ip address on average. hio_oow_t. 0 for no limit.
+         * 429 is sent without creating a task beyond it and the connection is closed */
+        HIO_SVC_HTTS_CLIENT_REQ_RATE,
+        /* requests allowed to a client ip address at once above the average rate. hio_oow_t.
+         * 0 for the same as HIO_SVC_HTTS_CLIENT_REQ_RATE */
+        HIO_SVC_HTTS_CLIENT_REQ_BURST
 };
 
 typedef enum hio_svc_htts_option_t hio_svc_htts_option_t;
 
+struct hio_svc_htts_fcache_stat_t
+{
+	hio_oow_t count;      /**< number of files in the open file cache */
+	hio_oow_t hits;       /**< number of requests served with a cached file */
+	hio_oow_t misses;     /**< number of requests that had to open a file */
+	hio_oow_t mem_count;  /**< number of files whose responses are held in memory */
+	hio_oow_t mem_size;   /**< total bytes of the responses held in memory */
+	hio_oow_t mem_hits;   /**< number of requests served from memory */
+	hio_oow_t mem_misses; /**< number of small file requests not found in memory */
+};
+typedef struct hio_svc_htts_fcache_stat_t hio_svc_htts_fcache_stat_t;
+
+struct hio_svc_htts_alog_cfg_t
+{
+	const hio_bch_t* path;       /**< access log file */
+	hio_oow_t ring_size;         /**< bytes of records buffered for the writer. 0 for the default */
+	hio_foff_t rotate_size;      /**< rotate when the file reaches this size. 0 for no size-based rotation */
+	hio_oow_t rotate_interval;   /**< rotate when the file has been open for this many seconds. 0 for no time-based rotation */
+};
+typedef struct hio_svc_htts_alog_cfg_t hio_svc_htts_alog_cfg_t;
+
+struct hio_svc_htts_alog_stat_t
+{
+	hio_oow_t records;  /**< number of records queued to the writer */
+	hio_oow_t dropped;  /**< number of records dropped for the full ring */
+	hio_oow_t rotated;  /**< number of times the file has been rotated */
+	hio_oow_t errors;   /**< number of failed writes and reopens by the writer */
+};
+typedef struct hio_svc_htts_alog_stat_t hio_svc_htts_alog_stat_t;
+
+struct hio_svc_htts_stat_t
+{
+	hio_oow_t clients;   /**< number of client connections */
+	hio_oow_t tasks;     /**< number of tasks alive */
+	hio_oow_t task_file; /**< number of file tasks started */
+	hio_oow_t task_cgi;  /**< number of cgi tasks started */
+	hio_oow_t task_fcgi; /**< number of fastcgi tasks started */
+	hio_oow_t task_prxy; /**< number of proxy tasks started */
+	hio_oow_t task_thr;  /**< number of thread tasks started */
+	hio_oow_t task_fun;  /**< number of function tasks started */
+	hio_oow_t task_txt;  /**< number of text tasks started */
+};
+typedef struct hio_svc_htts_stat_t hio_svc_htts_stat_t;
+
 /* -------------------------------------------------------------- */
 typedef struct hio_svc_htts_t hio_svc_htts_t;
 typedef struct hio_svc_httc_t hio_svc_httc_t;
@@ -93,10 +205,35 @@ typedef struct hio_svc_httc_t hio_svc_httc_t;
 typedef struct hio_svc_htts_task_t hio_svc_htts_task_t;
 typedef struct hio_svc_htts_cli_t hio_svc_htts_cli_t;
 
+/**
+ * The hio_svc_htts_route_param_t type holds a path segment captured by
+ * a parameter or a wildcard of a route. hio_svc_htts_matchroute() makes the
+ * name point to the route and the value point to the path given. The copies
+ * kept for the task made by hio_svc_htts_doroute() are null-terminated.
+ */
+struct hio_svc_htts_route_param_t
+{
+	const hio_bch_t* name;
+	hio_oow_t        nlen;
+	const hio_bch_t* value;
+	hio_oow_t        vlen;
+};
+typedef struct hio_svc_htts_route_param_t hio_svc_htts_route_param_t;
+
+/* maximum number of parameters and a wildcard in a route path */
+#define HIO_SVC_HTTS_ROUTE_PARAMS_MAX 16
+
 typedef void (*hio_svc_htts_task_on_kill_t) (
 	hio_svc_htts_task_t* task
 );
 
+/* called when the request body moved to a temporary file has been written
+ * out by the writer thread. status is 0 on success and -1 on failure */
+typedef void (*hio_svc_htts_task_on_req_body_end_t) (
+	hio_svc_htts_task_t* task,
+	int                  status
+);
+
 #define HIO_SVC_HTTS_TASK_HEADER \
 	hio_svc_htts_t* htts; \
 	hio_oow_t task_size; \
@@ -114,6 +251,11 @@ typedef void (*hio_svc_htts_task_on_kill_t) (
 	unsigned int task_res_started: 1; \
 	unsigned int task_res_ended: 1; \
 	unsigned int task_res_ever_sent: 1; \
+	unsigned int task_res_no_compress: 1; \
+	unsigned int task_req_accept_gzip: 1; \
+	unsigned int task_req_accept_br: 1; \
+	unsigned int task_req_body_paused: 1; \
+	unsigned int task_req_body_failed: 1; \
 	int task_req_flags; \
 	hio_http_version_t task_req_version; \
 	hio_http_method_t task_req_method; \
@@ -121,7 +263,18 @@ typedef void (*hio_svc_htts_task_on_kill_t) (
 	hio_bch_t* task_req_qpath; \
 	hio_oow_t task_req_conlen; \
 	hio_http_status_t task_status_code; \
-	hio_ooi_t task_res_pending_writes;
+	hio_ooi_t task_res_pending_writes; \
+	hio_foff_t task_res_octets; \
+	hio_ntime_t task_req_since; \
+	hio_bch_t* task_req_cli_addr; \
+	hio_svc_htts_route_param_t* task_route_params; \
+	hio_oow_t task_route_nparams; \
+	int task_req_body_fd; \
+	hio_foff_t task_req_body_len; \
+	hio_dev_thr_t* task_req_body_writer; \
+	hio_oow_t task_req_body_pending_writes; \
+	hio_svc_htts_task_on_req_body_end_t task_req_body_on_end; \
+	void* task_res_zip;
 
 struct hio_svc_htts_task_t
 {
@@ -162,6 +315,13 @@ typedef int (*hio_svc_htts_proc_req_t) (
 );
 
 /* -------------------------------------------------------------- */
+struct hio_svc_htts_thr_hdr_t
+{
+	const hio_bch_t* key;
+	const hio_bch_t* value;
+};
+typedef struct hio_svc_htts_thr_hdr_t hio_svc_htts_thr_hdr_t;
+
 struct hio_svc_htts_thr_func_info_t
 {
 	hio_http_method_t  req_method;
@@ -170,10 +330,17 @@ struct hio_svc_htts_thr_func_info_t
 	hio_bch_t*         req_param;
 	int                req_x_http_method_override; /* -1 or hio_http_method_t */
 
-	/* TODO: header table */
+	/* snapshot of the request headers. a header with multiple values
+	 * appears as many times as the number of its values. */
+	const hio_svc_htts_thr_hdr_t* req_hdrs;
+	hio_oow_t                     req_nhdrs;
 
 	hio_skad_t         client_addr;
 	hio_skad_t         server_addr;
+
+	/* parameters captured by the route dispatched by hio_svc_htts_doroute() */
+	const hio_svc_htts_route_param_t* route_params;
+	hio_oow_t                         route_nparams;
 };
 typedef struct hio_svc_htts_thr_func_info_t hio_svc_htts_thr_func_info_t;
 
@@ -186,43 +353,51 @@ typedef void (*hio_svc_htts_thr_func_t) (
 
 /* -------------------------------------------------------------- */
 
-struct hio_svc_htts_fun_func_info_t
-{
-	hio_http_method_t  req_method;
-	hio_http_version_t req_version;
-	hio_bch_t*         req_path;
-	hio_bch_t*         req_param;
-	int                req_x_http_method_override; /* -1 or hio_http_method_t */
-
-	/* TODO: header table */
-
-	hio_skad_t         client_addr;
-	hio_skad_t         server_addr;
-};
-typedef struct hio_svc_htts_fun_func_info_t hio_svc_htts_fun_func_info_t;
-
-typedef void (*hio_svc_htts_fun_func_t) (
-	hio_svc_htts_t*    htts,
-	void*              ctx
+/* the function is called on the loop thread with the complete request.
+ * the request body is in the request content unless it has grown beyond
+ * HIO_SVC_HTTS_TASK_REQ_BODY_MEM_MAX. see hio_svc_htts_task_getreqbodyfd().
+ * with HIO_SVC_HTTS_FUN_STREAM_REQ_BODY, it is called with the request
+ * header only and the body is passed to the content callback of the request.
+ * it writes the response with hio_svc_htts_task_startreshdr(),
+ * hio_svc_htts_task_addresbody(), hio_svc_htts_task_endbody() and the like.
+ * it can keep the task with HIO_SVC_HTTS_TASK_RCUP() and end the response
+ * later. if it returns -1 before starting the response, 500 is sent. */
+typedef int (*hio_svc_htts_fun_func_t) (
+	hio_svc_htts_t*      htts,
+	hio_svc_htts_task_t* task,
+	hio_htre_t*          req,
+	void*                ctx
 );
 
 /* -------------------------------------------------------------- */
 
-#if 0
 enum hio_svc_htts_cgi_option_t
 {
-	/* no option yet */
+	/* run the script on a standby helper started in advance if available.
+	 * see HIO_SVC_HTTS_TASK_CGI_PREFORK */
+	HIO_SVC_HTTS_CGI_PREFORK = (1 << 0)
 };
 
+#if 0
 enum hio_svc_htts_fcgi_option_t
 {
 	/* no option yet */
 };
 #endif
 
+enum hio_svc_htts_fun_option_t
+{
+	/* call the function as soon as the request header arrives. the function
+	 * receives the body with hio_htre_setconcb() on the request as it arrives.
+	 * the body is discarded if no callback is set */
+	HIO_SVC_HTTS_FUN_STREAM_REQ_BODY   = (1 << 0)
+};
+
 enum hio_svc_htts_file_option_t
 {
-	HIO_SVC_HTTS_FILE_READ_ONLY        = (1 << 0)
+	HIO_SVC_HTTS_FILE_READ_ONLY        = (1 << 0),
+	/* serve foo.br or foo.gz in place of foo if present and accepted by the client */
+	HIO_SVC_HTTS_FILE_PRECOMPRESSED    = (1 << 1)
 };
 
 #if 0
@@ -254,6 +429,168 @@ struct hio_svc_htts_file_cbs_t
 };
 typedef struct hio_svc_htts_file_cbs_t hio_svc_htts_file_cbs_t;
 
+/* -------------------------------------------------------------- */
+
+enum hio_svc_htts_route_type_t
+{
+	HIO_SVC_HTTS_ROUTE_FILE,
+	HIO_SVC_HTTS_ROUTE_CGI,
+	HIO_SVC_HTTS_ROUTE_FCGI,
+	HIO_SVC_HTTS_ROUTE_THR,
+	HIO_SVC_HTTS_ROUTE_FUN,
+	HIO_SVC_HTTS_ROUTE_PRXY,
+	HIO_SVC_HTTS_ROUTE_TXT
+};
+typedef enum hio_svc_htts_route_type_t hio_svc_htts_route_type_t;
+
+#define HIO_SVC_HTTS_ROUTE_METHOD(mth) ((hio_bitmask_t)1 << (mth))
+#define HIO_SVC_HTTS_ROUTE_ALL_METHODS (((hio_bitmask_t)1 << (HIO_HTTP_CONNECT + 1)) - 1)
+
+/**
+ * The hio_svc_htts_route_t type defines the handler dispatched by
+ * hio_svc_htts_doroute(). The strings are copied when the route is added.
+ * For the file, cgi and fastcgi handlers, the path matched by the trailing
+ * wildcard of a route prefixed with a slash becomes the file path or the
+ * script name. The query path is used if the route has no wildcard.
+ */
+struct hio_svc_htts_route_t
+{
+	hio_svc_htts_route_type_t   type;
+	int                         options;
+	hio_svc_htts_task_on_kill_t on_kill;
+
+	union
+	{
+		struct
+		{
+			const hio_bch_t*         docroot;
+			const hio_bch_t*         mime_type; /* may be HIO_NULL */
+			hio_svc_htts_file_cbs_t* cbs; /* not copied. may be HIO_NULL */
+		} file;
+
+		struct
+		{
+			const hio_bch_t* docroot;
+		} cgi;
+
+		struct
+		{
+			hio_skad_t       addr;
+			const hio_bch_t* docroot;
+		} fcgi;
+
+		struct
+		{
+			hio_svc_htts_thr_func_t func;
+			void*                   ctx;
+		} thr;
+
+		struct
+		{
+			hio_svc_htts_fun_func_t func;
+			void*                   ctx;
+		} fun;
+
+		struct
+		{
+			hio_skad_t addr;
+		} prxy;
+
+		struct
+		{
+			int              status_code;
+			const hio_bch_t* content_type;
+			const hio_bch_t* content_text;
+		} txt;
+	} u;
+};
+typedef struct hio_svc_htts_route_t hio_svc_htts_route_t;
+
+
+/* -------------------------------------------------------------- */
+
+struct hio_svc_httc_tmout_t
+{
+	hio_ntime_t c; /**< time allowed to connect. not positive for no limit */
+	hio_ntime_t r; /**< time allowed between reads while a response is awaited. not positive for no limit */
+	hio_ntime_t i; /**< time an idle connection is kept open. not positive for no limit */
+};
+typedef struct hio_svc_httc_tmout_t hio_svc_httc_tmout_t;
+
+enum hio_svc_httc_option_t
+{
+	/* maximum number of connections to an origin. hio_oow_t. 0 for no limit.
+	 * a request waits for a connection to become available beyond it */
+	HIO_SVC_HTTC_CONN_MAX,
+	/* maximum number of requests sent on a connection ahead of their responses. hio_oow_t.
+	 * 1 disables pipelining. requests are pipelined only when no more connections can be made */
+	HIO_SVC_HTTC_PIPELINE_MAX
+};
+typedef enum hio_svc_httc_option_t hio_svc_httc_option_t;
+
+enum hio_svc_httc_req_option_t
+{
+	/* connect to the origin over ssl. the server name indication is not
+	 * sent and the certificate of the server is not verified */
+	HIO_SVC_HTTC_REQ_SSL = (1 << 0),
+	/* allow the request to be sent again on another connection if the
+	 * connection is lost before the response. only the requests with an
+	 * idempotent method are sent again without it */
+	HIO_SVC_HTTC_REQ_RETRYABLE = (1 << 1)
+};
+typedef enum hio_svc_httc_req_option_t hio_svc_httc_req_option_t;
+
+/**
+ * The hio_svc_httc_reqinfo_t type describes a request to send with
+ * hio_svc_httc_sendreq(). The origin is identified by the address and
+ * the #HIO_SVC_HTTC_REQ_SSL option.
+ */
+struct hio_svc_httc_reqinfo_t
+{
+	hio_skad_t        addr;        /**< address of the origin server */
+	int               options;     /**< 0 or bitwise-ORed of #hio_svc_httc_req_option_t */
+	hio_http_method_t method;
+	const hio_bch_t*  path;        /**< request target */
+	const hio_bch_t*  host;        /**< value of the Host header. HIO_NULL to use the address */
+	const hio_bch_t*  headers;     /**< extra header lines each terminated by CRLF. HIO_NULL for none */
+	const void*       content;     /**< request body sent with Content-Length */
+	hio_oow_t         content_len;
+};
+typedef struct hio_svc_httc_reqinfo_t hio_svc_httc_reqinfo_t;
+
+typedef struct hio_svc_httc_req_t hio_svc_httc_req_t;
+
+/* the final response header has been received. interim responses are skipped */
+typedef int (*hio_svc_httc_on_header_t) (
+	hio_svc_httc_req_t* req,
+	hio_htre_t*         res,
+	void*               ctx
+);
+
+/* a piece of the response body. the chunked transfer coding is removed */
+typedef int (*hio_svc_httc_on_body_t) (
+	hio_svc_httc_req_t* req,
+	const void*         data,
+	hio_oow_t           dlen,
+	void*               ctx
+);
+
+/* the request is over. status is HIO_ENOERR if the response has been
+ * received completely. the request is destroyed upon return */
+typedef void (*hio_svc_httc_on_done_t) (
+	hio_svc_httc_req_t* req,
+	hio_errnum_t        status,
+	void*               ctx
+);
+
+struct hio_svc_httc_cbs_t
+{
+	hio_svc_httc_on_header_t on_header; /* may be HIO_NULL */
+	hio_svc_httc_on_body_t   on_body;   /* may be HIO_NULL */
+	hio_svc_httc_on_done_t   on_done;
+};
+typedef struct hio_svc_httc_cbs_t hio_svc_httc_cbs_t;
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -286,11 +623,36 @@ HIO_EXPORT hio_http_method_t hio_bchars_to_http_method (
 	hio_oow_t        namelen
 );
 
+HIO_EXPORT const hio_bch_t* hio_http_hdr_to_bcstr (
+	hio_http_hdr_t id
+);
+
+/**
+ * The hio_bchars_to_http_hdr() function maps a header name to its id
+ * case-insensitively. It returns #HIO_HTTP_HDR_OTHER for a name not known.
+ */
+HIO_EXPORT hio_http_hdr_t hio_bchars_to_http_hdr (
+	const hio_bch_t* nameptr,
+	hio_oow_t        namelen
+);
+
 HIO_EXPORT int hio_parse_http_range_bcstr (
 	const hio_bch_t*  str,
 	hio_http_range_t* range
 );
 
+/**
+ * The hio_parse_http_ranges_bcstr() function parses a range set like
+ * bytes=0-99,200-299,-100. It stores up to \a capa ranges to the \a ranges
+ * array and returns the number of ranges found, which can be greater than
+ * \a capa. It returns -1 if the string is malformed.
+ */
+HIO_EXPORT int hio_parse_http_ranges_bcstr (
+	const hio_bch_t*  str,
+	hio_http_range_t* ranges,
+	hio_oow_t         capa
+);
+
 HIO_EXPORT int hio_parse_http_time_bcstr (
 	const hio_bch_t* str,
 	hio_ntime_t*     nt
@@ -430,6 +792,71 @@ HIO_EXPORT int hio_svc_htts_enablefcgic (
 	hio_svc_fcgic_tmout_t* tmout
 );
 
+/**
+ * The hio_svc_htts_openalog() function starts writing a record per request
+ * to the access log file specified in @a cfg. A record is formatted on the
+ * loop thread into a ring buffer and a background thread writes the buffer
+ * to the file and rotates the file, so the loop never waits on the file.
+ * A record is dropped and counted if the ring is full. A rotated file is
+ * renamed to the path followed by the time of rotation.
+ */
+HIO_EXPORT int hio_svc_htts_openalog (
+	hio_svc_htts_t*                htts,
+	const hio_svc_htts_alog_cfg_t* cfg
+);
+
+/**
+ * The hio_svc_htts_closealog() function stops access logging. It waits for
+ * the background thread to write the records buffered.
+ */
+HIO_EXPORT void hio_svc_htts_closealog (
+	hio_svc_htts_t*                htts
+);
+
+HIO_EXPORT void hio_svc_htts_getalogstat (
+	hio_svc_htts_t*                htts,
+	hio_svc_htts_alog_stat_t*      stat
+);
+
+/**
+ * The hio_svc_htts_getstat() function copies the counters of \a htts to \a stat.
+ */
+HIO_EXPORT void hio_svc_htts_getstat (
+	hio_svc_htts_t*                htts,
+	hio_svc_htts_stat_t*           stat
+);
+
+/**
+ * The hio_svc_htts_getallstat() function adds up the counters of all
+ * the htts services in the process to \a stat and returns the number
+ * of services. It is safe to call on a thread other than those running
+ * the loops of the services as the counters are read atomically.
+ */
+HIO_EXPORT hio_oow_t hio_svc_htts_getallstat (
+	hio_svc_htts_stat_t*           stat
+);
+
+/* return the fastcgi client service enabled with hio_svc_htts_enablefcgic() */
+HIO_EXPORT hio_svc_fcgic_t* hio_svc_htts_getfcgic (
+	hio_svc_htts_t*        htts
+);
+
+/* start the dns client service used by the proxy task to resolve
+ * the host name of an upstream server. the proxy task accepts a
+ * literal address only if it is not enabled. */
+HIO_EXPORT int hio_svc_htts_enablednc (
+	hio_svc_htts_t*        htts,
+	const hio_skad_t*      serv_addr,
+	const hio_ntime_t*     send_tmout,
+	const hio_ntime_t*     reply_tmout,
+	hio_oow_t              max_tries
+);
+
+/* return the dns client service enabled with hio_svc_htts_enablednc() */
+HIO_EXPORT hio_svc_dnc_t* hio_svc_htts_getdnc (
+	hio_svc_htts_t*        htts
+);
+
 HIO_EXPORT int hio_svc_htts_writetosidechan (
 	hio_svc_htts_t* htts,
 	hio_oow_t       idx, /* listener index */
@@ -482,6 +909,22 @@ HIO_EXPORT int hio_svc_htts_dofcgi (
 	hio_svc_htts_task_on_kill_t on_kill
 );
 
+/**
+ * The hio_svc_htts_dofcgiupstream() function is the same as hio_svc_htts_dofcgi()
+ * except that the fastcgi server is chosen from the upstream group made with
+ * hio_svc_fcgic_openupstream() on the client service returned by hio_svc_htts_getfcgic().
+ */
+HIO_EXPORT int hio_svc_htts_dofcgiupstream (
+	hio_svc_htts_t*             htts,
+	hio_dev_sck_t*              csck,
+	hio_htre_t*                 req,
+	hio_svc_fcgic_upstream_t*   fcgis_ups,
+	const hio_bch_t*            docroot,
+	const hio_bch_t*            script,
+	int                         options,
+	hio_svc_htts_task_on_kill_t on_kill
+);
+
 HIO_EXPORT int hio_svc_htts_dofile (
 	hio_svc_htts_t*             htts,
 	hio_dev_sck_t*              csck,
@@ -494,6 +937,20 @@ HIO_EXPORT int hio_svc_htts_dofile (
 	hio_svc_htts_file_cbs_t*    cbs
 );
 
+/**
+ * The hio_svc_htts_purgefilecache() function drops all the entries in the
+ * open file cache. A file still being transferred is closed when the
+ * transfer is over.
+ */
+HIO_EXPORT void hio_svc_htts_purgefilecache (
+	hio_svc_htts_t*             htts
+);
+
+HIO_EXPORT void hio_svc_htts_getfilecachestat (
+	hio_svc_htts_t*             htts,
+	hio_svc_htts_fcache_stat_t* stat
+);
+
 HIO_EXPORT int hio_svc_htts_dofcgi (
 	hio_svc_htts_t*             htts,
 	hio_dev_sck_t*              csck,
@@ -524,6 +981,52 @@ HIO_EXPORT int hio_svc_htts_dothr (
 	hio_svc_htts_task_on_kill_t on_kill
 );
 
+/**
+ * The hio_svc_htts_thr_getreqheader() function returns the first value of
+ * the request header \a key from the header snapshot in \a tfi. The lookup
+ * is case-insensitive. It returns #HIO_NULL if the header is not found.
+ */
+HIO_EXPORT const hio_bch_t* hio_svc_htts_thr_getreqheader (
+	const hio_svc_htts_thr_func_info_t* tfi,
+	const hio_bch_t*                    key
+);
+
+/**
+ * The hio_svc_htts_thr_getrouteparam() function returns the value of the
+ * route parameter or the wildcard \a name from the copy in \a tfi. It returns
+ * #HIO_NULL if no such parameter exists or the task has not been dispatched
+ * by hio_svc_htts_doroute().
+ */
+HIO_EXPORT const hio_bch_t* hio_svc_htts_thr_getrouteparam (
+	const hio_svc_htts_thr_func_info_t* tfi,
+	const hio_bch_t*                    name
+);
+
+/**
+ * The hio_svc_htts_thr_writereshdr() function writes the response status
+ * and headers to \a iop in the binary frame understood by the thread task,
+ * which saves the task from parsing CGI-style text output. Call it from
+ * a thread function before writing the response body. A handler may still
+ * write a CGI-style header instead. It returns -1 if \a status_code is not
+ * between 100 and 599 or writing fails.
+ */
+HIO_EXPORT int hio_svc_htts_thr_writereshdr (
+	hio_dev_thr_iopair_t*         iop,
+	int                           status_code,
+	const hio_svc_htts_thr_hdr_t* hdrs,
+	hio_oow_t                     nhdrs
+);
+
+HIO_EXPORT int hio_svc_htts_dofun (
+	hio_svc_htts_t*             htts,
+	hio_dev_sck_t*              csck,
+	hio_htre_t*                 req,
+	hio_svc_htts_fun_func_t     func,
+	void*                       ctx,
+	int                         options,
+	hio_svc_htts_task_on_kill_t on_kill
+);
+
 HIO_EXPORT int hio_svc_htts_dotxt (
 	hio_svc_htts_t*             htts,
 	hio_dev_sck_t*              csck,
@@ -535,6 +1038,90 @@ HIO_EXPORT int hio_svc_htts_dotxt (
 	hio_svc_htts_task_on_kill_t on_kill
 );
 
+/**
+ * The hio_svc_htts_dometrics() function responds with the counters of
+ * all the hio instances and the htts services in the process in the
+ * Prometheus text exposition format.
+ */
+HIO_EXPORT int hio_svc_htts_dometrics (
+	hio_svc_htts_t*             htts,
+	hio_dev_sck_t*              csck,
+	hio_htre_t*                 req,
+	hio_svc_htts_task_on_kill_t on_kill
+);
+
+/**
+ * The hio_svc_htts_addroute() function adds a route for the request methods
+ * in @a methods and the path pattern @a path. @a methods is a bitwise-ORed
+ * value of HIO_SVC_HTTS_ROUTE_METHOD() for each method. A path segment
+ * starting with a colon(:) matches any single segment and captures it under
+ * the name following the colon. An asterisk(*) at the beginning of the last
+ * segment matches the rest of the path including slashes. A static segment
+ * is preferred to a parameter and a parameter to a wildcard.
+ *
+ *  - /users/:id/posts captures the segment after /users/ as id
+ *  - *path as the last segment after /static captures the rest as path
+ *
+ * It fails with #HIO_EEXIST if a route is already set for any of the methods
+ * on the same pattern, or with #HIO_EINVAL if a parameter is named
+ * differently from another route at the same position or the pattern has
+ * more than #HIO_SVC_HTTS_ROUTE_PARAMS_MAX parameters and wildcards.
+ */
+HIO_EXPORT int hio_svc_htts_addroute (
+	hio_svc_htts_t*             htts,
+	hio_bitmask_t               methods,
+	const hio_bch_t*            path,
+	const hio_svc_htts_route_t* route
+);
+
+/**
+ * The hio_svc_htts_clearroutes() function deletes all the routes.
+ */
+HIO_EXPORT void hio_svc_htts_clearroutes (
+	hio_svc_htts_t*             htts
+);
+
+/**
+ * The hio_svc_htts_matchroute() function finds the route for @a path in time
+ * proportional to the path length. It stores the parameters captured to
+ * @a params up to as many as @a *nparams and sets @a *nparams to the number
+ * of parameters stored. It returns HIO_NULL if no route matches the path.
+ * If the path matches but no route is set for the method, it returns
+ * HIO_NULL and sets @a *nparams to the maximum value of #hio_oow_t.
+ */
+HIO_EXPORT const hio_svc_htts_route_t* hio_svc_htts_matchroute (
+	hio_svc_htts_t*             htts,
+	hio_http_method_t           method,
+	const hio_bch_t*            path,
+	hio_svc_htts_route_param_t* params,
+	hio_oow_t*                  nparams
+);
+
+/**
+ * The hio_svc_htts_doroute() function dispatches the request to the handler
+ * of the route matching the request method and the query path. It sends
+ * 405 Method Not Allowed if the path matches but the method doesn't. It
+ * returns 1 if the request has been handled, 0 if no route matches, and -1
+ * on failure. The parameters captured are kept in the task made for the
+ * request. See hio_svc_htts_task_getrouteparam() and
+ * hio_svc_htts_thr_getrouteparam().
+ */
+HIO_EXPORT int hio_svc_htts_doroute (
+	hio_svc_htts_t*             htts,
+	hio_dev_sck_t*              csck,
+	hio_htre_t*                 req
+);
+
+/**
+ * The hio_svc_htts_task_getrouteparam() function returns the value of the
+ * route parameter or the wildcard \a name captured for the task dispatched by
+ * hio_svc_htts_doroute(). It returns #HIO_NULL if no such parameter exists.
+ */
+HIO_EXPORT const hio_bch_t* hio_svc_htts_task_getrouteparam (
+	hio_svc_htts_task_t*        task,
+	const hio_bch_t*            name
+);
+
 HIO_EXPORT hio_svc_htts_task_t* hio_svc_htts_task_make (
 	hio_svc_htts_t*              htts,
 	hio_oow_t                    task_size,
@@ -602,9 +1189,55 @@ HIO_EXPORT int hio_svc_htts_task_endbody (
 	hio_svc_htts_task_t* task
 );
 
+/**
+ * The hio_svc_htts_task_addreqbody() function buffers a request body segment
+ * for a task that handles the body after it has been received fully. The body
+ * is kept in the content of @a req until it grows beyond
+ * HIO_SVC_HTTS_TASK_REQ_BODY_MEM_MAX. It is then moved to an unlinked
+ * temporary file under the directory named by TMPDIR or /tmp. The file is
+ * written by a thread so that the loop doesn't block on the disk. Reading
+ * the client is paused while the thread lags behind.
+ */
+HIO_EXPORT int hio_svc_htts_task_addreqbody (
+	hio_svc_htts_task_t* task,
+	hio_htre_t*          req,
+	const void*          data,
+	hio_oow_t            dlen
+);
+
+/**
+ * The hio_svc_htts_task_endreqbody() function tells that the whole request
+ * body has been passed to hio_svc_htts_task_addreqbody(). It returns 1 if
+ * the body is ready, 0 if @a on_end is to be called once the temporary file
+ * has been written, and -1 on failure.
+ */
+HIO_EXPORT int hio_svc_htts_task_endreqbody (
+	hio_svc_htts_task_t*                task,
+	hio_svc_htts_task_on_req_body_end_t on_end
+);
+
+/**
+ * The hio_svc_htts_task_getreqbodyfd() function returns the file descriptor
+ * of the temporary file holding the request body rewound to the beginning.
+ * It returns -1 if the body is in the request content. The file is closed
+ * when the task is killed. The body length is in task_req_body_len.
+ */
+HIO_EXPORT int hio_svc_htts_task_getreqbodyfd (
+	hio_svc_htts_task_t* task
+);
+
+enum hio_svc_htts_task_expect100_option_t
+{
+	/* don't send 100 Continue for Expect: 100-continue */
+	HIO_SVC_HTTS_TASK_EXPECT100_NO_CONTINUE = (1 << 0),
+	/* the task relays a chunked request body without knowing its length. 411 is sent otherwise */
+	HIO_SVC_HTTS_TASK_EXPECT100_CHUNKED     = (1 << 1)
+};
+typedef enum hio_svc_htts_task_expect100_option_t hio_svc_htts_task_expect100_option_t;
+
 HIO_EXPORT int hio_svc_htts_task_handleexpect100 (
 	hio_svc_htts_task_t* task,
-	int                  no_continue
+	int                  options /**< 0 or bitwise-ORed of #hio_svc_htts_task_expect100_option_t enumerators */
 );
 
 HIO_EXPORT void hio_svc_htts_fmtgmtime (
@@ -620,6 +1253,64 @@ HIO_EXPORT hio_bch_t* hio_svc_htts_dupmergepaths (
 	const hio_bch_t*   path
 );
 
+/* ------------------------------------------------------------------------- */
+/* HTTP CLIENT SERVICE                                                       */
+/* ------------------------------------------------------------------------- */
+
+HIO_EXPORT hio_svc_httc_t* hio_svc_httc_start (
+	hio_t*                      hio,
+	const hio_svc_httc_tmout_t* tmout
+);
+
+HIO_EXPORT void hio_svc_httc_stop (
+	hio_svc_httc_t*    httc
+);
+
+#if defined(HIO_HAVE_INLINE)
+static HIO_INLINE hio_t* hio_svc_httc_gethio(hio_svc_httc_t* svc) { return hio_svc_gethio((hio_svc_t*)svc); }
+#else
+#	define hio_svc_httc_gethio(svc) hio_svc_gethio(svc)
+#endif
+
+HIO_EXPORT int hio_svc_httc_getoption (
+	hio_svc_httc_t*       httc,
+	hio_svc_httc_option_t id,
+	void*                 value
+);
+
+HIO_EXPORT int hio_svc_httc_setoption (
+	hio_svc_httc_t*       httc,
+	hio_svc_httc_option_t id,
+	const void*           value
+);
+
+/**
+ * The hio_svc_httc_sendreq() function sends a request over an idle
+ * keep-alive connection to the origin, a new connection or behind other
+ * requests on a busy connection, whichever is available first. The request
+ * waits for a connection if none is available. The callbacks are invoked on
+ * the loop thread and \a on_done is invoked exactly once unless the request
+ * is cancelled. A request that hasn't got any response octets is sent again
+ * once on another connection if the connection used gets closed.
+ *
+ * \return request handle on success, #HIO_NULL on failure.
+ */
+HIO_EXPORT hio_svc_httc_req_t* hio_svc_httc_sendreq (
+	hio_svc_httc_t*               httc,
+	const hio_svc_httc_reqinfo_t* ri,
+	const hio_svc_httc_cbs_t*     cbs,
+	void*                         ctx
+);
+
+/**
+ * The hio_svc_httc_cancelreq() function cancels a request without invoking
+ * the callbacks any more. The response of a request already sent is read
+ * and discarded to keep the connection.
+ */
+HIO_EXPORT void hio_svc_httc_cancelreq (
+	hio_svc_httc_req_t*   req
+);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -38,6 +38,7 @@ typedef enum hio_dev_pro_sid_t hio_dev_pro_sid_t;
 
 typedef struct hio_dev_pro_t hio_dev_pro_t;
 typedef struct hio_dev_pro_slave_t hio_dev_pro_slave_t;
+typedef struct hio_dev_pro_pool_t hio_dev_pro_pool_t;
 
 typedef int (*hio_dev_pro_on_read_t) (
 	hio_dev_pro_t*    dev,
@@ -127,8 +128,25 @@ struct hio_dev_pro_make_t
 	hio_dev_pro_on_close_t on_close; /* optional */
 	hio_dev_pro_on_fork_t on_fork; /* optional */
 	void* fork_ctx;
+
+	/* optional. HIO_NULL-terminated array of "NAME=VALUE" strings to use as
+	 * the environment of the child process instead of the inherited one */
+	hio_bch_t** env;
+
+	/* optional. if set, the command runs on a standby helper of the pool
+	 * as long as the io flags match those of the pool and on_fork is not
+	 * set. a new process is started otherwise. */
+	hio_dev_pro_pool_t* pool;
 };
 
+struct hio_dev_pro_poolstat_t
+{
+	hio_oow_t nstandby; /**< number of standby helpers waiting */
+	hio_oow_t nhits;    /**< number of commands run on a standby helper */
+	hio_oow_t nmisses;  /**< number of commands that needed a new process */
+};
+typedef struct hio_dev_pro_poolstat_t hio_dev_pro_poolstat_t;
+
 
 enum hio_dev_pro_ioctl_cmd_t
 {
@@ -141,6 +159,11 @@ typedef enum hio_dev_pro_ioctl_cmd_t hio_dev_pro_ioctl_cmd_t;
 extern "C" {
 #endif
 
+/**
+ * The hio_dev_pro_make() function starts a child process running the command
+ * given. It fails if the process can't be created. A command that can't be
+ * executed doesn't make it fail. The child process exits with 128 instead.
+ */
 HIO_EXPORT  hio_dev_pro_t* hio_dev_pro_make (
 	hio_t*                    hio,
 	hio_oow_t                 xtnsize,
@@ -204,6 +227,35 @@ HIO_EXPORT int hio_dev_pro_killchild (
 	hio_dev_pro_t*     pro
 );
 
+/**
+ * The hio_dev_pro_openpool() function creates a pool that keeps up to
+ * \a max_standby standby helpers started in advance with the io set up
+ * according to \a flags. A helper is the \a helper program, hio-standby
+ * installed under the libexec directory if it is #HIO_NULL. It waits until
+ * hio_dev_pro_make() sends it a command and executes the command in place.
+ * The helpers are started the same way as a command and the pool starts
+ * replacements on a later loop iteration.
+ */
+HIO_EXPORT hio_dev_pro_pool_t* hio_dev_pro_openpool (
+	hio_t*             hio,
+	const hio_bch_t*   helper,
+	int                flags,
+	hio_oow_t          max_standby
+);
+
+/**
+ * The hio_dev_pro_closepool() function kills the waiting helpers and
+ * destroys the pool. The process devices already made are not affected.
+ */
+HIO_EXPORT void hio_dev_pro_closepool (
+	hio_dev_pro_pool_t* pool
+);
+
+HIO_EXPORT void hio_dev_pro_getpoolstat (
+	hio_dev_pro_pool_t*     pool,
+	hio_dev_pro_poolstat_t* stat
+);
+
 #if defined(__cplusplus)
 }
 #endif
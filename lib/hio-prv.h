@@ -120,6 +120,12 @@ int hio_makesyshndcloexec (
 	hio_syshnd_t hnd
 );
 
+/* close all the handles numbered \a lowhnd or higher. it is meant
+ * to be called in a child process before exec() */
+void hio_closesyshndsfrom (
+	hio_syshnd_t lowhnd
+);
+
 void hio_cleartmrjobs (
 	hio_t* hio
 );
@@ -37,6 +37,7 @@ typedef enum hio_dev_thr_sid_t hio_dev_thr_sid_t;
 
 typedef struct hio_dev_thr_t hio_dev_thr_t;
 typedef struct hio_dev_thr_slave_t hio_dev_thr_slave_t;
+typedef struct hio_dev_thr_pool_t hio_dev_thr_pool_t;
 
 typedef int (*hio_dev_thr_on_read_t) (
 	hio_dev_thr_t*    dev,
@@ -100,7 +101,20 @@ struct hio_dev_thr_make_t
 	hio_dev_thr_on_write_t on_write; /* mandatory */
 	hio_dev_thr_on_read_t on_read; /* mandatory */
 	hio_dev_thr_on_close_t on_close; /* optional */
+
+	/* optional. if set, the function runs on a worker of the pool instead
+	 * of a new thread. hio_dev_thr_make() fails with HIO_EBUSY if all
+	 * workers are busy and the pool queue is full. */
+	hio_dev_thr_pool_t* pool;
+};
+
+struct hio_dev_thr_poolstat_t
+{
+	hio_oow_t nworkers;
+	hio_oow_t nidle;
+	hio_oow_t nqueued;
 };
+typedef struct hio_dev_thr_poolstat_t hio_dev_thr_poolstat_t;
 
 enum hio_dev_thr_ioctl_cmd_t
 {
@@ -165,6 +179,43 @@ HIO_EXPORT int hio_dev_thr_timedwrite (
 	void*              wrctx
 );
 
+/**
+ * The hio_dev_thr_openpool() function creates a pool of at most \a max_workers
+ * threads to run the functions of thread devices made with the pool. Workers
+ * are created on demand and kept for reuse. At most \a max_queued functions
+ * can wait for a worker to become free.
+ *
+ * The pipes given to a function in the pool are reused by later functions.
+ * The output is over when the function returns. The function must not use
+ * the descriptors after it returns. If it closes one, set the descriptor in
+ * the I/O pair to HIO_SYSHND_INVALID.
+ */
+HIO_EXPORT hio_dev_thr_pool_t* hio_dev_thr_openpool (
+	hio_t*             hio,
+	hio_oow_t          max_workers,
+	hio_oow_t          max_queued
+);
+
+/**
+ * The hio_dev_thr_closepool() function waits for all the queued and running
+ * functions to finish and destroys the pool. Call it before hio_fini() after
+ * all thread devices using the pool are gone.
+ */
+HIO_EXPORT void hio_dev_thr_closepool (
+	hio_dev_thr_pool_t* pool
+);
+
+HIO_EXPORT int hio_dev_thr_setpoollimit (
+	hio_dev_thr_pool_t* pool,
+	hio_oow_t           max_workers,
+	hio_oow_t           max_queued
+);
+
+HIO_EXPORT void hio_dev_thr_getpoolstat (
+	hio_dev_thr_pool_t*     pool,
+	hio_dev_thr_poolstat_t* stat
+);
+
 HIO_EXPORT int hio_dev_thr_close (
 	hio_dev_thr_t*     thr,
 	hio_dev_thr_sid_t  sid
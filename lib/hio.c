@@ -24,6 +24,7 @@
 
 #include "hio-prv.h"
 #include <hio-fmt.h>
+#include <hio-spl.h>
 #include <stdlib.h> /* malloc, free, etc */
 
 #define DEV_CAP_ALL_WATCHED (HIO_DEV_CAP_IN_WATCHED | HIO_DEV_CAP_OUT_WATCHED | HIO_DEV_CAP_PRI_WATCHED)
@@ -69,6 +70,33 @@ static hio_mmgr_t default_mmgr =
 
 /* ========================================================================= */
 
+/* all hio instances in the process for hio_getallstat(). the lock guards
+ * the list only. the counters of an instance are read from the copy that
+ * its loop publishes under its own lock before waiting for events */
+static hio_spl_t all_hio_spl = HIO_SPL_INIT;
+static hio_t* all_hio = HIO_NULL;
+
+static void link_to_all_hio (hio_t* hio)
+{
+	hio_spl_lock (&all_hio_spl);
+	hio->stat.prev = HIO_NULL;
+	hio->stat.next = all_hio;
+	if (all_hio) all_hio->stat.prev = hio;
+	all_hio = hio;
+	hio_spl_unlock (&all_hio_spl);
+}
+
+static void unlink_from_all_hio (hio_t* hio)
+{
+	hio_spl_lock (&all_hio_spl);
+	if (hio->stat.prev) hio->stat.prev->stat.next = hio->stat.next;
+	else all_hio = hio->stat.next;
+	if (hio->stat.next) hio->stat.next->stat.prev = hio->stat.prev;
+	hio_spl_unlock (&all_hio_spl);
+}
+
+/* ========================================================================= */
+
 hio_t* hio_open (hio_mmgr_t* mmgr, hio_oow_t xtnsize, hio_cmgr_t* cmgr, hio_bitmask_t features, hio_oow_t tmrcapa, hio_errinf_t* errinfo)
 {
 	hio_t* hio;
@@ -142,6 +170,7 @@ int hio_init (hio_t* hio, hio_mmgr_t* mmgr, hio_cmgr_t* cmgr, hio_bitmask_t feat
 	HIO_SVCL_INIT (&hio->actsvc);
 
 	hio_sys_gettime (hio, &hio->init_time);
+	link_to_all_hio (hio);
 	return 0;
 
 oops:
@@ -162,6 +191,7 @@ void hio_fini (hio_t* hio)
 	hio_oow_t nactdevs = 0, nhltdevs = 0, nzmbdevs = 0, ndieharddevs = 0; /* statistics */
 
 	hio->_fini_in_progress = 1;
+	unlink_from_all_hio (hio);
 
 	/* clean up free cwq list */
 	for (i = 0; i < HIO_COUNTOF(hio->cwqfl); i++)
@@ -464,6 +494,7 @@ static HIO_INLINE void unlink_wq (hio_t* hio, hio_wq_t* q)
 		HIO_ASSERT (hio, q->tmridx == HIO_TMRIDX_INVALID);
 	}
 	HIO_WQ_UNLINK (q);
+	hio->stat.c.wq_depth--;
 }
 
 static void fire_cwq_handlers (hio_t* hio)
@@ -661,6 +692,7 @@ static HIO_INLINE void handle_event (hio_t* hio, hio_dev_t* dev, int events, int
 					}
 
 					unlink_wq (hio, q);
+					hio->stat.c.bytes_out += q->olen;
 					y = dev->dev_evcb->on_write(dev, q->olen, q->ctx, &q->dstaddr);
 					hio_freemem (hio, q);
 
@@ -752,6 +784,8 @@ static HIO_INLINE void handle_event (hio_t* hio, hio_dev_t* dev, int events, int
 			}
 			else /*if (x >= 1) */
 			{
+				hio->stat.c.bytes_in += len;
+
 				/* call on_write() callbacks enqueued from the device before calling on_read().
 				 * if on_write() callback is delayed, there can be out-of-order execution
 				 * between on_read() and on_write() callbacks. for instance, if a write request
@@ -882,6 +916,7 @@ static void clear_unneeded_cfmbs (hio_t* hio)
 		if (!cur->cfmb_checker || cur->cfmb_checker(hio, cur))
 		{
 			HIO_CFMBL_UNLINK_CFMB (cur);
+			hio->stat.c.cfmb_count--;
 			/*hio_freemem (hio, cur);*/
 			cur->cfmb_freeer (hio, cur);
 		}
@@ -1490,6 +1525,7 @@ static void on_write_timeout (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t*
 
 	HIO_ASSERT (hio, q->tmridx == HIO_TMRIDX_INVALID);
 	HIO_WQ_UNLINK(q);
+	hio->stat.c.wq_depth--;
 	hio_freemem (hio, q);
 
 	if (x <= -1)
@@ -1499,7 +1535,7 @@ static void on_write_timeout (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t*
 	}
 }
 
-static HIO_INLINE int __enqueue_completed_write (hio_dev_t* dev, hio_iolen_t len, void* wrctx, const hio_devaddr_t* dstaddr)
+static HIO_INLINE int __enqueue_completed_write (hio_dev_t* dev, hio_iolen_t len, hio_iolen_t wrlen, void* wrctx, const hio_devaddr_t* dstaddr)
 {
 	hio_t* hio = dev->hio;
 	hio_cwq_t* cwq;
@@ -1536,6 +1572,7 @@ static HIO_INLINE int __enqueue_completed_write (hio_dev_t* dev, hio_iolen_t len
 	}
 
 	cwq->olen = len;
+	hio->stat.c.bytes_out += wrlen; /* a non-stream device may have written less than len */
 
 	HIO_CWQ_ENQ (&dev->hio->cwq, cwq);
 	dev->cw_count++; /* increment the number of complete write operations */
@@ -1604,6 +1641,7 @@ static HIO_INLINE int __enqueue_pending_write (hio_dev_t* dev, hio_iolen_t olen,
 	}
 
 	HIO_WQ_ENQ (&dev->wq, q);
+	if (++hio->stat.c.wq_depth > hio->stat.c.wq_depth_max) hio->stat.c.wq_depth_max = hio->stat.c.wq_depth;
 	if (!(dev->dev_cap & HIO_DEV_CAP_OUT_WATCHED))
 	{
 		/* if output is not being watched, arrange to do so */
@@ -1677,6 +1715,7 @@ static HIO_INLINE int __enqueue_pending_sendfile (hio_dev_t* dev, hio_iolen_t ol
 	}
 
 	HIO_WQ_ENQ (&dev->wq, q);
+	if (++hio->stat.c.wq_depth > hio->stat.c.wq_depth_max) hio->stat.c.wq_depth_max = hio->stat.c.wq_depth;
 	if (!(dev->dev_cap & HIO_DEV_CAP_OUT_WATCHED))
 	{
 		/* if output is not being watched, arrange to do so */
@@ -1768,6 +1807,7 @@ static HIO_INLINE int __dev_write (hio_dev_t* dev, const void* data, hio_iolen_t
 		if (x <= -1) return -1;
 		else if (x == 0) goto enqueue_data;
 
+		urem -= ulen;
 		/* partial writing is still considered ok for a non-stream device. */
 
 		/* read the comment in the 'if' block above for why i enqueue the write completion event
@@ -1784,7 +1824,7 @@ enqueue_data:
 	return __enqueue_pending_write(dev, len, urem, &iov, 1, 0, tmout, wrctx, dstaddr);
 
 enqueue_completed_write:
-	return __enqueue_completed_write(dev, len, wrctx, dstaddr);
+	return __enqueue_completed_write(dev, len, len - urem, wrctx, dstaddr);
 }
 
 static HIO_INLINE int __dev_writev (hio_dev_t* dev, hio_iovec_t* iov, hio_iolen_t iovcnt, const hio_ntime_t* tmout, void* wrctx, const hio_devaddr_t* dstaddr)
@@ -1889,7 +1929,7 @@ enqueue_data:
 	return __enqueue_pending_write(dev, len, urem, iov, iovcnt, index, tmout, wrctx, dstaddr);
 
 enqueue_completed_write:
-	return __enqueue_completed_write(dev, len, wrctx, dstaddr);
+	return __enqueue_completed_write(dev, len, len - urem, wrctx, dstaddr);
 }
 
 static int __dev_sendfile (hio_dev_t* dev, hio_syshnd_t in_fd, hio_foff_t foff, hio_iolen_t len, const hio_ntime_t* tmout, void* wrctx)
@@ -1977,7 +2017,7 @@ enqueue_data:
 	return __enqueue_pending_sendfile(dev, len, urem, uoff, in_fd, tmout, wrctx, HIO_NULL);
 
 enqueue_completed_write:
-	return __enqueue_completed_write(dev, len, wrctx, HIO_NULL);
+	return __enqueue_completed_write(dev, len, len, wrctx, HIO_NULL);
 }
 
 int hio_dev_write (hio_dev_t* dev, const void* data, hio_iolen_t len, void* wrctx, const hio_devaddr_t* dstaddr)
@@ -2059,6 +2099,54 @@ void hio_addcfmb (hio_t* hio, hio_cfmb_t* cfmb, hio_cfmb_checker_t checker, hio_
 	cfmb->cfmb_checker = checker;
 	cfmb->cfmb_freeer = freeer? freeer: (hio_cfmb_freeer_t)hio_freemem;
 	HIO_CFMBL_APPEND_CFMB (&hio->cfmb, cfmb);
+	hio->stat.c.cfmb_count++;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void hio_getstat (hio_t* hio, hio_stat_t* stat)
+{
+	*stat = hio->stat.c;
+	stat->tmr_size = hio->tmr.size;
+}
+
+void hio_publishstat (hio_t* hio)
+{
+	hio_spl_lock (&hio->stat.pub_spl);
+	hio_getstat (hio, &hio->stat.pub);
+	hio_spl_unlock (&hio->stat.pub_spl);
+}
+
+hio_oow_t hio_getallstat (hio_stat_t* stat)
+{
+	hio_t* hio;
+	hio_oow_t count = 0;
+
+	HIO_MEMSET (stat, 0, HIO_SIZEOF(*stat));
+
+	hio_spl_lock (&all_hio_spl);
+	for (hio = all_hio; hio; hio = hio->stat.next)
+	{
+		hio_stat_t s;
+
+		hio_spl_lock (&hio->stat.pub_spl);
+		s = hio->stat.pub;
+		hio_spl_unlock (&hio->stat.pub_spl);
+
+		stat->accepts += s.accepts;
+		stat->bytes_in += s.bytes_in;
+		stat->bytes_out += s.bytes_out;
+		stat->wq_depth += s.wq_depth;
+		if (s.wq_depth_max > stat->wq_depth_max) stat->wq_depth_max = s.wq_depth_max;
+		stat->tmr_size += s.tmr_size;
+		stat->cfmb_count += s.cfmb_count;
+		HIO_ADD_NTIME (&stat->mux_wait, &stat->mux_wait, &s.mux_wait);
+		HIO_ADD_NTIME (&stat->mux_busy, &stat->mux_busy, &s.mux_busy);
+		count++;
+	}
+	hio_spl_unlock (&all_hio_spl);
+
+	return count;
 }
 
 /* ------------------------------------------------------------------------ */
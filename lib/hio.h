@@ -30,6 +30,7 @@
  * library.
  */
 #include <hio-cmn.h>
+#include <hio-spl.h>
 #include <stdarg.h>
 
 #if defined(_WIN32)
@@ -201,6 +202,26 @@ struct hio_tmrjob_t
 
 /* ========================================================================= */
 
+/**
+ * The hio_stat_t type holds the counters of an event loop. The counters
+ * are updated by the thread running the loop without locking.
+ */
+struct hio_stat_t
+{
+	hio_oow_t     accepts;      /**< number of connections accepted */
+	hio_uintmax_t bytes_in;     /**< octets read from devices */
+	hio_uintmax_t bytes_out;    /**< octets written to devices */
+	hio_oow_t     wq_depth;     /**< number of write requests pending on devices */
+	hio_oow_t     wq_depth_max; /**< highest number of write requests pending */
+	hio_oow_t     tmr_size;     /**< number of timer jobs scheduled */
+	hio_oow_t     cfmb_count;   /**< number of memory blocks waiting to be freed */
+	hio_ntime_t   mux_wait;     /**< time spent waiting on the multiplexer */
+	hio_ntime_t   mux_busy;     /**< time spent running between the waits */
+};
+typedef struct hio_stat_t hio_stat_t;
+
+/* ========================================================================= */
+
 struct hio_dev_mth_t
 {
 	/* ------------------------------------------------------------------ */
@@ -788,6 +809,16 @@ struct hio_t
 
 	hio_svc_t actsvc; /* list head of active services */
 
+	struct
+	{
+		hio_stat_t c; /* tmr_size is filled when read */
+		hio_stat_t pub; /* copy of c for other threads. see hio_publishstat() */
+		hio_spl_t pub_spl;
+		hio_ntime_t mux_woke;
+		hio_t* prev; /* in the list of all hio instances */
+		hio_t* next;
+	} stat;
+
 	/* platform specific fields below */
 	hio_sys_t* sysdep;
 };
@@ -1174,6 +1205,39 @@ HIO_EXPORT void hio_addcfmb (
 	hio_cfmb_freeer_t  freeer
 );
 
+/* =========================================================================
+ * STATISTICS
+ * ========================================================================= */
+
+/**
+ * The hio_getstat() function copies the counters of \a hio to \a stat.
+ * It must be called on the thread running the loop of \a hio.
+ */
+HIO_EXPORT void hio_getstat (
+	hio_t*             hio,
+	hio_stat_t*        stat
+);
+
+/**
+ * The hio_getallstat() function adds up the counters of all the hio
+ * instances in the process to \a stat. The highest of wq_depth_max is
+ * taken instead of the sum. It returns the number of instances. The
+ * counters of an instance are those published by its loop before it last
+ * waited for events. See hio_publishstat().
+ */
+HIO_EXPORT hio_oow_t hio_getallstat (
+	hio_stat_t*        stat
+);
+
+/**
+ * The hio_publishstat() function copies the counters of \a hio for
+ * hio_getallstat() called on another thread. The loop calls it before
+ * waiting for events.
+ */
+HIO_EXPORT void hio_publishstat (
+	hio_t*             hio
+);
+
 /* =========================================================================
  * STRING ENCODING CONVERSION
  * ========================================================================= */
@@ -27,6 +27,18 @@
 #include <hio-path.h>
 #include "hio-prv.h"
 
+#if defined(__GNUC__) && defined(__AVX2__)
+#	include <immintrin.h>
+#	define HTRD_SCAN_AVX2
+#endif
+#if defined(__GNUC__) && defined(__SSE2__)
+#	include <emmintrin.h>
+#	define HTRD_SCAN_SSE2
+#elif defined(__GNUC__) && defined(__ARM_NEON)
+#	include <arm_neon.h>
+#	define HTRD_SCAN_NEON
+#endif
+
 static const hio_bch_t NUL = '\0';
 
 /* for htrd->fed.s.flags */
@@ -86,6 +98,73 @@ static HIO_INLINE int xdigit_to_num (hio_bch_t c)
 	return HIO_XDIGIT_TO_NUM(c);
 }
 
+/* find the first octet that matches c1, c2 or c3 in the range [ptr, end).
+ * it returns end if no such octet is found. 16 or 32 octets are compared
+ * at a time if the target supports it. the remainder is checked one by one */
+static HIO_INLINE const hio_bch_t* find_any_octet (const hio_bch_t* ptr, const hio_bch_t* end, hio_bch_t c1, hio_bch_t c2, hio_bch_t c3)
+{
+#if defined(HTRD_SCAN_AVX2)
+	if (end - ptr >= 32)
+	{
+		const __m256i y1 = _mm256_set1_epi8(c1);
+		const __m256i y2 = _mm256_set1_epi8(c2);
+		const __m256i y3 = _mm256_set1_epi8(c3);
+
+		do
+		{
+			__m256i y = _mm256_loadu_si256((const __m256i*)ptr);
+			unsigned int m = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(y, y1), _mm256_cmpeq_epi8(y, y2)),
+				_mm256_cmpeq_epi8(y, y3)));
+			if (m) return ptr + __builtin_ctz(m);
+			ptr += 32;
+		}
+		while (end - ptr >= 32);
+	}
+#endif
+
+#if defined(HTRD_SCAN_SSE2)
+	if (end - ptr >= 16)
+	{
+		const __m128i x1 = _mm_set1_epi8(c1);
+		const __m128i x2 = _mm_set1_epi8(c2);
+		const __m128i x3 = _mm_set1_epi8(c3);
+
+		do
+		{
+			__m128i x = _mm_loadu_si128((const __m128i*)ptr);
+			unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(x, x1), _mm_cmpeq_epi8(x, x2)),
+				_mm_cmpeq_epi8(x, x3)));
+			if (m) return ptr + __builtin_ctz(m);
+			ptr += 16;
+		}
+		while (end - ptr >= 16);
+	}
+#elif defined(HTRD_SCAN_NEON)
+	if (end - ptr >= 16)
+	{
+		const uint8x16_t x1 = vdupq_n_u8((hio_uint8_t)c1);
+		const uint8x16_t x2 = vdupq_n_u8((hio_uint8_t)c2);
+		const uint8x16_t x3 = vdupq_n_u8((hio_uint8_t)c3);
+
+		do
+		{
+			uint8x16_t x = vld1q_u8((const hio_uint8_t*)ptr);
+			uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(x, x1), vceqq_u8(x, x2)), vceqq_u8(x, x3));
+			/* narrow each matching octet to a nibble of a 64-bit mask */
+			uint64_t n = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+			if (n) return ptr + (__builtin_ctzll(n) >> 2);
+			ptr += 16;
+		}
+		while (end - ptr >= 16);
+	}
+#endif
+
+	while (ptr < end && *ptr != c1 && *ptr != c2 && *ptr != c3) ptr++;
+	return ptr;
+}
+
 static HIO_INLINE int push_to_buffer (hio_htrd_t* htrd, hio_becs_t* octb, const hio_bch_t* ptr, hio_oow_t len)
 {
 	if (hio_becs_ncat(octb, ptr, len) == (hio_oow_t)-1)
@@ -100,6 +179,19 @@ static HIO_INLINE int push_content (hio_htrd_t* htrd, const hio_bch_t* ptr, hio_
 {
 	HIO_ASSERT (htrd->hio, len > 0);
 
+	if (htrd->limit.body_max > 0 && !(htrd->flags & FEEDING_DUMMIFIED))
+	{
+		/* the content length is checked against the limit upon
+		 * header completion. this catches chunked contents and
+		 * a response read until the connection is closed */
+		if (len > htrd->limit.body_max - htrd->fed.s.clen)
+		{
+			htrd->errnum = HIO_HTRD_EBODYTOOLARGE;
+			return -1;
+		}
+		htrd->fed.s.clen += len;
+	}
+
 	if (htrd->recbs.push_content) return htrd->recbs.push_content(htrd, &htrd->re, ptr, len);
 
 	if (hio_htre_addcontent(&htrd->re, ptr, len) <= -1)
@@ -445,6 +537,16 @@ void hio_htrd_setoption (hio_htrd_t* htrd, hio_bitmask_t mask)
 	htrd->option = mask;
 }
 
+void hio_htrd_getlimit (hio_htrd_t* htrd, hio_htrd_limit_t* limit)
+{
+	*limit = htrd->limit;
+}
+
+void hio_htrd_setlimit (hio_htrd_t* htrd, const hio_htrd_limit_t* limit)
+{
+	htrd->limit = *limit;
+}
+
 const hio_htrd_recbs_t* hio_htrd_getrecbs (hio_htrd_t* htrd)
 {
 	return &htrd->recbs;
@@ -455,12 +557,11 @@ void hio_htrd_setrecbs (hio_htrd_t* htrd, const hio_htrd_recbs_t* recbs)
 	htrd->recbs = *recbs;
 }
 
-static int capture_connection (hio_htrd_t* htrd, hio_htb_pair_t* pair)
+static int capture_connection (hio_htrd_t* htrd, const hio_htre_hdr_t* hdr)
 {
-	hio_htre_hdrval_t* val;
+	const hio_htre_hdrval_t* val;
 
-	val = HIO_HTB_VPTR(pair);
-	while (val->next) val = val->next;
+	val = hdr->tail;
 
 	/* The value for Connection: may get comma-separated.
 	 * so use hio_find_bcstr_word_in_bcstr() instead of hio_comp_bcstr(). */
@@ -493,15 +594,14 @@ static int capture_connection (hio_htrd_t* htrd, hio_htb_pair_t* pair)
 	return 0;
 }
 
-static int capture_content_length (hio_htrd_t* htrd, hio_htb_pair_t* pair)
+static int capture_content_length (hio_htrd_t* htrd, const hio_htre_hdr_t* hdr)
 {
 	hio_oow_t len = 0, off = 0, tmp;
 	const hio_bch_t* ptr;
-	hio_htre_hdrval_t* val;
+	const hio_htre_hdrval_t* val;
 
 	/* get the last content_length */
-	val = HIO_HTB_VPTR(pair);
-	while (val->next) val = val->next;
+	val = hdr->tail;
 
 	ptr = val->ptr;
 	while (off < val->len)
@@ -546,14 +646,14 @@ static int capture_content_length (hio_htrd_t* htrd, hio_htb_pair_t* pair)
 	return 0;
 }
 
-static int capture_expect (hio_htrd_t* htrd, hio_htb_pair_t* pair)
+static int capture_expect (hio_htrd_t* htrd, const hio_htre_hdr_t* hdr)
 {
-	hio_htre_hdrval_t* val;
+	const hio_htre_hdrval_t* val;
 
 	/* Expect is included */
 	htrd->re.flags |= HIO_HTRE_ATTR_EXPECT;
 
-	val = HIO_HTB_VPTR(pair);
+	val = &hdr->val;
 	while (val)
 	{
 		/* Expect: 100-continue is included */
@@ -564,24 +664,22 @@ static int capture_expect (hio_htrd_t* htrd, hio_htb_pair_t* pair)
 	return 0;
 }
 
-static int capture_status (hio_htrd_t* htrd, hio_htb_pair_t* pair)
+static int capture_status (hio_htrd_t* htrd, const hio_htre_hdr_t* hdr)
 {
-	hio_htre_hdrval_t* val;
+	const hio_htre_hdrval_t* val;
 
-	val = HIO_HTB_VPTR(pair);
-	while (val->next) val = val->next;
+	val = hdr->tail;
 
 	htrd->re.attr.status = val->ptr;
 	return 0;
 }
 
-static int capture_transfer_encoding (hio_htrd_t* htrd, hio_htb_pair_t* pair)
+static int capture_transfer_encoding (hio_htrd_t* htrd, const hio_htre_hdr_t* hdr)
 {
 	int n;
-	hio_htre_hdrval_t* val;
+	const hio_htre_hdrval_t* val;
 
-	val = HIO_HTB_VPTR(pair);
-	while (val->next) val = val->next;
+	val = hdr->tail;
 
 	n = hio_comp_bcstr(val->ptr, "chunked", 1);
 	if (n == 0)
@@ -603,152 +701,32 @@ badre:
 	return -1;
 }
 
-static HIO_INLINE int capture_key_header (hio_htrd_t* htrd, hio_htb_pair_t* pair)
+static HIO_INLINE int capture_key_header (hio_htrd_t* htrd, const hio_htre_hdr_t* hdr)
 {
-	static struct
-	{
-		const hio_bch_t* ptr;
-		hio_oow_t        len;
-		int (*handler) (hio_htrd_t*, hio_htb_pair_t*);
-	} hdrtab[] =
-	{
-		{ "Connection",         10, capture_connection },
-		{ "Content-Length",     14, capture_content_length },
-		{ "Expect",             6,  capture_expect },
-		{ "Status",             6,  capture_status },
-		{ "Transfer-Encoding",  17, capture_transfer_encoding  }
-	};
-
-	int n;
-	hio_oow_t mid, count, base = 0;
-
-	/* perform binary search */
-	for (count = HIO_COUNTOF(hdrtab); count > 0; count /= 2)
+	switch (hdr->id)
 	{
-		mid = base + count / 2;
+		case HIO_HTTP_HDR_CONNECTION:
+			return capture_connection(htrd, hdr);
 
-		n = hio_comp_bchars(HIO_HTB_KPTR(pair), HIO_HTB_KLEN(pair), hdrtab[mid].ptr, hdrtab[mid].len, 1);
-		if (n == 0)
-		{
-			/* bingo! */
-			return hdrtab[mid].handler(htrd, pair);
-		}
-
-		if (n > 0) { base = mid + 1; count--; }
-	}
+		case HIO_HTTP_HDR_CONTENT_LENGTH:
+			return capture_content_length(htrd, hdr);
 
-	/* No callback functions were interested in this header field. */
-	return 0;
-}
+		case HIO_HTTP_HDR_EXPECT:
+			return capture_expect(htrd, hdr);
 
-struct hdr_cbserter_ctx_t
-{
-	hio_htrd_t* htrd;
-	void*       vptr;
-	hio_oow_t  vlen;
-};
+		case HIO_HTTP_HDR_STATUS:
+			return capture_status(htrd, hdr);
 
-static hio_htb_pair_t* hdr_cbserter (hio_htb_t* htb, hio_htb_pair_t* pair, void* kptr, hio_oow_t klen, void* ctx)
-{
-	struct hdr_cbserter_ctx_t* tx = (struct hdr_cbserter_ctx_t*)ctx;
-
-	if (pair == HIO_NULL)
-	{
-		/* the key is new. let's create a new pair. */
-		hio_htb_pair_t* p;
-		hio_htre_hdrval_t *val;
-
-		val = hio_allocmem(htb->hio, HIO_SIZEOF(*val));
-		if (HIO_UNLIKELY(!val))
-		{
-			tx->htrd->errnum = HIO_HTRD_ENOMEM;
-			return HIO_NULL;
-		}
+		case HIO_HTTP_HDR_TRANSFER_ENCODING:
+			return capture_transfer_encoding(htrd, hdr);
 
-		HIO_MEMSET (val, 0, HIO_SIZEOF(*val));
-		val->ptr = tx->vptr;
-		val->len = tx->vlen;
-		val->next = HIO_NULL;
-
-		p = hio_htb_allocpair(htb, kptr, klen, val, 0);
-		if (HIO_UNLIKELY(!p))
-		{
-			hio_freemem (htb->hio, val);
-			tx->htrd->errnum = HIO_HTRD_ENOMEM;
-		}
-		else
-		{
-			if (capture_key_header(tx->htrd, p) <= -1)
-			{
-				/* Destroy the pair created here
-				 * as it is not added to the hash table yet */
-				hio_htb_freepair (htb, p);
-				p = HIO_NULL;
-			}
-		}
-
-		return p;
-	}
-	else
-	{
-		/* RFC2616
-		 * Multiple message-header fields with the same field-name
-		 * MAY be present in a message if and only if the entire
-		 * field-value for that header field is defined as a
-		 * comma-separated list [i.e., #(values)]. It MUST be possible
-		 * to combine the multiple header fields into one
-		 * "field-name: field-value" pair, without changing the semantics
-		 * of the message, by appending each subsequent field-value
-		 * to the first, each separated by a comma. The order in which
-		 * header fields with the same field-name are received is therefore
-		 * significant to the interpretation of the combined field value,
-		 * and thus a proxy MUST NOT change the order of these field values
-		 * when a message is forwarded.
-
-		 * RFC6265 defines the syntax for Set-Cookie and Cookie.
-		 * this seems to be conflicting with RFC2616.
-		 *
-		 * Origin servers SHOULD NOT fold multiple Set-Cookie header fields
-		 * into a single header field. The usual mechanism for folding HTTP
-		 * headers fields (i.e., as defined in [RFC2616]) might change the
-		 * semantics of the Set-Cookie header field because the %x2C (",")
-		 * character is used by Set-Cookie in a way that conflicts with
-		 * such folding.
-		 *
-		 * So i just maintain the list of values for a key instead of
-		 * folding them.
-		 */
-
-		hio_htre_hdrval_t* val;
-		hio_htre_hdrval_t* tmp;
-
-		val = (hio_htre_hdrval_t*)hio_allocmem(tx->htrd->hio, HIO_SIZEOF(*val));
-		if (HIO_UNLIKELY(!val))
-		{
-			tx->htrd->errnum = HIO_HTRD_ENOMEM;
-			return HIO_NULL;
-		}
-
-		HIO_MEMSET (val, 0, HIO_SIZEOF(*val));
-		val->ptr = tx->vptr;
-		val->len = tx->vlen;
-		val->next = HIO_NULL;
-
-/* TODO: doubly linked list for speed-up??? */
-		tmp = HIO_HTB_VPTR(pair);
-		HIO_ASSERT (tx->htrd->hio, tmp != HIO_NULL);
-
-		/* find the tail */
-		while (tmp->next) tmp = tmp->next;
-		/* append it to the list*/
-		tmp->next = val;
-
-		if (capture_key_header(tx->htrd, pair) <= -1) return HIO_NULL;
-		return pair;
+		default:
+			/* No callback functions were interested in this header field. */
+			return 0;
 	}
 }
 
-hio_bch_t* parse_header_field (hio_htrd_t* htrd, hio_bch_t* line, hio_htb_t* tab)
+static hio_bch_t* parse_header_field (hio_htrd_t* htrd, hio_bch_t* line, hio_bch_t* end, int trailer)
 {
 	hio_bch_t* p = line, * last;
 	struct
@@ -765,11 +743,10 @@ hio_bch_t* parse_header_field (hio_htrd_t* htrd, hio_bch_t* line, hio_htb_t* tab
 	HIO_ASSERT (htrd->hio, !is_whspace_octet(*p));
 
 	/* check the field name */
-	name.ptr = last = p;
-	while (*p != '\0' && *p != '\n' && *p != ':')
-	{
-		if (!is_space_octet(*p++)) last = p;
-	}
+	name.ptr = p;
+	p = (hio_bch_t*)find_any_octet(p, end, ':', '\n', '\0');
+	last = p;
+	while (last > name.ptr && is_space_octet(last[-1])) last--;
 	name.len = last - name.ptr;
 
 	if (*p != ':')
@@ -791,11 +768,10 @@ hio_bch_t* parse_header_field (hio_htrd_t* htrd, hio_bch_t* line, hio_htb_t* tab
 	/* skip the colon and spaces after it */
 	do { p++; } while (is_space_octet(*p));
 
-	value.ptr = last = p;
-	while (*p != '\0' && *p != '\n')
-	{
-		if (!is_space_octet(*p++)) last = p;
-	}
+	value.ptr = p;
+	p = (hio_bch_t*)find_any_octet(p, end, '\n', '\0', '\0');
+	last = p;
+	while (last > value.ptr && is_space_octet(last[-1])) last--;
 
 	value.len = last - value.ptr;
 	if (*p != '\n') goto badhdr; /* not ending with a new line */
@@ -833,21 +809,18 @@ hio_bch_t* parse_header_field (hio_htrd_t* htrd, hio_bch_t* line, hio_htb_t* tab
 
 	/* insert the new field to the header table */
 	{
-		struct hdr_cbserter_ctx_t ctx;
-
-		ctx.htrd = htrd;
-		ctx.vptr = value.ptr;
-		ctx.vlen = value.len;
+		const hio_htre_hdr_t* hdr;
 
-		htrd->errnum = HIO_HTRD_ENOERR;
-		if (hio_htb_cbsert (
-			tab, name.ptr, name.len,
-			hdr_cbserter, &ctx) == HIO_NULL)
+		hdr = trailer? hio_htre_addtrailer(&htrd->re, name.ptr, name.len, value.ptr, value.len):
+		               hio_htre_addheader(&htrd->re, name.ptr, name.len, value.ptr, value.len);
+		if (HIO_UNLIKELY(!hdr))
 		{
-			if (htrd->errnum == HIO_HTRD_ENOERR)
-				htrd->errnum = HIO_HTRD_ENOMEM;
+			htrd->errnum = HIO_HTRD_ENOMEM;
 			return HIO_NULL;
 		}
+
+		htrd->errnum = HIO_HTRD_ENOERR;
+		if (capture_key_header(htrd, hdr) <= -1) return HIO_NULL;
 	}
 
 	return p;
@@ -859,7 +832,7 @@ badhdr:
 
 static HIO_INLINE int parse_initial_line_and_headers (hio_htrd_t* htrd, const hio_bch_t* req, hio_oow_t rlen)
 {
-	hio_bch_t* p;
+	hio_bch_t* p, * end;
 
 	/* add the actual request */
 	if (push_to_buffer (htrd, &htrd->fed.b.raw, req, rlen) <= -1) return -1;
@@ -868,6 +841,7 @@ static HIO_INLINE int parse_initial_line_and_headers (hio_htrd_t* htrd, const hi
 	if (push_to_buffer (htrd, &htrd->fed.b.raw, &NUL, 1) <= -1) return -1;
 
 	p = HIO_BECS_PTR(&htrd->fed.b.raw);
+	end = p + HIO_BECS_LEN(&htrd->fed.b.raw) - 1; /* at the terminating null */
 
 #if 0
 	if (htrd->option & HIO_HTRD_SKIP_EMPTY_LINES)
@@ -894,7 +868,7 @@ static HIO_INLINE int parse_initial_line_and_headers (hio_htrd_t* htrd, const hi
 		/* TODO: return error if protocol is 0.9.
 		 * HTTP/0.9 must not get headers... */
 
-		p = parse_header_field(htrd, p, &htrd->re.hdrtab);
+		p = parse_header_field(htrd, p, end, 0);
 		if (HIO_UNLIKELY(!p)) return -1;
 	}
 	while (1);
@@ -972,6 +946,16 @@ static const hio_bch_t* getchunklen (hio_htrd_t* htrd, const hio_bch_t* ptr, hio
 	return ptr;
 }
 
+static HIO_INLINE int is_over_trailer_limit (hio_htrd_t* htrd, hio_oow_t len)
+{
+	if (htrd->limit.hdr_max > 0 && HIO_BECS_LEN(&htrd->fed.b.tra) + len > htrd->limit.hdr_max)
+	{
+		htrd->errnum = HIO_HTRD_EHDRTOOLARGE;
+		return 1;
+	}
+	return 0;
+}
+
 static const hio_bch_t* get_trailing_headers (hio_htrd_t* htrd, const hio_bch_t* req, const hio_bch_t* end)
 {
 	const hio_bch_t* ptr = req;
@@ -995,15 +979,17 @@ static const hio_bch_t* get_trailing_headers (hio_htrd_t* htrd, const hio_bch_t*
 				}
 				else
 				{
-					hio_bch_t* p;
+					hio_bch_t* p, * end;
 
 					HIO_ASSERT (htrd->hio, htrd->fed.s.crlf <= 3);
 					htrd->fed.s.crlf = 0;
 
+					if (is_over_trailer_limit(htrd, ptr - req)) return HIO_NULL;
 					if (push_to_buffer(htrd, &htrd->fed.b.tra, req, ptr - req) <= -1 ||
 					    push_to_buffer(htrd, &htrd->fed.b.tra, &NUL, 1) <= -1) return HIO_NULL;
 
 					p = HIO_BECS_PTR(&htrd->fed.b.tra);
+					end = p + HIO_BECS_LEN(&htrd->fed.b.tra) - 1;
 
 					do
 					{
@@ -1013,7 +999,7 @@ static const hio_bch_t* get_trailing_headers (hio_htrd_t* htrd, const hio_bch_t*
 						/* TODO: return error if protocol is 0.9.
 						 * HTTP/0.9 must not get headers... */
 
-						p = parse_header_field(htrd, p, ((htrd->option & HIO_HTRD_TRAILERS)? &htrd->re.trailers: &htrd->re.hdrtab));
+						p = parse_header_field(htrd, p, end, (htrd->option & HIO_HTRD_TRAILERS));
 						if (HIO_UNLIKELY(!p)) return HIO_NULL;
 					}
 					while (1);
@@ -1035,6 +1021,7 @@ static const hio_bch_t* get_trailing_headers (hio_htrd_t* htrd, const hio_bch_t*
 		}
 	}
 
+	if (is_over_trailer_limit(htrd, ptr - req)) return HIO_NULL;
 	if (push_to_buffer (htrd, &htrd->fed.b.tra, req, ptr - req) <= -1)
 		return HIO_NULL;
 
@@ -1098,7 +1085,39 @@ int hio_htrd_feed (hio_htrd_t* htrd, const hio_bch_t* req, hio_oow_t len, hio_oo
 
 	while (ptr < end)
 	{
-		register hio_bch_t b = *ptr++;
+		register hio_bch_t b;
+		const hio_bch_t* eol;
+
+		/* jump over the octets that affect neither the crlf state
+		 * nor the validity of the request in one go */
+		eol = find_any_octet(ptr, end, '\n', '\r', '\0');
+		if (eol > ptr)
+		{
+			/* increment length of a request in raw
+			 * excluding crlf */
+			htrd->fed.s.plen += eol - ptr;
+			/* mark that neither CR nor LF was seen */
+			htrd->fed.s.crlf = 0;
+
+			/* check the limits before the octets get buffered.
+			 * plen is the length of the initial line until
+			 * the first LF is seen */
+			if (htrd->limit.line_max > 0 && htrd->fed.s.lines <= 0 && htrd->fed.s.plen > htrd->limit.line_max)
+			{
+				htrd->errnum = HIO_HTRD_ELINETOOLONG;
+				return -1;
+			}
+			if (htrd->limit.hdr_max > 0 && htrd->fed.s.plen > htrd->limit.hdr_max)
+			{
+				htrd->errnum = HIO_HTRD_EHDRTOOLARGE;
+				return -1;
+			}
+
+			ptr = eol;
+			if (ptr >= end) break;
+		}
+
+		b = *ptr++;
 
 #if 0
 		if (htrd->option & HIO_HTRD_SKIP_EMPTY_LINES &&
@@ -1131,6 +1150,13 @@ int hio_htrd_feed (hio_htrd_t* htrd, const hio_bch_t* req, hio_oow_t len, hio_oo
 					 * mark the first LF is seen here.
 					 */
 					htrd->fed.s.crlf = 2;
+
+					htrd->fed.s.lines++;
+					if (htrd->limit.hdr_count_max > 0 && htrd->fed.s.lines > htrd->limit.hdr_count_max + 1)
+					{
+						htrd->errnum = HIO_HTRD_EHDRTOOLARGE;
+						return -1;
+					}
 				}
 				else
 				{
@@ -1147,12 +1173,21 @@ int hio_htrd_feed (hio_htrd_t* htrd, const hio_bch_t* req, hio_oow_t len, hio_oo
 					htrd->fed.s.crlf = 0;
 					/* reset the raw request length */
 					htrd->fed.s.plen = 0;
+					htrd->fed.s.lines = 0;
 
 					if (parse_initial_line_and_headers(htrd, req, ptr - req) <= -1)
 					{
 						return -1;
 					}
 
+					if (htrd->limit.body_max > 0 && (htrd->re.flags & HIO_HTRE_ATTR_LENGTH) &&
+					    htrd->re.attr.content_length > htrd->limit.body_max)
+					{
+						/* fail early without waiting for the content */
+						htrd->errnum = HIO_HTRD_EBODYTOOLARGE;
+						return -1;
+					}
+
 #if 0
 					/* compelete request header is received */
 					header_completed_during_this_feed = 1;
@@ -1460,13 +1495,6 @@ hio_printf (HIO_T("CONTENT_LENGTH %d, RAW HEADER LENGTH %d\n"),
 					htrd->fed.s.crlf++;
 				else htrd->fed.s.crlf = 1;
 				break;
-
-			default:
-				/* increment length of a request in raw
-				 * excluding crlf */
-				htrd->fed.s.plen++;
-				/* mark that neither CR nor LF was seen */
-				htrd->fed.s.crlf = 0;
 		}
 	}
 
@@ -26,46 +26,212 @@
 #include <hio-http.h>
 #include "hio-prv.h"
 
-static void free_hdrval (hio_htb_t* htb, void* vptr, hio_oow_t vlen)
+static void init_hdrtab (hio_htre_hdrtab_t* tab, hio_htre_hdr_t* ent, hio_oow_t capa, hio_uint16_t* idx, hio_oow_t idxcapa)
 {
-	hio_htre_hdrval_t* val;
-	hio_htre_hdrval_t* tmp;
+	HIO_MEMSET (tab, 0, HIO_SIZEOF(*tab));
+	tab->ent = tab->ient = ent;
+	tab->capa = capa;
+	tab->idx = tab->iidx = idx;
+	tab->idxcapa = idxcapa;
+	if (idx) HIO_MEMSET (idx, 0, idxcapa * HIO_SIZEOF(*idx));
+}
+
+static void fini_hdrtab (hio_htre_hdrtab_t* tab, hio_t* hio)
+{
+	if (tab->ent != tab->ient) hio_freemem (hio, tab->ent);
+	if (tab->idx != tab->iidx) hio_freemem (hio, tab->idx);
+	tab->ent = HIO_NULL;
+	tab->idx = HIO_NULL;
+	tab->count = tab->capa = 0;
+	tab->nnames = tab->idxcapa = 0;
+	tab->nids = 0;
+}
 
-	val = vptr;
-	while (val)
+static void clear_hdrtab (hio_htre_hdrtab_t* tab)
+{
+	/* keep the storage grown for the previous message for reuse */
+	if (tab->nnames > 0) HIO_MEMSET (tab->idx, 0, tab->idxcapa * HIO_SIZEOF(*tab->idx));
+	if (tab->nids > 0) HIO_MEMSET (tab->byid, 0, HIO_SIZEOF(tab->byid));
+	tab->count = 0;
+	tab->nnames = 0;
+	tab->nids = 0;
+}
+
+static HIO_INLINE hio_oow_t hash_hdr_name (const hio_bch_t* name, hio_oow_t nlen)
+{
+	hio_oow_t h = 2166136261u, i;
+	/* folding the case bit makes the hash case-insensitive for letters.
+	 * a few non-letters collide but the comparison sorts them out */
+	for (i = 0; i < nlen; i++) h = (h ^ (hio_uint8_t)(name[i] | 0x20)) * 16777619u;
+	return h;
+}
+
+static hio_oow_t find_hdr_slot (const hio_htre_hdrtab_t* tab, const hio_bch_t* name, hio_oow_t nlen, hio_oow_t hash)
+{
+	hio_oow_t mask = tab->idxcapa - 1, slot;
+
+	for (slot = hash & mask; tab->idx[slot]; slot = (slot + 1) & mask)
 	{
-		tmp = val;
-		val = val->next;
-		hio_freemem (htb->hio, tmp);
+		const hio_htre_hdr_t* hdr = &tab->ent[tab->idx[slot] - 1];
+		if (hdr->hash == hash && hio_comp_bchars(hdr->name, hdr->nlen, name, nlen, 1) == 0) break;
 	}
+
+	return slot;
 }
 
-int hio_htre_init (hio_htre_t* re, hio_t* hio)
+static int grow_hdrtab_ent (hio_htre_hdrtab_t* tab, hio_t* hio)
 {
-	static hio_htb_style_t style =
+	hio_htre_hdr_t* ent;
+	hio_oow_t capa, i;
+
+	capa = tab->capa > 0? tab->capa * 2: 16;
+	if (capa > HIO_TYPE_MAX(hio_uint16_t)) capa = HIO_TYPE_MAX(hio_uint16_t);
+	if (capa <= tab->count)
 	{
-		{
-			HIO_HTB_COPIER_DEFAULT,
-			HIO_HTB_COPIER_DEFAULT
-		},
-		{
-			HIO_HTB_FREEER_DEFAULT,
-			free_hdrval
-		},
-		HIO_HTB_COMPER_DEFAULT,
-		HIO_HTB_KEEPER_DEFAULT,
-		HIO_HTB_SIZER_DEFAULT,
-		HIO_HTB_HASHER_DEFAULT
-	};
+		hio_seterrbfmt (hio, HIO_EBUFFULL, "too many header fields");
+		return -1;
+	}
+
+	ent = (hio_htre_hdr_t*)hio_allocmem(hio, capa * HIO_SIZEOF(*ent));
+	if (HIO_UNLIKELY(!ent)) return -1;
 
+	/* the values are linked with pointers. rebase them to the new array */
+	HIO_MEMCPY (ent, tab->ent, tab->count * HIO_SIZEOF(*ent));
+	for (i = 0; i < tab->count; i++)
+	{
+		if (ent[i].val.next) ent[i].val.next = &ent[(hio_htre_hdr_t*)ent[i].val.next - tab->ent].val;
+		if (ent[i].tail) ent[i].tail = &ent[(hio_htre_hdr_t*)ent[i].tail - tab->ent].val;
+	}
+
+	if (tab->ent != tab->ient) hio_freemem (hio, tab->ent);
+	tab->ent = ent;
+	tab->capa = capa;
+	return 0;
+}
+
+static int grow_hdrtab_idx (hio_htre_hdrtab_t* tab, hio_t* hio)
+{
+	hio_uint16_t* idx;
+	hio_oow_t capa, mask, i;
+
+	capa = tab->idxcapa > 0? tab->idxcapa * 2: 16;
+	idx = (hio_uint16_t*)hio_callocmem(hio, capa * HIO_SIZEOF(*idx));
+	if (HIO_UNLIKELY(!idx)) return -1;
+
+	mask = capa - 1;
+	for (i = 0; i < tab->count; i++)
+	{
+		hio_oow_t slot;
+		/* skip an entry that is not the first of a name or is indexed by id */
+		if (!tab->ent[i].tail || tab->ent[i].id != HIO_HTTP_HDR_OTHER) continue;
+		for (slot = tab->ent[i].hash & mask; idx[slot]; slot = (slot + 1) & mask) /* nothing */;
+		idx[slot] = i + 1;
+	}
+
+	if (tab->idx != tab->iidx) hio_freemem (hio, tab->idx);
+	tab->idx = idx;
+	tab->idxcapa = capa;
+	return 0;
+}
+
+static const hio_htre_hdr_t* add_hdr (hio_htre_hdrtab_t* tab, hio_t* hio, const hio_bch_t* name, hio_oow_t nlen, const hio_bch_t* vptr, hio_oow_t vlen)
+{
+	hio_htre_hdr_t* hdr, * head;
+	hio_http_hdr_t id;
+	hio_uint16_t* slot;
+	hio_oow_t hash = 0;
+
+	id = hio_bchars_to_http_hdr(name, nlen);
+	if (id == HIO_HTTP_HDR_OTHER)
+	{
+		/* keep the index at most half full */
+		if ((tab->nnames + 1) * 2 > tab->idxcapa && grow_hdrtab_idx(tab, hio) <= -1) return HIO_NULL;
+	}
+	if (tab->count >= tab->capa && grow_hdrtab_ent(tab, hio) <= -1) return HIO_NULL;
+
+	if (id == HIO_HTTP_HDR_OTHER)
+	{
+		hash = hash_hdr_name(name, nlen);
+		slot = &tab->idx[find_hdr_slot(tab, name, nlen, hash)];
+	}
+	else
+	{
+		slot = &tab->byid[id];
+	}
+
+	hdr = &tab->ent[tab->count];
+	hdr->val.ptr = vptr;
+	hdr->val.len = vlen;
+	hdr->val.next = HIO_NULL;
+	hdr->name = name;
+	hdr->nlen = nlen;
+	hdr->hash = hash;
+	hdr->id = id;
+	hdr->tail = HIO_NULL;
+
+	if (*slot)
+	{
+		/* RFC2616 allows folding multiple fields of the same name into
+		 * one comma-separated value. but RFC6265 says Set-Cookie must not
+		 * be folded. so the values are kept in a list instead of folding */
+		head = &tab->ent[*slot - 1];
+		head->tail->next = &hdr->val;
+		head->tail = &hdr->val;
+	}
+	else
+	{
+		head = hdr;
+		head->tail = &hdr->val;
+		*slot = tab->count + 1;
+		if (id == HIO_HTTP_HDR_OTHER) tab->nnames++;
+		else tab->nids++;
+	}
+
+	tab->count++;
+	return head;
+}
+
+static HIO_INLINE const hio_htre_hdrval_t* get_hdrval_by_id (const hio_htre_hdrtab_t* tab, hio_http_hdr_t id)
+{
+	if (id <= HIO_HTTP_HDR_OTHER || id >= HIO_HTTP_HDR_COUNT || !tab->byid[id]) return HIO_NULL;
+	return &tab->ent[tab->byid[id] - 1].val;
+}
+
+static const hio_htre_hdrval_t* get_hdrval (const hio_htre_hdrtab_t* tab, const hio_bch_t* name)
+{
+	hio_oow_t nlen, slot;
+	hio_http_hdr_t id;
+
+	nlen = hio_count_bcstr(name);
+	id = hio_bchars_to_http_hdr(name, nlen);
+	if (id != HIO_HTTP_HDR_OTHER) return get_hdrval_by_id(tab, id);
+
+	if (tab->nnames <= 0) return HIO_NULL;
+	slot = find_hdr_slot(tab, name, nlen, hash_hdr_name(name, nlen));
+	return tab->idx[slot]? &tab->ent[tab->idx[slot] - 1].val: HIO_NULL;
+}
+
+static int walk_hdrtab (hio_htre_t* re, const hio_htre_hdrtab_t* tab, hio_htre_header_walker_t walker, void* ctx)
+{
+	hio_oow_t i;
+
+	/* visit the names in the order of their first appearance */
+	for (i = 0; i < tab->count; i++)
+	{
+		if (tab->ent[i].tail && walker(re, tab->ent[i].name, &tab->ent[i].val, ctx) <= -1) return -1;
+	}
+
+	return 0;
+}
+
+int hio_htre_init (hio_htre_t* re, hio_t* hio)
+{
 	HIO_MEMSET (re, 0, HIO_SIZEOF(*re));
 	re->hio = hio;
 
-	if (hio_htb_init(&re->hdrtab, hio, 60, 70, 1, 1) <= -1) return -1;
-	if (hio_htb_init(&re->trailers, hio, 20, 70, 1, 1) <= -1) return -1;
-
-	hio_htb_setstyle (&re->hdrtab, &style);
-	hio_htb_setstyle (&re->trailers, &style);
+	init_hdrtab (&re->hdrtab, re->hdrent, HIO_COUNTOF(re->hdrent), re->hdridx, HIO_COUNTOF(re->hdridx));
+	/* trailers are rare. the storage is allocated on demand */
+	init_hdrtab (&re->trailers, HIO_NULL, 0, HIO_NULL, 0);
 
 	hio_becs_init (&re->content, hio, 0);
 #if 0
@@ -81,8 +247,8 @@ void hio_htre_fini (hio_htre_t* re)
 	hio_becs_fini (&re->iniline);
 #endif
 	hio_becs_fini (&re->content);
-	hio_htb_fini (&re->trailers);
-	hio_htb_fini (&re->hdrtab);
+	fini_hdrtab (&re->trailers, re->hio);
+	fini_hdrtab (&re->hdrtab, re->hio);
 
 	if (re->orgqpath.buf)
 	{
@@ -115,8 +281,8 @@ void hio_htre_clear (hio_htre_t* re)
 	HIO_MEMSET (&re->version, 0, HIO_SIZEOF(re->version));
 	HIO_MEMSET (&re->attr, 0, HIO_SIZEOF(re->attr));
 
-	hio_htb_clear (&re->hdrtab);
-	hio_htb_clear (&re->trailers);
+	clear_hdrtab (&re->hdrtab);
+	clear_hdrtab (&re->trailers);
 
 	hio_becs_clear (&re->content);
 #if 0
@@ -126,59 +292,42 @@ void hio_htre_clear (hio_htre_t* re)
 
 const hio_htre_hdrval_t* hio_htre_getheaderval (const hio_htre_t* re, const hio_bch_t* name)
 {
-	hio_htb_pair_t* pair;
-	pair = hio_htb_search(&re->hdrtab, name, hio_count_bcstr(name));
-	if (pair == HIO_NULL) return HIO_NULL;
-	return HIO_HTB_VPTR(pair);
+	return get_hdrval(&re->hdrtab, name);
 }
 
 const hio_htre_hdrval_t* hio_htre_gettrailerval (const hio_htre_t* re, const hio_bch_t* name)
 {
-	hio_htb_pair_t* pair;
-	pair = hio_htb_search(&re->trailers, name, hio_count_bcstr(name));
-	if (pair == HIO_NULL) return HIO_NULL;
-	return HIO_HTB_VPTR(pair);
+	return get_hdrval(&re->trailers, name);
 }
 
-struct header_walker_ctx_t
+const hio_htre_hdrval_t* hio_htre_getheaderbyid (const hio_htre_t* re, hio_http_hdr_t id)
 {
-	hio_htre_t* re;
-	hio_htre_header_walker_t walker;
-	void* ctx;
-	int ret;
-};
+	return get_hdrval_by_id(&re->hdrtab, id);
+}
 
-static hio_htb_walk_t walk_headers (hio_htb_t* htb, hio_htb_pair_t* pair, void* ctx)
+const hio_htre_hdrval_t* hio_htre_gettrailerbyid (const hio_htre_t* re, hio_http_hdr_t id)
 {
-	struct header_walker_ctx_t* hwctx = (struct header_walker_ctx_t*)ctx;
-	if (hwctx->walker (hwctx->re, HIO_HTB_KPTR(pair), HIO_HTB_VPTR(pair), hwctx->ctx) <= -1)
-	{
-		hwctx->ret = -1;
-		return HIO_HTB_WALK_STOP;
-	}
-	return HIO_HTB_WALK_FORWARD;
+	return get_hdrval_by_id(&re->trailers, id);
+}
+
+const hio_htre_hdr_t* hio_htre_addheader (hio_htre_t* re, const hio_bch_t* name, hio_oow_t nlen, const hio_bch_t* vptr, hio_oow_t vlen)
+{
+	return add_hdr(&re->hdrtab, re->hio, name, nlen, vptr, vlen);
+}
+
+const hio_htre_hdr_t* hio_htre_addtrailer (hio_htre_t* re, const hio_bch_t* name, hio_oow_t nlen, const hio_bch_t* vptr, hio_oow_t vlen)
+{
+	return add_hdr(&re->trailers, re->hio, name, nlen, vptr, vlen);
 }
 
 int hio_htre_walkheaders (hio_htre_t* re, hio_htre_header_walker_t walker, void* ctx)
 {
-	struct header_walker_ctx_t hwctx;
-	hwctx.re = re;
-	hwctx.walker = walker;
-	hwctx.ctx = ctx;
-	hwctx.ret = 0;
-	hio_htb_walk (&re->hdrtab, walk_headers, &hwctx);
-	return hwctx.ret;
+	return walk_hdrtab(re, &re->hdrtab, walker, ctx);
 }
 
 int hio_htre_walktrailers (hio_htre_t* re, hio_htre_header_walker_t walker, void* ctx)
 {
-	struct header_walker_ctx_t hwctx;
-	hwctx.re = re;
-	hwctx.walker = walker;
-	hwctx.ctx = ctx;
-	hwctx.ret = 0;
-	hio_htb_walk (&re->trailers, walk_headers, &hwctx);
-	return hwctx.ret;
+	return walk_hdrtab(re, &re->trailers, walker, ctx);
 }
 
 int hio_htre_addcontent (hio_htre_t* re, const hio_bch_t* ptr, hio_oow_t len)
@@ -0,0 +1,439 @@
+/*
+    Copyright (c) 2016-2020 Chung, Hyung-Hwan. All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+    IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+    NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+    THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "http-prv.h"
+#include <hio-fmt.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <stdio.h> /* for rename */
+
+/*
+ * A record is formatted on the loop thread and copied into a ring buffer
+ * under a mutex that is held only for the copy. A writer thread takes the
+ * buffered octets out of the ring and writes them to the file outside the
+ * mutex. If the ring doesn't have room for a record, the record is dropped
+ * rather than waiting for the writer. The writer also rotates the file.
+ */
+
+#define ALOG_RING_SIZE_DEFAULT (256 * 1024)
+#define ALOG_REC_MAX 2048
+#define ALOG_ROTATE_SUFFIX_MAX 40
+
+struct hio_svc_htts_alog_t
+{
+	hio_svc_htts_t* htts;
+	hio_bch_t* path;
+	hio_bch_t* rpath; /* buffer for the name of a rotated file */
+	hio_foff_t rotate_size;
+	hio_oow_t rotate_interval;
+
+	pthread_t thr;
+	pthread_mutex_t mtx;
+	pthread_cond_t cnd;
+
+	/* the fields below are protected by mtx. the loop thread appends
+	 * at tail + len and the writer consumes from tail */
+	hio_uint8_t* ring;
+	hio_oow_t capa;
+	hio_oow_t tail;
+	hio_oow_t len;
+	int stop;
+	hio_svc_htts_alog_stat_t stat;
+
+	/* touched by the writer only after start */
+	int fd;
+	hio_foff_t fsize;
+	time_t opened;
+
+	/* timestamp formatted for the second of the last record. loop thread only */
+	time_t tcache_sec;
+	hio_bch_t tcache[32];
+	hio_oow_t tcache_len;
+};
+
+static const hio_bch_t* alog_mon_name[] =
+{
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/* ------------------------------------------------------------------------ */
+
+static int open_alog_file (const hio_bch_t* path, hio_foff_t* fsize)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd <= -1) return -1;
+
+	*fsize = (fstat(fd, &st) >= 0)? (hio_foff_t)st.st_size: 0;
+	return fd;
+}
+
+static void rotate_alog_file (hio_svc_htts_alog_t* alog, time_t now)
+{
+	struct tm bt;
+	hio_oow_t x, i;
+	int fd;
+
+	if (alog->fd >= 0 && alog->fsize <= 0)
+	{
+		/* nothing to keep in a separate file */
+		alog->opened = now;
+		return;
+	}
+
+	localtime_r (&now, &bt);
+	x = hio_fmttobcstr(HIO_NULL, alog->rpath, hio_count_bcstr(alog->path) + ALOG_ROTATE_SUFFIX_MAX,
+		"%hs.%04d%02d%02d-%02d%02d%02d", alog->path,
+		bt.tm_year + 1900, bt.tm_mon + 1, bt.tm_mday, bt.tm_hour, bt.tm_min, bt.tm_sec);
+
+	/* size-based rotation can happen more than once in a second */
+	for (i = 1; access(alog->rpath, F_OK) == 0 && i < 1000; i++)
+	{
+		hio_fmttobcstr (HIO_NULL, &alog->rpath[x], ALOG_ROTATE_SUFFIX_MAX - 20, ".%zu", i);
+	}
+
+	if (alog->fd >= 0)
+	{
+		close (alog->fd);
+		alog->fd = -1;
+	}
+
+	if (rename(alog->path, alog->rpath) <= -1)
+	{
+		pthread_mutex_lock (&alog->mtx);
+		alog->stat.errors++;
+		pthread_mutex_unlock (&alog->mtx);
+	}
+
+	fd = open_alog_file(alog->path, &alog->fsize);
+	pthread_mutex_lock (&alog->mtx);
+	if (fd <= -1) alog->stat.errors++;
+	else alog->stat.rotated++;
+	pthread_mutex_unlock (&alog->mtx);
+
+	alog->fd = fd;
+	alog->opened = now;
+}
+
+static void write_alog_file (hio_svc_htts_alog_t* alog, const hio_uint8_t* ptr, hio_oow_t len)
+{
+	time_t now;
+
+	now = time(HIO_NULL);
+	if ((alog->rotate_size > 0 && alog->fsize >= alog->rotate_size) ||
+	    (alog->rotate_interval > 0 && now - alog->opened >= (time_t)alog->rotate_interval) ||
+	    alog->fd <= -1)
+	{
+		/* a file failed to reopen is retried in the next round */
+		rotate_alog_file (alog, now);
+		if (alog->fd <= -1) return;
+	}
+
+	while (len > 0)
+	{
+		ssize_t n;
+
+		n = write(alog->fd, ptr, len);
+		if (n <= -1)
+		{
+			if (errno == EINTR) continue;
+			/* the remaining octets are lost */
+			pthread_mutex_lock (&alog->mtx);
+			alog->stat.errors++;
+			pthread_mutex_unlock (&alog->mtx);
+			break;
+		}
+
+		ptr += n;
+		len -= n;
+		alog->fsize += n;
+	}
+}
+
+static void* run_alog_writer (void* ctx)
+{
+	hio_svc_htts_alog_t* alog = (hio_svc_htts_alog_t*)ctx;
+
+	pthread_mutex_lock (&alog->mtx);
+	while (1)
+	{
+		const hio_uint8_t* ptr;
+		hio_oow_t len;
+
+		if (alog->len <= 0)
+		{
+			struct timespec ts;
+
+			if (alog->stop) break;
+
+			/* wake up periodically for time-based rotation on a quiet log */
+			clock_gettime (CLOCK_REALTIME, &ts);
+			ts.tv_sec += 1;
+			pthread_cond_timedwait (&alog->cnd, &alog->mtx, &ts);
+
+			if (alog->len <= 0 && !alog->stop && alog->rotate_interval > 0 && time(HIO_NULL) - alog->opened >= (time_t)alog->rotate_interval)
+			{
+				pthread_mutex_unlock (&alog->mtx);
+				rotate_alog_file (alog, time(HIO_NULL));
+				pthread_mutex_lock (&alog->mtx);
+			}
+			continue;
+		}
+
+		/* the loop thread doesn't touch the octets between tail and tail + len */
+		ptr = &alog->ring[alog->tail];
+		len = alog->capa - alog->tail;
+		if (len > alog->len) len = alog->len;
+		pthread_mutex_unlock (&alog->mtx);
+
+		write_alog_file (alog, ptr, len);
+
+		pthread_mutex_lock (&alog->mtx);
+		alog->tail = (alog->tail + len) % alog->capa;
+		alog->len -= len;
+	}
+	pthread_mutex_unlock (&alog->mtx);
+
+	return HIO_NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int hio_svc_htts_openalog (hio_svc_htts_t* htts, const hio_svc_htts_alog_cfg_t* cfg)
+{
+	hio_t* hio = htts->hio;
+	hio_svc_htts_alog_t* alog;
+	hio_oow_t plen, capa;
+	int n;
+
+	if (htts->alog)
+	{
+		hio_seterrbfmt (hio, HIO_EPERM, "access log already open");
+		return -1;
+	}
+
+	plen = hio_count_bcstr(cfg->path);
+	capa = cfg->ring_size > 0? cfg->ring_size: ALOG_RING_SIZE_DEFAULT;
+	if (capa < ALOG_REC_MAX) capa = ALOG_REC_MAX;
+
+	alog = (hio_svc_htts_alog_t*)hio_callocmem(hio, HIO_SIZEOF(*alog) + (plen + 1) + (plen + ALOG_ROTATE_SUFFIX_MAX) + capa);
+	if (HIO_UNLIKELY(!alog)) return -1;
+
+	alog->htts = htts;
+	alog->path = (hio_bch_t*)(alog + 1);
+	alog->rpath = alog->path + plen + 1;
+	alog->ring = (hio_uint8_t*)(alog->rpath + plen + ALOG_ROTATE_SUFFIX_MAX);
+	alog->capa = capa;
+	alog->rotate_size = cfg->rotate_size;
+	alog->rotate_interval = cfg->rotate_interval;
+	alog->tcache_sec = -1;
+	HIO_MEMCPY (alog->path, cfg->path, plen + 1);
+
+	alog->fd = open_alog_file(alog->path, &alog->fsize);
+	if (alog->fd <= -1)
+	{
+		hio_seterrwithsyserr (hio, 0, errno);
+		hio_freemem (hio, alog);
+		return -1;
+	}
+	alog->opened = time(HIO_NULL);
+
+	pthread_mutex_init (&alog->mtx, HIO_NULL);
+	pthread_cond_init (&alog->cnd, HIO_NULL);
+
+	n = pthread_create(&alog->thr, HIO_NULL, run_alog_writer, alog);
+	if (n != 0)
+	{
+		hio_seterrwithsyserr (hio, 0, n);
+		pthread_cond_destroy (&alog->cnd);
+		pthread_mutex_destroy (&alog->mtx);
+		close (alog->fd);
+		hio_freemem (hio, alog);
+		return -1;
+	}
+
+	htts->alog = alog;
+	return 0;
+}
+
+void hio_svc_htts_closealog (hio_svc_htts_t* htts)
+{
+	hio_svc_htts_alog_t* alog = htts->alog;
+
+	if (!alog) return;
+	htts->alog = HIO_NULL;
+
+	pthread_mutex_lock (&alog->mtx);
+	alog->stop = 1;
+	pthread_cond_signal (&alog->cnd);
+	pthread_mutex_unlock (&alog->mtx);
+
+	/* the writer exits after having written what is buffered */
+	pthread_join (alog->thr, HIO_NULL);
+
+	pthread_cond_destroy (&alog->cnd);
+	pthread_mutex_destroy (&alog->mtx);
+	if (alog->fd >= 0) close (alog->fd);
+	hio_freemem (htts->hio, alog);
+}
+
+void hio_svc_htts_getalogstat (hio_svc_htts_t* htts, hio_svc_htts_alog_stat_t* stat)
+{
+	hio_svc_htts_alog_t* alog = htts->alog;
+
+	if (!alog)
+	{
+		HIO_MEMSET (stat, 0, HIO_SIZEOF(*stat));
+		return;
+	}
+
+	pthread_mutex_lock (&alog->mtx);
+	*stat = alog->stat;
+	pthread_mutex_unlock (&alog->mtx);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static hio_oow_t put_alog_text (hio_bch_t* buf, hio_oow_t len, hio_oow_t max, const hio_bch_t* str)
+{
+	while (*str != '\0' && len < max)
+	{
+		hio_bch_t c = *str++;
+
+		/* escape what could fake a field or a record */
+		if (c == '"' || c == '\\' || (hio_uint8_t)c < 0x20 || (hio_uint8_t)c >= 0x7F)
+		{
+			static hio_bch_t xdigits[] = "0123456789ABCDEF";
+			if (max - len < 4) break;
+			buf[len++] = '\\';
+			buf[len++] = 'x';
+			buf[len++] = xdigits[(hio_uint8_t)c >> 4];
+			buf[len++] = xdigits[(hio_uint8_t)c & 0xF];
+		}
+		else buf[len++] = c;
+	}
+
+	return len;
+}
+
+static hio_oow_t put_alog_chars (hio_bch_t* buf, hio_oow_t len, hio_oow_t max, const hio_bch_t* str, hio_oow_t slen)
+{
+	if (slen > max - len) slen = max - len;
+	HIO_MEMCPY (&buf[len], str, slen);
+	return len + slen;
+}
+
+static hio_oow_t put_alog_uint (hio_bch_t* buf, hio_oow_t len, hio_oow_t max, hio_uintmax_t v)
+{
+	if (max - len < 24) return len;
+	return len + hio_fmt_uintmax_to_bcstr(&buf[len], max - len, v, 10, -1, '\0', HIO_NULL);
+}
+
+/* write a record of the fixed layout below. it is the common log format
+ * followed by the microseconds taken from the request to the end of the task.
+ *
+ *  address - - [day/month/year:hour:minute:second +0000] "method path HTTP/x.y" status octets usecs
+ */
+void hio_svc_htts_writealog (hio_svc_htts_t* htts, hio_svc_htts_task_t* task)
+{
+	hio_svc_htts_alog_t* alog = htts->alog;
+	hio_bch_t rec[ALOG_REC_MAX];
+	hio_oow_t len, max, pos;
+	hio_ntime_t now, dur;
+	time_t sec;
+
+	sec = time(HIO_NULL);
+	if (sec != alog->tcache_sec)
+	{
+		struct tm bt;
+		gmtime_r (&sec, &bt);
+		alog->tcache_len = hio_fmttobcstr(HIO_NULL, alog->tcache, HIO_SIZEOF(alog->tcache),
+			"%02d/%hs/%04d:%02d:%02d:%02d +0000",
+			bt.tm_mday, alog_mon_name[bt.tm_mon], bt.tm_year + 1900, bt.tm_hour, bt.tm_min, bt.tm_sec);
+		alog->tcache_sec = sec;
+	}
+
+	hio_gettime (htts->hio, &now);
+	HIO_SUB_NTIME (&dur, &now, &task->task_req_since);
+	if (HIO_IS_NEG_NTIME(&dur)) HIO_CLEAR_NTIME (&dur);
+
+	/* leave room for the fields after the path however long it is */
+	max = HIO_SIZEOF(rec) - 128;
+
+	len = put_alog_text(rec, 0, max, task->task_req_cli_addr? task->task_req_cli_addr: "-");
+	len = put_alog_chars(rec, len, max, " - - [", 6);
+	len = put_alog_chars(rec, len, max, alog->tcache, alog->tcache_len);
+	len = put_alog_chars(rec, len, max, "] \"", 3);
+	len = put_alog_text(rec, len, max, task->task_req_qmth);
+	rec[len++] = ' ';
+	len = put_alog_text(rec, len, max, task->task_req_qpath);
+
+	max = HIO_SIZEOF(rec) - 1;
+	len = put_alog_chars(rec, len, max, " HTTP/", 6);
+	len = put_alog_uint(rec, len, max, task->task_req_version.major);
+	rec[len++] = '.';
+	len = put_alog_uint(rec, len, max, task->task_req_version.minor);
+	rec[len++] = '"';
+	rec[len++] = ' ';
+	len = put_alog_uint(rec, len, max, task->task_status_code);
+	rec[len++] = ' ';
+	len = put_alog_uint(rec, len, max, task->task_res_octets);
+	rec[len++] = ' ';
+	len = put_alog_uint(rec, len, max, (hio_uintmax_t)dur.sec * HIO_USECS_PER_SEC + HIO_NSEC_TO_USEC(dur.nsec));
+	rec[len++] = '\n';
+
+	pthread_mutex_lock (&alog->mtx);
+	if (alog->capa - alog->len < len)
+	{
+		alog->stat.dropped++;
+	}
+	else
+	{
+		hio_oow_t first;
+
+		pos = (alog->tail + alog->len) % alog->capa;
+		first = alog->capa - pos;
+		if (first >= len)
+		{
+			HIO_MEMCPY (&alog->ring[pos], rec, len);
+		}
+		else
+		{
+			HIO_MEMCPY (&alog->ring[pos], rec, first);
+			HIO_MEMCPY (alog->ring, &rec[first], len - first);
+		}
+
+		if (alog->len <= 0) pthread_cond_signal (&alog->cnd);
+		alog->len += len;
+		alog->stat.records++;
+	}
+	pthread_mutex_unlock (&alog->mtx);
+}
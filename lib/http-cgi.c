@@ -30,13 +30,9 @@
 #include <unistd.h> /* TODO: move file operations to sys-file.XXX */
 #include <fcntl.h>
 #include <sys/stat.h>
-#include <stdlib.h> /* setenv, clearenv */
+#include <stdlib.h> /* getenv */
 #include <errno.h>
 
-#if defined(HAVE_CRT_EXTERNS_H)
-#	include <crt_externs.h> /* _NSGetEnviron */
-#endif
-
 #define CGI_ALLOW_UNLIMITED_REQ_CONTENT_LENGTH
 
 
@@ -639,55 +635,66 @@ struct peer_fork_ctx_t
 };
 typedef struct peer_fork_ctx_t peer_fork_ctx_t;
 
+static int add_cgi_env (hio_becs_t* env, const hio_bch_t* name, const hio_bch_t* value)
+{
+	if (hio_becs_cat(env, name) == (hio_oow_t)-1 ||
+	    hio_becs_ccat(env, '=') == (hio_oow_t)-1 ||
+	    hio_becs_cat(env, value) == (hio_oow_t)-1 ||
+	    hio_becs_ccat(env, '\0') == (hio_oow_t)-1) return -1;
+	return 0;
+}
+
 static int peer_capture_request_header (hio_htre_t* req, const hio_bch_t* key, const hio_htre_hdrval_t* val, void* ctx)
 {
-	hio_becs_t* dbuf = (hio_becs_t*)ctx;
+	hio_becs_t* env = (hio_becs_t*)ctx;
 
 	if (hio_comp_bcstr(key, "Connection", 1) != 0 &&
 	    hio_comp_bcstr(key, "Transfer-Encoding", 1) != 0 &&
 	    hio_comp_bcstr(key, "Content-Length", 1) != 0 &&
 	    hio_comp_bcstr(key, "Expect", 1) != 0)
 	{
-		hio_oow_t val_offset;
+		hio_oow_t name_offset;
 		hio_bch_t* ptr;
 
-		hio_becs_clear (dbuf);
-		if (hio_becs_cpy(dbuf, "HTTP_") == (hio_oow_t)-1 ||
-		    hio_becs_cat(dbuf, key) == (hio_oow_t)-1 ||
-		    hio_becs_ccat(dbuf, '\0') == (hio_oow_t)-1) return -1;
+		name_offset = HIO_BECS_LEN(env);
+		if (hio_becs_cat(env, "HTTP_") == (hio_oow_t)-1 ||
+		    hio_becs_cat(env, key) == (hio_oow_t)-1) return -1;
 
-		for (ptr = HIO_BECS_PTR(dbuf); *ptr; ptr++)
+		for (ptr = HIO_BECS_CPTR(env, name_offset); *ptr; ptr++)
 		{
 			*ptr = hio_to_bch_upper(*ptr);
 			if (*ptr =='-') *ptr = '_';
 		}
 
-		val_offset = HIO_BECS_LEN(dbuf);
-		if (hio_becs_cat(dbuf, val->ptr) == (hio_oow_t)-1) return -1;
+		if (hio_becs_ccat(env, '=') == (hio_oow_t)-1 ||
+		    hio_becs_cat(env, val->ptr) == (hio_oow_t)-1) return -1;
 		val = val->next;
 		while (val)
 		{
-			if (hio_becs_cat(dbuf, ",") == (hio_oow_t)-1 ||
-			    hio_becs_cat(dbuf, val->ptr) == (hio_oow_t)-1) return -1;
+			if (hio_becs_cat(env, ",") == (hio_oow_t)-1 ||
+			    hio_becs_cat(env, val->ptr) == (hio_oow_t)-1) return -1;
 			val = val->next;
 		}
-
-		setenv (HIO_BECS_PTR(dbuf), HIO_BECS_CPTR(dbuf, val_offset), 1);
+		if (hio_becs_ccat(env, '\0') == (hio_oow_t)-1) return -1;
 	}
 
 	return 0;
 }
 
-static int cgi_peer_on_fork (hio_dev_pro_t* pro, void* fork_ctx)
+static hio_bch_t** make_cgi_env (hio_t* hio, peer_fork_ctx_t* fc)
 {
-	hio_t* hio = pro->hio; /* in this callback, the pro device is not fully up. however, the hio field is guaranteed to be available */
-	peer_fork_ctx_t* fc = (peer_fork_ctx_t*)fork_ctx;
+	/* build the environment of the cgi script in the parent process so that
+	 * the child doesn't have to allocate memory between fork() and exec() */
 	hio_oow_t content_length;
 	const hio_bch_t* qparam;
 	const hio_bch_t* tmpstr;
-	hio_bch_t* path, * lang;
 	hio_bch_t tmp[256];
-	hio_becs_t dbuf;
+	hio_becs_t env;
+	hio_bch_t** envp = HIO_NULL;
+	hio_bch_t* ptr, * end;
+	hio_oow_t count, i;
+
+	if (hio_becs_init(&env, hio, 1024) <= -1) return HIO_NULL;
 
 	qparam = hio_htre_getqparam(fc->req);
 	/* the anchor/fragment is never part of the server-side URL.
@@ -695,90 +702,78 @@ static int cgi_peer_on_fork (hio_dev_pro_t* pro, void* fork_ctx)
 	 * hio_htre_getqanchor() is just disregarded here. */
 
 	tmpstr = getenv("PATH");
-	if (!tmpstr) tmpstr = "";
-	path = hio_dupbcstr(hio, tmpstr, HIO_NULL);
+	if (add_cgi_env(&env, "PATH", (tmpstr? tmpstr: "")) <= -1) goto oops;
 
 	tmpstr = getenv("LANG");
-	if (!tmpstr) tmpstr = "";
-	lang = hio_dupbcstr(hio, tmpstr, HIO_NULL);
-
-#if defined(HAVE_CLEARENV)
-	clearenv ();
-#elif defined(HAVE_CRT_EXTERNS_H)
-	{
-		char** environ = *_NSGetEnviron();
-		if (environ) environ[0] = '\0';
-	}
-
-#else
-	{
-		extern char** environ;
-		/* environ = NULL; this crashed this program on NetBSD */
-		if (environ) environ[0] = '\0';
-	}
-#endif
-	if (path)
-	{
-		setenv ("PATH", path, 1);
-		hio_freemem (hio, path);
-	}
-
-	if (lang)
-	{
-		setenv ("LANG", lang, 1);
-		hio_freemem (hio, lang);
-	}
+	if (add_cgi_env(&env, "LANG", (tmpstr? tmpstr: "")) <= -1) goto oops;
 
-	setenv ("GATEWAY_INTERFACE", "CGI/1.1", 1);
+	if (add_cgi_env(&env, "GATEWAY_INTERFACE", "CGI/1.1") <= -1) goto oops;
 
 	hio_fmttobcstr (hio, tmp, HIO_COUNTOF(tmp), "HTTP/%d.%d", (int)hio_htre_getmajorversion(fc->req), (int)hio_htre_getminorversion(fc->req));
-	setenv ("SERVER_PROTOCOL", tmp, 1);
+	if (add_cgi_env(&env, "SERVER_PROTOCOL", tmp) <= -1) goto oops;
 
-	setenv ("DOCUMENT_ROOT", fc->docroot, 1);
-	setenv ("SCRIPT_NAME", fc->script, 1);
-	setenv ("SCRIPT_FILENAME", fc->actual_script, 1);
+	if (add_cgi_env(&env, "DOCUMENT_ROOT", fc->docroot) <= -1 ||
+	    add_cgi_env(&env, "SCRIPT_NAME", fc->script) <= -1 ||
+	    add_cgi_env(&env, "SCRIPT_FILENAME", fc->actual_script) <= -1) goto oops;
 	/* TODO: PATH_INFO */
 
-	setenv ("REQUEST_METHOD", hio_htre_getqmethodname(fc->req), 1);
-	setenv ("REQUEST_URI", hio_htre_getqpath(fc->req), 1);
+	if (add_cgi_env(&env, "REQUEST_METHOD", hio_htre_getqmethodname(fc->req)) <= -1 ||
+	    add_cgi_env(&env, "REQUEST_URI", hio_htre_getqpath(fc->req)) <= -1) goto oops;
 
-	if (qparam) setenv ("QUERY_STRING", qparam, 1);
+	if (qparam && add_cgi_env(&env, "QUERY_STRING", qparam) <= -1) goto oops;
 
 	if (hio_htre_getreqcontentlen(fc->req, &content_length) == 0)
 	{
 		hio_fmt_uintmax_to_bcstr(tmp, HIO_COUNTOF(tmp), content_length, 10, 0, '\0', HIO_NULL);
-		setenv ("CONTENT_LENGTH", tmp, 1);
+		if (add_cgi_env(&env, "CONTENT_LENGTH", tmp) <= -1) goto oops;
 	}
 	else
 	{
 		/* content length unknown, neither is it 0 - this is not standard */
-		setenv ("CONTENT_LENGTH", "-1", 1);
+		if (add_cgi_env(&env, "CONTENT_LENGTH", "-1") <= -1) goto oops;
 	}
-	setenv ("SERVER_SOFTWARE", fc->cli->htts->server_name, 1);
+	if (add_cgi_env(&env, "SERVER_SOFTWARE", fc->cli->htts->server_name) <= -1) goto oops;
 
 	hio_skadtobcstr (hio, &fc->cli->sck->localaddr, tmp, HIO_COUNTOF(tmp), HIO_SKAD_TO_BCSTR_ADDR);
-	setenv ("SERVER_ADDR", tmp, 1);
+	if (add_cgi_env(&env, "SERVER_ADDR", tmp) <= -1) goto oops;
 
 	gethostname (tmp, HIO_COUNTOF(tmp)); /* if this fails, i assume tmp contains the ip address set by hio_skadtobcstr() above */
-	setenv ("SERVER_NAME", tmp, 1);
+	if (add_cgi_env(&env, "SERVER_NAME", tmp) <= -1) goto oops;
 
 	hio_skadtobcstr (hio, &fc->cli->sck->localaddr, tmp, HIO_COUNTOF(tmp), HIO_SKAD_TO_BCSTR_PORT);
-	setenv ("SERVER_PORT", tmp, 1);
+	if (add_cgi_env(&env, "SERVER_PORT", tmp) <= -1) goto oops;
 
 	hio_skadtobcstr (hio, &fc->cli->sck->remoteaddr, tmp, HIO_COUNTOF(tmp), HIO_SKAD_TO_BCSTR_ADDR);
-	setenv ("REMOTE_ADDR", tmp, 1);
+	if (add_cgi_env(&env, "REMOTE_ADDR", tmp) <= -1) goto oops;
 
 	hio_skadtobcstr (hio, &fc->cli->sck->remoteaddr, tmp, HIO_COUNTOF(tmp), HIO_SKAD_TO_BCSTR_PORT);
-	setenv ("REMOTE_PORT", tmp, 1);
+	if (add_cgi_env(&env, "REMOTE_PORT", tmp) <= -1) goto oops;
+
+	if (hio_htre_walkheaders(fc->req, peer_capture_request_header, &env) <= -1) goto oops;
+	/* [NOTE] trailers are not available when this cgi resource is started. let's not call hio_htre_walktrailers() */
 
-	if (hio_becs_init(&dbuf, hio, 256) >= 0)
+	/* the pointer array and the strings are held in a single block */
+	end = HIO_BECS_PTR(&env) + HIO_BECS_LEN(&env);
+	for (count = 0, ptr = HIO_BECS_PTR(&env); ptr < end; ptr++)
 	{
-		hio_htre_walkheaders (fc->req,  peer_capture_request_header, &dbuf);
-		/* [NOTE] trailers are not available when this cgi resource is started. let's not call hio_htre_walktrailers() */
-		hio_becs_fini (&dbuf);
+		if (*ptr == '\0') count++;
 	}
 
-	return 0;
+	envp = hio_allocmem(hio, (count + 1) * HIO_SIZEOF(*envp) + HIO_BECS_LEN(&env));
+	if (HIO_UNLIKELY(!envp)) goto oops;
+
+	ptr = (hio_bch_t*)(envp + count + 1);
+	HIO_MEMCPY (ptr, HIO_BECS_PTR(&env), HIO_BECS_LEN(&env));
+	for (i = 0; i < count; i++)
+	{
+		envp[i] = ptr;
+		ptr += hio_count_bcstr(ptr) + 1;
+	}
+	envp[i] = HIO_NULL;
+
+oops:
+	hio_becs_fini (&env);
+	return envp;
 }
 
 /* ----------------------------------------------------------------------- */
@@ -889,8 +884,6 @@ static int bind_task_to_peer (cgi_t* cgi, hio_dev_sck_t* csck, hio_htre_t* req,
 	mi.on_read = cgi_peer_on_read;
 	mi.on_write = cgi_peer_on_write;
 	mi.on_close = cgi_peer_on_close;
-	mi.on_fork = cgi_peer_on_fork;
-	mi.fork_ctx = &fc;
 
 	if (access(mi.cmd, X_OK) == -1)
 	{
@@ -900,7 +893,27 @@ static int bind_task_to_peer (cgi_t* cgi, hio_dev_sck_t* csck, hio_htre_t* req,
 		return -2;
 	}
 
+	if ((cgi->options & HIO_SVC_HTTS_CGI_PREFORK) && htts->option.task_cgi_prefork > 0)
+	{
+		if (!htts->cgi_pool)
+		{
+			/* the script still runs on a new process without the pool */
+			htts->cgi_pool = hio_dev_pro_openpool(hio, htts->option.task_cgi_prefork_helper, mi.flags, htts->option.task_cgi_prefork);
+			if (HIO_UNLIKELY(!htts->cgi_pool))
+				HIO_DEBUG2 (hio, "HTTS(%p) - unable to open cgi process pool - %js\n", htts, hio_geterrmsg(hio));
+		}
+		mi.pool = htts->cgi_pool;
+	}
+
+	mi.env = make_cgi_env(hio, &fc);
+	if (HIO_UNLIKELY(!mi.env))
+	{
+		hio_freemem (hio, fc.actual_script);
+		return -1;
+	}
+
 	cgi->peer = hio_dev_pro_make(hio, HIO_SIZEOF(*peer_xtn), &mi);
+	hio_freemem (hio, mi.env);
 	if (HIO_UNLIKELY(!cgi->peer))
 	{
 		hio_freemem (hio, fc.actual_script);
@@ -1017,6 +1030,7 @@ int hio_svc_htts_docgi (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* r
 
 	cgi = (cgi_t*)hio_svc_htts_task_make(htts, HIO_SIZEOF(*cgi), cgi_on_kill, req, csck);
 	if (HIO_UNLIKELY(!cgi)) goto oops;
+	HIO_SVC_HTTS_STAT_INC (htts, task_cgi);
 	HIO_SVC_HTTS_TASK_RCUP((hio_svc_htts_task_t*)cgi);
 	if (inc_ntask_cgis(htts) <= -1)
 	{
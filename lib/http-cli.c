@@ -0,0 +1,901 @@
+/*
+    Copyright (c) 2016-2020 Chung, Hyung-Hwan. All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+    IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+    NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+    THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "http-prv.h"
+#include <hio-fmt.h>
+#include <hio-chr.h>
+
+#define HTTC_DEFAULT_CONN_MAX 4
+#define HTTC_DEFAULT_PIPELINE_MAX 4
+
+enum httc_req_state_t
+{
+	HTTC_REQ_WAITING,  /* in the wait queue of the origin */
+	HTTC_REQ_ASSIGNED, /* in the request queue of a connection */
+	HTTC_REQ_DETACHED  /* being finished */
+};
+
+struct hio_svc_httc_req_t
+{
+	hio_svc_httc_t* httc;
+	hio_svc_httc_origin_t* origin;
+	struct httc_conn_t* conn; /* valid in the HTTC_REQ_ASSIGNED state only */
+	hio_svc_httc_req_t* q_prev;
+	hio_svc_httc_req_t* q_next;
+
+	hio_svc_httc_cbs_t cbs;
+	void* ctx;
+	hio_http_method_t method;
+
+	unsigned int state: 2;
+	unsigned int cancelled: 1;
+	unsigned int retried: 1;
+	unsigned int retryable: 1; /* safe to send again even if the server has got it */
+	unsigned int sent: 1;
+	unsigned int res_started: 1; /* any response octets received */
+
+	hio_oow_t len;
+	hio_bch_t* data; /* request line, header and body. points to the memory after the structure */
+};
+
+struct httc_reqq_t
+{
+	hio_svc_httc_req_t* head;
+	hio_svc_httc_req_t* tail;
+	hio_oow_t count;
+};
+typedef struct httc_reqq_t httc_reqq_t;
+
+/* the extension area of a connection socket */
+struct httc_conn_t
+{
+	hio_svc_httc_t* httc;
+	hio_svc_httc_origin_t* origin;
+	hio_dev_sck_t* sck;
+	hio_htrd_t* htrd;
+	struct httc_conn_t* prev; /* in the connections of the origin */
+	struct httc_conn_t* next;
+
+	httc_reqq_t reqq; /* requests sent or to send in the order of the responses */
+	hio_oow_t nres; /* number of responses received completely */
+
+	hio_tmridx_t tmridx; /* read timeout while busy, idle timeout while idle */
+	hio_ntime_t last_read;
+
+	unsigned int linked: 1; /* linked to the origin */
+	unsigned int connected: 1;
+	unsigned int broken: 1; /* no more requests can be sent */
+	unsigned int interim: 1; /* an interim response is being read */
+	unsigned int res_hdr: 1; /* the final response header has been read */
+	unsigned int res_until_close: 1; /* the response body ends when the connection is closed */
+};
+typedef struct httc_conn_t httc_conn_t;
+
+struct httc_htrd_xtn_t
+{
+	httc_conn_t* conn;
+};
+typedef struct httc_htrd_xtn_t httc_htrd_xtn_t;
+
+/* a server identified by the address and the use of ssl */
+struct hio_svc_httc_origin_t
+{
+	hio_svc_httc_origin_t* next; /* next origin in the same hash bucket */
+	hio_skad_t addr;
+	int ssl;
+	httc_conn_t* conn;
+	hio_oow_t nconns;
+	httc_reqq_t waitq; /* requests waiting for a connection */
+};
+
+static int dispatch_req (hio_svc_httc_t* httc, hio_svc_httc_req_t* req);
+static void drain_waitq (hio_svc_httc_t* httc, hio_svc_httc_origin_t* origin);
+
+/* ----------------------------------------------------------------------- */
+
+static void enq_req (httc_reqq_t* q, hio_svc_httc_req_t* req)
+{
+	req->q_prev = q->tail;
+	req->q_next = HIO_NULL;
+	if (q->tail) q->tail->q_next = req;
+	else q->head = req;
+	q->tail = req;
+	q->count++;
+}
+
+static void unlink_req (httc_reqq_t* q, hio_svc_httc_req_t* req)
+{
+	if (req->q_prev) req->q_prev->q_next = req->q_next;
+	else q->head = req->q_next;
+	if (req->q_next) req->q_next->q_prev = req->q_prev;
+	else q->tail = req->q_prev;
+	req->q_prev = HIO_NULL;
+	req->q_next = HIO_NULL;
+	q->count--;
+}
+
+static void finish_req (hio_svc_httc_req_t* req, hio_errnum_t status)
+{
+	hio_t* hio = req->httc->hio;
+
+	HIO_ASSERT (hio, req->state == HTTC_REQ_DETACHED);
+	if (!req->cancelled && req->cbs.on_done) req->cbs.on_done (req, status, req->ctx);
+	hio_freemem (hio, req);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static hio_oow_t hash_origin (const hio_skad_t* addr, int ssl)
+{
+	hio_oow_t hv;
+	hio_uint8_t ipad[16];
+	hio_oow_t iplen;
+	int tmp;
+
+	tmp = hio_skad_get_family(addr);
+	HIO_HASH_BYTES (hv, &tmp, HIO_SIZEOF(tmp));
+	tmp = hio_skad_get_port(addr);
+	HIO_HASH_MORE_BYTES (hv, &tmp, HIO_SIZEOF(tmp));
+	iplen = hio_skad_get_ipad_bytes(addr, ipad, HIO_SIZEOF(ipad));
+	HIO_HASH_MORE_BYTES (hv, ipad, iplen);
+	HIO_HASH_MORE_BYTES (hv, &ssl, HIO_SIZEOF(ssl));
+
+	return hv;
+}
+
+static hio_svc_httc_origin_t* get_origin (hio_svc_httc_t* httc, const hio_skad_t* addr, int ssl)
+{
+	hio_svc_httc_origin_t* origin;
+	hio_oow_t b;
+
+	b = hash_origin(addr, ssl) & (HIO_SVC_HTTC_ORIGIN_BKT_SIZE - 1);
+	for (origin = httc->bkt[b]; origin; origin = origin->next)
+	{
+		if (origin->ssl == ssl && hio_equal_skads(&origin->addr, addr, 1)) return origin;
+	}
+
+	origin = (hio_svc_httc_origin_t*)hio_callocmem(httc->hio, HIO_SIZEOF(*origin));
+	if (HIO_UNLIKELY(!origin)) return HIO_NULL;
+
+	origin->addr = *addr;
+	origin->ssl = ssl;
+	origin->next = httc->bkt[b];
+	httc->bkt[b] = origin;
+	return origin;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void set_conn_timer (httc_conn_t* conn, const hio_ntime_t* tmout, hio_tmrjob_handler_t handler)
+{
+	hio_t* hio = conn->httc->hio;
+
+	if (conn->tmridx != HIO_TMRIDX_INVALID)
+	{
+		hio_deltmrjob (hio, conn->tmridx);
+		HIO_ASSERT (hio, conn->tmridx == HIO_TMRIDX_INVALID);
+	}
+
+	if (HIO_IS_POS_NTIME(tmout) && hio_schedtmrjobafter(hio, tmout, handler, &conn->tmridx, conn) <= -1)
+	{
+		HIO_DEBUG2 (hio, "HTTC(%p) - unable to schedule timer for connection %p. continuing\n", conn->httc, conn->sck);
+	}
+}
+
+static int is_idempotent (hio_http_method_t method)
+{
+	switch (method)
+	{
+		case HIO_HTTP_HEAD:
+		case HIO_HTTP_GET:
+		case HIO_HTTP_PUT:
+		case HIO_HTTP_DELETE:
+		case HIO_HTTP_OPTIONS:
+		case HIO_HTTP_TRACE:
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+static void fail_conn (httc_conn_t* conn, hio_errnum_t errnum, int halt)
+{
+	hio_svc_httc_t* httc = conn->httc;
+	httc_reqq_t q;
+	hio_svc_httc_req_t* req;
+	int first = 1;
+
+	conn->broken = 1;
+	if (halt) hio_dev_sck_halt (conn->sck);
+
+	/* take over the requests. they can be cancelled in the callbacks invoked below */
+	q = conn->reqq;
+	HIO_MEMSET (&conn->reqq, 0, HIO_SIZEOF(conn->reqq));
+	for (req = q.head; req; req = req->q_next)
+	{
+		req->state = HTTC_REQ_DETACHED;
+		req->conn = HIO_NULL;
+	}
+
+	while ((req = q.head))
+	{
+		unlink_req (&q, req);
+
+		/* send a request again on another connection if it has got nothing
+		 * and the connection has worked for another request or it's not the
+		 * first one sent. a request that has failed on a fresh connection
+		 * won't get any better by retrying. neither will the one that has
+		 * timed out waiting for its response. a request that the server may
+		 * have processed is sent again only if doing so is harmless */
+		if (!httc->stopping && !req->cancelled && !req->retried && !req->res_started && (req->retryable || !req->sent) &&
+		    conn->connected && (conn->nres > 0 || !first) && !(first && errnum == HIO_ETMOUT))
+		{
+			HIO_DEBUG2 (httc->hio, "HTTC(%p) - retrying request %p on another connection\n", httc, req);
+			req->retried = 1;
+			if (dispatch_req(httc, req) >= 0) { first = 0; continue; }
+			req->state = HTTC_REQ_DETACHED;
+		}
+
+		first = 0;
+		finish_req (req, errnum);
+	}
+}
+
+static void on_read_timeout (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	httc_conn_t* conn = (httc_conn_t*)job->ctx;
+	hio_ntime_t t;
+
+	HIO_ADD_NTIME (&t, &conn->last_read, &conn->httc->tmout.r);
+	if (HIO_CMP_NTIME(now, &t) < 0 && hio_schedtmrjobat(hio, &t, on_read_timeout, &conn->tmridx, conn) >= 0) return;
+
+	HIO_DEBUG2 (hio, "HTTC(%p) - response timed out on connection %p\n", conn->httc, conn->sck);
+	fail_conn (conn, HIO_ETMOUT, 1);
+}
+
+static void on_idle_timeout (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	httc_conn_t* conn = (httc_conn_t*)job->ctx;
+
+	HIO_ASSERT (hio, conn->reqq.count == 0);
+	HIO_DEBUG2 (hio, "HTTC(%p) - closing idle connection %p\n", conn->httc, conn->sck);
+	conn->broken = 1;
+	hio_dev_sck_halt (conn->sck);
+}
+
+static int send_req (httc_conn_t* conn, hio_svc_httc_req_t* req)
+{
+	if (conn->reqq.head == req)
+	{
+		/* the connection was idle. start waiting for the response */
+		hio_gettime (conn->httc->hio, &conn->last_read);
+		set_conn_timer (conn, &conn->httc->tmout.r, on_read_timeout);
+	}
+
+	if (hio_dev_sck_write(conn->sck, req->data, req->len, HIO_NULL, HIO_NULL) <= -1) return -1;
+	req->sent = 1;
+	return 0;
+}
+
+static int assign_req (httc_conn_t* conn, hio_svc_httc_req_t* req)
+{
+	enq_req (&conn->reqq, req);
+	req->state = HTTC_REQ_ASSIGNED;
+	req->conn = conn;
+
+	/* a request assigned before the connection is established is sent in on_connect() */
+	if (conn->connected && send_req(conn, req) <= -1)
+	{
+		unlink_req (&conn->reqq, req);
+		req->state = HTTC_REQ_DETACHED;
+		req->conn = HIO_NULL;
+
+		/* the requests already sent fail when the connection is closed */
+		conn->broken = 1;
+		hio_dev_sck_halt (conn->sck);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int conn_htrd_peek (hio_htrd_t* htrd, hio_htre_t* res)
+{
+	httc_conn_t* conn = ((httc_htrd_xtn_t*)hio_htrd_getxtn(htrd))->conn;
+	hio_svc_httc_req_t* req = conn->reqq.head;
+	int status_code, no_body;
+
+	HIO_ASSERT (conn->httc->hio, req != HIO_NULL);
+
+	status_code = hio_htre_getscodeval(res);
+	if (status_code >= 100 && status_code <= 199)
+	{
+		/* an interim response. skip it and wait for the final response */
+		conn->interim = 1;
+		no_body = 1;
+	}
+	else
+	{
+		/* no content follows the header of these responses regardless of the header fields */
+		no_body = req->method == HIO_HTTP_HEAD ||
+		          status_code == HIO_HTTP_STATUS_NO_CONTENT ||
+		          status_code == HIO_HTTP_STATUS_NOT_MODIFIED;
+
+		conn->res_hdr = 1;
+		conn->res_until_close = !no_body && !(res->flags & (HIO_HTRE_ATTR_LENGTH | HIO_HTRE_ATTR_CHUNKED));
+
+		/* the connection can be reused only if the end of the response is known without closing it.
+		 * the requests pipelined behind are sent again on another connection after it's closed */
+		if (!(res->flags & HIO_HTRE_ATTR_KEEPALIVE) || conn->res_until_close) conn->broken = 1;
+
+		if (!req->cancelled && req->cbs.on_header && req->cbs.on_header(req, res, req->ctx) <= -1) return -1;
+	}
+
+	if (no_body)
+	{
+		/* let the reader complete the response without content */
+		res->flags &= ~HIO_HTRE_ATTR_CHUNKED;
+		res->flags |= HIO_HTRE_ATTR_LENGTH;
+		res->attr.content_length = 0;
+	}
+
+	return 0;
+}
+
+static int conn_htrd_poke (hio_htrd_t* htrd, hio_htre_t* res)
+{
+	httc_conn_t* conn = ((httc_htrd_xtn_t*)hio_htrd_getxtn(htrd))->conn;
+	hio_svc_httc_t* httc = conn->httc;
+	hio_svc_httc_req_t* req = conn->reqq.head;
+
+	if (conn->interim)
+	{
+		conn->interim = 0;
+		return 0;
+	}
+
+	unlink_req (&conn->reqq, req);
+	req->state = HTTC_REQ_DETACHED;
+	req->conn = HIO_NULL;
+	conn->nres++;
+	conn->res_hdr = 0;
+	conn->res_until_close = 0;
+
+	if (conn->reqq.count > 0)
+	{
+		/* the wait for the next response begins */
+		hio_gettime (httc->hio, &conn->last_read);
+	}
+	else if (conn->broken)
+	{
+		hio_dev_sck_halt (conn->sck);
+	}
+	else
+	{
+		set_conn_timer (conn, &httc->tmout.i, on_idle_timeout);
+	}
+
+	finish_req (req, HIO_ENOERR);
+
+	if (!httc->stopping) drain_waitq (httc, conn->origin);
+	return 0;
+}
+
+static int conn_htrd_push_content (hio_htrd_t* htrd, hio_htre_t* res, const hio_bch_t* data, hio_oow_t dlen)
+{
+	httc_conn_t* conn = ((httc_htrd_xtn_t*)hio_htrd_getxtn(htrd))->conn;
+	hio_svc_httc_req_t* req = conn->reqq.head;
+
+	if (!req->cancelled && req->cbs.on_body) return req->cbs.on_body(req, data, dlen, req->ctx);
+	return 0;
+}
+
+static hio_htrd_recbs_t conn_htrd_recbs =
+{
+	conn_htrd_peek,
+	conn_htrd_poke,
+	conn_htrd_push_content
+};
+
+/* ----------------------------------------------------------------------- */
+
+static void conn_on_connect (hio_dev_sck_t* sck)
+{
+	httc_conn_t* conn = hio_dev_sck_getxtn(sck);
+	hio_svc_httc_t* httc = conn->httc;
+	hio_svc_httc_req_t* req;
+
+	HIO_DEBUG2 (httc->hio, "HTTC(%p) - connected %p\n", httc, sck);
+	conn->connected = 1;
+
+	for (req = conn->reqq.head; req; req = req->q_next)
+	{
+		if (send_req(conn, req) <= -1)
+		{
+			fail_conn (conn, HIO_ECONLOST, 1);
+			return;
+		}
+	}
+
+	if (conn->reqq.count <= 0) set_conn_timer (conn, &httc->tmout.i, on_idle_timeout);
+	drain_waitq (httc, conn->origin);
+}
+
+static void conn_on_disconnect (hio_dev_sck_t* sck)
+{
+	httc_conn_t* conn = hio_dev_sck_getxtn(sck);
+	hio_svc_httc_t* httc = conn->httc;
+	hio_svc_httc_origin_t* origin = conn->origin;
+	int linked = conn->linked;
+
+	HIO_DEBUG2 (httc->hio, "HTTC(%p) - disconnected %p\n", httc, sck);
+
+	if (linked)
+	{
+		if (conn->prev) conn->prev->next = conn->next;
+		else origin->conn = conn->next;
+		if (conn->next) conn->next->prev = conn->prev;
+		origin->nconns--;
+		conn->linked = 0;
+	}
+
+	if (conn->tmridx != HIO_TMRIDX_INVALID)
+	{
+		hio_deltmrjob (httc->hio, conn->tmridx);
+		HIO_ASSERT (httc->hio, conn->tmridx == HIO_TMRIDX_INVALID);
+	}
+
+	if (conn->htrd)
+	{
+		hio_htrd_close (conn->htrd);
+		conn->htrd = HIO_NULL;
+	}
+
+	fail_conn (conn, (httc->stopping? HIO_EINTR: conn->connected? HIO_ECONLOST: HIO_ECONRF), 0);
+
+	/* the requests waiting for the connection slot can make a new connection */
+	if (linked && !httc->stopping) drain_waitq (httc, origin);
+}
+
+static int conn_on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t dlen, const hio_skad_t* srcaddr)
+{
+	httc_conn_t* conn = hio_dev_sck_getxtn(sck);
+	hio_t* hio = sck->hio;
+	hio_oow_t rem;
+
+	if (dlen <= -1)
+	{
+		HIO_DEBUG2 (hio, "HTTC(%p) - read error on connection %p\n", conn->httc, sck);
+		fail_conn (conn, HIO_ECONRS, 1);
+		return 0;
+	}
+
+	if (dlen == 0)
+	{
+		HIO_DEBUG2 (hio, "HTTC(%p) - EOF on connection %p\n", conn->httc, sck);
+		conn->broken = 1;
+
+		/* the response without the length ends here */
+		if (conn->res_hdr && conn->res_until_close && hio_htrd_halt(conn->htrd) <= -1)
+		{
+			fail_conn (conn, HIO_EBADRE, 1);
+			return 0;
+		}
+
+		fail_conn (conn, HIO_ECONLOST, 1);
+		return 0;
+	}
+
+	hio_gettime (hio, &conn->last_read);
+
+	while (1)
+	{
+		if (!conn->reqq.head)
+		{
+			/* more than the responses to the requests sent */
+			HIO_DEBUG2 (hio, "HTTC(%p) - unexpected data on connection %p\n", conn->httc, sck);
+			fail_conn (conn, HIO_EBADRE, 1);
+			break;
+		}
+
+		conn->reqq.head->res_started = 1;
+		if (hio_htrd_feed(conn->htrd, data, dlen, &rem) <= -1)
+		{
+			HIO_DEBUG2 (hio, "HTTC(%p) - bad response on connection %p\n", conn->httc, sck);
+			fail_conn (conn, HIO_EBADRE, 1);
+			break;
+		}
+
+		if (rem <= 0) break;
+
+		/* the remaining data belongs to the response to the next request */
+		data = (const hio_uint8_t*)data + (dlen - rem);
+		dlen = rem;
+	}
+
+	return 0;
+}
+
+static int conn_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrctx, const hio_skad_t* dstaddr)
+{
+	httc_conn_t* conn = hio_dev_sck_getxtn(sck);
+
+	if (wrlen <= -1)
+	{
+		HIO_DEBUG2 (sck->hio, "HTTC(%p) - write error on connection %p\n", conn->httc, sck);
+		fail_conn (conn, HIO_ECONRS, 1);
+	}
+
+	return 0;
+}
+
+static httc_conn_t* make_conn (hio_svc_httc_t* httc, hio_svc_httc_origin_t* origin)
+{
+	hio_t* hio = httc->hio;
+	hio_dev_sck_make_t m;
+	hio_dev_sck_connect_t c;
+	hio_dev_sck_t* sck;
+	httc_conn_t* conn;
+
+	HIO_MEMSET (&m, 0, HIO_SIZEOF(m));
+	if (hio_get_stream_sck_type_from_skad(&origin->addr, &m.type) <= -1)
+	{
+		hio_seterrnum (hio, HIO_EINVAL);
+		return HIO_NULL;
+	}
+
+	m.on_write = conn_on_write;
+	m.on_read = conn_on_read;
+	m.on_connect = conn_on_connect;
+	m.on_disconnect = conn_on_disconnect;
+
+	sck = hio_dev_sck_make(hio, HIO_SIZEOF(*conn), &m);
+	if (HIO_UNLIKELY(!sck)) return HIO_NULL;
+
+	conn = hio_dev_sck_getxtn(sck);
+	HIO_MEMSET (conn, 0, HIO_SIZEOF(*conn));
+	conn->httc = httc;
+	conn->origin = origin;
+	conn->sck = sck;
+	conn->tmridx = HIO_TMRIDX_INVALID;
+
+	conn->htrd = hio_htrd_open(hio, HIO_SIZEOF(httc_htrd_xtn_t));
+	if (HIO_UNLIKELY(!conn->htrd)) goto oops;
+	hio_htrd_setoption (conn->htrd, HIO_HTRD_RESPONSE);
+	hio_htrd_setrecbs (conn->htrd, &conn_htrd_recbs);
+	((httc_htrd_xtn_t*)hio_htrd_getxtn(conn->htrd))->conn = conn;
+
+	HIO_MEMSET (&c, 0, HIO_SIZEOF(c));
+	c.remoteaddr = origin->addr;
+	if (origin->ssl) c.options |= HIO_DEV_SCK_CONNECT_SSL;
+	c.connect_tmout = httc->tmout.c;
+	if (!HIO_IS_POS_NTIME(&c.connect_tmout)) HIO_INIT_NTIME (&c.connect_tmout, -1, 0);
+	if (hio_dev_sck_connect(sck, &c) <= -1) goto oops;
+
+	conn->linked = 1;
+	conn->prev = HIO_NULL;
+	conn->next = origin->conn;
+	if (origin->conn) origin->conn->prev = conn;
+	origin->conn = conn;
+	origin->nconns++;
+
+	HIO_DEBUG3 (hio, "HTTC(%p) - connecting %p - %zu connections to the origin\n", httc, sck, origin->nconns);
+	return conn;
+
+oops:
+	hio_dev_sck_kill (sck);
+	return HIO_NULL;
+}
+
+/* find a connection to send a request on. an idle connection comes first.
+ * a new connection comes next. a connected one with the fewest requests
+ * in progress comes last. it returns 0 if none is available */
+static int get_conn (hio_svc_httc_t* httc, hio_svc_httc_origin_t* origin, httc_conn_t** conn_out)
+{
+	httc_conn_t* conn, * best = HIO_NULL;
+
+	for (conn = origin->conn; conn; conn = conn->next)
+	{
+		if (conn->broken) continue;
+		if (conn->reqq.count <= 0)
+		{
+			*conn_out = conn;
+			return 1;
+		}
+		if (conn->connected && conn->reqq.count < httc->option.pipeline_max &&
+		    (!best || conn->reqq.count < best->reqq.count)) best = conn;
+	}
+
+	if (httc->option.conn_max <= 0 || origin->nconns < httc->option.conn_max)
+	{
+		conn = make_conn(httc, origin);
+		if (HIO_UNLIKELY(!conn)) return -1;
+		*conn_out = conn;
+		return 1;
+	}
+
+	*conn_out = best;
+	return best? 1: 0;
+}
+
+static int dispatch_req (hio_svc_httc_t* httc, hio_svc_httc_req_t* req)
+{
+	httc_conn_t* conn;
+	int n;
+
+	n = get_conn(httc, req->origin, &conn);
+	if (n <= -1) return -1;
+
+	if (n == 0)
+	{
+		enq_req (&req->origin->waitq, req);
+		req->state = HTTC_REQ_WAITING;
+		return 0;
+	}
+
+	return assign_req(conn, req);
+}
+
+static void drain_waitq (hio_svc_httc_t* httc, hio_svc_httc_origin_t* origin)
+{
+	while (origin->waitq.head)
+	{
+		hio_svc_httc_req_t* req;
+		httc_conn_t* conn;
+		int n;
+
+		n = get_conn(httc, origin, &conn);
+		if (n == 0) break;
+
+		req = origin->waitq.head;
+		unlink_req (&origin->waitq, req);
+		req->state = HTTC_REQ_DETACHED;
+
+		if (n <= -1 || assign_req(conn, req) <= -1)
+		{
+			/* keep the rest waiting for a connection in use to become available.
+			 * fail them if there is no connection to the origin left */
+			finish_req (req, hio_geterrnum(httc->hio));
+			if (n <= -1 && origin->nconns > 0) break;
+		}
+	}
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int build_req (hio_svc_httc_t* httc, const hio_svc_httc_reqinfo_t* ri)
+{
+	hio_becs_t* buf = httc->becbuf;
+	const hio_bch_t* mth;
+
+	mth = hio_http_method_to_bcstr(ri->method);
+	if (!mth || ri->method == HIO_HTTP_OTHER || !ri->path || ri->path[0] == '\0')
+	{
+		hio_seterrbfmt (httc->hio, HIO_EINVAL, "invalid request method or path");
+		return -1;
+	}
+
+	hio_becs_clear (buf);
+	if (hio_becs_fcat(buf, "%hs %hs HTTP/1.1\r\nHost: ", mth, ri->path) == (hio_oow_t)-1) return -1;
+
+	if (ri->host)
+	{
+		if (hio_becs_cat(buf, ri->host) == (hio_oow_t)-1) return -1;
+	}
+	else
+	{
+		hio_bch_t tmp[HIO_SKAD_IP_STRLEN + 1];
+		hio_skadtobcstr (httc->hio, &ri->addr, tmp, HIO_COUNTOF(tmp), HIO_SKAD_TO_BCSTR_ADDR | HIO_SKAD_TO_BCSTR_PORT);
+		if (hio_becs_cat(buf, tmp) == (hio_oow_t)-1) return -1;
+	}
+
+	if (hio_becs_cat(buf, "\r\n") == (hio_oow_t)-1) return -1;
+
+	if ((ri->content_len > 0 || ri->method == HIO_HTTP_POST || ri->method == HIO_HTTP_PUT) &&
+	    hio_becs_fcat(buf, "Content-Length: %zu\r\n", ri->content_len) == (hio_oow_t)-1) return -1;
+
+	if ((ri->headers && hio_becs_cat(buf, ri->headers) == (hio_oow_t)-1) ||
+	    hio_becs_cat(buf, "\r\n") == (hio_oow_t)-1) return -1;
+
+	if (ri->content_len > 0 && hio_becs_ncat(buf, (const hio_bch_t*)ri->content, ri->content_len) == (hio_oow_t)-1) return -1;
+
+	return 0;
+}
+
+hio_svc_httc_req_t* hio_svc_httc_sendreq (hio_svc_httc_t* httc, const hio_svc_httc_reqinfo_t* ri, const hio_svc_httc_cbs_t* cbs, void* ctx)
+{
+	hio_t* hio = httc->hio;
+	hio_svc_httc_origin_t* origin;
+	hio_svc_httc_req_t* req;
+
+	if (httc->stopping)
+	{
+		hio_seterrbfmt (hio, HIO_EPERM, "service being stopped");
+		return HIO_NULL;
+	}
+
+	if (build_req(httc, ri) <= -1) return HIO_NULL;
+
+	origin = get_origin(httc, &ri->addr, !!(ri->options & HIO_SVC_HTTC_REQ_SSL));
+	if (HIO_UNLIKELY(!origin)) return HIO_NULL;
+
+	req = (hio_svc_httc_req_t*)hio_callocmem(hio, HIO_SIZEOF(*req) + HIO_BECS_LEN(httc->becbuf));
+	if (HIO_UNLIKELY(!req)) return HIO_NULL;
+
+	req->httc = httc;
+	req->origin = origin;
+	req->cbs = *cbs;
+	req->ctx = ctx;
+	req->method = ri->method;
+	req->retryable = !!(ri->options & HIO_SVC_HTTC_REQ_RETRYABLE) || is_idempotent(ri->method);
+	req->state = HTTC_REQ_DETACHED;
+	req->data = (hio_bch_t*)(req + 1);
+	req->len = HIO_BECS_LEN(httc->becbuf);
+	HIO_MEMCPY (req->data, HIO_BECS_PTR(httc->becbuf), req->len);
+
+	if (dispatch_req(httc, req) <= -1)
+	{
+		hio_freemem (hio, req);
+		return HIO_NULL;
+	}
+
+	return req;
+}
+
+void hio_svc_httc_cancelreq (hio_svc_httc_req_t* req)
+{
+	hio_t* hio = req->httc->hio;
+
+	switch (req->state)
+	{
+		case HTTC_REQ_WAITING:
+			unlink_req (&req->origin->waitq, req);
+			hio_freemem (hio, req);
+			break;
+
+		case HTTC_REQ_ASSIGNED:
+			if (!req->sent)
+			{
+				unlink_req (&req->conn->reqq, req);
+				hio_freemem (hio, req);
+				break;
+			}
+			/* the response is read and discarded */
+			req->cancelled = 1;
+			break;
+
+		default:
+			req->cancelled = 1;
+			break;
+	}
+}
+
+/* ----------------------------------------------------------------------- */
+
+hio_svc_httc_t* hio_svc_httc_start (hio_t* hio, const hio_svc_httc_tmout_t* tmout)
+{
+	hio_svc_httc_t* httc = HIO_NULL;
+
+	httc = (hio_svc_httc_t*)hio_callocmem(hio, HIO_SIZEOF(*httc));
+	if (HIO_UNLIKELY(!httc)) goto oops;
+
+	httc->hio = hio;
+	httc->svc_stop = (hio_svc_stop_t)hio_svc_httc_stop;
+	HIO_INIT_NTIME (&httc->tmout.c, -1, 0);
+	HIO_INIT_NTIME (&httc->tmout.r, -1, 0);
+	HIO_INIT_NTIME (&httc->tmout.i, -1, 0);
+	if (tmout) httc->tmout = *tmout;
+
+	httc->option.conn_max = HTTC_DEFAULT_CONN_MAX;
+	httc->option.pipeline_max = HTTC_DEFAULT_PIPELINE_MAX;
+
+	httc->becbuf = hio_becs_open(hio, 0, 256);
+	if (HIO_UNLIKELY(!httc->becbuf)) goto oops;
+
+	HIO_SVCL_APPEND_SVC (&hio->actsvc, (hio_svc_t*)httc);
+	HIO_DEBUG1 (hio, "HTTC - STARTED SERVICE %p\n", httc);
+	return httc;
+
+oops:
+	if (httc)
+	{
+		if (httc->becbuf) hio_becs_close (httc->becbuf);
+		hio_freemem (hio, httc);
+	}
+	return HIO_NULL;
+}
+
+void hio_svc_httc_stop (hio_svc_httc_t* httc)
+{
+	hio_t* hio = httc->hio;
+	hio_oow_t i;
+
+	HIO_DEBUG1 (hio, "HTTC - STOPPING SERVICE %p\n", httc);
+	httc->stopping = 1;
+
+	for (i = 0; i < HIO_COUNTOF(httc->bkt); i++)
+	{
+		while (httc->bkt[i])
+		{
+			hio_svc_httc_origin_t* origin = httc->bkt[i];
+
+			while (origin->waitq.head)
+			{
+				hio_svc_httc_req_t* req = origin->waitq.head;
+				unlink_req (&origin->waitq, req);
+				req->state = HTTC_REQ_DETACHED;
+				finish_req (req, HIO_EINTR);
+			}
+
+			/* the disconnect callback fails the requests and unlinks the connection */
+			while (origin->conn) hio_dev_sck_kill (origin->conn->sck);
+
+			httc->bkt[i] = origin->next;
+			hio_freemem (hio, origin);
+		}
+	}
+
+	HIO_SVCL_UNLINK_SVC (httc);
+	hio_becs_close (httc->becbuf);
+	hio_freemem (hio, httc);
+
+	HIO_DEBUG1 (hio, "HTTC - STOPPED SERVICE %p\n", httc);
+}
+
+int hio_svc_httc_getoption (hio_svc_httc_t* httc, hio_svc_httc_option_t id, void* value)
+{
+	switch (id)
+	{
+		case HIO_SVC_HTTC_CONN_MAX:
+			*(hio_oow_t*)value = httc->option.conn_max;
+			return 0;
+
+		case HIO_SVC_HTTC_PIPELINE_MAX:
+			*(hio_oow_t*)value = httc->option.pipeline_max;
+			return 0;
+	}
+
+	hio_seterrnum (httc->hio, HIO_EINVAL);
+	return -1;
+}
+
+int hio_svc_httc_setoption (hio_svc_httc_t* httc, hio_svc_httc_option_t id, const void* value)
+{
+	switch (id)
+	{
+		case HIO_SVC_HTTC_CONN_MAX:
+			httc->option.conn_max = *(const hio_oow_t*)value;
+			return 0;
+
+		case HIO_SVC_HTTC_PIPELINE_MAX:
+			if (*(const hio_oow_t*)value <= 0) break;
+			httc->option.pipeline_max = *(const hio_oow_t*)value;
+			return 0;
+	}
+
+	hio_seterrnum (httc->hio, HIO_EINVAL);
+	return -1;
+}
@@ -661,7 +661,7 @@ static void unbind_task_from_client (fcgi_t* fcgi, int rcdown)
 
 /* ----------------------------------------------------------------------- */
 
-static int bind_task_to_peer (fcgi_t* fcgi, const hio_skad_t* fcgis_addr)
+static int bind_task_to_peer (fcgi_t* fcgi, const hio_skad_t* fcgis_addr, hio_svc_fcgic_upstream_t* fcgis_ups)
 {
 	hio_htrd_t* htrd;
 	fcgi_peer_xtn_t* pxtn;
@@ -672,7 +672,9 @@ static int bind_task_to_peer (fcgi_t* fcgi, const hio_skad_t* fcgis_addr)
 	hio_htrd_setoption (htrd, HIO_HTRD_SKIP_INITIAL_LINE | HIO_HTRD_RESPONSE);
 	hio_htrd_setrecbs (htrd, &peer_htrd_recbs);
 
-	fcgi->peer = hio_svc_fcgic_tie(fcgi->htts->fcgic, fcgis_addr, fcgi_peer_on_read, fcgi_peer_on_write, fcgi_peer_on_untie, fcgi);
+	fcgi->peer = fcgis_ups?
+		hio_svc_fcgic_tieupstream(fcgis_ups, fcgi_peer_on_read, fcgi_peer_on_write, fcgi_peer_on_untie, fcgi):
+		hio_svc_fcgic_tie(fcgi->htts->fcgic, fcgis_addr, fcgi_peer_on_read, fcgi_peer_on_write, fcgi_peer_on_untie, fcgi);
 	if (HIO_UNLIKELY(!fcgi->peer))
 	{
 		hio_htrd_close (htrd);
@@ -752,7 +754,7 @@ static int setup_for_content_length(fcgi_t* fcgi, hio_htre_t* req)
 
 /* ----------------------------------------------------------------------- */
 
-int hio_svc_htts_dofcgi (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* req, const hio_skad_t* fcgis_addr, const hio_bch_t* docroot, const hio_bch_t* script, int options, hio_svc_htts_task_on_kill_t on_kill)
+static int do_fcgi (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* req, const hio_skad_t* fcgis_addr, hio_svc_fcgic_upstream_t* fcgis_ups, const hio_bch_t* docroot, const hio_bch_t* script, int options, hio_svc_htts_task_on_kill_t on_kill)
 {
 	hio_t* hio = htts->hio;
 	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(csck);
@@ -771,6 +773,7 @@ int hio_svc_htts_dofcgi (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t*
 
 	fcgi = (fcgi_t*)hio_svc_htts_task_make(htts, HIO_SIZEOF(*fcgi), fcgi_on_kill, req, csck);
 	if (HIO_UNLIKELY(!fcgi)) goto oops;
+	HIO_SVC_HTTS_STAT_INC (htts, task_fcgi);
 	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)fcgi);
 
 	if (HIO_UNLIKELY(!htts->fcgic))
@@ -783,21 +786,21 @@ int hio_svc_htts_dofcgi (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t*
 	bind_task_to_client (fcgi, csck);
 	bound_to_client = 1;
 
-	if (bind_task_to_peer(fcgi, fcgis_addr) <= -1) goto oops;
+	if (bind_task_to_peer(fcgi, fcgis_addr, fcgis_ups) <= -1) goto oops;
 	bound_to_peer = 1;
 
+	/* send FCGI_BEGIN_REQUEST and FCGI_PARAMS before any FCGI_STDIN records
+	 * including the empty one written for a request without contents */
+	if (hio_svc_fcgic_beginrequest(fcgi->peer) <= -1) goto oops;
+	if (write_params(fcgi, csck, req, docroot, script) <= -1) goto oops;
+	if (hio_svc_fcgic_writeparam(fcgi->peer, HIO_NULL, 0, HIO_NULL, 0) <= -1) goto oops; /* end of params */
+
 	if (hio_svc_htts_task_handleexpect100((hio_svc_htts_task_t*)fcgi, 0) <= -1) goto oops;
 	if (setup_for_content_length(fcgi, req) <= -1) goto oops;
 
 	/* TODO: store current input watching state and use it when destroying the fcgi data */
 	if (hio_dev_sck_read(csck, !(fcgi->over & FCGI_OVER_READ_FROM_CLIENT)) <= -1) goto oops;
 
-	/* send FCGI_BEGIN_REQUEST */
-	if (hio_svc_fcgic_beginrequest(fcgi->peer) <= -1) goto oops;
-	/* write FCGI_PARAM */
-	if (write_params(fcgi, csck, req, docroot, script) <= -1) goto oops;
-	if (hio_svc_fcgic_writeparam(fcgi->peer, HIO_NULL, 0, HIO_NULL, 0) <= -1) goto oops; /* end of params */
-
 	HIO_SVC_HTTS_TASKL_APPEND_TASK (&htts->task, (hio_svc_htts_task_t*)fcgi);
 	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)fcgi);
 
@@ -818,3 +821,13 @@ oops:
 	}
 	return -1;
 }
+
+int hio_svc_htts_dofcgi (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* req, const hio_skad_t* fcgis_addr, const hio_bch_t* docroot, const hio_bch_t* script, int options, hio_svc_htts_task_on_kill_t on_kill)
+{
+	return do_fcgi(htts, csck, req, fcgis_addr, HIO_NULL, docroot, script, options, on_kill);
+}
+
+int hio_svc_htts_dofcgiupstream (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* req, hio_svc_fcgic_upstream_t* fcgis_ups, const hio_bch_t* docroot, const hio_bch_t* script, int options, hio_svc_htts_task_on_kill_t on_kill)
+{
+	return do_fcgi(htts, csck, req, HIO_NULL, fcgis_ups, docroot, script, options, on_kill);
+}
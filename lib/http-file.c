@@ -34,6 +34,10 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
+#if defined(HAVE_ZLIB)
+#	include <zlib.h>
+#endif
+
 #define FILE_ALLOW_UNLIMITED_REQ_CONTENT_LENGTH
 
 #define FILE_OVER_READ_FROM_CLIENT (1 << 0)
@@ -42,6 +46,27 @@
 #define FILE_OVER_WRITE_TO_PEER    (1 << 3)
 #define FILE_OVER_ALL (FILE_OVER_READ_FROM_CLIENT | FILE_OVER_READ_FROM_PEER | FILE_OVER_WRITE_TO_CLIENT | FILE_OVER_WRITE_TO_PEER)
 
+#define FILE_MAX_RANGES 16
+
+struct file_range_t
+{
+	hio_foff_t from;
+	hio_foff_t to;
+};
+typedef struct file_range_t file_range_t;
+
+/* state of a multipart/byteranges response */
+struct file_mrange_t
+{
+	hio_oow_t count; /* number of parts */
+	hio_oow_t index; /* index of the next part to send */
+	int closed; /* the closing boundary has been sent */
+	hio_bch_t boundary[64];
+	hio_bch_t* mime_type; /* content type of each part */
+	file_range_t r[FILE_MAX_RANGES];
+};
+typedef struct file_mrange_t file_mrange_t;
+
 struct file_t
 {
 	HIO_SVC_HTTS_TASK_HEADER;
@@ -55,6 +80,9 @@ struct file_t
 	hio_oow_t num_pending_writes_to_peer;
 	int sendfile_ok;
 	int peer;
+	hio_svc_htts_fcent_t* peer_fcent; /* non-null if peer is borrowed from the open file cache */
+	const hio_bch_t* content_encoding; /* non-null if the contents sent are encoded */
+	file_mrange_t* mrange; /* non-null for a multi-range request */
 	hio_foff_t total_size;
 	hio_foff_t start_offset;
 	hio_foff_t end_offset;
@@ -62,10 +90,11 @@ struct file_t
 	hio_bch_t peer_buf[8192];
 	hio_tmridx_t peer_tmridx;
 	hio_bch_t peer_etag[128];
+	hio_ntime_t peer_mtime;
 
 	unsigned int over: 4; /* must be large enough to accomodate FILE_OVER_ALL */
 	unsigned int client_htrd_recbs_changed: 1;
-	unsigned int etag_match: 1;
+	unsigned int not_modified: 1;
 
 	hio_dev_sck_on_read_t client_org_on_read;
 	hio_dev_sck_on_write_t client_org_on_write;
@@ -77,6 +106,7 @@ typedef struct file_t file_t;
 static void unbind_task_from_client (file_t* file, int rcdown);
 static void unbind_task_from_peer (file_t* file, int rcdown);
 static int file_send_contents_to_client (file_t* file);
+static void fcent_drop_mem_var (hio_svc_htts_t* htts, hio_svc_htts_fcent_t* ent, int var);
 
 static HIO_INLINE int get_tcp_cork (hio_dev_sck_t* sck)
 {
@@ -216,6 +246,13 @@ static void file_on_kill (hio_svc_htts_task_t* task)
 		unbind_task_from_client (file, 0);
 	}
 
+	if (file->mrange)
+	{
+		if (file->mrange->mime_type) hio_freemem (hio, file->mrange->mime_type);
+		hio_freemem (hio, file->mrange);
+		file->mrange = HIO_NULL;
+	}
+
 	if (file->task_next) HIO_SVC_HTTS_TASKL_UNLINK_TASK (file); /* detach from the htts service only if it's attached */
 
 	HIO_DEBUG5 (hio, "HTTS(%p) - file(t=%p,c=%p[%d],p=%d) - killed the task\n", file->htts, file, file->task_client, (file->task_csck? file->task_csck->hnd: -1), file->peer);
@@ -386,6 +423,96 @@ static hio_htrd_recbs_t file_client_htrd_recbs =
 
 /* --------------------------------------------------------------------- */
 
+static void fmt_content_range (file_t* file, hio_foff_t from, hio_foff_t to, hio_bch_t* buf, hio_oow_t len)
+{
+	/* bytes from-to/total. formatted without %ju. the formatter takes a
+	 * hio_uintmax_t wider than a word off the varargs a word at a time,
+	 * which goes wrong where the abi aligns the value to a register pair.
+	 * whether it does depends on the position of the argument */
+	hio_oow_t x;
+
+	x = hio_copy_bcstr(buf, len, "bytes ");
+	x += hio_fmt_uintmax_to_bcstr(&buf[x], len - x, from, 10, -1, '\0', HIO_NULL);
+	buf[x++] = '-';
+	x += hio_fmt_uintmax_to_bcstr(&buf[x], len - x, to, 10, -1, '\0', HIO_NULL);
+	buf[x++] = '/';
+	hio_fmt_uintmax_to_bcstr (&buf[x], len - x, file->total_size, 10, -1, '\0', HIO_NULL);
+}
+
+static int file_res_varies_by_encoding (file_t* file, const hio_bch_t* mime_type)
+{
+	/* a precompressed file or the gzipped copy in the memory cache may be sent
+	 * for another request. it must not depend on the Accept-Encoding header of
+	 * the current request so that the identity variant carries Vary as well */
+	if (file->content_encoding || (file->options & HIO_SVC_HTTS_FILE_PRECOMPRESSED)) return 1;
+#if defined(HAVE_ZLIB)
+	if (file->htts->option.res_compress_min > 0 && file->htts->option.file_memcache_max > 0 &&
+	    file->total_size >= file->htts->option.res_compress_min && mime_type &&
+	    hio_svc_htts_iscompressibletype(mime_type, hio_count_bcstr(mime_type))) return 1;
+#endif
+	return 0;
+}
+
+static int file_add_validators (file_t* file, const hio_bch_t* mime_type)
+{
+	/* shared by 200, 206 and 304 as a 304 response must carry what the full one would */
+	hio_bch_t dtbuf[64];
+
+	hio_fmt_http_time_to_bcstr (&file->peer_mtime, dtbuf, HIO_COUNTOF(dtbuf));
+	if ((file_res_varies_by_encoding(file, mime_type) && hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "Vary", "Accept-Encoding") <= -1) ||
+	    hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "ETag", file->peer_etag) <= -1 ||
+	    hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "Last-Modified", dtbuf) <= -1) return -1;
+	return 0;
+}
+
+static int file_add_res_headers (file_t* file, int status_code, hio_foff_t content_length, const hio_bch_t* mime_type)
+{
+	hio_bch_t clbuf[64];
+
+	if (mime_type && mime_type[0] != '\0' && hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "Content-Type", mime_type) <= -1) return -1;
+
+	if (file->content_encoding && hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "Content-Encoding", file->content_encoding) <= -1) return -1;
+
+	if ((file->task_req_method == HIO_HTTP_GET || file->task_req_method == HIO_HTTP_HEAD) &&
+	    file_add_validators(file, mime_type) <= -1) return -1;
+
+	if (status_code == HIO_HTTP_STATUS_PARTIAL_CONTENT && !file->mrange)
+	{
+		hio_bch_t crbuf[128];
+		fmt_content_range (file, file->start_offset, file->end_offset, crbuf, HIO_COUNTOF(crbuf));
+		if (hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "Content-Range", crbuf) <= -1) return -1;
+	}
+
+/* ----- */
+// TODO: Allow-Contents
+// Allow-Headers... support custom headers...
+	if (hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "Access-Control-Allow-Origin", "*") <= -1) return -1;
+/* ----- */
+
+	/* not with %ju for the reason given in fmt_content_range() */
+	hio_fmt_uintmax_to_bcstr (clbuf, HIO_COUNTOF(clbuf), content_length, 10, -1, '\0', HIO_NULL);
+	if (hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "Content-Length", clbuf) <= -1) return -1;
+	return 0;
+}
+
+static int format_mrange_part_header (file_t* file, hio_oow_t index)
+{
+	/* format the boundary and the header of a part in the temporary buffer.
+	 * the index equal to the number of parts produces the closing boundary */
+	file_mrange_t* mr = file->mrange;
+	hio_becs_t* buf = file->htts->becbuf;
+	hio_bch_t crbuf[128];
+
+	if (index >= mr->count)
+		return hio_becs_fmt(buf, "\r\n--%hs--\r\n", mr->boundary) == (hio_oow_t)-1? -1: 0;
+
+	if (hio_becs_fmt(buf, "%hs--%hs\r\n", (index > 0? "\r\n": ""), mr->boundary) == (hio_oow_t)-1) return -1;
+	if (mr->mime_type && mr->mime_type[0] != '\0' && hio_becs_fcat(buf, "Content-Type: %hs\r\n", mr->mime_type) == (hio_oow_t)-1) return -1;
+	fmt_content_range (file, mr->r[index].from, mr->r[index].to, crbuf, HIO_COUNTOF(crbuf));
+	if (hio_becs_fcat(buf, "Content-Range: %hs\r\n\r\n", crbuf) == (hio_oow_t)-1) return -1;
+	return 0;
+}
+
 static int file_send_header_to_client (file_t* file, int status_code, int force_close, const hio_bch_t* mime_type)
 {
 	hio_svc_htts_cli_t* cli = file->task_client;
@@ -400,29 +527,256 @@ static int file_send_header_to_client (file_t* file, int status_code, int force_
 	content_length = file->end_offset - file->start_offset + 1;
 	if (status_code == HIO_HTTP_STATUS_OK && file->total_size != content_length) status_code = HIO_HTTP_STATUS_PARTIAL_CONTENT;
 
+	if (file->mrange)
+	{
+		hio_oow_t i;
+
+		status_code = HIO_HTTP_STATUS_PARTIAL_CONTENT;
+		if (mime_type)
+		{
+			file->mrange->mime_type = hio_dupbcstr(file->htts->hio, mime_type, HIO_NULL);
+			if (HIO_UNLIKELY(!file->mrange->mime_type)) return -1;
+		}
+
+		/* the length of the whole multipart body */
+		content_length = 0;
+		for (i = 0; i < file->mrange->count; i++)
+		{
+			if (format_mrange_part_header(file, i) <= -1) return -1;
+			content_length += HIO_BECS_LEN(file->htts->becbuf) + (file->mrange->r[i].to - file->mrange->r[i].from + 1);
+		}
+		if (format_mrange_part_header(file, i) <= -1) return -1;
+		content_length += HIO_BECS_LEN(file->htts->becbuf);
+
+		if (hio_becs_fmt(file->htts->becbuf, "multipart/byteranges; boundary=%hs", file->mrange->boundary) == (hio_oow_t)-1) return -1;
+		mime_type = HIO_BECS_PTR(file->htts->becbuf);
+
+		/* let file_send_contents_to_client() begin with the first part */
+		file->cur_offset = file->end_offset + 1;
+	}
+
 	if (hio_svc_htts_task_startreshdr((hio_svc_htts_task_t*)file, status_code, HIO_NULL, 0) <= -1) return -1;
+	if (file_add_res_headers(file, status_code, content_length, mime_type) <= -1) return -1;
+	if (hio_svc_htts_task_endreshdr((hio_svc_htts_task_t*)file) <= -1) return -1;
 
-	if (mime_type && mime_type[0] != '\0' && hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "Content-Type", mime_type) <= -1) return -1;
+	return 0;
+}
 
-	if ((file->task_req_method == HIO_HTTP_GET || file->task_req_method == HIO_HTTP_HEAD) &&
-	    hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "ETag", file->peer_etag) <= -1) return -1;
+static int file_send_not_modified_to_client (file_t* file, const hio_bch_t* mime_type)
+{
+	if (HIO_UNLIKELY(!file->task_client)) return 0;
+
+	/* 304 has no body. it carries the validators and Vary only */
+	if (hio_svc_htts_task_startreshdr((hio_svc_htts_task_t*)file, HIO_HTTP_STATUS_NOT_MODIFIED, HIO_NULL, 0) <= -1 ||
+	    file_add_validators(file, mime_type) <= -1 ||
+	    hio_svc_htts_task_endreshdr((hio_svc_htts_task_t*)file) <= -1) return -1;
+	return 0;
+}
 
-	if (status_code == HIO_HTTP_STATUS_PARTIAL_CONTENT &&
-	    hio_svc_htts_task_addreshdrfmt((hio_svc_htts_task_t*)file, "Content-Ranges", "bytes %ju-%ju/%ju", (hio_uintmax_t)file->start_offset, (hio_uintmax_t)file->end_offset, (hio_uintmax_t)file->total_size) <= -1) return -1;
+static int file_can_use_memcache (file_t* file)
+{
+	hio_svc_htts_t* htts = file->htts;
 
-/* ----- */
-// TODO: Allow-Contents
-// Allow-Headers... support custom headers...
-	if (hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)file, "Access-Control-Allow-Origin", "*") <= -1) return -1;
-/* ----- */
+	/* only a full response of a small file already in the open file cache qualifies */
+	return file->peer_fcent && !file->mrange && htts->option.file_memcache_max > 0 &&
+	       file->task_req_method == HIO_HTTP_GET && file->task_client &&
+	       file->start_offset == 0 && file->end_offset == file->total_size - 1 &&
+	       file->total_size <= htts->option.file_memcache_file_max;
+}
 
-	if (hio_svc_htts_task_addreshdrfmt((hio_svc_htts_task_t*)file, "Content-Length", "%ju", (hio_uintmax_t)content_length) <= -1) return -1;
+static int file_pread_all (file_t* file, hio_bch_t* buf, hio_oow_t len)
+{
+	hio_oow_t pos;
 
-	if (hio_svc_htts_task_endreshdr((hio_svc_htts_task_t*)file) <= -1) return -1;
+	for (pos = 0; pos < len; )
+	{
+		ssize_t n;
+		n = pread(file->peer, &buf[pos], len - pos, pos);
+		if (n <= 0) return -1; /* EOF or error. the file must have been changed */
+		pos += n;
+	}
 
 	return 0;
 }
 
+#if defined(HAVE_ZLIB)
+static hio_bch_t* file_gzip_contents (file_t* file, hio_oow_t* zlen)
+{
+	hio_t* hio = file->htts->hio;
+	hio_bch_t* raw, * zbuf = HIO_NULL;
+	z_stream strm;
+
+	raw = (hio_bch_t*)hio_allocmem(hio, file->total_size);
+	if (HIO_UNLIKELY(!raw)) return HIO_NULL;
+	if (file_pread_all(file, raw, file->total_size) <= -1) goto done;
+
+	HIO_MEMSET (&strm, 0, HIO_SIZEOF(strm));
+	if (deflateInit2(&strm, file->htts->option.res_compress_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) goto done;
+
+	/* a compressed copy larger than the original is useless. Z_FINISH
+	 * doesn't return Z_STREAM_END if the output buffer is too small */
+	zbuf = (hio_bch_t*)hio_allocmem(hio, file->total_size);
+	if (HIO_LIKELY(zbuf))
+	{
+		strm.next_in = (Bytef*)raw;
+		strm.avail_in = file->total_size;
+		strm.next_out = (Bytef*)zbuf;
+		strm.avail_out = file->total_size;
+		if (deflate(&strm, Z_FINISH) == Z_STREAM_END)
+		{
+			*zlen = strm.total_out;
+		}
+		else
+		{
+			file->peer_fcent->mem.no_gzip = 1;
+			hio_freemem (hio, zbuf);
+			zbuf = HIO_NULL;
+		}
+	}
+	deflateEnd (&strm);
+
+done:
+	hio_freemem (hio, raw);
+	return zbuf;
+}
+#endif
+
+static int file_build_memcache (file_t* file, const hio_bch_t* mime_type, int var)
+{
+	hio_svc_htts_t* htts = file->htts;
+	hio_svc_htts_fcent_t* ent = file->peer_fcent;
+	hio_becs_t* sbuf = file->task_client->sbuf;
+	hio_oow_t hdr_off, hdr_len, mime_len, body_len, etag_len;
+	hio_bch_t* ptr, * zbody = HIO_NULL;
+	int n;
+
+	body_len = file->total_size;
+#if defined(HAVE_ZLIB)
+	if (var == HIO_SVC_HTTS_FCENT_MEM_GZIP)
+	{
+		zbody = file_gzip_contents(file, &body_len);
+		if (!zbody) return 0; /* don't care about failure */
+	}
+#endif
+
+	/* let file_add_res_headers() produce the same entity headers as the normal path.
+	 * the general headers already in the buffer are not part of the memory cache
+	 * as they vary per request. the gzipped variant has its own entity tag. */
+	hdr_off = HIO_BECS_LEN(sbuf);
+	etag_len = hio_count_bcstr(file->peer_etag);
+	if (zbody)
+	{
+		/* "xxx" to "xxx-gz" */
+		file->content_encoding = "gzip";
+		hio_copy_bcstr (&file->peer_etag[etag_len - 1], HIO_COUNTOF(file->peer_etag) - etag_len + 1, "-gz\"");
+	}
+	n = file_add_res_headers(file, HIO_HTTP_STATUS_OK, body_len, mime_type);
+	if (zbody)
+	{
+		file->content_encoding = HIO_NULL;
+		file->peer_etag[etag_len - 1] = '"';
+		file->peer_etag[etag_len] = '\0';
+	}
+	if (n <= -1 || hio_becs_cat(sbuf, "\r\n") == (hio_oow_t)-1) goto oops;
+	hdr_len = HIO_BECS_LEN(sbuf) - hdr_off;
+
+	mime_len = mime_type? hio_count_bcstr(mime_type): 0;
+	if (hdr_len + body_len > htts->option.file_memcache_max) goto done; /* too large for the budget */
+
+	ptr = (hio_bch_t*)hio_allocmem(htts->hio, hdr_len + body_len + mime_len + 1);
+	if (HIO_UNLIKELY(!ptr)) goto done; /* don't care about failure */
+
+	HIO_MEMCPY (ptr, HIO_BECS_CPTR(sbuf, hdr_off), hdr_len);
+	if (zbody)
+	{
+		HIO_MEMCPY (&ptr[hdr_len], zbody, body_len);
+	}
+	else if (file_pread_all(file, &ptr[hdr_len], body_len) <= -1)
+	{
+		hio_freemem (htts->hio, ptr);
+		goto done;
+	}
+
+	hio_svc_htts_trimfilememcache (htts, htts->option.file_memcache_max - (hdr_len + body_len));
+
+	ent->mem.var[var].ptr = ptr;
+	ent->mem.var[var].len = hdr_len + body_len;
+	ent->mem.var[var].mime_type = &ptr[hdr_len + body_len];
+	if (mime_type) HIO_MEMCPY (ent->mem.var[var].mime_type, mime_type, mime_len);
+	ent->mem.var[var].mime_type[mime_len] = '\0';
+
+	if (!ent->mem.next)
+	{
+		/* not on the memory lru list yet */
+		ent->mem.next = htts->fcache.mem_lru.mem.next;
+		ent->mem.prev = &htts->fcache.mem_lru;
+		ent->mem.next->mem.prev = ent;
+		htts->fcache.mem_lru.mem.next = ent;
+	}
+	htts->fcache.mem_count++;
+	htts->fcache.mem_size += ent->mem.var[var].len;
+
+done:
+	if (zbody) hio_freemem (htts->hio, zbody);
+	hio_becs_setlen (sbuf, hdr_off); /* leave the general headers only */
+	return 0;
+
+oops:
+	if (zbody) hio_freemem (htts->hio, zbody);
+	return -1;
+}
+
+static int file_send_memcached_res_to_client (file_t* file, const hio_bch_t* mime_type, int var)
+{
+	hio_svc_htts_t* htts = file->htts;
+	hio_svc_htts_fcent_t* ent = file->peer_fcent;
+
+	if (var == HIO_SVC_HTTS_FCENT_MEM_GZIP && ent->mem.no_gzip) var = HIO_SVC_HTTS_FCENT_MEM_IDENTITY;
+	if (hio_svc_htts_task_startreshdr((hio_svc_htts_task_t*)file, HIO_HTTP_STATUS_OK, HIO_NULL, 0) <= -1) return -1;
+
+	if (ent->mem.var[var].ptr && hio_comp_bcstr(ent->mem.var[var].mime_type, (mime_type? mime_type: ""), 0) == 0)
+	{
+		htts->fcache.mem_hits++;
+
+		/* move it to the front of the memory lru list */
+		ent->mem.prev->mem.next = ent->mem.next;
+		ent->mem.next->mem.prev = ent->mem.prev;
+		ent->mem.next = htts->fcache.mem_lru.mem.next;
+		ent->mem.prev = &htts->fcache.mem_lru;
+		ent->mem.next->mem.prev = ent;
+		htts->fcache.mem_lru.mem.next = ent;
+	}
+	else
+	{
+		htts->fcache.mem_misses++;
+
+	retry:
+		fcent_drop_mem_var (htts, ent, var); /* built with a different mime type */
+		if (file_build_memcache(file, mime_type, var) <= -1) return -1;
+
+		if (!ent->mem.var[var].ptr)
+		{
+			if (var == HIO_SVC_HTTS_FCENT_MEM_GZIP)
+			{
+				/* not worth compressing or no room for it */
+				var = HIO_SVC_HTTS_FCENT_MEM_IDENTITY;
+				if (!ent->mem.var[var].ptr || hio_comp_bcstr(ent->mem.var[var].mime_type, (mime_type? mime_type: ""), 0) != 0) goto retry;
+			}
+			else
+			{
+				/* couldn't keep it in memory. fall back to the normal transfer */
+				if (file_add_res_headers(file, HIO_HTTP_STATUS_OK, file->total_size, mime_type) <= -1 ||
+				    hio_svc_htts_task_endreshdr((hio_svc_htts_task_t*)file) <= -1) return -1;
+				return 0;
+			}
+		}
+	}
+
+	if (hio_svc_htts_task_endreshdrwithraw((hio_svc_htts_task_t*)file, ent->mem.var[var].ptr, ent->mem.var[var].len) <= -1) return -1;
+	file->cur_offset = file->end_offset + 1; /* the whole contents have been sent */
+	return 0;
+}
+
 static void send_contents_to_client_later (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* tmrjob)
 {
 	file_t* file = (file_t*)tmrjob->ctx;
@@ -436,11 +790,33 @@ static int file_send_contents_to_client (file_t* file)
 
 	if (file->cur_offset > file->end_offset)
 	{
+		file_mrange_t* mr = file->mrange;
+
+		if (mr && !mr->closed)
+		{
+			/* move on to the next part or close the multipart body */
+			if (format_mrange_part_header(file, mr->index) <= -1 ||
+			    hio_svc_htts_task_addresbody((hio_svc_htts_task_t*)file, HIO_BECS_PTR(file->htts->becbuf), HIO_BECS_LEN(file->htts->becbuf)) <= -1) return -1;
+
+			if (mr->index < mr->count)
+			{
+				file->start_offset = mr->r[mr->index].from;
+				file->end_offset = mr->r[mr->index].to;
+				file->cur_offset = file->start_offset;
+				mr->index++;
+				goto send_range;
+			}
+
+			mr->closed = 1;
+		}
+
 		/* reached the end */
 		file_mark_over (file, FILE_OVER_READ_FROM_PEER);
 		return 0;
 	}
 
+send_range:
+
 	lim = file->end_offset - file->cur_offset + 1;
 	if (file->sendfile_ok)
 	{
@@ -452,7 +828,9 @@ static int file_send_contents_to_client (file_t* file)
 	{
 		ssize_t n;
 
-		n = read(file->peer, file->peer_buf, (lim < HIO_SIZEOF(file->peer_buf)? lim: HIO_SIZEOF(file->peer_buf)));
+		if (lim > HIO_SIZEOF(file->peer_buf)) lim = HIO_SIZEOF(file->peer_buf);
+		/* the file offset of a cached descriptor is shared by all tasks. use pread() for it */
+		n = (file->peer_fcent || file->mrange)? pread(file->peer, file->peer_buf, lim, file->cur_offset): read(file->peer, file->peer_buf, lim);
 		if (n == -1)
 		{
 			if ((errno == EAGAIN || errno == EINTR) && file->peer_tmridx == HIO_TMRIDX_INVALID)
@@ -493,85 +871,459 @@ static int file_send_contents_to_client (file_t* file)
 	((x) == EPERM || (x) == EACCES)? HIO_HTTP_STATUS_FORBIDDEN: HIO_HTTP_STATUS_INTERNAL_SERVER_ERROR \
 )
 
-static HIO_INLINE int process_range_header (file_t* file, hio_htre_t* req, int* error_status)
+static HIO_INLINE void get_stat_mtime (const struct stat* st, hio_ntime_t* nt)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+	nt->sec = st->st_mtim.tv_sec;
+	nt->nsec = st->st_mtim.tv_nsec;
+#else
+	nt->sec = st->st_mtime;
+	nt->nsec = 0;
+#endif
+}
+
+static void make_etag (hio_bch_t* buf, hio_oow_t len, const struct stat* st)
+{
+	hio_ntime_t mtime;
+	hio_oow_t etag_len = 0;
+
+	/* a strong entity tag in the form of "inode-size-mtime" with the mtime in nanoseconds if available */
+	get_stat_mtime (st, &mtime);
+	buf[etag_len++] = '"';
+	etag_len += hio_fmt_uintmax_to_bcstr(&buf[etag_len], len - etag_len, st->st_ino, 16, -1, '\0', HIO_NULL);
+	buf[etag_len++] = '-';
+	etag_len += hio_fmt_uintmax_to_bcstr(&buf[etag_len], len - etag_len, st->st_size, 16, -1, '\0', HIO_NULL);
+	buf[etag_len++] = '-';
+	etag_len += hio_fmt_uintmax_to_bcstr(&buf[etag_len], len - etag_len, mtime.sec, 16, -1, '\0', HIO_NULL);
+	if (mtime.nsec > 0)
+	{
+		buf[etag_len++] = '.';
+		etag_len += hio_fmt_uintmax_to_bcstr(&buf[etag_len], len - etag_len, mtime.nsec, 16, -1, '\0', HIO_NULL);
+	}
+	buf[etag_len++] = '"';
+	buf[etag_len] = '\0';
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* the open file cache keeps the descriptors of recently served regular files
+ * open along with the file attributes needed to build the response header.
+ * an entry is reference-counted so that a task can keep sending a file that
+ * has been evicted or invalidated in the middle of transfer. */
+
+static void fcent_release (hio_svc_htts_t* htts, hio_svc_htts_fcent_t* ent)
+{
+	HIO_ASSERT (htts->hio, ent->refcnt > 0);
+	if (--ent->refcnt == 0)
+	{
+		close (ent->fd);
+		hio_freemem (htts->hio, ent);
+	}
+}
+
+static void fcent_drop_mem_var (hio_svc_htts_t* htts, hio_svc_htts_fcent_t* ent, int var)
 {
+	if (ent->mem.var[var].ptr)
+	{
+		htts->fcache.mem_count--;
+		htts->fcache.mem_size -= ent->mem.var[var].len;
+
+		hio_freemem (htts->hio, ent->mem.var[var].ptr);
+		ent->mem.var[var].ptr = HIO_NULL;
+		ent->mem.var[var].len = 0;
+		ent->mem.var[var].mime_type = HIO_NULL;
+
+		for (var = 0; var < HIO_COUNTOF(ent->mem.var); var++)
+		{
+			if (ent->mem.var[var].ptr) return;
+		}
+
+		/* no more variants in memory */
+		ent->mem.prev->mem.next = ent->mem.next;
+		ent->mem.next->mem.prev = ent->mem.prev;
+		ent->mem.prev = HIO_NULL;
+		ent->mem.next = HIO_NULL;
+	}
+}
+
+static void fcent_drop_mem (hio_svc_htts_t* htts, hio_svc_htts_fcent_t* ent)
+{
+	int var;
+	for (var = 0; var < HIO_COUNTOF(ent->mem.var); var++) fcent_drop_mem_var (htts, ent, var);
+}
+
+static void fcache_unlink (hio_svc_htts_t* htts, hio_svc_htts_fcent_t* ent)
+{
+	hio_svc_htts_fcent_t** pp;
+
+	pp = &htts->fcache.bkt[ent->hv % htts->fcache.nbkts];
+	while (*pp != ent) pp = &(*pp)->bkt_next;
+	*pp = ent->bkt_next;
+
+	ent->lru_prev->lru_next = ent->lru_next;
+	ent->lru_next->lru_prev = ent->lru_prev;
+	htts->fcache.count--;
+
+	/* the memory cache is only for the linked entries. the data
+	 * is copied when written. so it's safe to free it immediately */
+	fcent_drop_mem (htts, ent);
+	fcent_release (htts, ent); /* drop the reference held by the cache */
+}
+
+static hio_svc_htts_fcent_t* fcache_find (hio_svc_htts_t* htts, const hio_bch_t* path, hio_oow_t hv)
+{
+	hio_svc_htts_fcent_t* ent;
+
+	if (!htts->fcache.bkt) return HIO_NULL;
+	for (ent = htts->fcache.bkt[hv % htts->fcache.nbkts]; ent; ent = ent->bkt_next)
+	{
+		if (ent->hv == hv && hio_comp_bcstr(ent->path, path, 0) == 0) return ent;
+	}
+	return HIO_NULL;
+}
+
+static int fcent_matches_stat (hio_svc_htts_fcent_t* ent, const struct stat* st)
+{
+	hio_ntime_t mtime;
+	get_stat_mtime (st, &mtime);
+	return S_ISREG(st->st_mode) && ent->size == st->st_size && HIO_CMP_NTIME(&ent->mtime, &mtime) == 0 &&
+	       ent->ino == (hio_uintmax_t)st->st_ino && ent->dev == (hio_uintmax_t)st->st_dev;
+}
+
+static hio_svc_htts_fcent_t* fcache_get (hio_svc_htts_t* htts, const hio_bch_t* path)
+{
+	hio_svc_htts_fcent_t* ent;
 	struct stat st;
-	const hio_htre_hdrval_t* tmp;
-	hio_oow_t etag_len;
+	hio_ntime_t now, t;
+	hio_oow_t hv;
 
-	if (fstat(file->peer, &st) <= -1)
+	HIO_HASH_BCSTR (hv, path);
+	ent = fcache_find(htts, path, hv);
+	if (!ent) return HIO_NULL;
+
+	/* fstat() over the open descriptor is cheap. it catches in-place
+	 * modification that would make the cached size wrong. stat() over the
+	 * path is done once in the ttl interval to detect a removed or replaced file */
+	if (fstat(ent->fd, &st) <= -1 || !fcent_matches_stat(ent, &st)) goto stale;
+
+	hio_gettime (htts->hio, &now);
+	HIO_SUB_NTIME (&t, &now, &ent->checked_at);
+	if (HIO_CMP_NTIME(&t, &htts->option.file_cache_ttl) >= 0)
 	{
-		*error_status = ERRNO_TO_STATUS_CODE(errno);
-		return -1;
+		if (stat(path, &st) <= -1 || !fcent_matches_stat(ent, &st)) goto stale;
+		ent->checked_at = now;
 	}
 
-	if ((st.st_mode & S_IFMT) != S_IFREG)
+	/* move it to the front of the lru list */
+	ent->lru_prev->lru_next = ent->lru_next;
+	ent->lru_next->lru_prev = ent->lru_prev;
+	ent->lru_next = htts->fcache.lru.lru_next;
+	ent->lru_prev = &htts->fcache.lru;
+	ent->lru_next->lru_prev = ent;
+	htts->fcache.lru.lru_next = ent;
+
+	ent->refcnt++; /* for the caller */
+	return ent;
+
+stale:
+	/* the file has been changed, removed, or replaced since it got cached */
+	fcache_unlink (htts, ent);
+	return HIO_NULL;
+}
+
+static hio_svc_htts_fcent_t* fcache_put (hio_svc_htts_t* htts, const hio_bch_t* path, int fd, const struct stat* st, const hio_bch_t* mime_type)
+{
+	hio_svc_htts_fcent_t* ent;
+	hio_oow_t hv, path_len, mime_len;
+
+	if (!htts->fcache.bkt)
 	{
-		/* TODO: support directory listing if S_IFDIR? still disallow special files. */
-		*error_status = HIO_HTTP_STATUS_FORBIDDEN;
-		return -1;
+		hio_oow_t nbkts;
+		nbkts = htts->option.file_cache_max < 4096? htts->option.file_cache_max: 4096;
+		htts->fcache.bkt = (hio_svc_htts_fcent_t**)hio_callocmem(htts->hio, HIO_SIZEOF(*htts->fcache.bkt) * nbkts);
+		if (HIO_UNLIKELY(!htts->fcache.bkt)) return HIO_NULL;
+		htts->fcache.nbkts = nbkts;
 	}
 
-#if defined(HAVE_STRUCT_STAT_MTIM)
-	etag_len = hio_fmt_uintmax_to_bcstr(&file->peer_etag[0], HIO_COUNTOF(file->peer_etag), st.st_mtim.tv_sec, 16, -1, '\0', HIO_NULL);
-	file->peer_etag[etag_len++] = '-';
-	#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
-	etag_len += hio_fmt_uintmax_to_bcstr(&file->peer_etag[etag_len], HIO_COUNTOF(file->peer_etag), st.st_mtim.tv_nsec, 16, -1, '\0', HIO_NULL);
-	file->peer_etag[etag_len++] = '-';
-	#endif
-#else
-	etag_len = hio_fmt_uintmax_to_bcstr(&file->peer_etag[0], HIO_COUNTOF(file->peer_etag), st.st_mtime, 16, -1, '\0', HIO_NULL);
-	file->peer_etag[etag_len++] = '-';
-#endif
-	etag_len += hio_fmt_uintmax_to_bcstr(&file->peer_etag[etag_len], HIO_COUNTOF(file->peer_etag) - etag_len, st.st_size, 16, -1, '\0', HIO_NULL);
-	file->peer_etag[etag_len++] = '-';
-	etag_len += hio_fmt_uintmax_to_bcstr(&file->peer_etag[etag_len], HIO_COUNTOF(file->peer_etag) - etag_len, st.st_ino, 16, -1, '\0', HIO_NULL);
-	file->peer_etag[etag_len++] = '-';
-	hio_fmt_uintmax_to_bcstr (&file->peer_etag[etag_len], HIO_COUNTOF(file->peer_etag) - etag_len, st.st_dev, 16, -1, '\0', HIO_NULL);
+	HIO_HASH_BCSTR (hv, path);
+	ent = fcache_find(htts, path, hv);
+	if (ent) fcache_unlink (htts, ent); /* replace the existing entry */
 
-	tmp = hio_htre_getheaderval(req, "If-None-Match");
-	if (tmp && hio_comp_bcstr(file->peer_etag, tmp->ptr, 0) == 0) file->etag_match = 1;
+	while (htts->fcache.count >= htts->option.file_cache_max)
+	{
+		/* evict the least recently used entry */
+		fcache_unlink (htts, htts->fcache.lru.lru_prev);
+	}
 
-	file->end_offset = st.st_size;
+	path_len = hio_count_bcstr(path);
+	mime_len = mime_type? hio_count_bcstr(mime_type): 0;
+
+	ent = (hio_svc_htts_fcent_t*)hio_callocmem(htts->hio, HIO_SIZEOF(*ent) + path_len + 1 + (mime_type? mime_len + 1: 0));
+	if (HIO_UNLIKELY(!ent)) return HIO_NULL;
+
+	ent->refcnt = 2; /* one for the cache, one for the caller */
+	ent->hv = hv;
+	hio_gettime (htts->hio, &ent->checked_at);
+	ent->fd = fd;
+	ent->size = st->st_size;
+	get_stat_mtime (st, &ent->mtime);
+	ent->ino = st->st_ino;
+	ent->dev = st->st_dev;
+	make_etag (ent->etag, HIO_COUNTOF(ent->etag), st);
+
+	ent->path = (hio_bch_t*)(ent + 1);
+	HIO_MEMCPY (ent->path, path, path_len + 1);
+	if (mime_type)
+	{
+		ent->mime_type = ent->path + path_len + 1;
+		HIO_MEMCPY (ent->mime_type, mime_type, mime_len + 1);
+	}
+
+	ent->bkt_next = htts->fcache.bkt[hv % htts->fcache.nbkts];
+	htts->fcache.bkt[hv % htts->fcache.nbkts] = ent;
+
+	ent->lru_next = htts->fcache.lru.lru_next;
+	ent->lru_prev = &htts->fcache.lru;
+	ent->lru_next->lru_prev = ent;
+	htts->fcache.lru.lru_next = ent;
+	htts->fcache.count++;
+
+	return ent;
+}
+
+static void fcache_drop (hio_svc_htts_t* htts, const hio_bch_t* path)
+{
+	hio_svc_htts_fcent_t* ent;
+	hio_oow_t hv;
+
+	HIO_HASH_BCSTR (hv, path);
+	ent = fcache_find(htts, path, hv);
+	if (ent) fcache_unlink (htts, ent);
+}
+
+void hio_svc_htts_purgefilecache (hio_svc_htts_t* htts)
+{
+	while (htts->fcache.lru.lru_next != &htts->fcache.lru)
+		fcache_unlink (htts, htts->fcache.lru.lru_next);
+}
+
+void hio_svc_htts_trimfilememcache (hio_svc_htts_t* htts, hio_oow_t size)
+{
+	/* drop the least recently used responses until the total fits in the given size */
+	while (htts->fcache.mem_size > size && htts->fcache.mem_lru.mem.prev != &htts->fcache.mem_lru)
+		fcent_drop_mem (htts, htts->fcache.mem_lru.mem.prev);
+}
+
+void hio_svc_htts_getfilecachestat (hio_svc_htts_t* htts, hio_svc_htts_fcache_stat_t* stat)
+{
+	stat->count = htts->fcache.count;
+	stat->hits = htts->fcache.hits;
+	stat->misses = htts->fcache.misses;
+	stat->mem_count = htts->fcache.mem_count;
+	stat->mem_size = htts->fcache.mem_size;
+	stat->mem_hits = htts->fcache.mem_hits;
+	stat->mem_misses = htts->fcache.mem_misses;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int match_etag (file_t* file, const hio_bch_t* tag, hio_oow_t len)
+{
+	hio_oow_t elen = hio_count_bcstr(file->peer_etag);
+
+	if (len == elen && HIO_MEMCMP(tag, file->peer_etag, len) == 0) return 1;
+
+	/* the gzipped variant from the memory cache has -gz appended to the tag */
+	return len == elen + 3 && HIO_MEMCMP(tag, file->peer_etag, elen - 1) == 0 && HIO_MEMCMP(&tag[elen - 1], "-gz\"", 4) == 0;
+}
+
+static int match_etag_list (file_t* file, const hio_bch_t* list, int weak)
+{
+	/* the list is either * or a comma-separated list of entity tags. e.g. "abc", W/"def" */
+	const hio_bch_t* ptr = list;
+
+	while (*ptr != '\0')
+	{
+		const hio_bch_t* tag;
+		int is_weak = 0;
+
+		while (*ptr == ' ' || *ptr == '\t' || *ptr == ',') ptr++;
+		if (*ptr == '\0') break;
+
+		if (*ptr == '*') return 1;
+		if (ptr[0] == 'W' && ptr[1] == '/')
+		{
+			is_weak = 1;
+			ptr += 2;
+		}
+		if (*ptr != '"') return 0; /* malformed */
+
+		tag = ptr++;
+		while (*ptr != '\0' && *ptr != '"') ptr++;
+		if (*ptr == '\0') return 0; /* malformed */
+		ptr++;
+
+		/* the strong comparison fails if either tag is weak */
+		if ((weak || !is_weak) && match_etag(file, tag, ptr - tag)) return 1;
+	}
+
+	return 0;
+}
+
+static int if_range_matches (file_t* file, hio_htre_t* req)
+{
+	const hio_htre_hdrval_t* tmp;
+	hio_ntime_t t;
+
+	tmp = hio_htre_getheaderbyid(req, HIO_HTTP_HDR_IF_RANGE);
+	if (!tmp) return 1; /* no condition */
+
+	/* either an entity tag or a date. the strong comparison is required for both */
+	if (tmp->ptr[0] == '"' || (tmp->ptr[0] == 'W' && tmp->ptr[1] == '/')) return match_etag_list(file, tmp->ptr, 0);
+	return hio_parse_http_time_bcstr(tmp->ptr, &t) >= 0 && file->peer_mtime.sec == t.sec;
+}
 
-	tmp = hio_htre_getheaderval(req, "Range"); /* TODO: support multiple ranges? */
+static HIO_INLINE int process_range_header (file_t* file, hio_htre_t* req, int* error_status)
+{
+	const hio_htre_hdrval_t* tmp;
+	hio_foff_t file_size;
+
+	if (file->peer_fcent)
+	{
+		/* the cached attributes have been verified in fcache_get() */
+		file_size = file->peer_fcent->size;
+		file->peer_mtime = file->peer_fcent->mtime;
+		hio_copy_bcstr (file->peer_etag, HIO_COUNTOF(file->peer_etag), file->peer_fcent->etag);
+	}
+	else
+	{
+		struct stat st;
+
+		if (fstat(file->peer, &st) <= -1)
+		{
+			*error_status = ERRNO_TO_STATUS_CODE(errno);
+			return -1;
+		}
+
+		if ((st.st_mode & S_IFMT) != S_IFREG)
+		{
+			/* TODO: support directory listing if S_IFDIR? still disallow special files. */
+			*error_status = HIO_HTTP_STATUS_FORBIDDEN;
+			return -1;
+		}
+
+		file_size = st.st_size;
+		get_stat_mtime (&st, &file->peer_mtime);
+		make_etag (file->peer_etag, HIO_COUNTOF(file->peer_etag), &st);
+	}
+
+	if (file->task_req_method == HIO_HTTP_GET || file->task_req_method == HIO_HTTP_HEAD)
+	{
+		/* If-Modified-Since is ignored if If-None-Match is present */
+		tmp = hio_htre_getheaderbyid(req, HIO_HTTP_HDR_IF_NONE_MATCH);
+		if (tmp)
+		{
+			for (; tmp; tmp = tmp->next)
+			{
+				if (match_etag_list(file, tmp->ptr, 1)) { file->not_modified = 1; break; }
+			}
+		}
+		else
+		{
+			hio_ntime_t ims;
+			tmp = hio_htre_getheaderbyid(req, HIO_HTTP_HDR_IF_MODIFIED_SINCE);
+			if (tmp && hio_parse_http_time_bcstr(tmp->ptr, &ims) >= 0 && file->peer_mtime.sec <= ims.sec) file->not_modified = 1;
+		}
+	}
+
+	file->end_offset = file_size;
+
+	tmp = hio_htre_getheaderbyid(req, HIO_HTTP_HDR_RANGE);
+	if (tmp && !if_range_matches(file, req)) tmp = HIO_NULL; /* the whole representation if the validator doesn't match */
 	if (tmp)
 	{
-		hio_http_range_t range;
+		hio_http_range_t ranges[FILE_MAX_RANGES];
+		file_range_t fr[FILE_MAX_RANGES];
+		hio_oow_t i, j, nfr = 0;
+		int n;
 
-		if (hio_parse_http_range_bcstr(tmp->ptr, &range) <= -1)
+		n = hio_parse_http_ranges_bcstr(tmp->ptr, ranges, HIO_COUNTOF(ranges));
+		if (n <= -1)
 		{
 		range_not_satisifiable:
 			*error_status = HIO_HTTP_STATUS_RANGE_NOT_SATISFIABLE;
 			return -1;
 		}
+		if (n > HIO_COUNTOF(ranges)) goto whole_file; /* too many ranges. ignore the header */
 
-		switch (range.type)
+		/* convert the ranges to offsets dropping unsatisfiable ones */
+		for (i = 0; i < n; i++)
 		{
-			case HIO_HTTP_RANGE_PROPER:
-				/* Range XXXX-YYYY */
-				if (range.to >= st.st_size) goto range_not_satisifiable;
-				file->start_offset = range.from;
-				file->end_offset = range.to;
-				break;
+			switch (ranges[i].type)
+			{
+				case HIO_HTTP_RANGE_PROPER:
+					/* Range XXXX-YYYY */
+					if (ranges[i].from >= file_size) continue;
+					fr[nfr].from = ranges[i].from;
+					fr[nfr].to = (ranges[i].to >= file_size)? (file_size - 1): ranges[i].to;
+					break;
+
+				case HIO_HTTP_RANGE_PREFIX:
+					/* Range: XXXX- */
+					if (ranges[i].from >= file_size) continue;
+					fr[nfr].from = ranges[i].from;
+					fr[nfr].to = file_size - 1;
+					break;
+
+				case HIO_HTTP_RANGE_SUFFIX:
+					/* Range: -XXXX */
+					if (ranges[i].to <= 0 || file_size <= 0) continue;
+					fr[nfr].from = (ranges[i].to >= file_size)? 0: (file_size - ranges[i].to);
+					fr[nfr].to = file_size - 1;
+					break;
+			}
 
-			case HIO_HTTP_RANGE_PREFIX:
-				/* Range: XXXX- */
-				if (range.from >= st.st_size) goto range_not_satisifiable;
-				file->start_offset = range.from;
-				file->end_offset = st.st_size - 1;
-				break;
+			/* keep them sorted by the starting offset */
+			for (j = nfr; j > 0 && fr[j - 1].from > fr[j].from; j--)
+			{
+				file_range_t t = fr[j - 1];
+				fr[j - 1] = fr[j];
+				fr[j] = t;
+			}
+			nfr++;
+		}
+		if (nfr <= 0) goto range_not_satisifiable;
 
-			case HIO_HTTP_RANGE_SUFFIX:
-				/* Range: -XXXX */
-				if (range.to >= st.st_size) goto range_not_satisifiable;
-				file->start_offset = st.st_size - range.to;
-				file->end_offset = st.st_size - 1;
-				break;
+		/* coalesce overlapping or adjacent ranges */
+		for (i = 0, j = 1; j < nfr; j++)
+		{
+			if (fr[j].from <= fr[i].to + 1)
+			{
+				if (fr[j].to > fr[i].to) fr[i].to = fr[j].to;
+			}
+			else fr[++i] = fr[j];
 		}
+		nfr = i + 1;
+
+		file->start_offset = fr[0].from;
+		file->end_offset = fr[0].to;
 
-		if (file->start_offset > 0)
+		if (nfr > 1)
 		{
+			/* multipart/byteranges */
+			file->mrange = (file_mrange_t*)hio_callocmem(file->htts->hio, HIO_SIZEOF(*file->mrange));
+			if (HIO_UNLIKELY(!file->mrange))
+			{
+				*error_status = HIO_HTTP_STATUS_INTERNAL_SERVER_ERROR;
+				return -1;
+			}
+			file->mrange->count = nfr;
+			HIO_MEMCPY (file->mrange->r, fr, nfr * HIO_SIZEOF(fr[0]));
+			hio_fmttobcstr (file->htts->hio, file->mrange->boundary, HIO_COUNTOF(file->mrange->boundary), "hio-%zx-%zx", (hio_oow_t)file, (hio_oow_t)file->peer_mtime.nsec);
+		}
+		else if (file->start_offset > 0 && !file->peer_fcent)
+		{
+			/* a descriptor shared via the cache is read with pread(). no seek needed */
 			if (lseek(file->peer, file->start_offset, SEEK_SET) <= -1)
 			{
 				*error_status = ERRNO_TO_STATUS_CODE(errno);
@@ -581,18 +1333,51 @@ static HIO_INLINE int process_range_header (file_t* file, hio_htre_t* req, int*
 	}
 	else
 	{
+	whole_file:
 		file->start_offset = 0;
-		file->end_offset = st.st_size - 1;
+		file->end_offset = file_size - 1;
 	}
 
 	file->cur_offset = file->start_offset;
-	file->total_size = st.st_size;
+	file->total_size = file_size;
 	return 0;
 }
 
+static const hio_bch_t* get_peer_mime_type (file_t* file, const hio_bch_t* actual_file)
+{
+	if (file->cbs && file->cbs->get_mime_type)
+		return file->cbs->get_mime_type(file->htts, file->task_req_qpath, actual_file, file->cbs->ctx);
+	return HIO_NULL;
+}
+
 static int open_peer_with_mode (file_t* file, const hio_bch_t* actual_file, int flags, int* error_status, const hio_bch_t** res_mime_type)
 {
 	struct stat st;
+	int for_read, cacheable, st_ok;
+
+	for_read = ((flags & O_ACCMODE) == O_RDONLY);
+	cacheable = for_read && file->htts->option.file_cache_max > 0;
+
+	if (cacheable)
+	{
+		file->peer_fcent = fcache_get(file->htts, actual_file);
+		if (!file->peer_fcent)
+		{
+			file->htts->fcache.misses++;
+		}
+		else
+		{
+			file->htts->fcache.hits++;
+			file->peer = file->peer_fcent->fd;
+			if (res_mime_type)
+			{
+				const hio_bch_t* mime_type;
+				mime_type = file->peer_fcent->mime_type? file->peer_fcent->mime_type: get_peer_mime_type(file, actual_file);
+				if (mime_type) *res_mime_type = mime_type;
+			}
+			return 0;
+		}
+	}
 
 	flags |= O_NONBLOCK;
 #if defined(O_CLOEXEC)
@@ -609,8 +1394,8 @@ static int open_peer_with_mode (file_t* file, const hio_bch_t* actual_file, int
 		return -1;
 	}
 
-	if (((flags | O_RDONLY) && fstat(file->peer, &st) >= 0 && S_ISDIR(st.st_mode)) && /* only for read operation */
-	    (file->cbs && file->cbs->open_dir_list)) /* directory listing is enabled */
+	st_ok = for_read && fstat(file->peer, &st) >= 0; /* only for read operation */
+	if ((st_ok && S_ISDIR(st.st_mode)) && (file->cbs && file->cbs->open_dir_list)) /* directory listing is enabled */
 	{
 		int alt_fd;
 
@@ -631,17 +1416,73 @@ static int open_peer_with_mode (file_t* file, const hio_bch_t* actual_file, int
 	}
 	else
 	{
-		if (res_mime_type && file->cbs && file->cbs->get_mime_type)
+		const hio_bch_t* mime_type = HIO_NULL;
+
+		if (res_mime_type)
 		{
-			const hio_bch_t* mime_type;
-			mime_type = file->cbs->get_mime_type(file->htts, file->task_req_qpath, actual_file, file->cbs->ctx);
+			mime_type = get_peer_mime_type(file, actual_file);
 			if (mime_type) *res_mime_type = mime_type;
 		}
+
+		if (cacheable && st_ok && S_ISREG(st.st_mode))
+		{
+			/* keep going without caching upon failure */
+			file->peer_fcent = fcache_put(file->htts, actual_file, file->peer, &st, mime_type);
+		}
 	}
 
 	return 0;
 }
 
+static int open_peer_precompressed (file_t* file, const hio_bch_t* actual_file)
+{
+	static struct
+	{
+		const hio_bch_t* ext;
+		const hio_bch_t* coding;
+	} encs[] =
+	{
+		{ ".br", "br" },
+		{ ".gz", "gzip" }
+	};
+	hio_oow_t i;
+
+	for (i = 0; i < HIO_COUNTOF(encs); i++)
+	{
+		const hio_bch_t* parts[3];
+		hio_bch_t* path;
+		int status_code, n;
+
+		if (i == 0 && !file->task_req_accept_br) continue;
+		if (i == 1 && !file->task_req_accept_gzip) continue;
+
+		parts[0] = actual_file;
+		parts[1] = encs[i].ext;
+		parts[2] = HIO_NULL;
+		path = hio_dupbcstrs(file->htts->hio, parts, HIO_NULL);
+		if (HIO_UNLIKELY(!path)) return -1;
+		n = open_peer_with_mode(file, path, O_RDONLY, &status_code, HIO_NULL);
+		hio_freemem (file->htts->hio, path);
+		if (n <= -1) continue;
+
+		if (!file->peer_fcent)
+		{
+			struct stat st;
+			if (fstat(file->peer, &st) <= -1 || !S_ISREG(st.st_mode))
+			{
+				close (file->peer);
+				file->peer = -1;
+				continue;
+			}
+		}
+
+		file->content_encoding = encs[i].coding;
+		return 0;
+	}
+
+	return -1;
+}
+
 /* ----------------------------------------------------------------------- */
 
 static void bind_task_to_client (file_t* file, hio_dev_sck_t* csck)
@@ -737,15 +1578,35 @@ static int bind_task_to_peer (file_t* file, hio_htre_t* req, const hio_bch_t* fi
 		{
 			const hio_bch_t* actual_mime_type = mime_type;
 
-			if (open_peer_with_mode(file, file_path, O_RDONLY, &status_code, (mime_type? HIO_NULL: &actual_mime_type)) <= -1 ||
-			    process_range_header(file, req, &status_code) <= -1) goto oops_with_status_code;
+			if ((file->options & HIO_SVC_HTTS_FILE_PRECOMPRESSED) && !file->task_req_qpath_ending_with_slash &&
+			    open_peer_precompressed(file, file_path) >= 0)
+			{
+				/* the mime type must be of the original file */
+				if (!mime_type) actual_mime_type = get_peer_mime_type(file, file_path);
+			}
+			else if (open_peer_with_mode(file, file_path, O_RDONLY, &status_code, (mime_type? HIO_NULL: &actual_mime_type)) <= -1) goto oops_with_status_code;
+
+			if (process_range_header(file, req, &status_code) <= -1) goto oops_with_status_code;
 
-			if (HIO_LIKELY(file->task_req_method == HIO_HTTP_GET))
+			if (file->not_modified)
+			{
+				if (file_send_not_modified_to_client(file, actual_mime_type) <= -1) goto oops;
+				file_mark_over (file, FILE_OVER_READ_FROM_PEER);
+			}
+			else if (HIO_LIKELY(file->task_req_method == HIO_HTTP_GET))
 			{
-				if (file->etag_match)
+
+				if (file_can_use_memcache(file))
 				{
-					status_code = HIO_HTTP_STATUS_NOT_MODIFIED;
-					goto oops_with_status_code;
+					int var = HIO_SVC_HTTS_FCENT_MEM_IDENTITY;
+				#if defined(HAVE_ZLIB)
+					if (file->task_req_accept_gzip && !file->content_encoding && file->htts->option.res_compress_min > 0 &&
+					    file->total_size >= file->htts->option.res_compress_min && actual_mime_type &&
+					    hio_svc_htts_iscompressibletype(actual_mime_type, hio_count_bcstr(actual_mime_type))) var = HIO_SVC_HTTS_FCENT_MEM_GZIP;
+				#endif
+					if (file_send_memcached_res_to_client(file, actual_mime_type, var) <= -1) goto oops;
+					if (file_send_contents_to_client(file) <= -1) goto oops;
+					break;
 				}
 
 				/* normal full transfer */
@@ -763,7 +1624,7 @@ static int bind_task_to_peer (file_t* file, hio_htre_t* req, const hio_bch_t* fi
 			{
 				if (file_send_header_to_client(file, HIO_HTTP_STATUS_OK, 0, actual_mime_type) <= -1) goto oops;
 				/* no content must be transmitted for HEAD despite Content-Length in the header. */
-				goto oops_with_status_code_2;
+				file_mark_over (file, FILE_OVER_READ_FROM_PEER);
 			}
 			break;
 		}
@@ -776,6 +1637,7 @@ static int bind_task_to_peer (file_t* file, hio_htre_t* req, const hio_bch_t* fi
 				goto oops_with_status_code;
 			}
 
+			fcache_drop (file->htts, file_path);
 			if (open_peer_with_mode(file, file_path, O_WRONLY | O_TRUNC | O_CREAT, &status_code, HIO_NULL) <= -1) goto oops_with_status_code;
 
 			/* the client input must be written to the peer side */
@@ -789,6 +1651,7 @@ static int bind_task_to_peer (file_t* file, hio_htre_t* req, const hio_bch_t* fi
 				goto oops_with_status_code;
 			}
 
+			fcache_drop (file->htts, file_path);
 			if (unlink(file_path) <= -1)
 			{
 				if (errno != EISDIR || (errno == EISDIR && rmdir(file_path) <= -1))
@@ -814,7 +1677,6 @@ static int bind_task_to_peer (file_t* file, hio_htre_t* req, const hio_bch_t* fi
 	 * completed or it can't proceed for various reasons */
 oops_with_status_code:
 	hio_svc_htts_task_sendfinalres((hio_svc_htts_task_t*)file, status_code, HIO_NULL, HIO_NULL, 0);
-oops_with_status_code_2:
 	file_mark_over (file, FILE_OVER_READ_FROM_PEER | FILE_OVER_WRITE_TO_PEER);
 oops:
 	return -1;
@@ -834,7 +1696,16 @@ static void unbind_task_from_peer (file_t* file, int rcdown)
 
 	if (file->peer >= 0)
 	{
-		close (file->peer);
+		if (file->peer_fcent)
+		{
+			/* the descriptor gets closed when the last reference is gone */
+			fcent_release (htts, file->peer_fcent);
+			file->peer_fcent = HIO_NULL;
+		}
+		else
+		{
+			close (file->peer);
+		}
 		file->peer = -1;
 		n++;
 	}
@@ -909,12 +1780,14 @@ int hio_svc_htts_dofile (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t*
 
 	file = (file_t*)hio_svc_htts_task_make(htts, HIO_SIZEOF(*file), file_on_kill, req, csck);
 	if (HIO_UNLIKELY(!file)) goto oops;
+	HIO_SVC_HTTS_STAT_INC (htts, task_file);
 	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)file); /* for temporary protection */
 
 	actual_file = hio_svc_htts_dupmergepaths(htts, docroot, filepath);
 	if (HIO_UNLIKELY(!actual_file)) goto oops;
 
 	file->options = options;
+	file->task_res_no_compress = 1; /* the file task handles compression by itself */
 	file->cbs = cbs; /* the given pointer must outlive the lifespan of the while file handling cycle. */
 	file->sendfile_ok = hio_dev_sck_sendfileok(csck);
 	file->peer_tmridx = HIO_TMRIDX_INVALID;
@@ -945,9 +1818,10 @@ oops:
 	HIO_DEBUG2 (hio, "HTTS(%p) - file(c=%d) failure\n", htts, csck->hnd);
 	if (file)
 	{
-		hio_svc_htts_task_sendfinalres((hio_svc_htts_task_t*)file, status_code, HIO_NULL, HIO_NULL, 1);
-		if (bound_to_peer) unbind_task_from_peer (file, 0);
-		if (bound_to_client) unbind_task_from_client (file, 0);
+		/* bind_task_to_peer() sends the response itself for an error status */
+		if (!file->task_res_ever_sent) hio_svc_htts_task_sendfinalres((hio_svc_htts_task_t*)file, status_code, HIO_NULL, HIO_NULL, 1);
+		if (bound_to_peer) unbind_task_from_peer (file, 1);
+		if (bound_to_client) unbind_task_from_client (file, 1);
 		file_halt_participating_devices (file);
 		if (actual_file) hio_freemem (hio, actual_file);
 		HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)file);
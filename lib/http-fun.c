@@ -0,0 +1,484 @@
+/*
+    Copyright (c) 2016-2020 Chung, Hyung-Hwan. All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+    IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+    NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+    THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "http-prv.h"
+
+#define FUN_OVER_READ_FROM_CLIENT (1 << 0)
+#define FUN_OVER_WRITE_TO_CLIENT  (1 << 1)
+#define FUN_OVER_ALL (FUN_OVER_READ_FROM_CLIENT | FUN_OVER_WRITE_TO_CLIENT)
+
+struct fun_t
+{
+	HIO_SVC_HTTS_TASK_HEADER;
+
+	hio_svc_htts_task_on_kill_t on_kill; /* user-provided on_kill callback */
+
+	int options;
+	hio_svc_htts_fun_func_t func;
+	void* ctx;
+
+	unsigned int over: 2; /* must be large enough to accomodate FUN_OVER_ALL */
+	unsigned int client_htrd_recbs_changed: 1;
+	unsigned int req_body_streaming: 1; /* the function has been called before the body ends */
+
+	hio_dev_sck_on_read_t client_org_on_read;
+	hio_dev_sck_on_write_t client_org_on_write;
+	hio_dev_sck_on_disconnect_t client_org_on_disconnect;
+	hio_htrd_recbs_t client_htrd_org_recbs;
+};
+typedef struct fun_t fun_t;
+
+static void unbind_task_from_client (fun_t* fun, int rcdown);
+
+static void fun_halt_participating_devices (fun_t* fun)
+{
+	HIO_DEBUG3 (fun->htts->hio, "HTTS(%p) - Halting participating devices in fun state %p(client=%p)\n", fun->htts, fun, fun->task_csck);
+	if (fun->task_csck) hio_dev_sck_halt (fun->task_csck);
+}
+
+static HIO_INLINE void fun_mark_over (fun_t* fun, int over_bits)
+{
+	unsigned int old_over;
+
+	old_over = fun->over;
+	fun->over |= over_bits;
+
+	HIO_DEBUG4 (fun->htts->hio, "HTTS(%p) - client=%p new-bits=%x over=%x\n", fun->htts, fun->task_csck, (int)over_bits, (int)fun->over);
+
+	if (!(old_over & FUN_OVER_READ_FROM_CLIENT) && (fun->over & FUN_OVER_READ_FROM_CLIENT))
+	{
+		if (fun->task_csck && hio_dev_sck_read(fun->task_csck, 0) <= -1)
+		{
+			HIO_DEBUG2 (fun->htts->hio, "HTTS(%p) - halting client(%p) for failure to disable input watching\n", fun->htts, fun->task_csck);
+			hio_dev_sck_halt (fun->task_csck);
+		}
+	}
+
+	if (old_over != FUN_OVER_ALL && fun->over == FUN_OVER_ALL && fun->task_csck)
+	{
+		/* ready to stop */
+		if (fun->task_keep_client_alive)
+		{
+			HIO_ASSERT (fun->htts->hio, fun->task_client->task == (hio_svc_htts_task_t*)fun);
+			unbind_task_from_client (fun, 1);
+		}
+		else
+		{
+			HIO_DEBUG2 (fun->htts->hio, "HTTS(%p) - halting client(%p) for no keep-alive\n", fun->htts, fun->task_csck);
+			hio_dev_sck_shutdown (fun->task_csck, HIO_DEV_SCK_SHUTDOWN_WRITE);
+			hio_dev_sck_halt (fun->task_csck);
+		}
+	}
+}
+
+static void fun_on_kill (hio_svc_htts_task_t* task)
+{
+	fun_t* fun = (fun_t*)task;
+	hio_t* hio = fun->htts->hio;
+
+	HIO_DEBUG2 (hio, "HTTS(%p) - killing fun client(%p)\n", fun->htts, fun->task_csck);
+
+	if (fun->on_kill) fun->on_kill (task);
+
+	if (fun->task_csck)
+	{
+		HIO_ASSERT (hio, fun->task_client != HIO_NULL);
+		unbind_task_from_client (fun, 0);
+	}
+
+	if (fun->task_next) HIO_SVC_HTTS_TASKL_UNLINK_TASK (fun); /* detach from the htts service only if it's attached */
+}
+
+static void fun_send_error (fun_t* fun)
+{
+	if (fun->task_res_started)
+	{
+		/* the response can't be fixed once it has started */
+		fun_halt_participating_devices (fun);
+	}
+	else
+	{
+		fun->task_keep_client_alive = 0;
+		fun->task_res_ended = 1;
+		if (hio_svc_htts_task_sendfinalres((hio_svc_htts_task_t*)fun, HIO_HTTP_STATUS_INTERNAL_SERVER_ERROR, HIO_NULL, HIO_NULL, 1) <= -1)
+			fun_halt_participating_devices (fun);
+	}
+}
+
+static void fun_end_read (fun_t* fun)
+{
+	fun_mark_over (fun, FUN_OVER_READ_FROM_CLIENT);
+
+	/* the function may have ended the response without any pending
+	 * writes if the client is gone. otherwise, the write completion
+	 * handler marks it over */
+	if (fun->task_res_ended && fun->task_res_pending_writes <= 0) fun_mark_over (fun, FUN_OVER_WRITE_TO_CLIENT);
+}
+
+static void fun_call_func (fun_t* fun, hio_htre_t* req)
+{
+	int n;
+
+	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)fun);
+
+	n = fun->func(fun->htts, (hio_svc_htts_task_t*)fun, req, fun->ctx);
+	if (n <= -1)
+	{
+		HIO_DEBUG2 (fun->htts->hio, "HTTS(%p) - function failure on client(%p)\n", fun->htts, fun->task_csck);
+		if (fun->req_body_streaming)
+		{
+			/* stop feeding the body to the function that has failed */
+			hio_htre_unsetconcb (req);
+			fun->req_body_streaming = 0;
+		}
+		fun_send_error (fun);
+	}
+
+	/* the client is read on until the body ends in the streaming mode */
+	if (!fun->req_body_streaming) fun_end_read (fun);
+
+	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)fun);
+}
+
+static void fun_on_req_body_end (hio_svc_htts_task_t* task, int status)
+{
+	fun_t* fun = (fun_t*)task;
+
+	/* the task is killed before the writer ends if the client is gone */
+	HIO_ASSERT (fun->htts->hio, fun->task_client != HIO_NULL);
+
+	if (status <= -1)
+	{
+		HIO_SVC_HTTS_TASK_RCUP (task);
+		fun_send_error (fun);
+		fun_end_read (fun);
+		HIO_SVC_HTTS_TASK_RCDOWN (task);
+	}
+	else
+	{
+		fun_call_func (fun, &fun->task_client->htrd->re);
+	}
+}
+
+static int fun_client_htrd_poke (hio_htrd_t* htrd, hio_htre_t* req)
+{
+	/* client request got completed. the contents have been accumulated
+	 * in the request or in a temporary file by fun_client_htrd_push_content() */
+	hio_svc_htts_cli_htrd_xtn_t* htrdxtn = (hio_svc_htts_cli_htrd_xtn_t*)hio_htrd_getxtn(htrd);
+	hio_dev_sck_t* sck = htrdxtn->sck;
+	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(sck);
+	fun_t* fun = (fun_t*)cli->task;
+	int n;
+
+	if (fun->req_body_streaming)
+	{
+		/* the end of the body has been passed to the content callback */
+		hio_htre_unsetconcb (req);
+		fun->req_body_streaming = 0;
+		fun_end_read (fun);
+		return 0;
+	}
+
+	n = hio_svc_htts_task_endreqbody((hio_svc_htts_task_t*)fun, fun_on_req_body_end);
+	if (n <= -1)
+	{
+		HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)fun);
+		fun_send_error (fun);
+		fun_end_read (fun);
+		HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)fun);
+	}
+	else if (n == 0)
+	{
+		/* the writer thread is still busy with the temporary file.
+		 * fun_on_req_body_end() calls the function later */
+		fun_mark_over (fun, FUN_OVER_READ_FROM_CLIENT);
+	}
+	else
+	{
+		fun_call_func (fun, req);
+	}
+	return 0;
+}
+
+static int fun_client_htrd_push_content (hio_htrd_t* htrd, hio_htre_t* req, const hio_bch_t* data, hio_oow_t dlen)
+{
+	hio_svc_htts_cli_htrd_xtn_t* htrdxtn = (hio_svc_htts_cli_htrd_xtn_t*)hio_htrd_getxtn(htrd);
+	hio_dev_sck_t* sck = htrdxtn->sck;
+	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(sck);
+	fun_t* fun = (fun_t*)cli->task;
+
+	HIO_ASSERT (sck->hio, cli->sck == sck);
+	if (fun->req_body_streaming) return req->concb? hio_htre_addcontent(req, data, dlen): 0;
+	return hio_svc_htts_task_addreqbody((hio_svc_htts_task_t*)fun, req, data, dlen);
+}
+
+static hio_htrd_recbs_t fun_client_htrd_recbs =
+{
+	HIO_NULL,
+	fun_client_htrd_poke,
+	fun_client_htrd_push_content
+};
+
+static void fun_client_on_disconnect (hio_dev_sck_t* sck)
+{
+	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(sck);
+	fun_t* fun = (fun_t*)cli->task;
+
+	if (fun)
+	{
+		HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)fun);
+
+		unbind_task_from_client (fun, 1);
+
+		/* call the parent handler*/
+		/*if (fun->client_org_on_disconnect) fun->client_org_on_disconnect (sck);*/
+		if (sck->on_disconnect) sck->on_disconnect (sck); /* restored to the orginal parent handler in unbind_task_from_client() */
+
+		HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)fun);
+	}
+}
+
+static int fun_client_on_read (hio_dev_sck_t* sck, const void* buf, hio_iolen_t len, const hio_skad_t* srcaddr)
+{
+	hio_t* hio = sck->hio;
+	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(sck);
+	fun_t* fun = (fun_t*)cli->task;
+	int n;
+
+	HIO_ASSERT (hio, sck == cli->sck);
+
+	n = fun->client_org_on_read? fun->client_org_on_read(sck, buf, len, srcaddr): 0;
+
+	if (len <= -1)
+	{
+		/* read error */
+		HIO_DEBUG3 (hio, "HTTPS(%p) - read error on client %p(%d)\n", fun->htts, sck, (int)sck->hnd);
+		goto oops;
+	}
+
+	if (len == 0)
+	{
+		/* EOF on the client side. the function can't be called with a partial request */
+		HIO_DEBUG3 (hio, "HTTPS(%p) - EOF from client %p(hnd=%d)\n", fun->htts, sck, (int)sck->hnd);
+		if (!(fun->over & FUN_OVER_READ_FROM_CLIENT)) goto oops;
+	}
+
+	if (n <= -1) goto oops;
+	return 0;
+
+oops:
+	fun_halt_participating_devices (fun);
+	return 0;
+}
+
+static int fun_client_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrctx, const hio_skad_t* dstaddr)
+{
+	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(sck);
+	fun_t* fun = (fun_t*)cli->task;
+	int n;
+
+	n = fun->client_org_on_write? fun->client_org_on_write(sck, wrlen, wrctx, dstaddr): 0;
+
+	if (wrlen == 0)
+	{
+		fun_mark_over (fun, FUN_OVER_WRITE_TO_CLIENT);
+	}
+	else if (wrlen > 0)
+	{
+		/* the response may still be streamed by the function */
+		if (fun->task_res_ended && fun->task_res_pending_writes <= 0)
+			fun_mark_over (fun, FUN_OVER_WRITE_TO_CLIENT);
+	}
+
+	if (n <= -1 || wrlen <= -1) fun_halt_participating_devices (fun);
+	return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void bind_task_to_client (fun_t* fun, hio_dev_sck_t* csck)
+{
+	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(csck);
+
+	HIO_ASSERT (fun->htts->hio, cli->sck == csck);
+	HIO_ASSERT (fun->htts->hio, cli->task == HIO_NULL);
+
+	/* fun->task_client and fun->task_csck are set in hio_svc_htts_task_make() */
+
+	/* remember the client socket's io event handlers */
+	fun->client_org_on_read = csck->on_read;
+	fun->client_org_on_write = csck->on_write;
+	fun->client_org_on_disconnect = csck->on_disconnect;
+
+	/* set new io events handlers on the client socket */
+	csck->on_read = fun_client_on_read;
+	csck->on_write = fun_client_on_write;
+	csck->on_disconnect = fun_client_on_disconnect;
+
+	cli->task = (hio_svc_htts_task_t*)fun;
+	HIO_SVC_HTTS_TASK_RCUP (fun);
+}
+
+static void unbind_task_from_client (fun_t* fun, int rcdown)
+{
+	hio_dev_sck_t* csck = fun->task_csck;
+	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(csck);
+
+	if (cli->task) /* only if it's bound */
+	{
+		HIO_ASSERT (fun->htts->hio, fun->task_client != HIO_NULL);
+		HIO_ASSERT (fun->htts->hio, fun->task_csck != HIO_NULL);
+		HIO_ASSERT (fun->htts->hio, fun->task_client->task == (hio_svc_htts_task_t*)fun);
+		HIO_ASSERT (fun->htts->hio, fun->task_client->htrd != HIO_NULL);
+
+		if (fun->req_body_streaming)
+		{
+			/* the content callback set by the function must not outlive the task */
+			hio_htre_unsetconcb (&fun->task_client->htrd->re);
+			fun->req_body_streaming = 0;
+		}
+
+		if (fun->client_htrd_recbs_changed)
+		{
+			hio_htrd_setrecbs (fun->task_client->htrd, &fun->client_htrd_org_recbs);
+			fun->client_htrd_recbs_changed = 0;
+		}
+
+		if (fun->client_org_on_read)
+		{
+			csck->on_read = fun->client_org_on_read;
+			fun->client_org_on_read = HIO_NULL;
+		}
+
+		if (fun->client_org_on_write)
+		{
+			csck->on_write = fun->client_org_on_write;
+			fun->client_org_on_write = HIO_NULL;
+		}
+
+		if (fun->client_org_on_disconnect)
+		{
+			csck->on_disconnect = fun->client_org_on_disconnect;
+			fun->client_org_on_disconnect = HIO_NULL;
+		}
+
+		/* there is some ordering issue in using HIO_SVC_HTTS_TASK_UNREF()
+		* because it can destroy the fun itself. so reset fun->task_client->task
+		* to null and call RCDOWN() later */
+		fun->task_client->task = HIO_NULL;
+
+		/* these two lines are also done in csck_on_disconnect() in http-svr.c because the socket is destroyed.
+		* the same lines here are because the task is unbound while the socket is still alive */
+		fun->task_client = HIO_NULL;
+		fun->task_csck = HIO_NULL;
+
+		/* enable input watching on the socket being unbound */
+		if (fun->task_keep_client_alive && hio_dev_sck_read(csck, 1) <= -1)
+		{
+			HIO_DEBUG2 (fun->htts->hio, "HTTS(%p) - halting client(%p) for failure to enable input watching\n", fun->htts, csck);
+			hio_dev_sck_halt (csck);
+		}
+
+		if (rcdown) HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)fun);
+	}
+}
+
+/* ----------------------------------------------------------------------- */
+
+int hio_svc_htts_dofun (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* req, hio_svc_htts_fun_func_t func, void* ctx, int options, hio_svc_htts_task_on_kill_t on_kill)
+{
+	hio_t* hio = htts->hio;
+	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(csck);
+	fun_t* fun = HIO_NULL;
+	int status_code = HIO_HTTP_STATUS_INTERNAL_SERVER_ERROR;
+	int bound_to_client = 0;
+	int have_content;
+
+	/* ensure that you call this function before any contents is received */
+	HIO_ASSERT (hio, hio_htre_getcontentlen(req) == 0);
+	HIO_ASSERT (hio, cli->sck == csck);
+
+	if (cli->task)
+	{
+		hio_seterrbfmt (hio, HIO_EPERM, "duplicate task request prohibited");
+		goto oops;
+	}
+
+	fun = (fun_t*)hio_svc_htts_task_make(htts, HIO_SIZEOF(*fun), fun_on_kill, req, csck);
+	if (HIO_UNLIKELY(!fun)) goto oops;
+	HIO_SVC_HTTS_STAT_INC (htts, task_fun);
+	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)fun);
+
+	fun->options = options;
+	fun->func = func;
+	fun->ctx = ctx;
+
+	bind_task_to_client (fun, csck);
+	bound_to_client = 1;
+
+	if (hio_svc_htts_task_handleexpect100((hio_svc_htts_task_t*)fun, 0) <= -1) goto oops;
+
+	have_content = fun->task_req_conlen > 0 || fun->task_req_conlen_unlimited;
+	if (have_content)
+	{
+		/* the function is called in the poke callback when the whole
+		 * request including the contents has been received */
+		fun->client_htrd_org_recbs = *hio_htrd_getrecbs(fun->task_client->htrd);
+		fun_client_htrd_recbs.peek = fun->client_htrd_org_recbs.peek;
+		hio_htrd_setrecbs (fun->task_client->htrd, &fun_client_htrd_recbs);
+		fun->client_htrd_recbs_changed = 1;
+	}
+
+	if (hio_dev_sck_read(csck, have_content) <= -1) goto oops;
+
+	HIO_SVC_HTTS_TASKL_APPEND_TASK (&htts->task, (hio_svc_htts_task_t*)fun);
+
+	/* set the on_kill callback only if this function can return success.
+	 * the on_kill callback won't be executed if this function returns failure. */
+	fun->on_kill = on_kill;
+
+	/* without contents, the function can be called right now. the poke
+	 * callback can't be relied on as the request parser may wait for
+	 * the connection to close for a HTTP/1.0 request without Content-Length.
+	 * in the streaming mode, the body is passed to the function as it arrives */
+	if (!have_content) fun_call_func (fun, req);
+	else if (options & HIO_SVC_HTTS_FUN_STREAM_REQ_BODY)
+	{
+		fun->req_body_streaming = 1;
+		fun_call_func (fun, req);
+	}
+
+	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)fun);
+	return 0;
+
+oops:
+	HIO_DEBUG2 (hio, "HTTS(%p) - FAILURE in dofun - socket(%p)\n", htts, csck);
+	if (fun)
+	{
+		hio_svc_htts_task_sendfinalres((hio_svc_htts_task_t*)fun, status_code, HIO_NULL, HIO_NULL, 1);
+		if (bound_to_client) unbind_task_from_client (fun, 1);
+		fun_halt_participating_devices (fun);
+		HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)fun);
+	}
+	return -1;
+}
@@ -0,0 +1,162 @@
+/*
+    Copyright (c) 2016-2020 Chung, Hyung-Hwan. All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+    IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+    NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+    THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "http-prv.h"
+#include <hio-fmt.h>
+#include <hio-spl.h>
+
+/* all htts services in the process for hio_svc_htts_getallstat().
+ * the lock guards the list only. the counters are read without it
+ * using relaxed atomic loads. see HIO_SVC_HTTS_STAT_INC() */
+static hio_spl_t all_htts_spl = HIO_SPL_INIT;
+static hio_svc_htts_t* all_htts = HIO_NULL;
+
+void hio_svc_htts_linkstat (hio_svc_htts_t* htts)
+{
+	hio_spl_lock (&all_htts_spl);
+	htts->stat.prev = HIO_NULL;
+	htts->stat.next = all_htts;
+	if (all_htts) all_htts->stat.prev = htts;
+	all_htts = htts;
+	hio_spl_unlock (&all_htts_spl);
+}
+
+void hio_svc_htts_unlinkstat (hio_svc_htts_t* htts)
+{
+	hio_spl_lock (&all_htts_spl);
+	if (htts->stat.prev) htts->stat.prev->stat.next = htts->stat.next;
+	else all_htts = htts->stat.next;
+	if (htts->stat.next) htts->stat.next->stat.prev = htts->stat.prev;
+	hio_spl_unlock (&all_htts_spl);
+}
+
+void hio_svc_htts_getstat (hio_svc_htts_t* htts, hio_svc_htts_stat_t* stat)
+{
+	stat->clients = HIO_SVC_HTTS_STAT_GET(htts, clients);
+	stat->task_file = HIO_SVC_HTTS_STAT_GET(htts, task_file);
+	stat->task_cgi = HIO_SVC_HTTS_STAT_GET(htts, task_cgi);
+	stat->task_fcgi = HIO_SVC_HTTS_STAT_GET(htts, task_fcgi);
+	stat->task_prxy = HIO_SVC_HTTS_STAT_GET(htts, task_prxy);
+	stat->task_thr = HIO_SVC_HTTS_STAT_GET(htts, task_thr);
+	stat->task_fun = HIO_SVC_HTTS_STAT_GET(htts, task_fun);
+	stat->task_txt = HIO_SVC_HTTS_STAT_GET(htts, task_txt);
+#if defined(HCL_ATOMIC_LOAD)
+	stat->tasks = HCL_ATOMIC_LOAD(&htts->stat.ntasks);
+#else
+	hio_spl_lock (&htts->stat.spl_ntasks);
+	stat->tasks = htts->stat.ntasks;
+	hio_spl_unlock (&htts->stat.spl_ntasks);
+#endif
+}
+
+hio_oow_t hio_svc_htts_getallstat (hio_svc_htts_stat_t* stat)
+{
+	hio_svc_htts_t* htts;
+	hio_oow_t count = 0;
+
+	HIO_MEMSET (stat, 0, HIO_SIZEOF(*stat));
+
+	hio_spl_lock (&all_htts_spl);
+	for (htts = all_htts; htts; htts = htts->stat.next)
+	{
+		hio_svc_htts_stat_t s;
+
+		hio_svc_htts_getstat (htts, &s);
+		stat->clients += s.clients;
+		stat->tasks += s.tasks;
+		stat->task_file += s.task_file;
+		stat->task_cgi += s.task_cgi;
+		stat->task_fcgi += s.task_fcgi;
+		stat->task_prxy += s.task_prxy;
+		stat->task_thr += s.task_thr;
+		stat->task_fun += s.task_fun;
+		stat->task_txt += s.task_txt;
+		count++;
+	}
+	hio_spl_unlock (&all_htts_spl);
+
+	return count;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int add_metric (hio_becs_t* buf, const hio_bch_t* name, const hio_bch_t* type, const hio_bch_t* help, hio_uintmax_t value)
+{
+	if (hio_becs_fcat(buf, "# HELP %hs %hs\n# TYPE %hs %hs\n", name, help, name, type) == (hio_oow_t)-1 ||
+	    hio_becs_fcat(buf, "%hs %ju\n", name, value) == (hio_oow_t)-1) return -1;
+	return 0;
+}
+
+static int add_time_metric (hio_becs_t* buf, const hio_bch_t* name, const hio_bch_t* help, const hio_ntime_t* value)
+{
+	if (hio_becs_fcat(buf, "# HELP %hs %hs\n# TYPE %hs counter\n", name, help, name) == (hio_oow_t)-1 ||
+	    hio_becs_fcat(buf, "%hs %zd.%06d\n", name, (hio_ooi_t)value->sec, (int)(value->nsec / 1000)) == (hio_oow_t)-1) return -1;
+	return 0;
+}
+
+static int add_task_metric (hio_becs_t* buf, const hio_bch_t* type, hio_oow_t value)
+{
+	return hio_becs_fcat(buf, "hio_htts_tasks_total{type=\"%hs\"} %zu\n", type, value) == (hio_oow_t)-1? -1: 0;
+}
+
+static int format_metrics (hio_becs_t* buf)
+{
+	hio_stat_t s;
+	hio_svc_htts_stat_t hs;
+	hio_oow_t nloops, nhtts;
+
+	nloops = hio_getallstat(&s);
+	nhtts = hio_svc_htts_getallstat(&hs);
+
+	hio_becs_clear (buf);
+	if (add_metric(buf, "hio_loops", "gauge", "Number of event loops.", nloops) <= -1 ||
+	    add_metric(buf, "hio_accepts_total", "counter", "Connections accepted.", s.accepts) <= -1 ||
+	    add_metric(buf, "hio_read_bytes_total", "counter", "Octets read from devices.", s.bytes_in) <= -1 ||
+	    add_metric(buf, "hio_written_bytes_total", "counter", "Octets written to devices.", s.bytes_out) <= -1 ||
+	    add_metric(buf, "hio_write_queue_depth", "gauge", "Write requests pending on devices.", s.wq_depth) <= -1 ||
+	    add_metric(buf, "hio_write_queue_depth_max", "gauge", "Highest number of write requests pending in a loop.", s.wq_depth_max) <= -1 ||
+	    add_metric(buf, "hio_timer_jobs", "gauge", "Timer jobs scheduled.", s.tmr_size) <= -1 ||
+	    add_metric(buf, "hio_cfmb_backlog", "gauge", "Memory blocks waiting to be freed.", s.cfmb_count) <= -1 ||
+	    add_time_metric(buf, "hio_mux_wait_seconds_total", "Time spent waiting for events.", &s.mux_wait) <= -1 ||
+	    add_time_metric(buf, "hio_mux_busy_seconds_total", "Time spent handling events.", &s.mux_busy) <= -1 ||
+	    add_metric(buf, "hio_htts_services", "gauge", "Number of http services.", nhtts) <= -1 ||
+	    add_metric(buf, "hio_htts_clients", "gauge", "Client connections to http services.", hs.clients) <= -1 ||
+	    add_metric(buf, "hio_htts_tasks", "gauge", "Tasks alive in http services.", hs.tasks) <= -1) return -1;
+
+	if (hio_becs_cat(buf, "# HELP hio_htts_tasks_total Tasks started by type.\n# TYPE hio_htts_tasks_total counter\n") == (hio_oow_t)-1 ||
+	    add_task_metric(buf, "file", hs.task_file) <= -1 ||
+	    add_task_metric(buf, "cgi", hs.task_cgi) <= -1 ||
+	    add_task_metric(buf, "fcgi", hs.task_fcgi) <= -1 ||
+	    add_task_metric(buf, "prxy", hs.task_prxy) <= -1 ||
+	    add_task_metric(buf, "thr", hs.task_thr) <= -1 ||
+	    add_task_metric(buf, "fun", hs.task_fun) <= -1 ||
+	    add_task_metric(buf, "txt", hs.task_txt) <= -1) return -1;
+
+	return 0;
+}
+
+int hio_svc_htts_dometrics (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* req, hio_svc_htts_task_on_kill_t on_kill)
+{
+	if (format_metrics(htts->becbuf) <= -1) return -1;
+	return hio_svc_htts_dotxt(htts, csck, req, HIO_HTTP_STATUS_OK, "text/plain; version=0.0.4", HIO_BECS_PTR(htts->becbuf), 0, on_kill);
+}
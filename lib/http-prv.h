@@ -27,6 +27,7 @@
 
 #include <hio-http.h>
 #include <hio-htrd.h>
+#include <hio-pro.h>
 #include <hio-sck.h>
 #include <hio-spl.h>
 #include "hio-prv.h"
@@ -49,6 +50,87 @@ struct hio_svc_htts_cli_t
 
 	hio_svc_htts_task_t* task;
 	hio_ntime_t last_active;
+
+	/* request progress checked against the deadlines by the client scanner */
+	unsigned int req_hdr_pending: 1;
+	unsigned int req_body_pending: 1;
+	unsigned int peer_counted: 1; /* counted in the connections of the client address */
+	hio_ntime_t req_hdr_since;
+	hio_ntime_t req_body_since;
+	hio_oow_t req_body_octets;
+};
+
+typedef struct hio_svc_htts_fcent_t hio_svc_htts_fcent_t;
+
+#define HIO_SVC_HTTS_FCENT_MEM_IDENTITY 0
+#define HIO_SVC_HTTS_FCENT_MEM_GZIP 1
+#define HIO_SVC_HTTS_FCENT_MEM_VAR_COUNT 2
+
+/* an entry in the open file cache used by the file task */
+struct hio_svc_htts_fcent_t
+{
+	hio_svc_htts_fcent_t* bkt_next; /* next entry in the same hash bucket */
+	hio_svc_htts_fcent_t* lru_prev;
+	hio_svc_htts_fcent_t* lru_next;
+
+	hio_oow_t refcnt; /* the cache holds 1 while the entry is linked. each user task holds 1 */
+	hio_oow_t hv; /* hash value of the path */
+	hio_ntime_t checked_at; /* last time the file has been verified against the file system */
+
+	int fd;
+	hio_foff_t size;
+	hio_ntime_t mtime;
+	hio_uintmax_t ino;
+	hio_uintmax_t dev;
+
+	hio_bch_t* path; /* points to the memory area after the structure */
+	hio_bch_t* mime_type; /* HIO_NULL or a copy of the mime type determined upon opening */
+	hio_bch_t etag[128];
+
+	/* the response of a small file held in memory except the status line and the general headers */
+	struct
+	{
+		hio_svc_htts_fcent_t* prev;
+		hio_svc_htts_fcent_t* next;
+		int no_gzip; /* the contents don't shrink when compressed */
+		struct
+		{
+			hio_bch_t* ptr; /* entity headers, the blank line, and the file contents */
+			hio_oow_t len;
+			hio_bch_t* mime_type; /* mime type used to build the response. points to the memory after the response */
+		} var[HIO_SVC_HTTS_FCENT_MEM_VAR_COUNT]; /* indexed by the content coding */
+	} mem;
+};
+
+typedef struct hio_svc_htts_prxy_ups_t hio_svc_htts_prxy_ups_t;
+
+#define HIO_SVC_HTTS_PRXY_UPS_BKT_SIZE 64
+
+/* an upstream server of the proxy task holding idle keep-alive connections */
+struct hio_svc_htts_prxy_ups_t
+{
+	hio_svc_htts_prxy_ups_t* next; /* next upstream in the same hash bucket */
+	hio_skad_t addr;
+	hio_dev_sck_t* idle; /* idle connections. the most recently released one comes first */
+	hio_oow_t nidle;
+};
+
+typedef struct hio_svc_htts_prxy_dns_t hio_svc_htts_prxy_dns_t;
+
+#define HIO_SVC_HTTS_PRXY_DNS_BKT_SIZE 64
+
+/* a host name of an upstream server resolved or being resolved for the proxy task */
+struct hio_svc_htts_prxy_dns_t
+{
+	hio_svc_htts_prxy_dns_t* next; /* next entry in the same hash bucket */
+	hio_dns_msg_t* reqmsg; /* query in progress. null once resolved */
+	hio_dns_rrt_t qtype; /* type of the query in progress */
+	hio_svc_htts_task_t* waiter; /* tasks waiting for the query to complete */
+	hio_ntime_t expiry; /* time when the resolved address becomes stale */
+	hio_uint8_t ip[16];
+	hio_oow_t iplen;
+	hio_oow_t len;
+	hio_bch_t name[1]; /* in lower case */
 };
 
 struct hio_svc_htts_cli_htrd_xtn_t
@@ -57,6 +139,22 @@ struct hio_svc_htts_cli_htrd_xtn_t
 };
 typedef struct hio_svc_htts_cli_htrd_xtn_t hio_svc_htts_cli_htrd_xtn_t;
 
+typedef struct hio_svc_htts_rtnode_t hio_svc_htts_rtnode_t;
+
+typedef struct hio_svc_htts_peer_t hio_svc_htts_peer_t;
+typedef struct hio_svc_htts_alog_t hio_svc_htts_alog_t;
+
+/* limiting state of a client ip address. an entry in an open addressing table */
+struct hio_svc_htts_peer_t
+{
+	hio_uint8_t ipad[16];
+	hio_uint8_t iplen; /* 0 for an empty slot */
+	hio_uint32_t hv;
+	hio_uint32_t nconns;
+	hio_uint32_t tokens; /* in 1/1000 of a request */
+	hio_ntime_t refilled;
+};
+
 struct hio_svc_htts_t
 {
 	HIO_SVC_HEADER;
@@ -70,6 +168,9 @@ struct hio_svc_htts_t
 	} l;
 	/*hio_dev_sck_t* lsck;*/
 	hio_svc_fcgic_t* fcgic;
+	hio_svc_dnc_t* dnc; /* used by the proxy task to resolve upstream host names */
+	hio_dev_thr_pool_t* thr_pool; /* created on demand if option.task_thr_max > 0 */
+	hio_dev_pro_pool_t* cgi_pool; /* created on demand if option.task_cgi_prefork > 0 */
 
 	hio_svc_htts_cli_t cli; /* list head for client list */
 	hio_svc_htts_task_t task; /* list head for task list */
@@ -80,12 +181,77 @@ struct hio_svc_htts_t
 
 	hio_becs_t* becbuf; /* temporary buffer for any work */
 
+	hio_svc_htts_rtnode_t* rtroot; /* root of the route trie. see http-rtr.c */
+	struct
+	{
+		/* parameters of the route being dispatched. hio_svc_htts_task_make() copies them */
+		const hio_svc_htts_route_param_t* ptr;
+		hio_oow_t count;
+	} rtparams;
+	hio_svc_htts_alog_t* alog; /* access log. see http-alog.c */
+
 	struct
 	{
 		hio_oow_t task_max;
 		hio_oow_t task_cgi_max;
+		hio_oow_t task_thr_max;
+		hio_oow_t task_fcgi_conn_max;
+		hio_oow_t task_fcgi_sess_max;
+		hio_oow_t task_prxy_idle_max;
+		hio_ntime_t task_prxy_conn_max_age;
+		hio_ntime_t task_prxy_idle_timeout;
+		hio_ntime_t task_prxy_dns_ttl_max;
+		hio_oow_t task_prxy_dns_cache_max;
+		hio_oow_t task_req_body_mem_max;
+		hio_htrd_limit_t req_limit;
+		hio_ntime_t req_hdr_timeout;
+		hio_oow_t req_body_rate_min;
+		hio_oow_t client_conn_max;
+		hio_oow_t client_req_rate;
+		hio_oow_t client_req_burst;
+		hio_oow_t task_thr_queue_max;
+		hio_oow_t task_cgi_prefork;
+		hio_bch_t* task_cgi_prefork_helper;
+		hio_oow_t file_cache_max;
+		hio_ntime_t file_cache_ttl;
+		hio_oow_t file_memcache_max;
+		hio_oow_t file_memcache_file_max;
+		hio_oow_t res_compress_min;
+		int res_compress_level;
 	} option;
 
+	struct
+	{
+		hio_svc_htts_fcent_t** bkt;
+		hio_oow_t nbkts;
+		hio_oow_t count;
+		hio_svc_htts_fcent_t lru; /* list head. the most recently used entry comes first */
+		hio_oow_t hits;
+		hio_oow_t misses;
+
+		hio_svc_htts_fcent_t mem_lru; /* list head of the entries holding a response in memory */
+		hio_oow_t mem_count;
+		hio_oow_t mem_size;
+		hio_oow_t mem_hits;
+		hio_oow_t mem_misses;
+	} fcache;
+
+	struct
+	{
+		hio_svc_htts_prxy_ups_t* bkt[HIO_SVC_HTTS_PRXY_UPS_BKT_SIZE];
+		hio_oow_t nidle;
+
+		hio_svc_htts_prxy_dns_t* dns_bkt[HIO_SVC_HTTS_PRXY_DNS_BKT_SIZE];
+		hio_oow_t ndns;
+	} prxy;
+
+	struct
+	{
+		hio_svc_htts_peer_t* ent;
+		hio_oow_t capa; /* power of 2 */
+		hio_oow_t count;
+	} peer;
+
 	struct
 	{
 		hio_ooi_t ntasks;
@@ -94,14 +260,111 @@ struct hio_svc_htts_t
 		hio_spl_t spl_ntasks;
 		hio_spl_t spl_ntask_cgis;
 	#endif
+		hio_svc_htts_stat_t c; /* tasks is filled from ntasks when read */
+		hio_svc_htts_t* prev; /* in the list of all htts services */
+		hio_svc_htts_t* next;
 	} stat;
 };
 
+/* the counters are updated only on the thread running the loop of the service.
+ * relaxed atomic accesses let hio_svc_htts_getallstat() read them on another thread */
+#if defined(HIO_HAVE_BUILTIN_ATOMIC_LOAD_N)
+#	define HIO_SVC_HTTS_STAT_INC(htts,name) __atomic_store_n(&(htts)->stat.c.name, (htts)->stat.c.name + 1, __ATOMIC_RELAXED)
+#	define HIO_SVC_HTTS_STAT_DEC(htts,name) __atomic_store_n(&(htts)->stat.c.name, (htts)->stat.c.name - 1, __ATOMIC_RELAXED)
+#	define HIO_SVC_HTTS_STAT_GET(htts,name) __atomic_load_n(&(htts)->stat.c.name, __ATOMIC_RELAXED)
+#else
+#	define HIO_SVC_HTTS_STAT_INC(htts,name) ((htts)->stat.c.name++)
+#	define HIO_SVC_HTTS_STAT_DEC(htts,name) ((htts)->stat.c.name--)
+#	define HIO_SVC_HTTS_STAT_GET(htts,name) ((htts)->stat.c.name)
+#endif
+
+typedef struct hio_svc_httc_origin_t hio_svc_httc_origin_t;
+
+#define HIO_SVC_HTTC_ORIGIN_BKT_SIZE 64
+
 struct hio_svc_httc_t
 {
 	HIO_SVC_HEADER;
+
+	int stopping;
+	hio_svc_httc_tmout_t tmout;
+
+	struct
+	{
+		hio_oow_t conn_max;
+		hio_oow_t pipeline_max;
+	} option;
+
+	hio_svc_httc_origin_t* bkt[HIO_SVC_HTTC_ORIGIN_BKT_SIZE];
+	hio_becs_t* becbuf; /* temporary buffer to build a request */
 };
 
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* the raw data must contain the remaining header lines, the blank line, and the body */
+int hio_svc_htts_task_endreshdrwithraw (
+	hio_svc_htts_task_t* task,
+	const void*          raw,
+	hio_iolen_t          rawlen
+);
+
+void hio_svc_htts_trimfilememcache (
+	hio_svc_htts_t*      htts,
+	hio_oow_t            size
+);
+
+void hio_svc_htts_purgeprxypool (
+	hio_svc_htts_t*      htts
+);
+
+void hio_svc_htts_purgeprxydns (
+	hio_svc_htts_t*      htts
+);
+
+int hio_svc_htts_iscompressibletype (
+	const hio_bch_t*     content_type,
+	hio_oow_t            len
+);
+
+/* the size of the memory block to hold a copy of the route parameters */
+hio_oow_t hio_svc_htts_getrouteparamsize (
+	const hio_svc_htts_route_param_t* params,
+	hio_oow_t                         nparams
+);
+
+/* copy the route parameters to the memory block sized with
+ * hio_svc_htts_getrouteparamsize(). the names and the values are null-terminated */
+void hio_svc_htts_copyrouteparams (
+	hio_svc_htts_route_param_t*       dst,
+	const hio_svc_htts_route_param_t* src,
+	hio_oow_t                         nparams
+);
+
+const hio_bch_t* hio_svc_htts_findrouteparam (
+	const hio_svc_htts_route_param_t* params,
+	hio_oow_t                         nparams,
+	const hio_bch_t*                  name
+);
+
+void hio_svc_htts_writealog (
+	hio_svc_htts_t*      htts,
+	hio_svc_htts_task_t* task
+);
+
+void hio_svc_htts_linkstat (
+	hio_svc_htts_t*      htts
+);
+
+void hio_svc_htts_unlinkstat (
+	hio_svc_htts_t*      htts
+);
+
+#if defined(__cplusplus)
+}
+#endif
+
 /* client list */
 #define HIO_SVC_HTTS_CLIL_APPEND_CLI(lh,cli) do { \
 	(cli)->cli_next = (lh); \
@@ -42,6 +42,9 @@
 
 #define PRXY_PENDING_IO_THRESHOLD 5
 
+#define PRXY_CONNECT_TMOUT 10 /* in seconds */
+#define PRXY_DNS_NAME_MAX 255
+
 #define PRXY_OVER_READ_FROM_CLIENT (1 << 0)
 #define PRXY_OVER_READ_FROM_PEER   (1 << 1)
 #define PRXY_OVER_WRITE_TO_CLIENT  (1 << 2)
@@ -58,9 +61,20 @@ struct prxy_t
 	hio_oow_t peer_pending_writes;
 	hio_dev_sck_t* peer;
 	hio_htrd_t* peer_htrd;
+	hio_skad_t peer_addr;
+	hio_becs_t* peer_reqhdr; /* request header kept to retry on a new connection if a reused one turns out to be dead */
+	hio_becs_t* peer_wbuf; /* data to write to the peer kept while the upstream host name is being resolved */
+	hio_svc_htts_prxy_dns_t* peer_dns; /* host name entry being resolved for the peer */
+	hio_svc_htts_task_t* peer_dns_next; /* next task waiting for the same host name to be resolved */
 
 	unsigned int over: 4; /* must be large enough to accomodate PRXY_OVER_ALL */
 	unsigned int client_htrd_recbs_changed: 1;
+	unsigned int peer_req_chunked: 1; /* the request body is relayed in chunks */
+	unsigned int peer_reused: 1; /* the peer connection has been taken from the idle connection pool */
+	unsigned int peer_res_received: 1; /* some response octets have been received from the peer */
+	unsigned int peer_keepalive: 1; /* the response allows the peer connection to be reused */
+	unsigned int peer_broken: 1; /* the peer connection can't be reused for an anomaly */
+	unsigned int peer_interim: 1; /* an interim response is being read from the peer */
 
 	hio_dev_sck_on_read_t client_org_on_read;
 	hio_dev_sck_on_write_t client_org_on_write;
@@ -71,12 +85,321 @@ typedef struct prxy_t prxy_t;
 
 struct prxy_peer_xtn_t
 {
-	prxy_t* prxy; /* back pointer to the prxy object */
+	prxy_t* prxy; /* back pointer to the prxy object. null if the connection is idle */
+
+	/* the fields below are used for the peer socket only. not for the peer htrd */
+	hio_svc_htts_t* htts;
+	hio_svc_htts_prxy_ups_t* ups; /* set while the connection is in the idle connection pool */
+	hio_dev_sck_t* idle_prev;
+	hio_dev_sck_t* idle_next;
+	hio_ntime_t born; /* time when the connection has been made */
+	hio_tmridx_t age_tmridx; /* timer job to close the idle connection when it gets too old */
 };
 typedef struct prxy_peer_xtn_t prxy_peer_xtn_t;
 
 static void unbind_task_from_client (prxy_t* prxy, int rcdown);
 static void unbind_task_from_peer (prxy_t* prxy, int rcdown);
+static void prxy_on_peer_failure (prxy_t* prxy, int retriable);
+
+/* ----------------------------------------------------------------------- */
+
+static hio_oow_t hash_skad (const hio_skad_t* addr)
+{
+	/* hio_equal_skads() considers the family, the port and the ip address only */
+	hio_oow_t hv;
+	hio_uint8_t ipad[16];
+	hio_oow_t iplen;
+	int tmp;
+
+	tmp = hio_skad_get_family(addr);
+	HIO_HASH_BYTES (hv, &tmp, HIO_SIZEOF(tmp));
+	tmp = hio_skad_get_port(addr);
+	HIO_HASH_MORE_BYTES (hv, &tmp, HIO_SIZEOF(tmp));
+	iplen = hio_skad_get_ipad_bytes(addr, ipad, HIO_SIZEOF(ipad));
+	HIO_HASH_MORE_BYTES (hv, ipad, iplen);
+
+	return hv;
+}
+
+static hio_svc_htts_prxy_ups_t* get_ups (hio_svc_htts_t* htts, const hio_skad_t* addr, int create)
+{
+	hio_svc_htts_prxy_ups_t* ups;
+	hio_oow_t b;
+
+	b = hash_skad(addr) & (HIO_SVC_HTTS_PRXY_UPS_BKT_SIZE - 1);
+	for (ups = htts->prxy.bkt[b]; ups; ups = ups->next)
+	{
+		if (hio_equal_skads(&ups->addr, addr, 1)) return ups;
+	}
+
+	if (!create) return HIO_NULL;
+
+	ups = (hio_svc_htts_prxy_ups_t*)hio_callocmem(htts->hio, HIO_SIZEOF(*ups));
+	if (HIO_UNLIKELY(!ups)) return HIO_NULL;
+
+	ups->addr = *addr;
+	ups->next = htts->prxy.bkt[b];
+	htts->prxy.bkt[b] = ups;
+	return ups;
+}
+
+static void unlink_idle_peer (hio_dev_sck_t* sck)
+{
+	prxy_peer_xtn_t* pxtn = hio_dev_sck_getxtn(sck);
+	hio_svc_htts_prxy_ups_t* ups = pxtn->ups;
+	hio_svc_htts_t* htts = pxtn->htts;
+
+	HIO_ASSERT (htts->hio, ups != HIO_NULL);
+	HIO_ASSERT (htts->hio, ups->nidle > 0);
+
+	if (pxtn->idle_prev) ((prxy_peer_xtn_t*)hio_dev_sck_getxtn(pxtn->idle_prev))->idle_next = pxtn->idle_next;
+	else ups->idle = pxtn->idle_next;
+	if (pxtn->idle_next) ((prxy_peer_xtn_t*)hio_dev_sck_getxtn(pxtn->idle_next))->idle_prev = pxtn->idle_prev;
+
+	pxtn->idle_prev = HIO_NULL;
+	pxtn->idle_next = HIO_NULL;
+	pxtn->ups = HIO_NULL;
+	ups->nidle--;
+	htts->prxy.nidle--;
+
+	if (pxtn->age_tmridx != HIO_TMRIDX_INVALID)
+	{
+		hio_deltmrjob (htts->hio, pxtn->age_tmridx);
+		HIO_ASSERT (htts->hio, pxtn->age_tmridx == HIO_TMRIDX_INVALID);
+	}
+}
+
+static void close_old_idle_peer (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	hio_dev_sck_t* sck = (hio_dev_sck_t*)job->ctx;
+	prxy_peer_xtn_t* pxtn = hio_dev_sck_getxtn(sck);
+
+	HIO_ASSERT (hio, pxtn->ups != HIO_NULL);
+	HIO_DEBUG3 (hio, "HTTS(%p) - closing old or long idle peer %p(hnd=%d)\n", pxtn->htts, sck, (int)sck->hnd);
+
+	unlink_idle_peer (sck);
+	hio_dev_sck_halt (sck);
+}
+
+static int is_peer_too_old (hio_svc_htts_t* htts, prxy_peer_xtn_t* pxtn)
+{
+	hio_ntime_t now, age;
+
+	hio_gettime (htts->hio, &now);
+	HIO_SUB_NTIME (&age, &now, &pxtn->born);
+	return HIO_CMP_NTIME(&age, &htts->option.task_prxy_conn_max_age) >= 0;
+}
+
+static hio_dev_sck_t* take_idle_peer (hio_svc_htts_t* htts, const hio_skad_t* addr)
+{
+	hio_svc_htts_prxy_ups_t* ups;
+
+	ups = get_ups(htts, addr, 0);
+	if (!ups) return HIO_NULL;
+
+	while (ups->idle)
+	{
+		hio_dev_sck_t* sck = ups->idle;
+
+		unlink_idle_peer (sck);
+		if (!is_peer_too_old(htts, hio_dev_sck_getxtn(sck))) return sck;
+
+		/* the timer job hasn't got a chance to close it yet */
+		hio_dev_sck_halt (sck);
+	}
+
+	return HIO_NULL;
+}
+
+static int put_idle_peer (hio_svc_htts_t* htts, hio_dev_sck_t* sck, const hio_skad_t* addr)
+{
+	hio_t* hio = htts->hio;
+	prxy_peer_xtn_t* pxtn = hio_dev_sck_getxtn(sck);
+	hio_svc_htts_prxy_ups_t* ups;
+	hio_ntime_t t;
+
+	HIO_ASSERT (hio, pxtn->prxy == HIO_NULL);
+	HIO_ASSERT (hio, pxtn->ups == HIO_NULL);
+
+	if (htts->option.task_prxy_idle_max <= 0 || is_peer_too_old(htts, pxtn)) return -1;
+
+	ups = get_ups(htts, addr, 1);
+	if (HIO_UNLIKELY(!ups) || ups->nidle >= htts->option.task_prxy_idle_max) return -1;
+
+	/* watch input while idle to detect that the peer has closed the connection */
+	if (hio_dev_sck_read(sck, 1) <= -1) return -1;
+
+	/* close it when it's been idle for too long or when it gets too old whichever comes first */
+	HIO_ADD_NTIME (&t, &pxtn->born, &htts->option.task_prxy_conn_max_age);
+	if (HIO_IS_POS_NTIME(&htts->option.task_prxy_idle_timeout))
+	{
+		hio_ntime_t idle;
+		hio_gettime (hio, &idle);
+		HIO_ADD_NTIME (&idle, &idle, &htts->option.task_prxy_idle_timeout);
+		if (HIO_CMP_NTIME(&idle, &t) < 0) t = idle;
+	}
+	if (hio_schedtmrjobat(hio, &t, close_old_idle_peer, &pxtn->age_tmridx, sck) <= -1) return -1;
+
+	pxtn->ups = ups;
+	pxtn->idle_prev = HIO_NULL;
+	pxtn->idle_next = ups->idle;
+	if (ups->idle) ((prxy_peer_xtn_t*)hio_dev_sck_getxtn(ups->idle))->idle_prev = sck;
+	ups->idle = sck;
+	ups->nidle++;
+	htts->prxy.nidle++;
+
+	HIO_DEBUG4 (hio, "HTTS(%p) - keeping idle peer %p(hnd=%d) - %zu idle connections to the upstream\n", htts, sck, (int)sck->hnd, ups->nidle);
+	return 0;
+}
+
+void hio_svc_htts_purgeprxypool (hio_svc_htts_t* htts)
+{
+	hio_oow_t i;
+
+	for (i = 0; i < HIO_COUNTOF(htts->prxy.bkt); i++)
+	{
+		while (htts->prxy.bkt[i])
+		{
+			hio_svc_htts_prxy_ups_t* ups = htts->prxy.bkt[i];
+
+			while (ups->idle)
+			{
+				hio_dev_sck_t* sck = ups->idle;
+				unlink_idle_peer (sck);
+				hio_dev_sck_kill (sck);
+			}
+
+			htts->prxy.bkt[i] = ups->next;
+			hio_freemem (htts->hio, ups);
+		}
+	}
+
+	HIO_ASSERT (htts->hio, htts->prxy.nidle == 0);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static hio_oow_t hash_name (const hio_bch_t* name, hio_oow_t len)
+{
+	hio_oow_t hv;
+	HIO_HASH_BYTES (hv, name, len);
+	return hv;
+}
+
+static void free_dns (hio_svc_htts_t* htts, hio_svc_htts_prxy_dns_t* dns)
+{
+	hio_svc_htts_prxy_dns_t** pp;
+
+	pp = &htts->prxy.dns_bkt[hash_name(dns->name, dns->len) & (HIO_SVC_HTTS_PRXY_DNS_BKT_SIZE - 1)];
+	while (*pp != dns) pp = &(*pp)->next;
+	*pp = dns->next;
+
+	HIO_ASSERT (htts->hio, htts->prxy.ndns > 0);
+	htts->prxy.ndns--;
+	hio_freemem (htts->hio, dns);
+}
+
+static void purge_stale_dns (hio_svc_htts_t* htts, const hio_ntime_t* now)
+{
+	hio_oow_t i;
+
+	for (i = 0; i < HIO_COUNTOF(htts->prxy.dns_bkt); i++)
+	{
+		hio_svc_htts_prxy_dns_t* dns, ** pp;
+
+		pp = &htts->prxy.dns_bkt[i];
+		while ((dns = *pp))
+		{
+			if (!dns->reqmsg && (!now || HIO_CMP_NTIME(&dns->expiry, now) <= 0))
+			{
+				*pp = dns->next;
+				htts->prxy.ndns--;
+				hio_freemem (htts->hio, dns);
+			}
+			else pp = &dns->next;
+		}
+	}
+}
+
+static hio_svc_htts_prxy_dns_t* find_dns (hio_svc_htts_t* htts, const hio_bch_t* name, hio_oow_t len)
+{
+	hio_svc_htts_prxy_dns_t* dns, ** pp;
+	hio_ntime_t now;
+
+	hio_gettime (htts->hio, &now);
+
+	pp = &htts->prxy.dns_bkt[hash_name(name, len) & (HIO_SVC_HTTS_PRXY_DNS_BKT_SIZE - 1)];
+	while ((dns = *pp))
+	{
+		if (!dns->reqmsg && HIO_CMP_NTIME(&dns->expiry, &now) <= 0)
+		{
+			/* drop a stale entry on the way */
+			*pp = dns->next;
+			htts->prxy.ndns--;
+			hio_freemem (htts->hio, dns);
+			continue;
+		}
+
+		if (dns->len == len && HIO_MEMCMP(dns->name, name, len) == 0) return dns;
+		pp = &dns->next;
+	}
+
+	return HIO_NULL;
+}
+
+static hio_svc_htts_prxy_dns_t* make_dns (hio_svc_htts_t* htts, const hio_bch_t* name, hio_oow_t len)
+{
+	hio_svc_htts_prxy_dns_t* dns;
+	hio_oow_t b;
+
+	if (htts->prxy.ndns >= htts->option.task_prxy_dns_cache_max)
+	{
+		hio_ntime_t now;
+		hio_gettime (htts->hio, &now);
+		purge_stale_dns (htts, &now);
+	}
+
+	dns = (hio_svc_htts_prxy_dns_t*)hio_callocmem(htts->hio, HIO_SIZEOF(*dns) + len);
+	if (HIO_UNLIKELY(!dns)) return HIO_NULL;
+
+	HIO_MEMCPY (dns->name, name, len);
+	dns->name[len] = '\0';
+	dns->len = len;
+
+	b = hash_name(name, len) & (HIO_SVC_HTTS_PRXY_DNS_BKT_SIZE - 1);
+	dns->next = htts->prxy.dns_bkt[b];
+	htts->prxy.dns_bkt[b] = dns;
+	htts->prxy.ndns++;
+	return dns;
+}
+
+void hio_svc_htts_purgeprxydns (hio_svc_htts_t* htts)
+{
+	if (htts->dnc)
+	{
+		/* drop the resolved entries only. the tasks are waiting on the others */
+		purge_stale_dns (htts, HIO_NULL);
+	}
+	else
+	{
+		/* the dns client service is gone along with the queries in progress */
+		hio_oow_t i;
+
+		for (i = 0; i < HIO_COUNTOF(htts->prxy.dns_bkt); i++)
+		{
+			while (htts->prxy.dns_bkt[i])
+			{
+				hio_svc_htts_prxy_dns_t* dns = htts->prxy.dns_bkt[i];
+				HIO_ASSERT (htts->hio, dns->waiter == HIO_NULL);
+				htts->prxy.dns_bkt[i] = dns->next;
+				hio_freemem (htts->hio, dns);
+			}
+		}
+		htts->prxy.ndns = 0;
+	}
+}
+
+/* ----------------------------------------------------------------------- */
 
 static void prxy_halt_participating_devices (prxy_t* prxy)
 {
@@ -92,6 +415,9 @@ static int prxy_write_to_peer (prxy_t* prxy, const void* data, hio_iolen_t dlen)
 {
 	if (prxy->peer)
 	{
+		/* shutting down the writing side leaves the connection unusable for another request */
+		if (dlen <= 0) prxy->peer_broken = 1;
+
 		prxy->peer_pending_writes++;
 		if (hio_dev_sck_write(prxy->peer, data, dlen, HIO_NULL, HIO_NULL) <= -1)
 		{
@@ -105,9 +431,77 @@ static int prxy_write_to_peer (prxy_t* prxy, const void* data, hio_iolen_t dlen)
 			if (prxy->task_csck && hio_dev_sck_read(prxy->task_csck, 0) <= -1) return -1;
 		}
 	}
+	else if (prxy->peer_wbuf)
+	{
+		/* the peer connection is made once the host name is resolved. keep the data till then */
+		if (dlen > 0 && hio_becs_ncat(prxy->peer_wbuf, data, dlen) == (hio_oow_t)-1) return -1;
+	}
+	return 0;
+}
+
+static int prxy_write_chunk_to_peer (prxy_t* prxy, const void* data, hio_iolen_t dlen)
+{
+	if (prxy->peer)
+	{
+		hio_iovec_t iov[3];
+		hio_bch_t lbuf[16];
+		hio_oow_t llen;
+
+		llen = hio_fmt_uintmax_to_bcstr(lbuf, HIO_COUNTOF(lbuf) - 1, dlen, 16 | HIO_FMT_UINTMAX_UPPERCASE, 0, '\0', HIO_NULL);
+		lbuf[llen++] = '\r';
+		lbuf[llen++] = '\n';
+
+		iov[0].iov_ptr = lbuf;
+		iov[0].iov_len = llen;
+		iov[1].iov_ptr = (void*)data;
+		iov[1].iov_len = dlen;
+		iov[2].iov_ptr = "\r\n";
+		iov[2].iov_len = 2;
+
+		prxy->peer_pending_writes++;
+		if (hio_dev_sck_writev(prxy->peer, iov, HIO_COUNTOF(iov), HIO_NULL, HIO_NULL) <= -1)
+		{
+			prxy->peer_pending_writes--;
+			return -1;
+		}
+
+		if (prxy->peer_pending_writes > PRXY_PENDING_IO_THRESHOLD)
+		{
+			/* suspend input watching */
+			if (prxy->task_csck && hio_dev_sck_read(prxy->task_csck, 0) <= -1) return -1;
+		}
+	}
+	else if (prxy->peer_wbuf)
+	{
+		if (hio_becs_fcat(prxy->peer_wbuf, "%zX\r\n", (hio_oow_t)dlen) == (hio_oow_t)-1 ||
+		    hio_becs_ncat(prxy->peer_wbuf, data, dlen) == (hio_oow_t)-1 ||
+		    hio_becs_cat(prxy->peer_wbuf, "\r\n") == (hio_oow_t)-1) return -1;
+	}
 	return 0;
 }
 
+static void attach_peer (prxy_t* prxy, hio_dev_sck_t* sck)
+{
+	prxy_peer_xtn_t* pxtn = hio_dev_sck_getxtn(sck);
+
+	HIO_ASSERT (prxy->htts->hio, prxy->peer == HIO_NULL);
+	HIO_ASSERT (prxy->htts->hio, pxtn->prxy == HIO_NULL);
+
+	pxtn->prxy = prxy;
+	prxy->peer = sck;
+	prxy->peer_pending_writes = 0;
+	HIO_SVC_HTTS_TASK_RCUP (prxy);
+}
+
+static void detach_peer (prxy_t* prxy, int rcdown)
+{
+	prxy_peer_xtn_t* pxtn = hio_dev_sck_getxtn(prxy->peer);
+
+	pxtn->prxy = HIO_NULL;
+	prxy->peer = HIO_NULL;
+	if (rcdown) HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
+}
+
 static HIO_INLINE void prxy_mark_over (prxy_t* prxy, int over_bits)
 {
 	hio_svc_htts_t* htts = prxy->htts;
@@ -140,10 +534,18 @@ static HIO_INLINE void prxy_mark_over (prxy_t* prxy, int over_bits)
 	if (old_over != PRXY_OVER_ALL && prxy->over == PRXY_OVER_ALL)
 	{
 		/* ready to stop */
+		HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)prxy);
+
 		if (prxy->peer)
 		{
-			HIO_DEBUG5 (hio, "HTTS(%p) - prxy(t=%p,c=%p[%d],p=%p) - halting unneeded peer\n", prxy->htts, prxy, prxy->task_client, (prxy->task_csck? prxy->task_csck->hnd: -1), prxy->peer);
-			hio_dev_sck_halt (prxy->peer);
+			hio_dev_sck_t* peer = prxy->peer;
+
+			detach_peer (prxy, 1);
+			if (!prxy->peer_keepalive || prxy->peer_broken || prxy->peer_pending_writes > 0 || put_idle_peer(htts, peer, &prxy->peer_addr) <= -1)
+			{
+				HIO_DEBUG5 (hio, "HTTS(%p) - prxy(t=%p,c=%p[%d],p=%p) - halting unneeded peer\n", prxy->htts, prxy, prxy->task_client, (prxy->task_csck? prxy->task_csck->hnd: -1), peer);
+				hio_dev_sck_halt (peer);
+			}
 		}
 
 		if (prxy->task_csck)
@@ -155,7 +557,6 @@ static HIO_INLINE void prxy_mark_over (prxy_t* prxy, int over_bits)
 				HIO_DEBUG5 (hio, "HTTS(%p) - prxy(t=%p,c=%p[%d],p=%p) - keeping client alive\n", prxy->htts, prxy, prxy->task_client, (prxy->task_csck? prxy->task_csck->hnd: -1), prxy->peer);
 				HIO_ASSERT (prxy->htts->hio, prxy->task_client->task == (hio_svc_htts_task_t*)prxy);
 				unbind_task_from_client (prxy, 1);
-				/* prxy must not be accessed from here down as it could have been destroyed */
 			}
 			else
 			{
@@ -164,6 +565,9 @@ static HIO_INLINE void prxy_mark_over (prxy_t* prxy, int over_bits)
 				hio_dev_sck_halt (prxy->task_csck);
 			}
 		}
+
+		HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
+		/* prxy must not be accessed from here down as it could have been destroyed */
 	}
 }
 
@@ -191,6 +595,12 @@ static void prxy_on_kill (hio_svc_htts_task_t* task)
 		unbind_task_from_client (prxy, 0);
 	}
 
+	if (prxy->peer_reqhdr)
+	{
+		hio_becs_close (prxy->peer_reqhdr);
+		prxy->peer_reqhdr = HIO_NULL;
+	}
+
 	if (prxy->task_next) HIO_SVC_HTTS_TASKL_UNLINK_TASK (prxy); /* detach from the htts service only if it's attached */
 	HIO_DEBUG5 (hio, "HTTS(%p) - prxy(t=%p,c=%p[%d],p=%p) - killed the task\n", prxy->htts, prxy, prxy->task_client, (prxy->task_csck? prxy->task_csck->hnd: -1), prxy->peer);
 }
@@ -206,23 +616,22 @@ static void prxy_peer_on_disconnect (hio_dev_sck_t* sck)
 	prxy_peer_xtn_t* pxtn = hio_dev_sck_getxtn(sck);
 	prxy_t* prxy = pxtn->prxy;
 
-	if (!prxy) return; /* prxy task already gone */
+	if (!prxy)
+	{
+		/* prxy task already gone or the connection is idle */
+		if (pxtn->ups) unlink_idle_peer (sck);
+		return;
+	}
 
 	HIO_DEBUG3 (hio, "HTTS(%p) - peer %p(hnd=%d) disconnectd\n", prxy->htts, sck, (int)sck->hnd);
 
-	/* reset prxy->peer before calling unbind_task_from_peer() because this is the peer close callback */
-	prxy->peer = HIO_NULL;
-	unbind_task_from_peer (prxy, 1);
+	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)prxy);
 
-	/*
-			if (!(prxy->over & PRXY_OVER_READ_FROM_PEER))
-			{
-				if (hio_svc_htts_task_endbody(prxy) <= -1)
-					prxy_halt_participating_devices (prxy);
-				else
-					prxy_mark_over (prxy, PRXY_OVER_READ_FROM_PEER);
-			}
-	*/
+	/* detach the peer before handling failure because this is the peer close callback */
+	detach_peer (prxy, 1);
+	if (!(prxy->over & PRXY_OVER_READ_FROM_PEER)) prxy_on_peer_failure (prxy, 0);
+
+	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
 }
 
 static int prxy_peer_on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t dlen, const hio_skad_t* srcaddr)
@@ -231,27 +640,55 @@ static int prxy_peer_on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t
 	prxy_peer_xtn_t* peer = hio_dev_sck_getxtn(sck);
 	prxy_t* prxy = peer->prxy;
 
-	HIO_ASSERT (hio, prxy != HIO_NULL);
+	if (!prxy)
+	{
+		/* an idle connection is not supposed to get anything but EOF. close it in any case */
+		HIO_DEBUG3 (hio, "HTTS - %hs from idle peer %p(hnd=%d)\n", (dlen <= -1? "read error": dlen == 0? "EOF": "unexpected data"), sck, (int)sck->hnd);
+		if (peer->ups) unlink_idle_peer (sck);
+		hio_dev_sck_halt (sck);
+		return 0;
+	}
+
+	/* the task may get destroyed while the response is processed as the
+	 * peer connection can go back to the pool. hold it until the end */
+	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)prxy);
 
 	if (dlen <= -1)
 	{
 		HIO_DEBUG3 (hio, "HTTS(%p) - read error from peer %p(hnd=%d)\n", prxy->htts, sck, (unsigned int)sck->hnd);
-		goto oops;
+		if (!(prxy->over & PRXY_OVER_READ_FROM_PEER)) prxy_on_peer_failure (prxy, 1);
+		else prxy_halt_participating_devices (prxy);
+		goto done;
 	}
 
 	if (dlen == 0)
 	{
 		HIO_DEBUG3 (hio, "HTTS(%p) - EOF from peer %p(hnd=%d)\n", prxy->htts, sck, (int)sck->hnd);
 
+		prxy->peer_broken = 1;
 		if (!(prxy->over & PRXY_OVER_READ_FROM_PEER))
 		{
-			int n;
-			/* the prxy script could be misbehaving.
-			 * it still has to read more but EOF is read.
-			 * otherwise peer_htrd_poke() should have been called */
-			n = hio_svc_htts_task_endbody((hio_svc_htts_task_t*)prxy);
-			prxy_mark_over (prxy, PRXY_OVER_READ_FROM_PEER);
-			if (n <= -1) goto oops;
+			if (!prxy->task_res_started)
+			{
+				/* the peer has closed the connection before sending a response header */
+				prxy_on_peer_failure (prxy, 1);
+			}
+			else
+			{
+				int n;
+
+				/* it finishes the response to be read until the connection is closed */
+				n = hio_htrd_halt(prxy->peer_htrd);
+				if (n >= 0 && !(prxy->over & PRXY_OVER_READ_FROM_PEER))
+				{
+					/* the peer could be misbehaving.
+					 * it still has to send more but EOF is read.
+					 * otherwise peer_htrd_poke() should have been called */
+					n = hio_svc_htts_task_endbody((hio_svc_htts_task_t*)prxy);
+					prxy_mark_over (prxy, PRXY_OVER_READ_FROM_PEER);
+				}
+				if (n <= -1) goto oops;
+			}
 		}
 	}
 	else
@@ -259,29 +696,44 @@ static int prxy_peer_on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t
 		hio_oow_t rem;
 
 		HIO_ASSERT (hio, !(prxy->over & PRXY_OVER_READ_FROM_PEER));
+		prxy->peer_res_received = 1;
 
-		if (hio_htrd_feed(prxy->peer_htrd, data, dlen, &rem) <= -1)
+		while (1)
 		{
-			HIO_DEBUG3 (hio, "HTTS(%p) - unable to feed peer htrd - peer %p(hnd=%d)\n", prxy->htts, sck, (int)sck->hnd);
-
-			if (!prxy->task_res_started && !(prxy->over & PRXY_OVER_WRITE_TO_CLIENT))
+			if (hio_htrd_feed(prxy->peer_htrd, data, dlen, &rem) <= -1)
 			{
-				hio_svc_htts_task_sendfinalres ((hio_svc_htts_task_t*)prxy, HIO_HTTP_STATUS_BAD_GATEWAY, HIO_NULL, HIO_NULL, 1); /* don't care about error because it jumps to oops below anyway */
+				HIO_DEBUG3 (hio, "HTTS(%p) - unable to feed peer htrd - peer %p(hnd=%d)\n", prxy->htts, sck, (int)sck->hnd);
+
+				if (!prxy->task_res_started && !(prxy->over & PRXY_OVER_WRITE_TO_CLIENT))
+				{
+					hio_svc_htts_task_sendfinalres ((hio_svc_htts_task_t*)prxy, HIO_HTTP_STATUS_BAD_GATEWAY, HIO_NULL, HIO_NULL, 1); /* don't care about error because it jumps to oops below anyway */
+				}
+
+				goto oops;
 			}
 
-			goto oops;
-		}
+			if (rem <= 0) break;
 
-		if (rem > 0)
-		{
-			/* If the script specifies Content-Length and produces longer data, it will come here */
+			if (prxy->over & PRXY_OVER_READ_FROM_PEER)
+			{
+				/* the peer has sent more than the response. the connection can't be reused */
+				prxy->peer_broken = 1;
+				break;
+			}
+
+			/* the remaining data follows an interim response */
+			data = (const hio_uint8_t*)data + (dlen - rem);
+			dlen = rem;
 		}
 	}
 
+done:
+	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
 	return 0;
 
 oops:
 	prxy_halt_participating_devices (prxy);
+	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
 	return 0;
 }
 
@@ -332,13 +784,18 @@ static int prxy_peer_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrct
 	return 0;
 
 oops:
-	prxy_halt_participating_devices (prxy);
+	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)prxy);
+	if (!(prxy->over & PRXY_OVER_READ_FROM_PEER)) prxy_on_peer_failure (prxy, 1);
+	else prxy_halt_participating_devices (prxy);
+	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
 	return 0;
 }
 
 
 static int peer_capture_response_header (hio_htre_t* req, const hio_bch_t* key, const hio_htre_hdrval_t* val, void* ctx)
 {
+	/* Keep-Alive is about the connection to the peer */
+	if (hio_comp_bcstr(key, "Keep-Alive", 1) == 0) return 0;
 	return hio_svc_htts_task_addreshdrs((hio_svc_htts_task_t*)(prxy_t*)ctx, key, val);
 }
 
@@ -347,20 +804,48 @@ static int peer_htrd_peek (hio_htrd_t* htrd, hio_htre_t* req)
 	prxy_peer_xtn_t* peer = hio_htrd_getxtn(htrd);
 	prxy_t* prxy = peer->prxy;
 	hio_svc_htts_cli_t* cli = prxy->task_client;
+	int status_code, no_body;
 
-	if (HIO_LIKELY(cli))
+	status_code = hio_htre_getscodeval(req);
+	if (status_code >= 100 && status_code <= 199)
 	{
-		int status_code = HIO_HTTP_STATUS_OK;
-		const hio_bch_t* status_desc = HIO_NULL;
-		int chunked;
+		/* an interim response. skip it and wait for the final response */
+		prxy->peer_interim = 1;
+		no_body = 1;
+	}
+	else
+	{
+		/* no content follows the header of these responses regardless of the header fields */
+		no_body = prxy->task_req_method == HIO_HTTP_HEAD ||
+		          status_code == HIO_HTTP_STATUS_NO_CONTENT ||
+		          status_code == HIO_HTTP_STATUS_NOT_MODIFIED;
 
-		if (req->attr.status) hio_parse_http_status_header_value(req->attr.status, &status_code, &status_desc);
+		/* the connection can be reused only if the end of the response is known without closing it */
+		prxy->peer_keepalive = (req->flags & HIO_HTRE_ATTR_KEEPALIVE) &&
+		                       (no_body || (req->flags & (HIO_HTRE_ATTR_LENGTH | HIO_HTRE_ATTR_CHUNKED)));
+
+		if (HIO_LIKELY(cli))
+		{
+			const hio_bch_t* status_desc;
+			int chunked;
 
-		chunked = prxy->task_keep_client_alive && !req->attr.content_length;
+			chunked = prxy->task_keep_client_alive && !no_body && !(req->flags & HIO_HTRE_ATTR_LENGTH);
+
+			status_desc = hio_htre_getsmesg(req);
+			if (status_desc && *status_desc == '\0') status_desc = HIO_NULL;
+
+			if (hio_svc_htts_task_startreshdr((hio_svc_htts_task_t*)prxy, status_code, status_desc, chunked) <= -1 ||
+				hio_htre_walkheaders(req, peer_capture_response_header, prxy) <= -1 ||
+				hio_svc_htts_task_endreshdr((hio_svc_htts_task_t*)prxy) <= -1) return -1;
+		}
+	}
 
-		if (hio_svc_htts_task_startreshdr((hio_svc_htts_task_t*)prxy, status_code, status_desc, chunked) <= -1 ||
-			hio_htre_walkheaders(req, peer_capture_response_header, prxy) <= -1 ||
-			hio_svc_htts_task_endreshdr((hio_svc_htts_task_t*)prxy) <= -1) return -1;
+	if (no_body)
+	{
+		/* let the reader complete the response without content */
+		req->flags &= ~HIO_HTRE_ATTR_CHUNKED;
+		req->flags |= HIO_HTRE_ATTR_LENGTH;
+		req->attr.content_length = 0;
 	}
 
 	return 0;
@@ -373,6 +858,12 @@ static int peer_htrd_poke (hio_htrd_t* htrd, hio_htre_t* req)
 	prxy_t* prxy = peer->prxy;
 	int n;
 
+	if (prxy->peer_interim)
+	{
+		prxy->peer_interim = 0;
+		return 0;
+	}
+
 	n = hio_svc_htts_task_endbody((hio_svc_htts_task_t*)prxy);
 	prxy_mark_over (prxy, PRXY_OVER_READ_FROM_PEER);
 	return n;
@@ -410,10 +901,10 @@ static int prxy_client_htrd_poke (hio_htrd_t* htrd, hio_htre_t* req)
 	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(sck);
 	prxy_t* prxy = (prxy_t*)cli->task;
 
-	/* indicate EOF to the client peer */
-	if (prxy_write_to_peer(prxy, HIO_NULL, 0) <= -1) return -1;
+	/* send the last chunk to end the request body. the connection is kept open for the response */
+	if (prxy->peer_req_chunked && prxy_write_to_peer(prxy, "0\r\n\r\n", 5) <= -1) return -1;
 
-	prxy_mark_over (prxy, PRXY_OVER_READ_FROM_CLIENT);
+	prxy_mark_over (prxy, PRXY_OVER_READ_FROM_CLIENT | (prxy->peer_pending_writes <= 0? PRXY_OVER_WRITE_TO_PEER: 0));
 	return 0;
 }
 
@@ -425,7 +916,7 @@ static int prxy_client_htrd_push_content (hio_htrd_t* htrd, hio_htre_t* req, con
 	prxy_t* prxy = (prxy_t*)cli->task;
 
 	HIO_ASSERT (sck->hio, cli->sck == sck);
-	return prxy_write_to_peer(prxy, data, dlen);
+	return prxy->peer_req_chunked? prxy_write_chunk_to_peer(prxy, data, dlen): prxy_write_to_peer(prxy, data, dlen);
 }
 
 static hio_htrd_recbs_t prxy_client_htrd_recbs =
@@ -472,6 +963,9 @@ static int prxy_client_on_read (hio_dev_sck_t* sck, const void* buf, hio_iolen_t
 
 	HIO_ASSERT (hio, sck == cli->sck);
 
+	/* the task can be destroyed in the middle if the request completes the whole transaction */
+	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)prxy);
+
 	n = prxy->client_org_on_read? prxy->client_org_on_read(sck, buf, len, srcaddr): 0;
 
 	if (len <= -1)
@@ -496,10 +990,12 @@ static int prxy_client_on_read (hio_dev_sck_t* sck, const void* buf, hio_iolen_t
 	}
 
 	if (n <= -1) goto oops;
+	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
 	return 0;
 
 oops:
 	prxy_halt_participating_devices (prxy);
+	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
 	return 0;
 }
 
@@ -510,6 +1006,8 @@ static int prxy_client_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wr
 	prxy_t* prxy = (prxy_t*)cli->task;
 	int n;
 
+	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)prxy);
+
 	n = prxy->client_org_on_write? prxy->client_org_on_write(sck, wrlen, wrctx, dstaddr): 0;
 
 	if (wrlen == 0)
@@ -537,6 +1035,7 @@ static int prxy_client_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wr
 	}
 
 	if (n <= -1 || wrlen <= -1) prxy_halt_participating_devices (prxy);
+	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
 	return 0;
 }
 
@@ -778,110 +1277,563 @@ static void unbind_task_from_client (prxy_t* prxy, int rcdown)
 
 /* ----------------------------------------------------------------------- */
 
-static void on_peer_ipaddr_resolved (hio_svc_dnc_t* dnc, hio_dns_msg_t* reqmsg, hio_errnum_t status, const void* data, hio_oow_t len)
+static hio_dev_sck_t* make_peer (prxy_t* prxy)
+{
+	hio_svc_htts_t* htts = prxy->htts;
+	hio_t* hio = htts->hio;
+	hio_dev_sck_make_t m;
+	hio_dev_sck_connect_t c;
+	hio_dev_sck_t* sck;
+	prxy_peer_xtn_t* pxtn;
+
+	HIO_MEMSET (&m, 0, HIO_SIZEOF(m));
+	if (hio_get_stream_sck_type_from_skad(&prxy->peer_addr, &m.type) <= -1)
+	{
+		hio_seterrnum (hio, HIO_EINVAL);
+		return HIO_NULL;
+	}
+
+	m.on_write = prxy_peer_on_write;
+	m.on_read = prxy_peer_on_read;
+	m.on_connect = prxy_peer_on_connect;
+	m.on_disconnect = prxy_peer_on_disconnect;
+
+	sck = hio_dev_sck_make(hio, HIO_SIZEOF(*pxtn), &m);
+	if (HIO_UNLIKELY(!sck)) return HIO_NULL;
+
+	pxtn = hio_dev_sck_getxtn(sck);
+	HIO_MEMSET (pxtn, 0, HIO_SIZEOF(*pxtn));
+	pxtn->htts = htts;
+	pxtn->age_tmridx = HIO_TMRIDX_INVALID;
+	hio_gettime (hio, &pxtn->born);
+
+	HIO_MEMSET (&c, 0, HIO_SIZEOF(c));
+	c.remoteaddr = prxy->peer_addr;
+	HIO_INIT_NTIME (&c.connect_tmout, PRXY_CONNECT_TMOUT, 0);
+	if (hio_dev_sck_connect(sck, &c) <= -1)
+	{
+		hio_dev_sck_kill (sck);
+		return HIO_NULL;
+	}
+
+	return sck;
+}
+
+static int get_peer_addr (prxy_t* prxy, hio_htre_t* req, hio_bch_t* name, hio_oow_t* namelen)
+{
+	/* return 1 if the authority part of the request target is a literal
+	 * address. return 0 if it's a host name to resolve. the port number
+	 * is stored into prxy->peer_addr in both cases. */
+	hio_t* hio = prxy->htts->hio;
+	const hio_bch_t* qpath = hio_htre_getqpath(req);
+	const hio_bch_t* host, * end, * colon;
+	hio_oow_t port = 80, i;
+	static hio_uint8_t any[HIO_IP4AD_LEN] = { 0, 0, 0, 0 };
+
+	/* TODO: https not supported yet */
+	if (hio_comp_bcstr_limited(qpath, "http://", 7, 1) != 0)
+	{
+		hio_seterrbfmt (hio, HIO_EINVAL, "no upstream address in the request");
+		return -1;
+	}
+
+	host = qpath + 7;
+	for (end = host; *end != '\0' && *end != '/'; end++) /* nothing */;
+
+	if (hio_bcharstoskad(hio, host, end - host, &prxy->peer_addr) >= 0)
+	{
+		if (hio_skad_get_port(&prxy->peer_addr) == 0)
+		{
+			/* use the default port as the authority doesn't specify one */
+			hio_bch_t tmp[HIO_SKAD_IP_STRLEN + 8];
+			hio_oow_t len;
+
+			len = hio_fmttobcstr(hio, tmp, HIO_COUNTOF(tmp), "%.*hs:80", (int)(end - host), host);
+			if (hio_bcharstoskad(hio, tmp, len, &prxy->peer_addr) <= -1) return -1;
+		}
+		return 1;
+	}
+
+	for (colon = host; colon < end && *colon != ':'; colon++) /* nothing */;
+	if (colon < end)
+	{
+		const hio_bch_t* ptr;
+
+		if (colon + 1 >= end) goto bad_authority;
+		for (port = 0, ptr = colon + 1; ptr < end; ptr++)
+		{
+			if (!hio_is_bch_digit(*ptr)) goto bad_authority;
+			port = port * 10 + (*ptr - '0');
+			if (port > 65535) goto bad_authority;
+		}
+	}
+
+	*namelen = colon - host;
+	if (*namelen <= 0 || *namelen > PRXY_DNS_NAME_MAX) goto bad_authority;
+	for (i = 0; i < *namelen; i++) name[i] = hio_to_bch_lower(host[i]);
+	name[i] = '\0';
+
+	/* the address is unknown until the host name is resolved */
+	hio_skad_init_for_ip_with_bytes (&prxy->peer_addr, port, any, HIO_SIZEOF(any));
+	return 0;
+
+bad_authority:
+	hio_seterrbfmt (hio, HIO_EINVAL, "invalid upstream authority %.*hs", (int)(end - host), host);
+	return -1;
+}
+
+static int is_hop_by_hop_header (hio_http_hdr_t id)
+{
+	switch (id)
+	{
+		case HIO_HTTP_HDR_CONNECTION:
+		case HIO_HTTP_HDR_KEEP_ALIVE:
+		case HIO_HTTP_HDR_PROXY_CONNECTION:
+		case HIO_HTTP_HDR_TE:
+		case HIO_HTTP_HDR_TRAILER:
+		case HIO_HTTP_HDR_TRANSFER_ENCODING:
+		case HIO_HTTP_HDR_UPGRADE:
+		case HIO_HTTP_HDR_CONTENT_LENGTH:
+		case HIO_HTTP_HDR_EXPECT:
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+struct peer_relay_ctx_t
+{
+	hio_becs_t* dbuf;
+	const hio_htre_hdrval_t* conn; /* Connection header of the request. looked up once before walking the headers */
+};
+typedef struct peer_relay_ctx_t peer_relay_ctx_t;
+
+static int peer_relay_request_header (hio_htre_t* req, const hio_bch_t* key, const hio_htre_hdrval_t* val, void* ctx)
+{
+	peer_relay_ctx_t* rctx = (peer_relay_ctx_t*)ctx;
+	const hio_htre_hdrval_t* conn;
+
+	if (is_hop_by_hop_header(hio_htre_gethdrvalid(val))) return 0;
+
+	/* the header fields listed in Connection are hop-by-hop too */
+	for (conn = rctx->conn; conn; conn = conn->next)
+	{
+		if (hio_find_bcstr_word_in_bcstr(conn->ptr, key, ',', 1)) return 0;
+	}
+
+	while (val)
+	{
+		if (hio_becs_fcat(rctx->dbuf, "%hs: %hs\r\n", key, val->ptr) == (hio_oow_t)-1) return -1;
+		val = val->next;
+	}
+
+	return 0;
+}
+
+static int build_request_header (prxy_t* prxy, hio_htre_t* req)
+{
+	/* build the request header to relay in htts->becbuf */
+	hio_svc_htts_t* htts = prxy->htts;
+	hio_becs_t* dbuf = htts->becbuf;
+	const hio_bch_t* path, * qparam;
+	hio_oow_t plen;
+	peer_relay_ctx_t rctx;
+
+	if (req->flags & HIO_HTRE_QPATH_PERDEC)
+	{
+		/* relay the path as the client has sent it */
+		path = req->orgqpath.ptr;
+		plen = req->orgqpath.len;
+	}
+	else
+	{
+		path = hio_htre_getqpath(req);
+		plen = hio_htre_getqpathlen(req);
+	}
+
+	if (plen >= 7 && hio_comp_bchars_bcstr(path, 7, "http://", 1) == 0)
+	{
+		/* strip the scheme and the authority off the absolute form */
+		const hio_bch_t* end = path + plen;
+		path += 7;
+		while (path < end && *path != '/') path++;
+		plen = end - path;
+		if (plen <= 0)
+		{
+			path = "/";
+			plen = 1;
+		}
+	}
+
+	qparam = hio_htre_getqparam(req);
+	rctx.dbuf = dbuf;
+	rctx.conn = hio_htre_getheaderbyid(req, HIO_HTTP_HDR_CONNECTION);
+
+	if (hio_becs_fmt(dbuf, "%hs %.*hs%hs%hs HTTP/1.1\r\n", hio_htre_getqmethodname(req), (int)plen, path, (qparam? "?": ""), (qparam? qparam: "")) == (hio_oow_t)-1 ||
+	    hio_htre_walkheaders(req, peer_relay_request_header, &rctx) <= -1) return -1;
+
+	if (prxy->peer_req_chunked)
+	{
+		if (hio_becs_cat(dbuf, "Transfer-Encoding: chunked\r\n") == (hio_oow_t)-1) return -1;
+	}
+	else if (prxy->task_req_conlen > 0)
+	{
+		if (hio_becs_fcat(dbuf, "Content-Length: %zu\r\n", prxy->task_req_conlen) == (hio_oow_t)-1) return -1;
+	}
+
+	if (hio_becs_fcat(dbuf, "Connection: %hs\r\n\r\n", (htts->option.task_prxy_idle_max > 0? "keep-alive": "close")) == (hio_oow_t)-1) return -1;
+	return 0;
+}
+
+static int is_idempotent (hio_http_method_t method)
 {
-	// initiate connect.
-	// enable read if necessary...
+	switch (method)
+	{
+		case HIO_HTTP_HEAD:
+		case HIO_HTTP_GET:
+		case HIO_HTTP_PUT:
+		case HIO_HTTP_DELETE:
+		case HIO_HTTP_OPTIONS:
+		case HIO_HTTP_TRACE:
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+static int send_request_header (prxy_t* prxy, const hio_bch_t* ptr, hio_oow_t len)
+{
+	if (prxy->peer_reused && !prxy->peer_req_chunked && prxy->task_req_conlen <= 0 && is_idempotent(prxy->task_req_method))
+	{
+		/* the idle connection may have been closed by the peer just before getting reused.
+		 * keep the request header to retry it on a new connection. this is feasible
+		 * for a request without content only as the content is not kept. the peer may
+		 * have processed the request before closing the connection. so it's not done
+		 * for a method that isn't idempotent like the http client */
+		prxy->peer_reqhdr = hio_becs_open(prxy->htts->hio, 0, len);
+		if (HIO_UNLIKELY(!prxy->peer_reqhdr) ||
+		    hio_becs_ncpy(prxy->peer_reqhdr, ptr, len) == (hio_oow_t)-1) return -1;
+	}
+
+	return prxy_write_to_peer(prxy, ptr, len);
+}
+
+static int retry_on_new_peer (prxy_t* prxy)
+{
+	hio_t* hio = prxy->htts->hio;
+	hio_dev_sck_t* sck;
+	int n;
+
+	HIO_DEBUG3 (hio, "HTTS(%p) - prxy(t=%p) - retrying request on new connection after failure of reused peer %p\n", prxy->htts, prxy, prxy->peer);
+
+	if (prxy->peer)
+	{
+		sck = prxy->peer;
+		detach_peer (prxy, 1);
+		hio_dev_sck_halt (sck);
+	}
+
+	sck = make_peer(prxy);
+	if (HIO_UNLIKELY(!sck)) return -1;
+
+	attach_peer (prxy, sck);
+	prxy->peer_reused = 0;
+	prxy->peer_broken = 0;
+
+	n = prxy_write_to_peer(prxy, HIO_BECS_PTR(prxy->peer_reqhdr), HIO_BECS_LEN(prxy->peer_reqhdr));
+	hio_becs_close (prxy->peer_reqhdr);
+	prxy->peer_reqhdr = HIO_NULL;
+	return n;
+}
+
+static void prxy_on_peer_failure (prxy_t* prxy, int retriable)
+{
+	/* the peer connection has failed before the response is read completely */
+
+	if (retriable && prxy->peer_reused && prxy->peer_reqhdr && !prxy->peer_res_received &&
+	    retry_on_new_peer(prxy) >= 0) return;
+
+	prxy->peer_broken = 1;
+
+	if (!prxy->task_res_started && !(prxy->over & PRXY_OVER_WRITE_TO_CLIENT))
+	{
+		/* nothing has been relayed to the client yet. respond with an error
+		 * and close the client connection when it's been sent */
+		prxy->task_keep_client_alive = 0;
+		if (hio_svc_htts_task_sendfinalres((hio_svc_htts_task_t*)prxy, HIO_HTTP_STATUS_BAD_GATEWAY, HIO_NULL, HIO_NULL, 1) >= 0)
+		{
+			prxy_mark_over (prxy, PRXY_OVER_READ_FROM_CLIENT | PRXY_OVER_READ_FROM_PEER | PRXY_OVER_WRITE_TO_PEER);
+			return;
+		}
+	}
+
+	prxy_halt_participating_devices (prxy);
 }
 
 /* ----------------------------------------------------------------------- */
 
-static int bind_task_to_peer (prxy_t* prxy, hio_dev_sck_t* csck, hio_htre_t* req, const hio_skad_t* skad)
+struct prxy_dns_msg_xtn_t
 {
-	hio_svc_htts_cli_t* cli = hio_dev_sck_getxtn(csck);
+	hio_svc_htts_t* htts;
+	hio_svc_htts_prxy_dns_t* dns;
+};
+typedef struct prxy_dns_msg_xtn_t prxy_dns_msg_xtn_t;
+
+static void on_peer_ipaddr_resolved (hio_svc_dnc_t* dnc, hio_dns_msg_t* reqmsg, hio_errnum_t status, const void* data, hio_oow_t len);
+
+static int query_dns (hio_svc_htts_t* htts, hio_svc_htts_prxy_dns_t* dns, hio_dns_rrt_t qtype)
+{
+	hio_dns_msg_t* reqmsg;
+	prxy_dns_msg_xtn_t* msgxtn;
+
+	reqmsg = hio_svc_dnc_resolve(htts->dnc, dns->name, qtype, HIO_SVC_DNC_RESOLVE_FLAG_BRIEF, on_peer_ipaddr_resolved, HIO_SIZEOF(*msgxtn));
+	if (HIO_UNLIKELY(!reqmsg)) return -1;
+
+	msgxtn = (prxy_dns_msg_xtn_t*)hio_svc_dnc_getresolvemsgxtn(htts->dnc, reqmsg);
+	msgxtn->htts = htts;
+	msgxtn->dns = dns;
+
+	dns->reqmsg = reqmsg;
+	dns->qtype = qtype;
+	return 0;
+}
+
+static void unlink_dns_waiter (prxy_t* prxy)
+{
+	hio_svc_htts_task_t** pp;
+
+	pp = &prxy->peer_dns->waiter;
+	while (*pp != (hio_svc_htts_task_t*)prxy) pp = &((prxy_t*)*pp)->peer_dns_next;
+	*pp = prxy->peer_dns_next;
+
+	prxy->peer_dns = HIO_NULL;
+	prxy->peer_dns_next = HIO_NULL;
+}
+
+static int resolve_peer_name (prxy_t* prxy, const hio_bch_t* name, hio_oow_t len)
+{
+	/* return 1 if the address is found in the cache. return 0 if the task must
+	 * wait for the query to complete. the port number in prxy->peer_addr is kept */
 	hio_svc_htts_t* htts = prxy->htts;
-	hio_t* hio = htts->hio;
-	hio_dev_sck_make_t m;
-	hio_dev_sck_t* sck = HIO_NULL;
-	hio_htrd_t* htrd = HIO_NULL;
-	prxy_peer_xtn_t* pxtn;
-	hio_skad_t resolved_skad;
+	hio_svc_htts_prxy_dns_t* dns;
+
+	if (!htts->dnc)
+	{
+		hio_seterrbfmt (htts->hio, HIO_ENOIMPL, "unable to resolve %.*hs - dns client not enabled", (int)len, name);
+		return -1;
+	}
+
+	dns = find_dns(htts, name, len);
+	if (dns && !dns->reqmsg)
+	{
+		hio_skad_init_for_ip_with_bytes (&prxy->peer_addr, hio_skad_get_port(&prxy->peer_addr), dns->ip, dns->iplen);
+		return 1;
+	}
 
-	if (!skad)
+	if (!dns)
 	{
-		const hio_bch_t* qpath = hio_htre_getqpath(req);
+		dns = make_dns(htts, name, len);
+		if (HIO_UNLIKELY(!dns)) return -1;
 
-		/* TODO: https not supported yet */
-		if (hio_comp_bcstr_limited(qpath, "http://", 7, 0) == 0)
+		if (query_dns(htts, dns, HIO_DNS_RRT_A) <= -1)
 		{
-			const hio_bch_t* host = qpath + 7;
-			if (hio_bcstrtoskad(hio, host, &resolved_skad) <= -1)
-			{
-				/*
-				if (hio_svc_dnc_resolve(htts->dnc, qpath + , qtype, 0, on_peer_ipaddr_resolved, 0) <= -1)
-				{
-				}*/
-			}
+			free_dns (htts, dns);
+			return -1;
 		}
 	}
 
-	HIO_MEMSET (&m, 0, HIO_SIZEOF(m));
-	if (hio_get_stream_sck_type_from_skad(skad, &m.type) <= -1)
+	/* join the query in progress */
+	prxy->peer_dns = dns;
+	prxy->peer_dns_next = dns->waiter;
+	dns->waiter = (hio_svc_htts_task_t*)prxy;
+	return 0;
+}
+
+static int connect_resolved_peer (prxy_t* prxy)
+{
+	hio_svc_htts_t* htts = prxy->htts;
+	hio_dev_sck_t* sck;
+	int n;
+
+	sck = take_idle_peer(htts, &prxy->peer_addr);
+	if (sck)
 	{
-		hio_seterrnum (hio, HIO_EINVAL);
-		goto oops;
+		HIO_DEBUG4 (htts->hio, "HTTS(%p) - prxy(t=%p) - reusing idle peer %p(hnd=%d)\n", htts, prxy, sck, (int)sck->hnd);
+		prxy->peer_reused = 1;
+	}
+	else
+	{
+		sck = make_peer(prxy);
+		if (HIO_UNLIKELY(!sck)) return -1;
 	}
 
-	m.on_write = prxy_peer_on_write;
-	m.on_read = prxy_peer_on_read;
-	m.on_connect = prxy_peer_on_connect;
-	m.on_disconnect = prxy_peer_on_disconnect;
+	attach_peer (prxy, sck);
 
-	sck = hio_dev_sck_make(hio, HIO_SIZEOF(*pxtn), &m);
-	htrd = hio_htrd_open(hio, HIO_SIZEOF(*pxtn));
-	if (HIO_UNLIKELY(!sck || !htrd)) goto oops;
+	/* write the request header and the content received while resolving */
+	n = send_request_header(prxy, HIO_BECS_PTR(prxy->peer_wbuf), HIO_BECS_LEN(prxy->peer_wbuf));
+	hio_becs_close (prxy->peer_wbuf);
+	prxy->peer_wbuf = HIO_NULL;
+	if (n <= -1) return -1;
 
-	hio_htrd_setoption (htrd, HIO_HTRD_RESPONSE);
-	hio_htrd_setrecbs (htrd, &peer_htrd_recbs);
+	/* resume reading the content from the client */
+	if (!(prxy->over & PRXY_OVER_READ_FROM_CLIENT) && prxy->task_csck && hio_dev_sck_read(prxy->task_csck, 1) <= -1) return -1;
+	return 0;
+}
 
-	prxy->peer = sck;
-	prxy->peer_htrd = htrd;
+static void on_peer_ipaddr_resolved (hio_svc_dnc_t* dnc, hio_dns_msg_t* reqmsg, hio_errnum_t status, const void* data, hio_oow_t len)
+{
+	prxy_dns_msg_xtn_t* msgxtn = (prxy_dns_msg_xtn_t*)hio_svc_dnc_getresolvemsgxtn(dnc, reqmsg);
+	hio_svc_htts_t* htts = msgxtn->htts;
+	hio_svc_htts_prxy_dns_t* dns = msgxtn->dns;
+	const hio_dns_brr_t* brr = (const hio_dns_brr_t*)data;
+	hio_t* hio = htts->hio;
+	hio_ntime_t ttl;
 
-	pxtn = hio_dev_sck_getxtn(prxy->peer);
-	pxtn->prxy = prxy;
-	HIO_SVC_HTTS_TASK_RCUP (prxy);
+	HIO_ASSERT (hio, dns->reqmsg == reqmsg);
+	dns->reqmsg = HIO_NULL;
+
+	HIO_INIT_NTIME (&ttl, 0, 0);
+	if (brr && (brr->rrtype == HIO_DNS_RRT_A || brr->rrtype == HIO_DNS_RRT_AAAA) && brr->dlen <= HIO_SIZEOF(dns->ip))
+	{
+		HIO_MEMCPY (dns->ip, brr->dptr, brr->dlen);
+		dns->iplen = brr->dlen;
+
+		/* keep the address no longer than the time-to-live of the record */
+		HIO_INIT_NTIME (&ttl, brr->ttl, 0);
+		if (HIO_CMP_NTIME(&ttl, &htts->option.task_prxy_dns_ttl_max) > 0) ttl = htts->option.task_prxy_dns_ttl_max;
+		hio_gettime (hio, &dns->expiry);
+		HIO_ADD_NTIME (&dns->expiry, &dns->expiry, &ttl);
+
+		HIO_DEBUG3 (hio, "HTTS(%p) - resolved %hs - ttl %ld\n", htts, dns->name, (long int)brr->ttl);
+	}
+	else if (dns->qtype == HIO_DNS_RRT_A && status == HIO_ENOERR && dns->waiter && query_dns(htts, dns, HIO_DNS_RRT_AAAA) >= 0)
+	{
+		/* no ipv4 address. the waiting tasks are notified when the ipv6 query completes */
+		return;
+	}
+	else
+	{
+		HIO_DEBUG3 (hio, "HTTS(%p) - unable to resolve %hs - status %d\n", htts, dns->name, (int)status);
+		dns->iplen = 0;
+	}
+
+	while (dns->waiter)
+	{
+		prxy_t* prxy = (prxy_t*)dns->waiter;
+
+		dns->waiter = prxy->peer_dns_next;
+		prxy->peer_dns = HIO_NULL;
+		prxy->peer_dns_next = HIO_NULL;
+
+		HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)prxy);
+		if (dns->iplen <= 0)
+		{
+			prxy_on_peer_failure (prxy, 0);
+		}
+		else
+		{
+			hio_skad_init_for_ip_with_bytes (&prxy->peer_addr, hio_skad_get_port(&prxy->peer_addr), dns->ip, dns->iplen);
+			if (connect_resolved_peer(prxy) <= -1) prxy_on_peer_failure (prxy, 0);
+		}
+		HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
+	}
+
+	if (!HIO_IS_POS_NTIME(&ttl) || htts->prxy.ndns > htts->option.task_prxy_dns_cache_max) free_dns (htts, dns);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int bind_task_to_peer (prxy_t* prxy, hio_dev_sck_t* csck, hio_htre_t* req, const hio_skad_t* skad)
+{
+	hio_svc_htts_t* htts = prxy->htts;
+	hio_t* hio = htts->hio;
+	hio_dev_sck_t* sck;
+	prxy_peer_xtn_t* pxtn;
+	hio_bch_t name[PRXY_DNS_NAME_MAX + 1];
+	hio_oow_t namelen;
+	int n = 1;
+
+	if (skad) prxy->peer_addr = *skad;
+	else
+	{
+		n = get_peer_addr(prxy, req, name, &namelen);
+		if (n == 0) n = resolve_peer_name(prxy, name, namelen);
+		if (n <= -1) return -1;
+	}
 
+	prxy->peer_htrd = hio_htrd_open(hio, HIO_SIZEOF(*pxtn));
+	if (HIO_UNLIKELY(!prxy->peer_htrd)) goto oops;
+
+	hio_htrd_setoption (prxy->peer_htrd, HIO_HTRD_RESPONSE);
+	hio_htrd_setrecbs (prxy->peer_htrd, &peer_htrd_recbs);
 	pxtn = hio_htrd_getxtn(prxy->peer_htrd);
 	pxtn->prxy = prxy;
-	HIO_SVC_HTTS_TASK_RCUP (prxy);
 
+	prxy->peer_req_chunked = prxy->task_req_conlen_unlimited;
+	if (build_request_header(prxy, req) <= -1) goto oops;
+
+	if (n == 0)
+	{
+		/* the host name is being resolved. keep the request header
+		 * until the connection is made in on_peer_ipaddr_resolved() */
+		HIO_DEBUG3 (hio, "HTTS(%p) - prxy(t=%p) - waiting for %hs to be resolved\n", htts, prxy, prxy->peer_dns->name);
+		prxy->peer_wbuf = hio_becs_open(hio, 0, HIO_BECS_LEN(htts->becbuf));
+		if (HIO_UNLIKELY(!prxy->peer_wbuf) ||
+		    hio_becs_ncpy(prxy->peer_wbuf, HIO_BECS_PTR(htts->becbuf), HIO_BECS_LEN(htts->becbuf)) == (hio_oow_t)-1) goto oops;
+		return 0;
+	}
+
+	/* reuse an idle connection to the same upstream if any. make a new one otherwise */
+	sck = take_idle_peer(htts, &prxy->peer_addr);
+	if (sck)
+	{
+		HIO_DEBUG4 (hio, "HTTS(%p) - prxy(t=%p) - reusing idle peer %p(hnd=%d)\n", htts, prxy, sck, (int)sck->hnd);
+		prxy->peer_reused = 1;
+	}
+	else
+	{
+		sck = make_peer(prxy);
+		if (HIO_UNLIKELY(!sck)) goto bad_gateway;
+	}
+
+	attach_peer (prxy, sck);
+	if (send_request_header(prxy, HIO_BECS_PTR(htts->becbuf), HIO_BECS_LEN(htts->becbuf)) <= -1) goto bad_gateway;
 	return 0;
 
 oops:
-	if (htrd) hio_htrd_close (htrd);
-	if (sck) hio_dev_sck_kill (sck);
+	unbind_task_from_peer (prxy, 1);
 	return -1;
+
+bad_gateway:
+	/* the connection to the upstream has failed immediately. e.g. refused on the loopback */
+	unbind_task_from_peer (prxy, 1);
+	return -2;
 }
 
 static void unbind_task_from_peer (prxy_t* prxy, int rcdown)
 {
-	int n = 0;
+	if (prxy->peer_dns) unlink_dns_waiter (prxy);
+
+	if (prxy->peer_wbuf)
+	{
+		hio_becs_close (prxy->peer_wbuf);
+		prxy->peer_wbuf = HIO_NULL;
+	}
 
 	if (prxy->peer_htrd)
 	{
+		/* the peer htrd is owned by the task without holding a reference */
 		hio_htrd_close (prxy->peer_htrd);
 		prxy->peer_htrd = HIO_NULL;
-		n++;
 	}
 
 	if (prxy->peer)
 	{
-		prxy_peer_xtn_t* peer_xtn;
-		peer_xtn = hio_dev_sck_getxtn(prxy->peer);
-		peer_xtn->prxy = HIO_NULL;
-
-		hio_dev_sck_kill (prxy->peer);
-		prxy->peer = HIO_NULL;
-		n++;
-	}
-
-	if (rcdown)
-	{
-		while (n > 0)
-		{
-			n--;
-			HIO_SVC_HTTS_TASK_RCDOWN((hio_svc_htts_task_t*)prxy);
-		}
+		hio_dev_sck_t* peer = prxy->peer;
+		detach_peer (prxy, rcdown);
+		hio_dev_sck_kill (peer);
 	}
 }
 
@@ -907,9 +1859,8 @@ static int setup_for_content_length(prxy_t* prxy, hio_htre_t* req)
 	}
 	else
 	{
-		/* no content to be uploaded from the client */
-		/* indicate EOF to the peer and disable input wathching from the client */
-		if (prxy_write_to_peer(prxy, HIO_NULL, 0) <= -1) return -1;
+		/* no content to be uploaded from the client. the request header tells
+		 * the peer that no content follows. disable input wathching from the client */
 		prxy_mark_over (prxy, PRXY_OVER_READ_FROM_CLIENT | PRXY_OVER_WRITE_TO_PEER);
 	}
 
@@ -938,6 +1889,7 @@ int hio_svc_htts_doprxy (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t*
 
 	prxy = (prxy_t*)hio_svc_htts_task_make(htts, HIO_SIZEOF(*prxy), prxy_on_kill, req, csck);
 	if (HIO_UNLIKELY(!prxy)) goto oops;
+	HIO_SVC_HTTS_STAT_INC (htts, task_prxy);
 	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)prxy);
 
 	prxy->options = options;
@@ -947,16 +1899,19 @@ int hio_svc_htts_doprxy (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t*
 
 	if ((n = bind_task_to_peer(prxy, csck, req, tgt_addr)) <= -1)
 	{
-		hio_svc_htts_task_sendfinalres((hio_svc_htts_task_t*)prxy, (n == 2? HIO_HTTP_STATUS_FORBIDDEN: HIO_HTTP_STATUS_INTERNAL_SERVER_ERROR), HIO_NULL, HIO_NULL, 1);
+		/* the final response is sent below */
+		if (n == -2) status_code = HIO_HTTP_STATUS_BAD_GATEWAY;
 		goto oops; /* TODO: must not go to oops.  just destroy the prxy and finalize the request .. */
 	}
 	bound_to_peer = 1;
 
-	if (hio_svc_htts_task_handleexpect100((hio_svc_htts_task_t*)prxy, 0) <= -1) goto oops;
+	/* a chunked request body is relayed in chunks as it arrives */
+	if (hio_svc_htts_task_handleexpect100((hio_svc_htts_task_t*)prxy, HIO_SVC_HTTS_TASK_EXPECT100_CHUNKED) <= -1) goto oops;
 	if (setup_for_content_length(prxy, req) <= -1) goto oops;
 
 	/* TODO: store current input watching state and use it when destroying the prxy data */
-	if (hio_dev_sck_read(csck, !(prxy->over & PRXY_OVER_READ_FROM_CLIENT)) <= -1) goto oops;
+	/* the client content is not read while the upstream host name is being resolved */
+	if (hio_dev_sck_read(csck, !(prxy->over & PRXY_OVER_READ_FROM_CLIENT) && !prxy->peer_dns) <= -1) goto oops;
 
 	HIO_SVC_HTTS_TASKL_APPEND_TASK (&htts->task, (hio_svc_htts_task_t*)prxy);
 	HIO_SVC_HTTS_TASK_RCDOWN ((hio_svc_htts_task_t*)prxy);
@@ -0,0 +1,653 @@
+/*
+    Copyright (c) 2016-2020 Chung, Hyung-Hwan. All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+    1. Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+    IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+    NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+    THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "http-prv.h"
+#include <hio-fmt.h>
+
+/*
+ * The route trie is a radix tree over the octets of the path patterns.
+ * A static edge holds the longest text shared by the patterns below it
+ * and the children of a node are indexed by the first octet of their
+ * edges. A parameter or a wildcard segment hangs off a node as a separate
+ * child that consumes a segment or the rest of the path when matched.
+ * A static edge is preferred. When it leads to a dead end, the parameter
+ * and then the wildcard at the same position are tried next. A lookup
+ * without such dead ends visits at most one node per path octet. Each
+ * dead end makes the part of the path below it walked again, so the worst
+ * case grows with the number of segments where a static child and a
+ * parameter overlap, not with the number of routes.
+ */
+
+#define RTNODE_STATIC 0
+#define RTNODE_PARAM  1
+#define RTNODE_WILD   2
+
+#define RTNODE_METHODS (HIO_HTTP_CONNECT + 1)
+
+struct hio_svc_htts_rtnode_t
+{
+	int type;
+	hio_bch_t* label; /* static text or the parameter name */
+	hio_oow_t llen;
+
+	hio_oow_t nchilds;
+	hio_oow_t capa;
+	hio_bch_t* first; /* first octet of each static child in ascending order */
+	hio_svc_htts_rtnode_t** child;
+
+	hio_svc_htts_rtnode_t* param;
+	hio_svc_htts_rtnode_t* wild;
+
+	hio_oow_t nroutes;
+	hio_svc_htts_route_t* route[RTNODE_METHODS];
+};
+
+struct rtmatch_t
+{
+	hio_svc_htts_route_param_t* params;
+	hio_oow_t capa;
+	hio_oow_t count;
+	const hio_bch_t* rest; /* path matched by the wildcard */
+};
+typedef struct rtmatch_t rtmatch_t;
+
+/* ------------------------------------------------------------------------ */
+
+static hio_svc_htts_rtnode_t* make_rtnode (hio_t* hio, int type, const hio_bch_t* label, hio_oow_t llen)
+{
+	hio_svc_htts_rtnode_t* node;
+
+	node = (hio_svc_htts_rtnode_t*)hio_callocmem(hio, HIO_SIZEOF(*node) + llen + 1);
+	if (HIO_UNLIKELY(!node)) return HIO_NULL;
+
+	node->type = type;
+	node->label = (hio_bch_t*)(node + 1);
+	node->llen = llen;
+	HIO_MEMCPY (node->label, label, llen);
+	return node;
+}
+
+static void free_rtnode (hio_t* hio, hio_svc_htts_rtnode_t* node)
+{
+	hio_oow_t i;
+
+	for (i = 0; i < node->nchilds; i++) free_rtnode (hio, node->child[i]);
+	if (node->param) free_rtnode (hio, node->param);
+	if (node->wild) free_rtnode (hio, node->wild);
+	for (i = 0; i < RTNODE_METHODS; i++)
+	{
+		if (node->route[i]) hio_freemem (hio, node->route[i]);
+	}
+
+	if (node->first) hio_freemem (hio, node->first);
+	if (node->child) hio_freemem (hio, node->child);
+	hio_freemem (hio, node);
+}
+
+static HIO_INLINE hio_oow_t find_rtnode_child (hio_svc_htts_rtnode_t* node, hio_bch_t c, int* found)
+{
+	/* binary search over the first octets. there are 256 children at most */
+	hio_oow_t lo = 0, hi = node->nchilds;
+
+	while (lo < hi)
+	{
+		hio_oow_t mid = lo + (hi - lo) / 2;
+		if ((hio_bchu_t)node->first[mid] < (hio_bchu_t)c) lo = mid + 1;
+		else hi = mid;
+	}
+
+	*found = (lo < node->nchilds && node->first[lo] == c);
+	return lo;
+}
+
+static int insert_rtnode_child (hio_t* hio, hio_svc_htts_rtnode_t* node, hio_oow_t idx, hio_svc_htts_rtnode_t* child)
+{
+	if (node->nchilds >= node->capa)
+	{
+		hio_oow_t newcapa;
+		hio_bch_t* tmp1;
+		hio_svc_htts_rtnode_t** tmp2;
+
+		newcapa = node->capa <= 0? 2: node->capa * 2;
+		tmp1 = (hio_bch_t*)hio_reallocmem(hio, node->first, newcapa * HIO_SIZEOF(*tmp1));
+		if (HIO_UNLIKELY(!tmp1)) return -1;
+		node->first = tmp1;
+
+		tmp2 = (hio_svc_htts_rtnode_t**)hio_reallocmem(hio, node->child, newcapa * HIO_SIZEOF(*tmp2));
+		if (HIO_UNLIKELY(!tmp2)) return -1;
+		node->child = tmp2;
+
+		node->capa = newcapa;
+	}
+
+	HIO_MEMMOVE (&node->first[idx + 1], &node->first[idx], (node->nchilds - idx) * HIO_SIZEOF(*node->first));
+	HIO_MEMMOVE (&node->child[idx + 1], &node->child[idx], (node->nchilds - idx) * HIO_SIZEOF(*node->child));
+	node->first[idx] = child->label[0];
+	node->child[idx] = child;
+	node->nchilds++;
+	return 0;
+}
+
+static hio_svc_htts_rtnode_t* add_static_rtnode (hio_t* hio, hio_svc_htts_rtnode_t* node, const hio_bch_t* seg, hio_oow_t slen)
+{
+	while (slen > 0)
+	{
+		hio_svc_htts_rtnode_t* child;
+		hio_oow_t idx, k;
+		int found;
+
+		idx = find_rtnode_child(node, seg[0], &found);
+		if (!found)
+		{
+			child = make_rtnode(hio, RTNODE_STATIC, seg, slen);
+			if (HIO_UNLIKELY(!child)) return HIO_NULL;
+			if (HIO_UNLIKELY(insert_rtnode_child(hio, node, idx, child) <= -1))
+			{
+				free_rtnode (hio, child);
+				return HIO_NULL;
+			}
+			return child;
+		}
+
+		child = node->child[idx];
+		for (k = 1; k < child->llen && k < slen && child->label[k] == seg[k]; k++) /* nothing */;
+
+		if (k < child->llen)
+		{
+			/* split the edge at the end of the common part */
+			hio_svc_htts_rtnode_t* mid;
+
+			mid = make_rtnode(hio, RTNODE_STATIC, child->label, k);
+			if (HIO_UNLIKELY(!mid)) return HIO_NULL;
+
+			child->label += k;
+			child->llen -= k;
+			if (HIO_UNLIKELY(insert_rtnode_child(hio, mid, 0, child) <= -1))
+			{
+				child->label -= k;
+				child->llen += k;
+				free_rtnode (hio, mid);
+				return HIO_NULL;
+			}
+
+			node->child[idx] = mid;
+			child = mid;
+		}
+
+		node = child;
+		seg += k;
+		slen -= k;
+	}
+
+	return node;
+}
+
+static hio_svc_htts_rtnode_t* add_var_rtnode (hio_svc_htts_t* htts, hio_svc_htts_rtnode_t** slot, int type, const hio_bch_t* name, hio_oow_t nlen)
+{
+	if (*slot)
+	{
+		if (hio_comp_bchars((*slot)->label, (*slot)->llen, name, nlen, 0) != 0)
+		{
+			hio_seterrbfmt (htts->hio, HIO_EINVAL, "%hs %.*hs conflicting with %.*hs",
+				(type == RTNODE_PARAM? "parameter": "wildcard"), nlen, name, (*slot)->llen, (*slot)->label);
+			return HIO_NULL;
+		}
+	}
+	else
+	{
+		*slot = make_rtnode(htts->hio, type, name, nlen);
+	}
+
+	return *slot;
+}
+
+static hio_svc_htts_rtnode_t* add_rtpath (hio_svc_htts_t* htts, const hio_bch_t* path)
+{
+	hio_t* hio = htts->hio;
+	hio_svc_htts_rtnode_t* node;
+	const hio_bch_t* p = path, * e;
+	hio_oow_t nvars = 0;
+
+	for (e = path + 1; *e != '\0'; e++)
+	{
+		if ((*e == ':' || *e == '*') && e[-1] == '/') nvars++;
+	}
+	if (nvars > HIO_SVC_HTTS_ROUTE_PARAMS_MAX)
+	{
+		hio_seterrbfmt (hio, HIO_EINVAL, "too many parameters - %hs", path);
+		return HIO_NULL;
+	}
+
+	if (!htts->rtroot)
+	{
+		htts->rtroot = make_rtnode(hio, RTNODE_STATIC, "", 0);
+		if (HIO_UNLIKELY(!htts->rtroot)) return HIO_NULL;
+	}
+
+	node = htts->rtroot;
+	while (*p != '\0')
+	{
+		if (*p == ':' && p[-1] == '/')
+		{
+			for (e = p + 1; *e != '\0' && *e != '/'; e++) /* nothing */;
+			if (e == p + 1) goto unnamed;
+			node = add_var_rtnode(htts, &node->param, RTNODE_PARAM, p + 1, e - p - 1);
+		}
+		else if (*p == '*' && p[-1] == '/')
+		{
+			for (e = p + 1; *e != '\0'; e++)
+			{
+				if (*e == '/')
+				{
+					hio_seterrbfmt (hio, HIO_EINVAL, "wildcard not in the last segment - %hs", path);
+					return HIO_NULL;
+				}
+			}
+			if (e == p + 1) goto unnamed;
+			node = add_var_rtnode(htts, &node->wild, RTNODE_WILD, p + 1, e - p - 1);
+		}
+		else
+		{
+			/* static text up to the next parameter or wildcard */
+			for (e = p + 1; *e != '\0' && !((*e == ':' || *e == '*') && e[-1] == '/'); e++) /* nothing */;
+			node = add_static_rtnode(hio, node, p, e - p);
+		}
+
+		if (HIO_UNLIKELY(!node)) return HIO_NULL;
+		p = e;
+	}
+
+	return node;
+
+unnamed:
+	hio_seterrbfmt (hio, HIO_EINVAL, "unnamed parameter or wildcard - %hs", path);
+	return HIO_NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static hio_svc_htts_route_t* dup_route (hio_t* hio, const hio_svc_htts_route_t* route)
+{
+	const hio_bch_t** str[3];
+	hio_oow_t nstrs = 0, i, total = 0;
+	hio_svc_htts_route_t* dup;
+	hio_bch_t* ptr;
+
+	switch (route->type)
+	{
+		case HIO_SVC_HTTS_ROUTE_FILE:
+			str[nstrs++] = (const hio_bch_t**)&route->u.file.docroot;
+			str[nstrs++] = (const hio_bch_t**)&route->u.file.mime_type;
+			break;
+
+		case HIO_SVC_HTTS_ROUTE_CGI:
+			str[nstrs++] = (const hio_bch_t**)&route->u.cgi.docroot;
+			break;
+
+		case HIO_SVC_HTTS_ROUTE_FCGI:
+			str[nstrs++] = (const hio_bch_t**)&route->u.fcgi.docroot;
+			break;
+
+		case HIO_SVC_HTTS_ROUTE_TXT:
+			str[nstrs++] = (const hio_bch_t**)&route->u.txt.content_type;
+			str[nstrs++] = (const hio_bch_t**)&route->u.txt.content_text;
+			break;
+
+		case HIO_SVC_HTTS_ROUTE_THR:
+		case HIO_SVC_HTTS_ROUTE_FUN:
+		case HIO_SVC_HTTS_ROUTE_PRXY:
+			break;
+
+		default:
+			hio_seterrbfmt (hio, HIO_EINVAL, "invalid route type %d", (int)route->type);
+			return HIO_NULL;
+	}
+
+	for (i = 0; i < nstrs; i++)
+	{
+		if (*str[i]) total += hio_count_bcstr(*str[i]) + 1;
+	}
+
+	dup = (hio_svc_htts_route_t*)hio_allocmem(hio, HIO_SIZEOF(*dup) + total);
+	if (HIO_UNLIKELY(!dup)) return HIO_NULL;
+
+	*dup = *route;
+	ptr = (hio_bch_t*)(dup + 1);
+	for (i = 0; i < nstrs; i++)
+	{
+		/* make the same field in the copy point to the copied string */
+		const hio_bch_t** dst = (const hio_bch_t**)((hio_uint8_t*)dup + ((hio_uint8_t*)str[i] - (hio_uint8_t*)route));
+		if (*str[i])
+		{
+			*dst = ptr;
+			ptr += hio_copy_bcstr_unlimited(ptr, *str[i]) + 1;
+		}
+	}
+
+	return dup;
+}
+
+int hio_svc_htts_addroute (hio_svc_htts_t* htts, hio_bitmask_t methods, const hio_bch_t* path, const hio_svc_htts_route_t* route)
+{
+	hio_t* hio = htts->hio;
+	hio_svc_htts_rtnode_t* node;
+	hio_svc_htts_route_t* dup[RTNODE_METHODS];
+	hio_oow_t i, n = 0;
+
+	if (path[0] != '/' || (methods & HIO_SVC_HTTS_ROUTE_ALL_METHODS) == 0)
+	{
+		hio_seterrbfmt (hio, HIO_EINVAL, "invalid route path or methods - %hs", path);
+		return -1;
+	}
+
+	node = add_rtpath(htts, path);
+	if (HIO_UNLIKELY(!node)) return -1;
+
+	for (i = 0; i < RTNODE_METHODS; i++)
+	{
+		dup[i] = HIO_NULL;
+		if ((methods & HIO_SVC_HTTS_ROUTE_METHOD(i)) && node->route[i])
+		{
+			hio_seterrbfmt (hio, HIO_EEXIST, "route already set - %hs", path);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < RTNODE_METHODS; i++)
+	{
+		if (!(methods & HIO_SVC_HTTS_ROUTE_METHOD(i))) continue;
+		dup[i] = dup_route(hio, route);
+		if (HIO_UNLIKELY(!dup[i])) goto oops;
+		n++;
+	}
+
+	for (i = 0; i < RTNODE_METHODS; i++)
+	{
+		if (dup[i]) node->route[i] = dup[i];
+	}
+	node->nroutes += n;
+
+	return 0;
+
+oops:
+	for (i = 0; i < RTNODE_METHODS; i++)
+	{
+		if (dup[i]) hio_freemem (hio, dup[i]);
+	}
+	return -1;
+}
+
+void hio_svc_htts_clearroutes (hio_svc_htts_t* htts)
+{
+	if (htts->rtroot)
+	{
+		free_rtnode (htts->hio, htts->rtroot);
+		htts->rtroot = HIO_NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+static HIO_INLINE void push_rtparam (rtmatch_t* m, hio_svc_htts_rtnode_t* node, const hio_bch_t* value, hio_oow_t vlen)
+{
+	if (m->count < m->capa)
+	{
+		hio_svc_htts_route_param_t* param = &m->params[m->count];
+		param->name = node->label;
+		param->nlen = node->llen;
+		param->value = value;
+		param->vlen = vlen;
+	}
+	m->count++;
+}
+
+static hio_svc_htts_rtnode_t* match_rtnode (hio_svc_htts_rtnode_t* node, const hio_bch_t* p, rtmatch_t* m)
+{
+	/* the label of the node given has been matched */
+	hio_svc_htts_rtnode_t* r;
+
+	if (*p != '\0' && node->nchilds > 0)
+	{
+		hio_oow_t idx;
+		int found;
+
+		idx = find_rtnode_child(node, *p, &found);
+		if (found)
+		{
+			hio_svc_htts_rtnode_t* child = node->child[idx];
+			hio_oow_t k;
+
+			for (k = 1; k < child->llen && p[k] == child->label[k]; k++) /* nothing */;
+			if (k >= child->llen)
+			{
+				r = match_rtnode(child, p + k, m);
+				if (r) return r;
+			}
+		}
+	}
+
+	if (*p == '\0')
+	{
+		if (node->nroutes > 0) return node;
+	}
+	else if (node->param && *p != '/')
+	{
+		const hio_bch_t* e;
+		hio_oow_t count = m->count;
+
+		for (e = p + 1; *e != '\0' && *e != '/'; e++) /* nothing */;
+		push_rtparam (m, node->param, p, e - p);
+		r = match_rtnode(node->param, e, m);
+		if (r) return r;
+		m->count = count;
+	}
+
+	if (node->wild && node->wild->nroutes > 0)
+	{
+		/* the wildcard matches the rest including an empty one */
+		push_rtparam (m, node->wild, p, hio_count_bcstr(p));
+		m->rest = p;
+		return node->wild;
+	}
+
+	return HIO_NULL;
+}
+
+static hio_svc_htts_rtnode_t* match_rtpath (hio_svc_htts_t* htts, const hio_bch_t* path, rtmatch_t* m)
+{
+	m->count = 0;
+	m->rest = HIO_NULL;
+	if (!htts->rtroot) return HIO_NULL;
+	return match_rtnode(htts->rtroot, path, m);
+}
+
+const hio_svc_htts_route_t* hio_svc_htts_matchroute (hio_svc_htts_t* htts, hio_http_method_t method, const hio_bch_t* path, hio_svc_htts_route_param_t* params, hio_oow_t* nparams)
+{
+	hio_svc_htts_rtnode_t* node;
+	rtmatch_t m;
+
+	m.params = params;
+	m.capa = nparams? *nparams: 0;
+
+	node = match_rtpath(htts, path, &m);
+	if (!node)
+	{
+		if (nparams) *nparams = 0;
+		return HIO_NULL;
+	}
+
+	if ((hio_oow_t)method >= RTNODE_METHODS || !node->route[method])
+	{
+		if (nparams) *nparams = HIO_TYPE_MAX(hio_oow_t);
+		return HIO_NULL;
+	}
+
+	if (nparams) *nparams = (m.count < m.capa)? m.count: m.capa;
+	return node->route[method];
+}
+
+static int send_method_not_allowed (hio_svc_htts_t* htts, hio_svc_htts_task_t* task, hio_htre_t* req, void* ctx)
+{
+	hio_svc_htts_rtnode_t* node = (hio_svc_htts_rtnode_t*)ctx;
+	const hio_bch_t* text = hio_http_status_to_bcstr(HIO_HTTP_STATUS_METHOD_NOT_ALLOWED);
+	hio_bch_t allow[128];
+	hio_oow_t i, len = 0;
+
+	/* list the methods routed for the path in the Allow header */
+	allow[0] = '\0';
+	for (i = HIO_HTTP_HEAD; i < RTNODE_METHODS; i++)
+	{
+		if (node->route[i])
+		{
+			len += hio_fmttobcstr(htts->hio, &allow[len], HIO_COUNTOF(allow) - len, "%hs%hs", (len > 0? ", ": ""), hio_http_method_to_bcstr((hio_http_method_t)i));
+		}
+	}
+
+	if (hio_svc_htts_task_startreshdr(task, HIO_HTTP_STATUS_METHOD_NOT_ALLOWED, HIO_NULL, 0) <= -1 ||
+	    hio_svc_htts_task_addreshdr(task, "Allow", allow) <= -1 ||
+	    hio_svc_htts_task_addreshdr(task, "Content-Type", "text/plain") <= -1 ||
+	    hio_svc_htts_task_addreshdrfmt(task, "Content-Length", "%zu", hio_count_bcstr(text)) <= -1 ||
+	    hio_svc_htts_task_endreshdr(task) <= -1 ||
+	    hio_svc_htts_task_addresbody(task, text, hio_count_bcstr(text)) <= -1 ||
+	    hio_svc_htts_task_endbody(task) <= -1) return -1;
+
+	return 0;
+}
+
+int hio_svc_htts_doroute (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* req)
+{
+	hio_svc_htts_rtnode_t* node;
+	const hio_svc_htts_route_t* route;
+	const hio_bch_t* qpath, * fpath;
+	hio_http_method_t mth;
+	hio_svc_htts_route_param_t params[HIO_SVC_HTTS_ROUTE_PARAMS_MAX];
+	rtmatch_t m;
+	int x;
+
+	qpath = hio_htre_getqpath(req);
+	mth = hio_htre_getqmethodtype(req);
+
+	/* hio_svc_htts_addroute() doesn't allow more parameters than the buffer holds */
+	m.params = params;
+	m.capa = HIO_COUNTOF(params);
+	node = match_rtpath(htts, qpath, &m);
+	if (!node) return 0;
+
+	if ((hio_oow_t)mth >= RTNODE_METHODS || !node->route[mth])
+	{
+		/* the response is made while the node is valid. a request body is discarded */
+		x = hio_svc_htts_dofun(htts, csck, req, send_method_not_allowed, node, HIO_SVC_HTTS_FUN_STREAM_REQ_BODY, HIO_NULL);
+		return (x <= -1)? -1: 1;
+	}
+
+	route = node->route[mth];
+
+	/* a wildcard always follows a slash. include it in the file path */
+	fpath = m.rest? m.rest - 1: qpath;
+
+	/* the task made by the handler copies the parameters */
+	htts->rtparams.ptr = params;
+	htts->rtparams.count = (m.count < m.capa)? m.count: m.capa;
+
+	switch (route->type)
+	{
+		case HIO_SVC_HTTS_ROUTE_FILE:
+			x = hio_svc_htts_dofile(htts, csck, req, route->u.file.docroot, fpath, route->u.file.mime_type, route->options, route->on_kill, route->u.file.cbs);
+			break;
+
+		case HIO_SVC_HTTS_ROUTE_CGI:
+			x = hio_svc_htts_docgi(htts, csck, req, route->u.cgi.docroot, fpath, route->options, route->on_kill);
+			break;
+
+		case HIO_SVC_HTTS_ROUTE_FCGI:
+			x = hio_svc_htts_dofcgi(htts, csck, req, &route->u.fcgi.addr, route->u.fcgi.docroot, fpath, route->options, route->on_kill);
+			break;
+
+		case HIO_SVC_HTTS_ROUTE_THR:
+			x = hio_svc_htts_dothr(htts, csck, req, route->u.thr.func, route->u.thr.ctx, route->options, route->on_kill);
+			break;
+
+		case HIO_SVC_HTTS_ROUTE_FUN:
+			x = hio_svc_htts_dofun(htts, csck, req, route->u.fun.func, route->u.fun.ctx, route->options, route->on_kill);
+			break;
+
+		case HIO_SVC_HTTS_ROUTE_PRXY:
+			x = hio_svc_htts_doprxy(htts, csck, req, &route->u.prxy.addr, route->options, route->on_kill);
+			break;
+
+		case HIO_SVC_HTTS_ROUTE_TXT:
+			x = hio_svc_htts_dotxt(htts, csck, req, route->u.txt.status_code, route->u.txt.content_type, route->u.txt.content_text, route->options, route->on_kill);
+			break;
+
+		default:
+			/* dup_route() never lets this happen */
+			hio_seterrnum (htts->hio, HIO_EINTERN);
+			x = -1;
+			break;
+	}
+
+	htts->rtparams.ptr = HIO_NULL;
+	htts->rtparams.count = 0;
+	return (x <= -1)? -1: 1;
+}
+
+/* ------------------------------------------------------------------------ */
+
+hio_oow_t hio_svc_htts_getrouteparamsize (const hio_svc_htts_route_param_t* params, hio_oow_t nparams)
+{
+	hio_oow_t i, size;
+
+	size = HIO_SIZEOF(*params) * nparams;
+	for (i = 0; i < nparams; i++) size += params[i].nlen + 1 + params[i].vlen + 1;
+	return size;
+}
+
+void hio_svc_htts_copyrouteparams (hio_svc_htts_route_param_t* dst, const hio_svc_htts_route_param_t* src, hio_oow_t nparams)
+{
+	hio_bch_t* ptr = (hio_bch_t*)(dst + nparams);
+	hio_oow_t i;
+
+	for (i = 0; i < nparams; i++)
+	{
+		dst[i] = src[i];
+		dst[i].name = ptr;
+		ptr += hio_copy_bchars_to_bcstr_unlimited(ptr, src[i].name, src[i].nlen) + 1;
+		dst[i].value = ptr;
+		ptr += hio_copy_bchars_to_bcstr_unlimited(ptr, src[i].value, src[i].vlen) + 1;
+	}
+}
+
+const hio_bch_t* hio_svc_htts_findrouteparam (const hio_svc_htts_route_param_t* params, hio_oow_t nparams, const hio_bch_t* name)
+{
+	hio_oow_t i;
+	for (i = 0; i < nparams; i++)
+	{
+		if (hio_comp_bchars_bcstr(params[i].name, params[i].nlen, name, 0) == 0) return params[i].value;
+	}
+	return HIO_NULL;
+}
+
+const hio_bch_t* hio_svc_htts_task_getrouteparam (hio_svc_htts_task_t* task, const hio_bch_t* name)
+{
+	return hio_svc_htts_findrouteparam(task->task_route_params, task->task_route_nparams, name);
+}
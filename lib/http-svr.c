@@ -25,18 +25,27 @@
 #include "http-prv.h"
 #include <hio-path.h>
 #include <hio-fmt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <stdarg.h>
 
+#if defined(HAVE_ZLIB)
+#	include <zlib.h>
+#endif
+
 #define INVALID_LIDX HIO_TYPE_MAX(hio_oow_t)
 
 static int htts_svr_wrctx;
+static int htts_svr_rejwrctx;
 
 /* ------------------------------------------------------------------------ */
 
 static int client_on_read (hio_dev_sck_t* sck, const void* buf, hio_iolen_t len, const hio_skad_t* srcaddr);
 static int client_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrctx, const hio_skad_t* dstaddr);
 static void client_on_disconnect (hio_dev_sck_t* sck);
+static void end_req_body_writer (hio_svc_htts_task_t* task, int failed);
 
 /* ------------------------------------------------------------------------ */
 
@@ -88,11 +97,229 @@ static void dec_ntasks (hio_svc_htts_t* htts)
 #endif
 }
 
+/* ------------------------------------------------------------------------ */
+/* per-client-address limits */
+
+#define PEER_TOKEN_UNIT 1000
+
+static HIO_INLINE hio_oow_t get_peer_capacity (hio_svc_htts_t* htts)
+{
+	/* bucket size in 1/1000 of a request */
+	return (htts->option.client_req_burst > 0? htts->option.client_req_burst: htts->option.client_req_rate) * PEER_TOKEN_UNIT;
+}
+
+static int grow_peer_table (hio_svc_htts_t* htts)
+{
+	hio_svc_htts_peer_t* ent;
+	hio_oow_t capa, i, j;
+
+	capa = htts->peer.capa <= 0? 64: htts->peer.capa * 2;
+	ent = (hio_svc_htts_peer_t*)hio_callocmem(htts->hio, capa * HIO_SIZEOF(*ent));
+	if (HIO_UNLIKELY(!ent)) return -1;
+
+	for (i = 0; i < htts->peer.capa; i++)
+	{
+		if (htts->peer.ent[i].iplen <= 0) continue;
+		for (j = htts->peer.ent[i].hv & (capa - 1); ent[j].iplen > 0; j = (j + 1) & (capa - 1)) /* nothing */;
+		ent[j] = htts->peer.ent[i];
+	}
+
+	if (htts->peer.ent) hio_freemem (htts->hio, htts->peer.ent);
+	htts->peer.ent = ent;
+	htts->peer.capa = capa;
+	return 0;
+}
+
+static hio_svc_htts_peer_t* get_peer (hio_svc_htts_t* htts, const hio_skad_t* addr, const hio_ntime_t* now)
+{
+	hio_uint8_t ipad[16];
+	hio_oow_t iplen, i, hv;
+	hio_svc_htts_peer_t* peer;
+
+	iplen = hio_skad_get_ipad_bytes(addr, ipad, HIO_SIZEOF(ipad));
+	if (iplen <= 0) return HIO_NULL; /* not an ip address. no limits */
+
+	HIO_HASH_BYTES (hv, ipad, iplen);
+	hv = (hio_uint32_t)hv;
+
+	if (htts->peer.capa > 0)
+	{
+		for (i = hv & (htts->peer.capa - 1); htts->peer.ent[i].iplen > 0; i = (i + 1) & (htts->peer.capa - 1))
+		{
+			peer = &htts->peer.ent[i];
+			if (peer->hv == hv && peer->iplen == iplen && HIO_MEMCMP(peer->ipad, ipad, iplen) == 0) return peer;
+		}
+	}
+
+	/* keep the table at most three quarters full */
+	if ((htts->peer.count + 1) * 4 > htts->peer.capa * 3)
+	{
+		if (grow_peer_table(htts) <= -1) return HIO_NULL;
+	}
+
+	for (i = hv & (htts->peer.capa - 1); htts->peer.ent[i].iplen > 0; i = (i + 1) & (htts->peer.capa - 1)) /* nothing */;
+	peer = &htts->peer.ent[i];
+	HIO_MEMCPY (peer->ipad, ipad, iplen);
+	peer->iplen = iplen;
+	peer->hv = hv;
+	peer->nconns = 0;
+	peer->tokens = get_peer_capacity(htts);
+	peer->refilled = *now;
+	htts->peer.count++;
+	return peer;
+}
+
+static void del_peer (hio_svc_htts_t* htts, hio_oow_t i)
+{
+	/* move the entries following the deleted one back if the deleted
+	 * slot is between their home slot and the current slot */
+	hio_oow_t mask = htts->peer.capa - 1, j = i, k;
+
+	while (1)
+	{
+		j = (j + 1) & mask;
+		if (htts->peer.ent[j].iplen <= 0) break;
+
+		k = htts->peer.ent[j].hv & mask;
+		if ((i <= j)? (i < k && k <= j): (i < k || k <= j)) continue;
+
+		htts->peer.ent[i] = htts->peer.ent[j];
+		i = j;
+	}
+
+	htts->peer.ent[i].iplen = 0;
+	htts->peer.count--;
+}
+
+static void refill_peer (hio_svc_htts_t* htts, hio_svc_htts_peer_t* peer, const hio_ntime_t* now)
+{
+	hio_ntime_t t;
+	hio_oow_t capa, ms, add;
+
+	capa = get_peer_capacity(htts);
+	HIO_SUB_NTIME (&t, now, &peer->refilled);
+	if (HIO_IS_NEG_NTIME(&t)) return;
+
+	ms = (hio_oow_t)t.sec * 1000 + t.nsec / 1000000;
+	add = ms * htts->option.client_req_rate; /* the rate per second is the number of tokens per millisecond */
+	if (add <= 0) return;
+
+	peer->tokens = (add >= capa || peer->tokens >= capa - add)? capa: peer->tokens + add;
+	peer->refilled = *now;
+}
+
+static int count_peer_conn (hio_svc_htts_cli_t* cli)
+{
+	hio_svc_htts_t* htts = cli->htts;
+	hio_svc_htts_peer_t* peer;
+
+	if (htts->option.client_conn_max <= 0) return 0;
+
+	peer = get_peer(htts, &cli->cli_addr, &cli->last_active);
+	if (!peer) return 0;
+
+	if (peer->nconns >= htts->option.client_conn_max)
+	{
+		HIO_DEBUG3 (htts->hio, "HTTS(%p) - too many connections from client %hs - %zu\n", htts, cli->cli_addr_bcstr, (hio_oow_t)peer->nconns);
+		return -1;
+	}
+
+	peer->nconns++;
+	cli->peer_counted = 1;
+	return 0;
+}
+
+static void uncount_peer_conn (hio_svc_htts_cli_t* cli)
+{
+	hio_svc_htts_t* htts = cli->htts;
+	hio_svc_htts_peer_t* peer;
+
+	if (!cli->peer_counted) return;
+	cli->peer_counted = 0;
+
+	/* the entry must be there as aging skips an entry with connections */
+	peer = get_peer(htts, &cli->cli_addr, &cli->last_active);
+	if (peer && peer->nconns > 0) peer->nconns--;
+}
+
+static int take_peer_token (hio_svc_htts_cli_t* cli)
+{
+	hio_svc_htts_t* htts = cli->htts;
+	hio_svc_htts_peer_t* peer;
+
+	if (htts->option.client_req_rate <= 0) return 1;
+
+	peer = get_peer(htts, &cli->cli_addr, &cli->last_active);
+	if (!peer) return 1;
+
+	refill_peer (htts, peer, &cli->last_active);
+	if (peer->tokens < PEER_TOKEN_UNIT) return 0;
+
+	peer->tokens -= PEER_TOKEN_UNIT;
+	return 1;
+}
+
+static void age_peers (hio_svc_htts_t* htts, const hio_ntime_t* now)
+{
+	hio_oow_t i = 0, capa;
+
+	capa = get_peer_capacity(htts);
+	while (i < htts->peer.capa)
+	{
+		hio_svc_htts_peer_t* peer = &htts->peer.ent[i];
+
+		if (peer->iplen > 0 && peer->nconns <= 0)
+		{
+			/* an entry with a full bucket is no different from a new one */
+			if (htts->option.client_req_rate > 0) refill_peer (htts, peer, now);
+			if (htts->option.client_req_rate <= 0 || peer->tokens >= capa)
+			{
+				/* an entry following may have moved in. check the same slot again */
+				del_peer (htts, i);
+				continue;
+			}
+		}
+
+		i++;
+	}
+}
+
+static void reject_too_many_requests (hio_svc_htts_cli_t* cli, hio_htre_t* req)
+{
+	static hio_bch_t msg[] = "HTTP/1.1 429 Too Many Requests\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+	HIO_DEBUG2 (cli->htts->hio, "HTTS(%p) - too many requests from client %hs\n", cli->htts, cli->cli_addr_bcstr);
+
+	/* no task is created for the request. the content is not needed and
+	 * no more requests are read. client_on_write() closes the connection
+	 * when the response has been sent */
+	hio_htre_discardcontent (req);
+	hio_dev_sck_read (cli->sck, 0);
+	if (hio_dev_sck_write(cli->sck, msg, HIO_SIZEOF(msg) - 1, &htts_svr_wrctx, HIO_NULL) <= -1 ||
+	    hio_dev_sck_write(cli->sck, HIO_NULL, 0, &htts_svr_rejwrctx, HIO_NULL) <= -1)
+	{
+		hio_dev_sck_halt (cli->sck);
+	}
+}
+
 /* ------------------------------------------------------------------------ */
 static int client_htrd_peek_request (hio_htrd_t* htrd, hio_htre_t* req)
 {
 	hio_svc_htts_cli_htrd_xtn_t* htrdxtn = (hio_svc_htts_cli_htrd_xtn_t*)hio_htrd_getxtn(htrd);
 	hio_svc_htts_cli_t* sckxtn = (hio_svc_htts_cli_t*)hio_dev_sck_getxtn(htrdxtn->sck);
+
+	/* the header deadline is over. the body deadline starts if any */
+	sckxtn->req_hdr_pending = 0;
+	sckxtn->req_body_pending = ((req->flags & HIO_HTRE_ATTR_CHUNKED) || ((req->flags & HIO_HTRE_ATTR_LENGTH) && req->attr.content_length > 0));
+	sckxtn->req_body_since = sckxtn->last_active;
+	sckxtn->req_body_octets = 0;
+
+	if (!take_peer_token(sckxtn))
+	{
+		reject_too_many_requests (sckxtn, req);
+		return 0;
+	}
+
 	return sckxtn->htts->proc_req(sckxtn->htts, htrdxtn->sck, req);
 }
 
@@ -119,9 +346,16 @@ static int init_client (hio_svc_htts_cli_t* cli, hio_dev_sck_t* sck)
 	cli->htrd = HIO_NULL;
 	cli->sbuf = HIO_NULL;
 	cli->task = HIO_NULL;
+	cli->req_hdr_pending = 0;
+	cli->req_body_pending = 0;
+	cli->peer_counted = 0;
 	/* keep this linked regardless of success or failure because the disconnect() callback
 	 * will call fini_client(). the error handler code after 'oops:' doesn't get this unlinked */
 	HIO_SVC_HTTS_CLIL_APPEND_CLI (&cli->htts->cli, cli);
+	HIO_SVC_HTTS_STAT_INC (cli->htts, clients);
+
+	hio_gettime (sck->hio, &cli->last_active);
+	if (count_peer_conn(cli) <= -1) goto oops;
 
 	cli->htrd = hio_htrd_open(sck->hio, HIO_SIZEOF(*htrdxtn));
 	if (HIO_UNLIKELY(!cli->htrd)) goto oops;
@@ -129,6 +363,7 @@ static int init_client (hio_svc_htts_cli_t* cli, hio_dev_sck_t* sck)
 	/* With HIO_HTRD_TRAILERS, htrd stores trailers in a separate place.
 	 * Otherwise, it is merged to the headers. */
 	/*hio_htrd_setoption (cli->htrd, HIO_HTRD_REQUEST | HIO_HTRD_TRAILERS);*/
+	hio_htrd_setlimit (cli->htrd, &cli->htts->option.req_limit);
 
 	cli->sbuf = hio_becs_open(sck->hio, 0, 2048);
 	if (HIO_UNLIKELY(!cli->sbuf)) goto oops;
@@ -138,8 +373,6 @@ static int init_client (hio_svc_htts_cli_t* cli, hio_dev_sck_t* sck)
 
 	hio_htrd_setrecbs (cli->htrd, &client_htrd_recbs);
 
-	hio_gettime (sck->hio, &cli->last_active);
-
 	HIO_DEBUG4 (sck->hio, "HTTS(%p) - client(c=%p,csck=%d[%d]) - initialized\n", cli->htts, cli, sck, (int)sck->hnd);
 
 	sck->on_read = client_on_read;
@@ -166,6 +399,7 @@ oops:
 
 static void fini_client (hio_svc_htts_cli_t* cli)
 {
+	HIO_SVC_HTTS_STAT_DEC (cli->htts, clients);
 	HIO_DEBUG4(cli->sck->hio, "HTTS(%p) - client(c=%p,sck=%p[%d]) - finalizing\n", cli->htts, cli, cli->sck, (int)cli->sck->hnd);
 
 	if (cli->task)
@@ -191,6 +425,7 @@ static void fini_client (hio_svc_htts_cli_t* cli)
 		cli->htrd = HIO_NULL;
 	}
 
+	uncount_peer_conn (cli);
 	HIO_SVC_HTTS_CLIL_UNLINK_CLI_CLEAN (cli);
 
 	/* are these needed? not symmetrical if done here.
@@ -347,9 +582,24 @@ static int client_on_read (hio_dev_sck_t* sck, const void* buf, hio_iolen_t len,
 	}
 
 	hio_gettime (hio, &cli->last_active);
+	if (!task)
+	{
+		if (!cli->req_hdr_pending)
+		{
+			/* the first octet of a new request header */
+			cli->req_hdr_pending = 1;
+			cli->req_body_pending = 0;
+			cli->req_hdr_since = cli->last_active;
+		}
+	}
+	else if (cli->req_body_pending)
+	{
+		cli->req_body_octets += len;
+	}
+
 	if ((x = hio_htrd_feed(cli->htrd, buf, len, &rem)) <= -1)
 	{
-		HIO_DEBUG3 (hio, "HTTS(%p) - feed error onto client htrd %p(%d)\n", htts, sck, (int)sck->hnd);
+		HIO_DEBUG4 (hio, "HTTS(%p) - feed error %d onto client htrd %p(%d)\n", htts, (int)hio_htrd_geterrnum(cli->htrd), sck, (int)sck->hnd);
 		goto oops;
 	}
 
@@ -413,6 +663,11 @@ static int client_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrctx,
 			}
 		}
 	}
+	else if (wrctx == &htts_svr_rejwrctx)
+	{
+		/* the response rejecting the request has been sent */
+		hio_dev_sck_halt (sck);
+	}
 
 	return 0;
 }
@@ -440,12 +695,38 @@ static void client_on_disconnect (hio_dev_sck_t* sck)
 /* ------------------------------------------------------------------------ */
 
 #define MAX_CLIENT_IDLE 10 /*TODO: make this configurable... */
+#define CLIENT_SCAN_INTERVAL 1
+#define REQ_BODY_RATE_GRACE 5
+
+static int is_req_body_too_slow (hio_svc_htts_t* htts, hio_svc_htts_cli_t* cli, const hio_ntime_t* now)
+{
+	hio_ntime_t t;
+
+	if (cli->htrd->clean)
+	{
+		/* the whole body has been read */
+		cli->req_body_pending = 0;
+		return 0;
+	}
+
+	if (cli->sck->dev_cap & HIO_DEV_CAP_IN_DISABLED)
+	{
+		/* the task has stopped reading the client because its peer is behind.
+		 * start measuring again when reading resumes */
+		cli->req_body_since = *now;
+		cli->req_body_octets = 0;
+		return 0;
+	}
+
+	HIO_SUB_NTIME (&t, now, &cli->req_body_since);
+	if (t.sec < REQ_BODY_RATE_GRACE) return 0;
+	return cli->req_body_octets / t.sec < htts->option.req_body_rate_min;
+}
 
 static void halt_idle_clients (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
 {
-/* TODO: this idle client detector is far away from being accurate.
- *       enhance htrd to specify timeout on feed() and utilize it...
- *       and remove this timer job */
+	/* this scans all clients every CLIENT_SCAN_INTERVAL seconds. a deadline
+	 * shorter than the interval is enforced as late as the next scan */
 	hio_svc_htts_t* htts = (hio_svc_htts_t*)job->ctx;
 	hio_svc_htts_cli_t* cli;
 	hio_ntime_t t;
@@ -456,18 +737,34 @@ static void halt_idle_clients (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t*
 	{
 		if (!cli->task)
 		{
-			hio_ntime_t t;
-			HIO_SUB_NTIME(&t, now, &cli->last_active);
+			if (cli->req_hdr_pending && HIO_IS_POS_NTIME(&htts->option.req_hdr_timeout))
+			{
+				HIO_SUB_NTIME(&t, now, &cli->req_hdr_since);
+				if (HIO_CMP_NTIME(&t, &htts->option.req_hdr_timeout) >= 0)
+				{
+					HIO_DEBUG4 (hio, "HTTS(%p) - Halting client(%p,%p,%d) for slow request header\n", htts, cli, cli->sck, (int)cli->sck->hnd);
+					hio_dev_sck_halt (cli->sck);
+					continue;
+				}
+			}
 
+			HIO_SUB_NTIME(&t, now, &cli->last_active);
 			if (HIO_CMP_NTIME(&t, &max_client_idle) >= 0)
 			{
 				HIO_DEBUG4 (hio, "HTTS(%p) - Halting idle client(%p,%p,%d)\n", htts, cli, cli->sck, (int)cli->sck->hnd);
 				hio_dev_sck_halt (cli->sck);
 			}
 		}
+		else if (cli->req_body_pending && htts->option.req_body_rate_min > 0 && is_req_body_too_slow(htts, cli, now))
+		{
+			HIO_DEBUG4 (hio, "HTTS(%p) - Halting client(%p,%p,%d) for slow request body\n", htts, cli, cli->sck, (int)cli->sck->hnd);
+			hio_dev_sck_halt (cli->sck);
+		}
 	}
 
-	HIO_INIT_NTIME (&t, MAX_CLIENT_IDLE, 0);
+	if (htts->peer.count > 0) age_peers (htts, now);
+
+	HIO_INIT_NTIME (&t, CLIENT_SCAN_INTERVAL, 0);
 	HIO_ADD_NTIME (&t, &t, now);
 	if (hio_schedtmrjobat(hio, &t, halt_idle_clients, &htts->idle_tmridx, htts) <= -1)
 	{
@@ -506,6 +803,32 @@ hio_svc_htts_t* hio_svc_htts_start (hio_t* hio, hio_oow_t xtnsize, hio_dev_sck_b
 
 	htts->option.task_max = HIO_TYPE_MAX(hio_oow_t);
 	htts->option.task_cgi_max = HIO_TYPE_MAX(hio_oow_t);
+	htts->option.task_thr_max = 0;
+	htts->option.task_thr_queue_max = 64;
+	htts->option.task_cgi_prefork = 0;
+	htts->option.task_cgi_prefork_helper = HIO_NULL;
+	htts->option.task_fcgi_conn_max = 0;
+	htts->option.task_fcgi_sess_max = 0;
+	htts->option.task_prxy_idle_max = 16;
+	HIO_INIT_NTIME (&htts->option.task_prxy_conn_max_age, 60, 0);
+	HIO_INIT_NTIME (&htts->option.task_prxy_idle_timeout, 4, 0);
+	HIO_INIT_NTIME (&htts->option.task_prxy_dns_ttl_max, 300, 0);
+	htts->option.task_prxy_dns_cache_max = 1024;
+	htts->option.task_req_body_mem_max = 1048576;
+	htts->option.req_limit.line_max = 8192;
+	htts->option.req_limit.hdr_max = 65536;
+	htts->option.req_limit.hdr_count_max = 100;
+	htts->option.req_limit.body_max = 0;
+	HIO_INIT_NTIME (&htts->option.req_hdr_timeout, 10, 0);
+	htts->option.req_body_rate_min = 0;
+	htts->option.file_cache_max = 0;
+	HIO_INIT_NTIME (&htts->option.file_cache_ttl, 1, 0);
+	htts->option.file_memcache_max = 0;
+	htts->option.file_memcache_file_max = 65536;
+	htts->option.res_compress_min = 0;
+	htts->option.res_compress_level = 6;
+	htts->fcache.lru.lru_prev = htts->fcache.lru.lru_next = &htts->fcache.lru;
+	htts->fcache.mem_lru.mem.prev = htts->fcache.mem_lru.mem.next = &htts->fcache.mem_lru;
 
 	htts->becbuf = hio_becs_open(hio, 0, 256);
 	if (HIO_UNLIKELY(!htts->becbuf)) goto oops;
@@ -626,7 +949,7 @@ hio_svc_htts_t* hio_svc_htts_start (hio_t* hio, hio_oow_t xtnsize, hio_dev_sck_b
 	{
 		hio_ntime_t t;
 
-		HIO_INIT_NTIME (&t, MAX_CLIENT_IDLE, 0);
+		HIO_INIT_NTIME (&t, CLIENT_SCAN_INTERVAL, 0);
 		if (hio_schedtmrjobafter(hio, &t, halt_idle_clients, &htts->idle_tmridx, htts) <= -1)
 		{
 			HIO_INFO1 (hio, "HTTS(%p) - unable to schedule idle client detector. continuting\n", htts);
@@ -639,7 +962,7 @@ hio_svc_htts_t* hio_svc_htts_start (hio_t* hio, hio_oow_t xtnsize, hio_dev_sck_b
 	hio_spl_init (&htts->stat.spl_ntasks);
 	hio_spl_init (&htts->stat.spl_ntask_cgis);
 #endif
-
+	hio_svc_htts_linkstat (htts);
 
 	return htts;
 
@@ -652,6 +975,12 @@ oops:
 			htts->fcgic = HIO_NULL;
 		}
 
+		if (htts->dnc)
+		{
+			hio_svc_dnc_stop (htts->dnc);
+			htts->dnc = HIO_NULL;
+		}
+
 		if (htts->l.sck)
 		{
 			for (i = 0; i < htts->l.count; i++)
@@ -680,6 +1009,14 @@ void hio_svc_htts_stop (hio_svc_htts_t* htts)
 		htts->fcgic = HIO_NULL;
 	}
 
+	if (htts->dnc)
+	{
+		/* some pending queries may get discarded without notification.
+		 * the proxy tasks still waiting for them are killed below */
+		hio_svc_dnc_stop (htts->dnc);
+		htts->dnc = HIO_NULL;
+	}
+
 	for (i = 0; i < htts->l.count; i++)
 	{
 		/* the socket may be null:
@@ -702,7 +1039,21 @@ void hio_svc_htts_stop (hio_svc_htts_t* htts)
 		ntasks++;
 	}
 
+	hio_svc_htts_purgeprxypool (htts);
+	hio_svc_htts_purgeprxydns (htts);
+	hio_svc_htts_purgefilecache (htts);
+	if (htts->fcache.bkt) hio_freemem (hio, htts->fcache.bkt);
+	hio_svc_htts_clearroutes (htts);
+	hio_svc_htts_closealog (htts);
+	if (htts->peer.ent) hio_freemem (hio, htts->peer.ent);
+
+	/* all thread tasks are gone. this waits for the pooled workers to finish */
+	if (htts->thr_pool) hio_dev_thr_closepool (htts->thr_pool);
+	if (htts->cgi_pool) hio_dev_pro_closepool (htts->cgi_pool);
+	if (htts->option.task_cgi_prefork_helper) hio_freemem (hio, htts->option.task_cgi_prefork_helper);
+
 	HIO_SVCL_UNLINK_SVC (htts);
+	hio_svc_htts_unlinkstat (htts);
 	if (htts->server_name && htts->server_name != htts->server_name_buf) hio_freemem (hio, htts->server_name);
 
 	if (htts->idle_tmridx != HIO_TMRIDX_INVALID) hio_deltmrjob (hio, htts->idle_tmridx);
@@ -734,6 +1085,114 @@ int hio_svc_htts_getoption (hio_svc_htts_t* htts, hio_svc_htts_option_t id, void
 			*(hio_oow_t*)value = htts->option.task_cgi_max;
 			break;
 
+		case HIO_SVC_HTTS_TASK_THR_MAX:
+			*(hio_oow_t*)value = htts->option.task_thr_max;
+			break;
+
+		case HIO_SVC_HTTS_TASK_THR_QUEUE_MAX:
+			*(hio_oow_t*)value = htts->option.task_thr_queue_max;
+			break;
+
+		case HIO_SVC_HTTS_TASK_CGI_PREFORK:
+			*(hio_oow_t*)value = htts->option.task_cgi_prefork;
+			break;
+
+		case HIO_SVC_HTTS_TASK_CGI_PREFORK_HELPER:
+			*(const hio_bch_t**)value = htts->option.task_cgi_prefork_helper;
+			break;
+
+		case HIO_SVC_HTTS_TASK_FCGI_CONN_MAX:
+			*(hio_oow_t*)value = htts->option.task_fcgi_conn_max;
+			break;
+
+		case HIO_SVC_HTTS_TASK_FCGI_SESS_MAX:
+			*(hio_oow_t*)value = htts->option.task_fcgi_sess_max;
+			break;
+
+		case HIO_SVC_HTTS_TASK_PRXY_IDLE_MAX:
+			*(hio_oow_t*)value = htts->option.task_prxy_idle_max;
+			break;
+
+		case HIO_SVC_HTTS_TASK_PRXY_CONN_MAX_AGE:
+			*(hio_ntime_t*)value = htts->option.task_prxy_conn_max_age;
+			break;
+
+		case HIO_SVC_HTTS_TASK_PRXY_IDLE_TIMEOUT:
+			*(hio_ntime_t*)value = htts->option.task_prxy_idle_timeout;
+			break;
+
+		case HIO_SVC_HTTS_TASK_PRXY_DNS_TTL_MAX:
+			*(hio_ntime_t*)value = htts->option.task_prxy_dns_ttl_max;
+			break;
+
+		case HIO_SVC_HTTS_TASK_PRXY_DNS_CACHE_MAX:
+			*(hio_oow_t*)value = htts->option.task_prxy_dns_cache_max;
+			break;
+
+		case HIO_SVC_HTTS_TASK_REQ_BODY_MEM_MAX:
+			*(hio_oow_t*)value = htts->option.task_req_body_mem_max;
+			break;
+
+		case HIO_SVC_HTTS_FILE_CACHE_MAX:
+			*(hio_oow_t*)value = htts->option.file_cache_max;
+			break;
+
+		case HIO_SVC_HTTS_FILE_CACHE_TTL:
+			*(hio_ntime_t*)value = htts->option.file_cache_ttl;
+			break;
+
+		case HIO_SVC_HTTS_FILE_MEMCACHE_MAX:
+			*(hio_oow_t*)value = htts->option.file_memcache_max;
+			break;
+
+		case HIO_SVC_HTTS_FILE_MEMCACHE_FILE_MAX:
+			*(hio_oow_t*)value = htts->option.file_memcache_file_max;
+			break;
+
+		case HIO_SVC_HTTS_RES_COMPRESS_MIN:
+			*(hio_oow_t*)value = htts->option.res_compress_min;
+			break;
+
+		case HIO_SVC_HTTS_RES_COMPRESS_LEVEL:
+			*(int*)value = htts->option.res_compress_level;
+			break;
+
+		case HIO_SVC_HTTS_REQ_LINE_MAX:
+			*(hio_oow_t*)value = htts->option.req_limit.line_max;
+			break;
+
+		case HIO_SVC_HTTS_REQ_HDR_MAX:
+			*(hio_oow_t*)value = htts->option.req_limit.hdr_max;
+			break;
+
+		case HIO_SVC_HTTS_REQ_HDR_COUNT_MAX:
+			*(hio_oow_t*)value = htts->option.req_limit.hdr_count_max;
+			break;
+
+		case HIO_SVC_HTTS_REQ_BODY_MAX:
+			*(hio_oow_t*)value = htts->option.req_limit.body_max;
+			break;
+
+		case HIO_SVC_HTTS_REQ_HDR_TIMEOUT:
+			*(hio_ntime_t*)value = htts->option.req_hdr_timeout;
+			break;
+
+		case HIO_SVC_HTTS_REQ_BODY_RATE_MIN:
+			*(hio_oow_t*)value = htts->option.req_body_rate_min;
+			break;
+
+		case HIO_SVC_HTTS_CLIENT_CONN_MAX:
+			*(hio_oow_t*)value = htts->option.client_conn_max;
+			break;
+
+		case HIO_SVC_HTTS_CLIENT_REQ_RATE:
+			*(hio_oow_t*)value = htts->option.client_req_rate;
+			break;
+
+		case HIO_SVC_HTTS_CLIENT_REQ_BURST:
+			*(hio_oow_t*)value = htts->option.client_req_burst;
+			break;
+
 		default:
 			goto einval;
 	}
@@ -756,60 +1215,255 @@ int hio_svc_htts_setoption (hio_svc_htts_t* htts, hio_svc_htts_option_t id, cons
 			htts->option.task_cgi_max = *(const hio_oow_t*)value;
 			break;
 
-		default:
-			goto einval;
-	}
+		case HIO_SVC_HTTS_TASK_THR_MAX:
+		case HIO_SVC_HTTS_TASK_THR_QUEUE_MAX:
+		{
+			hio_oow_t thr_max, queue_max;
 
-	return 0;
+			thr_max = (id == HIO_SVC_HTTS_TASK_THR_MAX)? *(const hio_oow_t*)value: htts->option.task_thr_max;
+			queue_max = (id == HIO_SVC_HTTS_TASK_THR_QUEUE_MAX)? *(const hio_oow_t*)value: htts->option.task_thr_queue_max;
 
-einval:
-        hio_seterrnum (htts->hio, HIO_EINVAL);
-        return -1;
-}
+			/* the pool can't go away while thread tasks may be using it.
+			 * the number of workers can be changed but not to 0 */
+			if (htts->thr_pool && (thr_max <= 0 || hio_dev_thr_setpoollimit(htts->thr_pool, thr_max, queue_max) <= -1))
+			{
+				if (thr_max <= 0) hio_seterrbfmt (htts->hio, HIO_EPERM, "unable to disable thread pool in use");
+				return -1;
+			}
 
-int hio_svc_htts_enablefcgic (hio_svc_htts_t* htts, hio_svc_fcgic_tmout_t* tmout)
-{
-	if (htts->fcgic) return 0;
-	htts->fcgic = hio_svc_fcgic_start(htts->hio, tmout);
-	return htts->fcgic? 0: -1;
-}
+			htts->option.task_thr_max = thr_max;
+			htts->option.task_thr_queue_max = queue_max;
+			break;
+		}
 
-int hio_svc_htts_setservernamewithbcstr (hio_svc_htts_t* htts, const hio_bch_t* name)
-{
-	hio_t* hio = htts->hio;
-	hio_bch_t* tmp;
+		case HIO_SVC_HTTS_TASK_CGI_PREFORK:
+			if (htts->cgi_pool && htts->option.task_cgi_prefork != *(const hio_oow_t*)value)
+			{
+				/* the running cgi processes don't depend on the pool.
+				 * a new pool is created upon next use */
+				hio_dev_pro_closepool (htts->cgi_pool);
+				htts->cgi_pool = HIO_NULL;
+			}
+			htts->option.task_cgi_prefork = *(const hio_oow_t*)value;
+			break;
 
-	if (hio_copy_bcstr(htts->server_name_buf, HIO_COUNTOF(htts->server_name_buf), name) == hio_count_bcstr(name))
-	{
-		tmp = htts->server_name_buf;
-	}
-	else
-	{
-		tmp = hio_dupbcstr(hio, name, HIO_NULL);
-		if (!tmp) return -1;
-	}
+		case HIO_SVC_HTTS_TASK_CGI_PREFORK_HELPER:
+		{
+			const hio_bch_t* helper = *(const hio_bch_t* const*)value;
+			hio_bch_t* tmp = HIO_NULL;
 
-	if (htts->server_name && htts->server_name != htts->server_name_buf) hio_freemem (hio, htts->server_name);
-	htts->server_name = tmp;
-	return 0;
-}
+			if (helper)
+			{
+				tmp = hio_dupbcstr(htts->hio, helper, HIO_NULL);
+				if (HIO_UNLIKELY(!tmp)) return -1;
+			}
 
-hio_dev_sck_t* hio_svc_htts_getlistendev (hio_svc_htts_t* htts, hio_oow_t idx)
-{
-	if (idx >= htts->l.count)
-	{
-		hio_seterrbfmt (htts->hio, HIO_EINVAL, "index out of range");
-		return HIO_NULL;
-	}
+			if (htts->cgi_pool)
+			{
+				hio_dev_pro_closepool (htts->cgi_pool);
+				htts->cgi_pool = HIO_NULL;
+			}
+			if (htts->option.task_cgi_prefork_helper) hio_freemem (htts->hio, htts->option.task_cgi_prefork_helper);
+			htts->option.task_cgi_prefork_helper = tmp;
+			break;
+		}
 
-	if (!htts->l.sck[idx])
-	{
-		hio_seterrbfmt (htts->hio, HIO_EINVAL, "no listener at the given index");
-		return HIO_NULL;
-	}
+		case HIO_SVC_HTTS_TASK_FCGI_CONN_MAX:
+			if (htts->fcgic && hio_svc_fcgic_setoption(htts->fcgic, HIO_SVC_FCGIC_CONN_MAX, value) <= -1) return -1;
+			htts->option.task_fcgi_conn_max = *(const hio_oow_t*)value;
+			break;
 
-	return htts->l.sck[idx];
-}
+		case HIO_SVC_HTTS_TASK_FCGI_SESS_MAX:
+			if (htts->fcgic && hio_svc_fcgic_setoption(htts->fcgic, HIO_SVC_FCGIC_SESS_MAX, value) <= -1) return -1;
+			htts->option.task_fcgi_sess_max = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_TASK_PRXY_IDLE_MAX:
+			htts->option.task_prxy_idle_max = *(const hio_oow_t*)value;
+			/* the idle connections above the new limit are closed when they are released next time */
+			if (htts->option.task_prxy_idle_max <= 0) hio_svc_htts_purgeprxypool (htts);
+			break;
+
+		case HIO_SVC_HTTS_TASK_PRXY_CONN_MAX_AGE:
+			htts->option.task_prxy_conn_max_age = *(const hio_ntime_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_TASK_PRXY_IDLE_TIMEOUT:
+			/* the connections already idle are closed on their old schedule */
+			htts->option.task_prxy_idle_timeout = *(const hio_ntime_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_TASK_PRXY_DNS_TTL_MAX:
+			htts->option.task_prxy_dns_ttl_max = *(const hio_ntime_t*)value;
+			/* the entries resolved are dropped. they're cached again with the new limit */
+			hio_svc_htts_purgeprxydns (htts);
+			break;
+
+		case HIO_SVC_HTTS_TASK_PRXY_DNS_CACHE_MAX:
+			/* the entries above the new limit expire as usual */
+			htts->option.task_prxy_dns_cache_max = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_TASK_REQ_BODY_MEM_MAX:
+			htts->option.task_req_body_mem_max = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_FILE_CACHE_MAX:
+			if (htts->option.file_cache_max != *(const hio_oow_t*)value)
+			{
+				/* the bucket array is resized for the new limit upon next insertion */
+				hio_svc_htts_purgefilecache (htts);
+				if (htts->fcache.bkt)
+				{
+					hio_freemem (htts->hio, htts->fcache.bkt);
+					htts->fcache.bkt = HIO_NULL;
+					htts->fcache.nbkts = 0;
+				}
+				htts->option.file_cache_max = *(const hio_oow_t*)value;
+			}
+			break;
+
+		case HIO_SVC_HTTS_FILE_CACHE_TTL:
+			htts->option.file_cache_ttl = *(const hio_ntime_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_FILE_MEMCACHE_MAX:
+			htts->option.file_memcache_max = *(const hio_oow_t*)value;
+			hio_svc_htts_trimfilememcache (htts, htts->option.file_memcache_max);
+			break;
+
+		case HIO_SVC_HTTS_FILE_MEMCACHE_FILE_MAX:
+			htts->option.file_memcache_file_max = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_RES_COMPRESS_MIN:
+		#if !defined(HAVE_ZLIB)
+			if (*(const hio_oow_t*)value > 0)
+			{
+				hio_seterrbfmt (htts->hio, HIO_ENOIMPL, "compression not supported");
+				return -1;
+			}
+		#endif
+			htts->option.res_compress_min = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_RES_COMPRESS_LEVEL:
+			if (*(const int*)value < 1 || *(const int*)value > 9) goto einval;
+			htts->option.res_compress_level = *(const int*)value;
+			break;
+
+		case HIO_SVC_HTTS_REQ_LINE_MAX:
+			htts->option.req_limit.line_max = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_REQ_HDR_MAX:
+			htts->option.req_limit.hdr_max = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_REQ_HDR_COUNT_MAX:
+			htts->option.req_limit.hdr_count_max = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_REQ_BODY_MAX:
+			htts->option.req_limit.body_max = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_REQ_HDR_TIMEOUT:
+			htts->option.req_hdr_timeout = *(const hio_ntime_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_REQ_BODY_RATE_MIN:
+			htts->option.req_body_rate_min = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_CLIENT_CONN_MAX:
+			htts->option.client_conn_max = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_CLIENT_REQ_RATE:
+			htts->option.client_req_rate = *(const hio_oow_t*)value;
+			break;
+
+		case HIO_SVC_HTTS_CLIENT_REQ_BURST:
+			htts->option.client_req_burst = *(const hio_oow_t*)value;
+			break;
+
+		default:
+			goto einval;
+	}
+
+	return 0;
+
+einval:
+        hio_seterrnum (htts->hio, HIO_EINVAL);
+        return -1;
+}
+
+int hio_svc_htts_enablefcgic (hio_svc_htts_t* htts, hio_svc_fcgic_tmout_t* tmout)
+{
+	if (htts->fcgic) return 0;
+	htts->fcgic = hio_svc_fcgic_start(htts->hio, tmout);
+	if (HIO_UNLIKELY(!htts->fcgic)) return -1;
+
+	hio_svc_fcgic_setoption (htts->fcgic, HIO_SVC_FCGIC_CONN_MAX, &htts->option.task_fcgi_conn_max);
+	hio_svc_fcgic_setoption (htts->fcgic, HIO_SVC_FCGIC_SESS_MAX, &htts->option.task_fcgi_sess_max);
+	return 0;
+}
+
+hio_svc_fcgic_t* hio_svc_htts_getfcgic (hio_svc_htts_t* htts)
+{
+	return htts->fcgic;
+}
+
+int hio_svc_htts_enablednc (hio_svc_htts_t* htts, const hio_skad_t* serv_addr, const hio_ntime_t* send_tmout, const hio_ntime_t* reply_tmout, hio_oow_t max_tries)
+{
+	if (htts->dnc) return 0;
+	htts->dnc = hio_svc_dnc_start(htts->hio, serv_addr, HIO_NULL, send_tmout, reply_tmout, max_tries);
+	if (HIO_UNLIKELY(!htts->dnc)) return -1;
+	return 0;
+}
+
+hio_svc_dnc_t* hio_svc_htts_getdnc (hio_svc_htts_t* htts)
+{
+	return htts->dnc;
+}
+
+int hio_svc_htts_setservernamewithbcstr (hio_svc_htts_t* htts, const hio_bch_t* name)
+{
+	hio_t* hio = htts->hio;
+	hio_bch_t* tmp;
+
+	if (hio_copy_bcstr(htts->server_name_buf, HIO_COUNTOF(htts->server_name_buf), name) == hio_count_bcstr(name))
+	{
+		tmp = htts->server_name_buf;
+	}
+	else
+	{
+		tmp = hio_dupbcstr(hio, name, HIO_NULL);
+		if (!tmp) return -1;
+	}
+
+	if (htts->server_name && htts->server_name != htts->server_name_buf) hio_freemem (hio, htts->server_name);
+	htts->server_name = tmp;
+	return 0;
+}
+
+hio_dev_sck_t* hio_svc_htts_getlistendev (hio_svc_htts_t* htts, hio_oow_t idx)
+{
+	if (idx >= htts->l.count)
+	{
+		hio_seterrbfmt (htts->hio, HIO_EINVAL, "index out of range");
+		return HIO_NULL;
+	}
+
+	if (!htts->l.sck[idx])
+	{
+		hio_seterrbfmt (htts->hio, HIO_EINVAL, "no listener at the given index");
+		return HIO_NULL;
+	}
+
+	return htts->l.sck[idx];
+}
 
 hio_oow_t hio_svc_htts_getnlistendevs (hio_svc_htts_t* htts)
 {
@@ -839,6 +1493,223 @@ int hio_svc_htts_getsockaddr (hio_svc_htts_t* htts, hio_oow_t idx, hio_skad_t* s
 
 /* ----------------------------------------------------------------- */
 
+int hio_svc_htts_iscompressibletype (const hio_bch_t* content_type, hio_oow_t len)
+{
+	static const hio_bch_t* types[] =
+	{
+		"application/javascript",
+		"application/json",
+		"application/xml",
+		"application/xhtml+xml",
+		"image/svg+xml"
+	};
+	hio_oow_t i;
+
+	/* strip the parameters like charset */
+	for (i = 0; i < len; i++)
+	{
+		if (content_type[i] == ';' || content_type[i] == ' ') { len = i; break; }
+	}
+
+	if (len > 5 && hio_comp_bchars_bcstr(content_type, 5, "text/", 1) == 0) return 1;
+	for (i = 0; i < HIO_COUNTOF(types); i++)
+	{
+		if (hio_comp_bchars_bcstr(content_type, len, types[i], 1) == 0) return 1;
+	}
+	return 0;
+}
+
+/* ----------------------------------------------------------------- */
+
+/* the state of compressing the response body on the fly */
+struct res_zip_t
+{
+#if defined(HAVE_ZLIB)
+	z_stream strm;
+#endif
+	int active; /* compression has begun at the end of the response header */
+	int type_ok; /* compressible content type has been seen */
+	hio_oow_t conlen_off; /* offset to the Content-Length line in the header buffer */
+	hio_oow_t conlen_len; /* length of the Content-Length line. 0 if not seen */
+	hio_oow_t etag_off; /* offset to the ETag value in the header buffer */
+	int etag_strong; /* a strong ETag has been seen */
+	hio_uint8_t obuf[8192];
+};
+typedef struct res_zip_t res_zip_t;
+
+static void free_res_zip (hio_svc_htts_task_t* task)
+{
+	res_zip_t* zip = (res_zip_t*)task->task_res_zip;
+#if defined(HAVE_ZLIB)
+	if (zip->active) deflateEnd (&zip->strm);
+#endif
+	hio_freemem (task->htts->hio, zip);
+	task->task_res_zip = HIO_NULL;
+}
+
+static int is_res_compressible (hio_svc_htts_task_t* task, int status_code)
+{
+	/* whether the response may get compressed for some client. the client's
+	 * acceptance is checked later as the identity variant needs Vary too */
+#if defined(HAVE_ZLIB)
+	return task->htts->option.res_compress_min > 0 && !task->task_res_no_compress && status_code == HIO_HTTP_STATUS_OK;
+#else
+	return 0;
+#endif
+}
+
+static void inspect_res_header_for_zip (hio_svc_htts_task_t* task, const hio_bch_t* key, hio_oow_t line_off)
+{
+	/* inspect a header line just added to the header buffer. the line is 'key: value\r\n' */
+	res_zip_t* zip = (res_zip_t*)task->task_res_zip;
+	hio_becs_t* sbuf = task->task_client->sbuf;
+	hio_oow_t klen, line_len;
+	const hio_bch_t* val;
+	hio_oow_t vlen;
+
+	klen = hio_count_bcstr(key);
+	line_len = HIO_BECS_LEN(sbuf) - line_off;
+	val = HIO_BECS_CPTR(sbuf, line_off + klen + 2);
+	vlen = line_len - klen - 4;
+
+	if (hio_comp_bcstr(key, "Content-Encoding", 1) == 0)
+	{
+		/* already encoded */
+		free_res_zip (task);
+	}
+	else if (hio_comp_bcstr(key, "Content-Type", 1) == 0)
+	{
+		if (hio_svc_htts_iscompressibletype(val, vlen)) zip->type_ok = 1;
+		else free_res_zip (task);
+	}
+	else if (hio_comp_bcstr(key, "Content-Length", 1) == 0)
+	{
+		hio_oow_t i, conlen = 0;
+		for (i = 0; i < vlen && val[i] >= '0' && val[i] <= '9'; i++) conlen = conlen * 10 + (val[i] - '0');
+		if (conlen < task->htts->option.res_compress_min)
+		{
+			free_res_zip (task);
+		}
+		else
+		{
+			/* the length is unknown until compression is over. it gets removed when the header ends */
+			zip->conlen_off = line_off;
+			zip->conlen_len = line_len;
+		}
+	}
+	else if (hio_comp_bcstr(key, "ETag", 1) == 0)
+	{
+		zip->etag_off = line_off + klen + 2;
+		zip->etag_strong = (vlen > 0 && val[0] == '"');
+	}
+}
+
+static int begin_res_zip (hio_svc_htts_task_t* task)
+{
+#if defined(HAVE_ZLIB)
+	res_zip_t* zip = (res_zip_t*)task->task_res_zip;
+	hio_becs_t* sbuf = task->task_client->sbuf;
+
+	if (!zip->type_ok)
+	{
+		/* unknown or incompressible content type */
+		free_res_zip (task);
+		return 0;
+	}
+
+	/* the response varies by Accept-Encoding whether it's compressed for this request or not */
+	if (hio_becs_cat(sbuf, "Vary: Accept-Encoding\r\n") == (hio_oow_t)-1) return -1;
+
+	if (!task->task_req_accept_gzip || task->task_req_method == HIO_HTTP_HEAD ||
+	    (zip->conlen_len > 0 && task->task_keep_client_alive && !task->task_res_chunked &&
+	     (task->task_req_version.major < 1 || (task->task_req_version.major == 1 && task->task_req_version.minor < 1))))
+	{
+		/* not acceptable to the client or no body to compress. or the body can't be
+		 * delimited without the content length as chunking is not available in HTTP/1.0 */
+		free_res_zip (task);
+		return 0;
+	}
+
+	/* 15 + 16 for the gzip header and trailer with the maximum window size */
+	if (deflateInit2(&zip->strm, task->htts->option.res_compress_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		free_res_zip (task);
+		return 0; /* just send it as it is */
+	}
+	zip->active = 1;
+
+	if (zip->etag_strong)
+	{
+		/* the compressed body is not byte-for-byte identical to what the strong entity tag stands for */
+		if (hio_becs_amend(sbuf, zip->etag_off, 0, "W/") == (hio_oow_t)-1) return -1;
+		if (zip->conlen_off > zip->etag_off) zip->conlen_off += 2;
+	}
+
+	if (zip->conlen_len > 0)
+	{
+		hio_becs_del (sbuf, zip->conlen_off, zip->conlen_len);
+		if (task->task_keep_client_alive && !task->task_res_chunked)
+		{
+			if (hio_becs_cat(sbuf, "Transfer-Encoding: chunked\r\n") == (hio_oow_t)-1) return -1;
+			task->task_res_chunked = 1;
+		}
+	}
+
+	if (hio_becs_cat(sbuf, "Content-Encoding: gzip\r\n") == (hio_oow_t)-1) return -1;
+#endif
+	return 0;
+}
+
+#define ACCEPT_ENCODING_GZIP (1 << 0)
+#define ACCEPT_ENCODING_BR   (1 << 1)
+
+static int get_accepted_encodings (hio_htre_t* req)
+{
+	const hio_htre_hdrval_t* val;
+	int encs = 0;
+
+	val = hio_htre_getheaderbyid(req, HIO_HTTP_HDR_ACCEPT_ENCODING);
+	for (; val; val = val->next)
+	{
+		const hio_bch_t* ptr = val->ptr;
+		const hio_bch_t* end = val->ptr + val->len;
+
+		while (ptr < end)
+		{
+			const hio_bch_t* tok, * tok_end;
+			int q_zero = 0;
+
+			while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == ',')) ptr++;
+			tok = ptr;
+			while (ptr < end && *ptr != ',' && *ptr != ';' && *ptr != ' ' && *ptr != '\t') ptr++;
+			tok_end = ptr;
+
+			/* look for q=0 in the parameters. gzip;q=0 means gzip is not acceptable */
+			while (ptr < end && *ptr != ',')
+			{
+				if (*ptr == '=' && ptr > tok_end && (ptr[-1] == 'q' || ptr[-1] == 'Q'))
+				{
+					const hio_bch_t* q = ptr + 1;
+					q_zero = 1;
+					while (q < end && *q != ',' && *q != ';')
+					{
+						if (*q >= '1' && *q <= '9') q_zero = 0;
+						q++;
+					}
+				}
+				ptr++;
+			}
+
+			if (q_zero) continue;
+			if (hio_comp_bchars_bcstr(tok, tok_end - tok, "gzip", 1) == 0 ||
+			    hio_comp_bchars_bcstr(tok, tok_end - tok, "x-gzip", 1) == 0) encs |= ACCEPT_ENCODING_GZIP;
+			else if (hio_comp_bchars_bcstr(tok, tok_end - tok, "br", 1) == 0) encs |= ACCEPT_ENCODING_BR;
+		}
+	}
+
+	return encs;
+}
+
 /* task_size must be the total size to allocate including the header.
  *
  * For instance, if you define a task like below,
@@ -856,16 +1727,20 @@ hio_svc_htts_task_t* hio_svc_htts_task_make (hio_svc_htts_t* htts, hio_oow_t tas
 {
 	hio_t* hio = htts->hio;
 	hio_svc_htts_task_t* task;
-	hio_oow_t qpath_len, qmth_len;
+	hio_oow_t qpath_len, qmth_len, addr_len, rtparams_size;
 
 	HIO_DEBUG1 (hio, "HTTS(%p) - allocating task\n", htts);
 
 	qpath_len = hio_htre_getqpathlen(req);
 	qmth_len = hio_htre_getqmethodlen(req);
+	/* the client address is kept for the access log as the task may outlive the client */
+	addr_len = htts->alog? HIO_SKAD_IP_STRLEN + 1: 0;
+	/* the parameters of the route are set while hio_svc_htts_doroute() dispatches the request */
+	rtparams_size = hio_svc_htts_getrouteparamsize(htts->rtparams.ptr, htts->rtparams.count);
 
 	if (inc_ntasks(htts) <= -1) return HIO_NULL;
 
-	task = hio_callocmem(hio, task_size + qmth_len + 1 + qpath_len + 1);
+	task = hio_callocmem(hio, task_size + rtparams_size + qmth_len + 1 + qpath_len + 1 + addr_len);
 	if (HIO_UNLIKELY(!task))
 	{
 		HIO_DEBUG1 (hio, "HTTS(%p) - failed to allocate task\n", htts);
@@ -886,12 +1761,32 @@ hio_svc_htts_task_t* hio_svc_htts_task_make (hio_svc_htts_t* htts, hio_oow_t tas
 	task->task_req_version = *hio_htre_getversion(req);
 	task->task_req_conlen_unlimited = hio_htre_getreqcontentlen(req, &task->task_req_conlen);
 	task->task_req_flags = req->flags;
-	task->task_req_qmth = (hio_bch_t*)((hio_uint8_t*)task + task_size);
+	task->task_req_body_fd = -1;
+	if (hio_htre_getheaderbyid(req, HIO_HTTP_HDR_ACCEPT_ENCODING))
+	{
+		int encs = get_accepted_encodings(req);
+		task->task_req_accept_gzip = !!(encs & ACCEPT_ENCODING_GZIP);
+		task->task_req_accept_br = !!(encs & ACCEPT_ENCODING_BR);
+	}
+	if (htts->rtparams.count > 0)
+	{
+		task->task_route_params = (hio_svc_htts_route_param_t*)((hio_uint8_t*)task + task_size);
+		task->task_route_nparams = htts->rtparams.count;
+		hio_svc_htts_copyrouteparams (task->task_route_params, htts->rtparams.ptr, htts->rtparams.count);
+	}
+	task->task_req_qmth = (hio_bch_t*)((hio_uint8_t*)task + task_size + rtparams_size);
 	task->task_req_qpath = task->task_req_qmth + qmth_len + 1;
 
 	HIO_MEMCPY (task->task_req_qmth, hio_htre_getqmethodname(req),qmth_len + 1);
 	HIO_MEMCPY (task->task_req_qpath, hio_htre_getqpath(req), qpath_len + 1);
 
+	task->task_req_since = task->task_client->last_active;
+	if (addr_len > 0)
+	{
+		task->task_req_cli_addr = task->task_req_qpath + qpath_len + 1;
+		hio_skadtobcstr (hio, &task->task_client->cli_addr, task->task_req_cli_addr, addr_len, HIO_SKAD_TO_BCSTR_ADDR);
+	}
+
 	/* originally set to listener_on_write/listener_on_disconnect, but set to
 	 * client_on_write/client_on_disconnect in init_client() when the client socket is accepted */
 	HIO_ASSERT (hio, csck->on_read == client_on_read);
@@ -910,6 +1805,14 @@ void hio_svc_htts_task_kill (hio_svc_htts_task_t* task)
 	HIO_DEBUG2 (hio, "HTTS(%p) - destroying task %p\n", htts, task);
 
 	if (task->task_on_kill) task->task_on_kill (task);
+	if (htts->alog) hio_svc_htts_writealog (htts, task);
+	if (task->task_res_zip) free_res_zip (task);
+	if (task->task_req_body_writer)
+	{
+		task->task_req_body_on_end = HIO_NULL;
+		end_req_body_writer (task, 1);
+	}
+	if (task->task_req_body_fd >= 0) close (task->task_req_body_fd);
 	hio_freemem (hio, task);
 
 	dec_ntasks (htts);
@@ -937,6 +1840,13 @@ int hio_svc_htts_task_startreshdr (hio_svc_htts_task_t* task, int status_code, c
 	task->task_res_chunked = chunked;
 	task->task_res_started = 1;
 	task->task_status_code = status_code;
+
+	if (is_res_compressible(task, status_code))
+	{
+		/* the decision is final when the header ends. see begin_res_zip() */
+		task->task_res_zip = hio_callocmem(task->htts->hio, HIO_SIZEOF(res_zip_t));
+		/* no compression upon allocation failure */
+	}
 	return 0;
 }
 
@@ -960,7 +1870,9 @@ int hio_svc_htts_task_addreshdrs (hio_svc_htts_task_t* task, const hio_bch_t* ke
 	if (!is_res_header_acceptable(key)) return 0; /* ignore it*/
 	while (value)
 	{
+		hio_oow_t line_off = HIO_BECS_LEN(cli->sbuf);
 		if (hio_becs_fcat(cli->sbuf, "%hs: %hs\r\n", key, value->ptr) == (hio_oow_t)-1) return -1;
+		if (task->task_res_zip) inspect_res_header_for_zip (task, key, line_off);
 		value = value->next;
 	}
 
@@ -970,18 +1882,23 @@ int hio_svc_htts_task_addreshdrs (hio_svc_htts_task_t* task, const hio_bch_t* ke
 int hio_svc_htts_task_addreshdr (hio_svc_htts_task_t* task, const hio_bch_t* key, const hio_bch_t* value)
 {
 	hio_svc_htts_cli_t* cli = task->task_client;
+	hio_oow_t line_off;
+
 	HIO_ASSERT (task->htts->hio, cli != HIO_NULL);
 	HIO_ASSERT (task->htts->hio, task->task_res_started);
 	HIO_ASSERT (task->htts->hio, !task->task_res_ended);
 
 	if (!is_res_header_acceptable(key)) return 0; /* just ignore it*/
+	line_off = HIO_BECS_LEN(cli->sbuf);
 	if (hio_becs_fcat(cli->sbuf, "%hs: %hs\r\n", key, value) == (hio_oow_t)-1) return -1;
+	if (task->task_res_zip) inspect_res_header_for_zip (task, key, line_off);
 	return 0;
 }
 
 int hio_svc_htts_task_addreshdrfmt (hio_svc_htts_task_t* task, const hio_bch_t* key, const hio_bch_t* vfmt, ...)
 {
 	hio_svc_htts_cli_t* cli = task->task_client;
+	hio_oow_t line_off;
 	va_list ap;
 
 	HIO_ASSERT (task->htts->hio, cli != HIO_NULL);
@@ -989,6 +1906,7 @@ int hio_svc_htts_task_addreshdrfmt (hio_svc_htts_task_t* task, const hio_bch_t*
 	HIO_ASSERT (task->htts->hio, !task->task_res_ended);
 
 	if (!is_res_header_acceptable(key)) return 0; /* just ignore it*/
+	line_off = HIO_BECS_LEN(cli->sbuf);
 	if (hio_becs_fcat(cli->sbuf, "%hs: ", key) == (hio_oow_t)-1) return -1;
 	va_start (ap, vfmt);
 	if (hio_becs_vfcat(cli->sbuf, vfmt, ap) == (hio_oow_t)-1)
@@ -998,6 +1916,7 @@ int hio_svc_htts_task_addreshdrfmt (hio_svc_htts_task_t* task, const hio_bch_t*
 	}
 	va_end (ap);
 	if (hio_becs_cat(cli->sbuf, "\r\n") == (hio_oow_t)-1) return -1;
+	if (task->task_res_zip) inspect_res_header_for_zip (task, key, line_off);
 	return 0;
 }
 
@@ -1016,6 +1935,8 @@ static int write_raw_to_client (hio_svc_htts_task_t* task, const void* data, hio
 		return -1;
 	}
 
+	task->task_res_octets += dlen;
+
 	return 0;
 }
 
@@ -1051,6 +1972,8 @@ static int write_chunk_to_client (hio_svc_htts_task_t* task, const void* data, h
 		return -1;
 	}
 
+	task->task_res_octets += llen + dlen + 2;
+
 	return 0;
 }
 
@@ -1061,6 +1984,7 @@ int hio_svc_htts_task_endreshdr (hio_svc_htts_task_t* task)
 	HIO_ASSERT (task->htts->hio, task->task_res_started);
 	HIO_ASSERT (task->htts->hio, !task->task_res_ended);
 
+	if (task->task_res_zip && begin_res_zip(task) <= -1) return -1;
 	if (hio_becs_cat(cli->sbuf, "\r\n") == (hio_oow_t)-1) return -1;
 	if (task->task_csck && write_raw_to_client(task, HIO_BECS_PTR(cli->sbuf), HIO_BECS_LEN(cli->sbuf)) <= -1) return -1;
 
@@ -1068,9 +1992,73 @@ int hio_svc_htts_task_endreshdr (hio_svc_htts_task_t* task)
 	return 0;
 }
 
+int hio_svc_htts_task_endreshdrwithraw (hio_svc_htts_task_t* task, const void* raw, hio_iolen_t rawlen)
+{
+	hio_svc_htts_cli_t* cli = task->task_client;
+	hio_iovec_t iov[2];
+
+	HIO_ASSERT (task->htts->hio, cli != HIO_NULL);
+	HIO_ASSERT (task->htts->hio, task->task_res_started);
+	HIO_ASSERT (task->htts->hio, !task->task_res_ended);
+	HIO_ASSERT (task->htts->hio, !task->task_res_chunked);
+	HIO_ASSERT (task->htts->hio, task->task_res_zip == HIO_NULL);
+
+	if (!task->task_csck) return 0;
+
+	/* send the header and the prebuilt data with a single write request */
+	iov[0].iov_ptr = HIO_BECS_PTR(cli->sbuf);
+	iov[0].iov_len = HIO_BECS_LEN(cli->sbuf);
+	iov[1].iov_ptr = (void*)raw;
+	iov[1].iov_len = rawlen;
+
+	task->task_res_ever_sent = 1;
+	task->task_res_pending_writes++;
+	if (hio_dev_sck_writev(task->task_csck, iov, HIO_COUNTOF(iov), &htts_svr_wrctx, HIO_NULL) <= -1)
+	{
+		task->task_res_pending_writes--;
+		return -1;
+	}
+
+	task->task_res_octets += iov[0].iov_len + rawlen;
+
+	return 0;
+}
+
+static int write_zipped_to_client (hio_svc_htts_task_t* task, const void* data, hio_iolen_t dlen, int finish)
+{
+#if defined(HAVE_ZLIB)
+	res_zip_t* zip = (res_zip_t*)task->task_res_zip;
+	int x;
+
+	zip->strm.next_in = (Bytef*)data;
+	zip->strm.avail_in = dlen;
+
+	/* flush at each call not to hold the data of a streaming response for long */
+	do
+	{
+		hio_oow_t outlen;
+
+		zip->strm.next_out = zip->obuf;
+		zip->strm.avail_out = HIO_SIZEOF(zip->obuf);
+		x = deflate(&zip->strm, (finish? Z_FINISH: Z_SYNC_FLUSH));
+		if (x == Z_STREAM_ERROR)
+		{
+			hio_seterrbfmt (task->htts->hio, HIO_ESYSERR, "compression failure");
+			return -1;
+		}
+
+		outlen = HIO_SIZEOF(zip->obuf) - zip->strm.avail_out;
+		if (outlen > 0 && (task->task_res_chunked? write_chunk_to_client(task, zip->obuf, outlen): write_raw_to_client(task, zip->obuf, outlen)) <= -1) return -1;
+	}
+	while (zip->strm.avail_out == 0 || (finish && x != Z_STREAM_END));
+#endif
+	return 0;
+}
+
 int hio_svc_htts_task_addresbody (hio_svc_htts_task_t* task, const void* data, hio_iolen_t dlen)
 {
 	if (!task->task_csck) return 0;
+	if (task->task_res_zip) return dlen > 0? write_zipped_to_client(task, data, dlen, 0): 0;
 	return task->task_res_chunked? write_chunk_to_client(task, data, dlen): write_raw_to_client(task, data, dlen);
 }
 
@@ -1084,6 +2072,8 @@ int hio_svc_htts_task_addresbodyfromfile (hio_svc_htts_task_t* task, int fd, hio
 			task->task_res_pending_writes--;
 			return -1;
 		}
+
+		task->task_res_octets += len;
 	}
 
 	return 0;
@@ -1103,6 +2093,7 @@ int hio_svc_htts_task_endbody (hio_svc_htts_task_t* task)
 		}
 		else
 		{
+			if (task->task_csck && task->task_res_zip && write_zipped_to_client(task, HIO_NULL, 0, 1) <= -1) return -1;
 			if (task->task_csck && task->task_res_chunked && write_raw_to_client(task, "0\r\n\r\n", 5) <= -1) return -1;
 		}
 
@@ -1171,10 +2162,288 @@ int hio_svc_htts_task_sendfinalres (hio_svc_htts_task_t* task, int status_code,
 	return 1;
 }
 
-int hio_svc_htts_task_handleexpect100 (hio_svc_htts_task_t* task, int no_continue)
+struct req_body_writer_xtn_t
+{
+	hio_svc_htts_task_t* task;
+	int status; /* errno reported by the writer thread */
+	int status_read;
+};
+typedef struct req_body_writer_xtn_t req_body_writer_xtn_t;
+
+static void req_body_writer_thr_func (hio_t* hio, hio_dev_thr_iopair_t* iop, void* ctx)
+{
+	int fd = (int)(hio_oow_t)ctx;
+	int err = 0;
+	hio_uint8_t buf[16384];
+
+	while (1)
+	{
+		ssize_t n, x;
+		hio_uint8_t* ptr;
+
+		n = read(iop->rfd, buf, HIO_SIZEOF(buf));
+		if (n <= -1)
+		{
+			if (errno == EINTR) continue;
+			if (!err) err = errno;
+			break;
+		}
+		if (n == 0) break;
+
+		/* keep draining the pipe after a failure so that the loop
+		 * side doesn't get stuck with writes that can't complete */
+		ptr = buf;
+		while (!err && n > 0)
+		{
+			x = write(fd, ptr, n);
+			if (x <= -1)
+			{
+				if (errno == EINTR) continue;
+				err = errno;
+				break;
+			}
+			ptr += x;
+			n -= x;
+		}
+	}
+
+	close (fd);
+	write (iop->wfd, &err, HIO_SIZEOF(err));
+}
+
+static void end_req_body_writer (hio_svc_htts_task_t* task, int failed)
+{
+	hio_dev_thr_t* writer = task->task_req_body_writer;
+	hio_svc_htts_task_on_req_body_end_t on_end;
+
+	if (!writer) return;
+
+	((req_body_writer_xtn_t*)hio_dev_thr_getxtn(writer))->task = HIO_NULL;
+	task->task_req_body_writer = HIO_NULL;
+	hio_dev_thr_halt (writer);
+
+	if (failed)
+	{
+		HIO_DEBUG2 (task->htts->hio, "HTTS(%p) - failed to write request body of task %p\n", task->htts, task);
+		task->task_req_body_failed = 1;
+	}
+
+	on_end = task->task_req_body_on_end;
+	task->task_req_body_on_end = HIO_NULL;
+	if (on_end) on_end (task, (task->task_req_body_failed? -1: 0));
+}
+
+static int req_body_writer_on_read (hio_dev_thr_t* writer, const void* data, hio_iolen_t len)
+{
+	req_body_writer_xtn_t* wxtn = (req_body_writer_xtn_t*)hio_dev_thr_getxtn(writer);
+
+	if (!wxtn->task) return 0;
+
+	if (len > 0)
+	{
+		if (len == HIO_SIZEOF(wxtn->status)) HIO_MEMCPY (&wxtn->status, data, len);
+		else wxtn->status = EIO;
+		wxtn->status_read = 1;
+		return 0;
+	}
+
+	/* the thread is done with the file */
+	if (len <= -1 && !wxtn->status) wxtn->status = EIO;
+	end_req_body_writer (wxtn->task, !wxtn->status_read || wxtn->status != 0);
+	return 0;
+}
+
+static int req_body_writer_on_write (hio_dev_thr_t* writer, hio_iolen_t wrlen, void* wrctx)
+{
+	req_body_writer_xtn_t* wxtn = (req_body_writer_xtn_t*)hio_dev_thr_getxtn(writer);
+	hio_svc_htts_task_t* task = wxtn->task;
+
+	if (!task) return 0;
+
+	task->task_req_body_pending_writes--;
+	if (wrlen <= -1) task->task_req_body_failed = 1;
+
+	if (task->task_req_body_pending_writes <= 0 && task->task_req_body_paused)
+	{
+		/* the thread has caught up. resume reading the client */
+		task->task_req_body_paused = 0;
+		if (task->task_csck && hio_dev_sck_read(task->task_csck, 1) <= -1) return -1;
+	}
+
+	return 0;
+}
+
+static void req_body_writer_on_close (hio_dev_thr_t* writer, hio_dev_thr_sid_t sid)
+{
+	req_body_writer_xtn_t* wxtn = (req_body_writer_xtn_t*)hio_dev_thr_getxtn(writer);
+
+	/* the output may get closed by a hang-up without an EOF read */
+	if (wxtn->task && sid != HIO_DEV_THR_IN) end_req_body_writer (wxtn->task, !wxtn->status_read || wxtn->status != 0);
+}
+
+static int write_req_body_to_file (hio_svc_htts_task_t* task, const void* ptr, hio_oow_t len)
+{
+	int n;
+
+	if (task->task_req_body_failed)
+	{
+		hio_seterrbfmt (task->htts->hio, HIO_ESYSERR, "unable to write request body to file");
+		return -1;
+	}
+
+	task->task_req_body_pending_writes++;
+	n = hio_dev_thr_write(task->task_req_body_writer, ptr, len, HIO_NULL);
+	if (n <= -1)
+	{
+		task->task_req_body_pending_writes--;
+		return -1;
+	}
+
+	if (len > 0) task->task_req_body_len += len;
+
+	/* the pipe is full. stop reading the client until the writer catches up
+	 * instead of piling up the body in the write queue */
+	if (n == 0 && !task->task_req_body_paused && task->task_csck)
+	{
+		if (hio_dev_sck_read(task->task_csck, 0) <= -1) return -1;
+		task->task_req_body_paused = 1;
+	}
+
+	return 0;
+}
+
+static int open_req_body_file (hio_svc_htts_task_t* task)
+{
+	hio_t* hio = task->htts->hio;
+	const hio_bch_t* dir;
+	hio_bch_t* path;
+	hio_oow_t plen;
+	int fd, wfd, flags;
+	hio_dev_thr_make_t mi;
+	hio_dev_thr_t* writer;
+
+	dir = getenv("TMPDIR");
+	if (!dir || dir[0] == '\0') dir = "/tmp";
+
+	plen = hio_count_bcstr(dir) + 32;
+	path = (hio_bch_t*)hio_allocmem(hio, plen);
+	if (HIO_UNLIKELY(!path)) return -1;
+	hio_fmttobcstr (hio, path, plen, "%hs/hio-body-XXXXXX", dir);
+
+	fd = mkstemp(path);
+	if (fd <= -1)
+	{
+		hio_seterrwithsyserr (hio, 0, errno);
+		hio_freemem (hio, path);
+		return -1;
+	}
+
+	/* the file is gone once the descriptor is closed */
+	unlink (path);
+	hio_freemem (hio, path);
+
+	flags = fcntl(fd, F_GETFD);
+	if (flags >= 0) fcntl (fd, F_SETFD, flags | FD_CLOEXEC);
+
+	/* the writer thread owns a duplicate so that the task can go away
+	 * while the thread is still writing */
+	wfd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (wfd <= -1)
+	{
+		hio_seterrwithsyserr (hio, 0, errno);
+		close (fd);
+		return -1;
+	}
+
+	HIO_MEMSET (&mi, 0, HIO_SIZEOF(mi));
+	mi.thr_func = req_body_writer_thr_func;
+	mi.thr_ctx = (void*)(hio_oow_t)wfd;
+	mi.on_read = req_body_writer_on_read;
+	mi.on_write = req_body_writer_on_write;
+	mi.on_close = req_body_writer_on_close;
+
+	writer = hio_dev_thr_make(hio, HIO_SIZEOF(req_body_writer_xtn_t), &mi);
+	if (HIO_UNLIKELY(!writer))
+	{
+		close (wfd);
+		close (fd);
+		return -1;
+	}
+	((req_body_writer_xtn_t*)hio_dev_thr_getxtn(writer))->task = task;
+
+	task->task_req_body_fd = fd;
+	task->task_req_body_len = 0;
+	task->task_req_body_writer = writer;
+	return 0;
+}
+
+int hio_svc_htts_task_addreqbody (hio_svc_htts_task_t* task, hio_htre_t* req, const void* data, hio_oow_t dlen)
+{
+	hio_becs_t* content = hio_htre_getcontent(req);
+	hio_oow_t mem_max = task->htts->option.task_req_body_mem_max;
+
+	if (task->task_req_body_fd <= -1)
+	{
+		if (mem_max <= 0 || HIO_BECS_LEN(content) + dlen <= mem_max)
+		{
+			return (hio_becs_ncat(content, data, dlen) == (hio_oow_t)-1)? -1: 0;
+		}
+
+		/* the body doesn't fit in memory. move what has been buffered so far
+		 * to a temporary file and keep appending to it */
+		if (open_req_body_file(task) <= -1) return -1;
+		if (HIO_BECS_LEN(content) > 0 && write_req_body_to_file(task, HIO_BECS_PTR(content), HIO_BECS_LEN(content)) <= -1) return -1;
+
+		/* the write queue holds its own copy. give back the memory */
+		hio_becs_clear (content);
+		hio_becs_setcapa (content, 0);
+	}
+
+	return (dlen > 0)? write_req_body_to_file(task, data, dlen): 0;
+}
+
+int hio_svc_htts_task_endreqbody (hio_svc_htts_task_t* task, hio_svc_htts_task_on_req_body_end_t on_end)
+{
+	if (!task->task_req_body_writer)
+	{
+		if (task->task_req_body_failed)
+		{
+			hio_seterrbfmt (task->htts->hio, HIO_ESYSERR, "unable to write request body to file");
+			return -1;
+		}
+		return 1;
+	}
+
+	task->task_req_body_on_end = on_end;
+	if (write_req_body_to_file(task, HIO_NULL, 0) <= -1)
+	{
+		task->task_req_body_on_end = HIO_NULL;
+		return -1;
+	}
+
+	/* the writer ends after the end of the data. no more reading
+	 * of the client needs resuming */
+	task->task_req_body_paused = 0;
+	return 0;
+}
+
+int hio_svc_htts_task_getreqbodyfd (hio_svc_htts_task_t* task)
+{
+	if (task->task_req_body_fd <= -1) return -1;
+
+	if (lseek(task->task_req_body_fd, 0, SEEK_SET) == (off_t)-1)
+	{
+		hio_seterrwithsyserr (task->htts->hio, 0, errno);
+		return -1;
+	}
+
+	return task->task_req_body_fd;
+}
+
+int hio_svc_htts_task_handleexpect100 (hio_svc_htts_task_t* task, int options)
 {
 #if !defined(TASK_ALLOW_UNLIMITED_REQ_CONTENT_LENGTH)
-	if (task->task_req_conlen_unlimited)
+	if (task->task_req_conlen_unlimited && !(options & HIO_SVC_HTTS_TASK_EXPECT100_CHUNKED))
 	{
 		/* Transfer-Encoding is chunked. no content-length is known in advance. */
 		/* option 1. buffer contents. if it gets too large, send 413 Request Entity Too Large.
@@ -1186,7 +2455,7 @@ int hio_svc_htts_task_handleexpect100 (hio_svc_htts_task_t* task, int no_continu
 
 	if (task->task_req_flags & HIO_HTRE_ATTR_EXPECT100)
 	{
-		if (!no_continue)
+		if (!(options & HIO_SVC_HTTS_TASK_EXPECT100_NO_CONTINUE))
 		{
 			/* TODO: Expect: 100-continue? who should handle this? fcgi? or the http server? */
 				/* CAN I LET the fcgi SCRIPT handle this? */
@@ -28,11 +28,22 @@
 #include <hio-chr.h>
 
 #include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
 
 #define THR_ALLOW_UNLIMITED_REQ_CONTENT_LENGTH
 
 #define THR_PENDING_IO_THRESHOLD 5
 
+/* a thread function can write a binary response header with
+ * hio_svc_htts_thr_writereshdr() instead of a CGI-style header.
+ * the frame begins with a null byte which can't start a text header.
+ *   marker(1) payload-length(4) status-code(2)
+ *   { key-length(2) key '\0' value-length(2) value '\0' }... */
+#define THR_RES_FRAME_MARKER '\0'
+#define THR_RES_FRAME_HDR_LEN 5
+#define THR_RES_FRAME_MAX 65536
+
 #define THR_OVER_READ_FROM_CLIENT (1 << 0)
 #define THR_OVER_READ_FROM_PEER   (1 << 1)
 #define THR_OVER_WRITE_TO_CLIENT  (1 << 2)
@@ -46,6 +57,14 @@ struct thr_func_start_t
 	hio_svc_htts_thr_func_t thr_func;
 	void* thr_ctx;
 	hio_svc_htts_thr_func_info_t tfi;
+
+	/* request header snapshot. the header array and the strings it points to
+	 * are held in a single memory block so that the thread can access them
+	 * without any locking and it gets freed in one go. */
+	hio_svc_htts_thr_hdr_t* req_hdrs; /* HIO_NULL while counting */
+	hio_oow_t req_nhdrs;
+	hio_oow_t req_hdrs_strlen;
+	hio_bch_t* req_hdrs_sptr;
 };
 typedef struct thr_func_start_t thr_func_start_t;
 
@@ -62,6 +81,10 @@ struct thr_t
 
 	unsigned int over: 4; /* must be large enough to accomodate THR_OVER_ALL */
 	unsigned int client_htrd_recbs_changed: 1;
+	unsigned int peer_res_mode_known: 1; /* set when the first output byte from the peer is seen */
+	unsigned int peer_res_framed: 1; /* the peer writes a binary response header */
+	unsigned int peer_res_frame_done: 1;
+	hio_becs_t* peer_res_frame; /* incomplete binary response header */
 
 	hio_dev_sck_on_read_t client_org_on_read;
 	hio_dev_sck_on_write_t client_org_on_write;
@@ -237,6 +260,113 @@ static void thr_peer_on_close (hio_dev_thr_t* peer, hio_dev_thr_sid_t sid)
 	}
 }
 
+static int thr_send_res_body (thr_t* thr, const void* data, hio_iolen_t dlen)
+{
+	int n;
+
+	n = hio_svc_htts_task_addresbody((hio_svc_htts_task_t*)thr, data, dlen);
+	if (thr->task_res_pending_writes > THR_PENDING_IO_THRESHOLD)
+	{
+		if (hio_dev_thr_read(thr->peer, 0) <= -1) n = -1;
+	}
+
+	return n;
+}
+
+static HIO_INLINE hio_oow_t get_frame_uint16 (const hio_uint8_t* p)
+{
+	return ((hio_oow_t)p[0] << 8) | p[1];
+}
+
+static int thr_send_res_frame (thr_t* thr, const hio_uint8_t* ptr, hio_oow_t len)
+{
+	hio_t* hio = thr->htts->hio;
+	const hio_uint8_t* end = ptr + len;
+	const hio_uint8_t* p;
+	int status_code, chunked;
+
+	if (len < 2) goto bad_frame;
+	status_code = (int)get_frame_uint16(ptr);
+	if (status_code < 100 || status_code > 599) goto bad_frame;
+
+	/* validate all the headers first and find Content-Length */
+	chunked = thr->task_keep_client_alive;
+	for (p = ptr + 2; p < end; )
+	{
+		const hio_bch_t* key;
+		hio_oow_t klen, vlen;
+
+		if (end - p < 2 || (klen = get_frame_uint16(p)) + 3 > (hio_oow_t)(end - p) || p[2 + klen] != '\0') goto bad_frame;
+		key = (const hio_bch_t*)p + 2;
+		p += klen + 3;
+		if (end - p < 2 || (vlen = get_frame_uint16(p)) + 3 > (hio_oow_t)(end - p) || p[2 + vlen] != '\0') goto bad_frame;
+		p += vlen + 3;
+
+		if (hio_comp_bchars_bcstr(key, klen, "Content-Length", 1) == 0) chunked = 0;
+	}
+
+	if (!thr->task_client) return 0; /* the client is gone */
+
+	if (hio_svc_htts_task_startreshdr((hio_svc_htts_task_t*)thr, status_code, HIO_NULL, chunked) <= -1) return -1;
+	for (p = ptr + 2; p < end; )
+	{
+		const hio_bch_t* key, * val;
+
+		key = (const hio_bch_t*)p + 2;
+		p += get_frame_uint16(p) + 3;
+		val = (const hio_bch_t*)p + 2;
+		p += get_frame_uint16(p) + 3;
+
+		if (hio_svc_htts_task_addreshdr((hio_svc_htts_task_t*)thr, key, val) <= -1) return -1;
+	}
+	return hio_svc_htts_task_endreshdr((hio_svc_htts_task_t*)thr);
+
+bad_frame:
+	hio_seterrbfmt (hio, HIO_EINVAL, "invalid response header frame from thread");
+	return -1;
+}
+
+static int thr_feed_res_frame (thr_t* thr, const void* data, hio_iolen_t dlen)
+{
+	hio_t* hio = thr->htts->hio;
+	const hio_uint8_t* ptr;
+	hio_oow_t len, flen;
+	int n;
+
+	if (thr->peer_res_frame_done) return thr_send_res_body(thr, data, dlen);
+
+	if (!thr->peer_res_frame)
+	{
+		thr->peer_res_frame = hio_becs_open(hio, 0, 256);
+		if (HIO_UNLIKELY(!thr->peer_res_frame)) return -1;
+	}
+	if (hio_becs_ncat(thr->peer_res_frame, data, dlen) == (hio_oow_t)-1) return -1;
+
+	ptr = (const hio_uint8_t*)HIO_BECS_PTR(thr->peer_res_frame);
+	len = HIO_BECS_LEN(thr->peer_res_frame);
+	if (len < THR_RES_FRAME_HDR_LEN) return 0; /* need more */
+
+	flen = ((hio_oow_t)ptr[1] << 24) | ((hio_oow_t)ptr[2] << 16) | ((hio_oow_t)ptr[3] << 8) | ptr[4];
+	if (flen > THR_RES_FRAME_MAX)
+	{
+		hio_seterrbfmt (hio, HIO_EINVAL, "response header frame from thread too large - %zu", flen);
+		return -1;
+	}
+	if (len < THR_RES_FRAME_HDR_LEN + flen) return 0; /* need more */
+
+	thr->peer_res_frame_done = 1;
+	n = thr_send_res_frame(thr, ptr + THR_RES_FRAME_HDR_LEN, flen);
+	if (n >= 0 && len > THR_RES_FRAME_HDR_LEN + flen)
+	{
+		/* the response body written together with the header */
+		n = thr_send_res_body(thr, ptr + THR_RES_FRAME_HDR_LEN + flen, len - THR_RES_FRAME_HDR_LEN - flen);
+	}
+
+	hio_becs_close (thr->peer_res_frame);
+	thr->peer_res_frame = HIO_NULL;
+	return n;
+}
+
 static int thr_peer_on_read (hio_dev_thr_t* peer, const void* data, hio_iolen_t dlen)
 {
 	hio_t* hio = peer->hio;
@@ -272,7 +402,13 @@ static int thr_peer_on_read (hio_dev_thr_t* peer, const void* data, hio_iolen_t
 
 		HIO_ASSERT (hio, !(thr->over & THR_OVER_READ_FROM_PEER));
 
-		if (hio_htrd_feed(thr->peer_htrd, data, dlen, &rem) <= -1)
+		if (!thr->peer_res_mode_known)
+		{
+			thr->peer_res_framed = (*(const hio_bch_t*)data == THR_RES_FRAME_MARKER);
+			thr->peer_res_mode_known = 1;
+		}
+
+		if (thr->peer_res_framed? (thr_feed_res_frame(thr, data, dlen) <= -1): (hio_htrd_feed(thr->peer_htrd, data, dlen, &rem) <= -1))
 		{
 			HIO_DEBUG2 (hio, "HTTPS(%p) - unable to feed peer htrd - peer %p\n", thr->htts, peer);
 
@@ -345,17 +481,9 @@ static int thr_peer_htrd_push_content (hio_htrd_t* htrd, hio_htre_t* req, const
 {
 	thr_peer_xtn_t* pxtn = hio_htrd_getxtn(htrd);
 	thr_t* thr = pxtn->task;
-	int n;
 
 	HIO_ASSERT (thr->htts->hio, htrd == thr->peer_htrd);
-
-	n = hio_svc_htts_task_addresbody((hio_svc_htts_task_t*)thr, data, dlen);
-	if (thr->task_res_pending_writes > THR_PENDING_IO_THRESHOLD)
-	{
-		if (hio_dev_thr_read(thr->peer, 0) <= -1) n = -1;
-	}
-
-	return n;
+	return thr_send_res_body(thr, data, dlen);
 }
 
 static hio_htrd_recbs_t thr_peer_htrd_recbs =
@@ -581,6 +709,8 @@ static void free_thr_start_info (void* ctx)
 	hio_t* hio = tfs->hio;
 	if (tfs->tfi.req_path) hio_freemem (hio, tfs->tfi.req_path);
 	if (tfs->tfi.req_param) hio_freemem (hio, tfs->tfi.req_param);
+	if (tfs->req_hdrs) hio_freemem (hio, tfs->req_hdrs);
+	if (tfs->tfi.route_params) hio_freemem (hio, (void*)tfs->tfi.route_params);
 	hio_freemem (hio, tfs);
 }
 
@@ -596,9 +726,39 @@ static int thr_capture_request_header (hio_htre_t* req, const hio_bch_t* key, co
 {
 	thr_func_start_t* tfs = (thr_func_start_t*)ctx;
 
-	if (hio_comp_bcstr(key, "X-HTTP-Method-Override", 1) == 0)
+	if (!tfs->req_hdrs)
 	{
-		tfs->tfi.req_x_http_method_override = hio_bchars_to_http_method(val->ptr, val->len); /* don't care about multiple values */
+		/* counting pass */
+		if (hio_comp_bcstr(key, "X-HTTP-Method-Override", 1) == 0)
+		{
+			tfs->tfi.req_x_http_method_override = hio_bchars_to_http_method(val->ptr, val->len); /* don't care about multiple values */
+		}
+
+		/* the key is stored once and shared by multiple values of the same header */
+		tfs->req_hdrs_strlen += hio_count_bcstr(key) + 1;
+		do
+		{
+			tfs->req_nhdrs++;
+			tfs->req_hdrs_strlen += val->len + 1;
+			val = val->next;
+		}
+		while (val);
+	}
+	else
+	{
+		/* filling pass */
+		const hio_bch_t* kptr = tfs->req_hdrs_sptr;
+
+		tfs->req_hdrs_sptr += hio_copy_bcstr_unlimited(tfs->req_hdrs_sptr, key) + 1;
+		do
+		{
+			hio_svc_htts_thr_hdr_t* hdr = &tfs->req_hdrs[tfs->req_nhdrs++];
+			hdr->key = kptr;
+			hdr->value = tfs->req_hdrs_sptr;
+			tfs->req_hdrs_sptr += hio_copy_bchars_to_bcstr_unlimited(tfs->req_hdrs_sptr, val->ptr, val->len) + 1;
+			val = val->next;
+		}
+		while (val);
 	}
 
 #if 0
@@ -728,10 +888,38 @@ static int bind_task_to_peer (thr_t* thr, hio_dev_sck_t* csck, hio_htre_t* req,
 
 	tfs->tfi.req_x_http_method_override = -1;
 	if (hio_htre_walkheaders(req, thr_capture_request_header, tfs) <= -1) goto oops;
+	if (tfs->req_nhdrs > 0)
+	{
+		/* take a snapshot of the request headers for the thread. the first
+		 * walk above has counted the entries and sized the strings. */
+		hio_oow_t nhdrs = tfs->req_nhdrs;
+
+		tfs->req_hdrs = hio_allocmem(hio, HIO_SIZEOF(*tfs->req_hdrs) * nhdrs + tfs->req_hdrs_strlen);
+		if (HIO_UNLIKELY(!tfs->req_hdrs)) goto oops;
+		tfs->req_hdrs_sptr = (hio_bch_t*)(tfs->req_hdrs + nhdrs);
+		tfs->req_nhdrs = 0;
+		if (hio_htre_walkheaders(req, thr_capture_request_header, tfs) <= -1) goto oops;
+		HIO_ASSERT (hio, tfs->req_nhdrs == nhdrs);
+
+		tfs->tfi.req_hdrs = tfs->req_hdrs;
+		tfs->tfi.req_nhdrs = nhdrs;
+	}
 
 	tfs->tfi.server_addr = csck->localaddr;
 	tfs->tfi.client_addr = csck->remoteaddr;
 
+	if (thr->task_route_nparams > 0)
+	{
+		/* the thread gets its own copy as the task may go away before the thread ends */
+		hio_svc_htts_route_param_t* params;
+
+		params = hio_allocmem(hio, hio_svc_htts_getrouteparamsize(thr->task_route_params, thr->task_route_nparams));
+		if (HIO_UNLIKELY(!params)) goto oops;
+		hio_svc_htts_copyrouteparams (params, thr->task_route_params, thr->task_route_nparams);
+		tfs->tfi.route_params = params;
+		tfs->tfi.route_nparams = thr->task_route_nparams;
+	}
+
 	HIO_MEMSET (&mi, 0, HIO_SIZEOF(mi));
 	mi.thr_func = thr_func;
 	mi.thr_ctx = tfs;
@@ -739,6 +927,16 @@ static int bind_task_to_peer (thr_t* thr, hio_dev_sck_t* csck, hio_htre_t* req,
 	mi.on_write = thr_peer_on_write;
 	mi.on_close = thr_peer_on_close;
 
+	if (htts->option.task_thr_max > 0)
+	{
+		if (!htts->thr_pool)
+		{
+			htts->thr_pool = hio_dev_thr_openpool(hio, htts->option.task_thr_max, htts->option.task_thr_queue_max);
+			if (HIO_UNLIKELY(!htts->thr_pool)) goto oops;
+		}
+		mi.pool = htts->thr_pool;
+	}
+
 	htrd = hio_htrd_open(hio, HIO_SIZEOF(*pxtn));
 	if (HIO_UNLIKELY(!htrd)) goto oops;
 	hio_htrd_setoption (htrd, HIO_HTRD_SKIP_INITIAL_LINE | HIO_HTRD_RESPONSE);
@@ -787,6 +985,12 @@ static void unbind_task_from_peer (thr_t* thr, int rcdown)
 		n++;
 	}
 
+	if (thr->peer_res_frame)
+	{
+		hio_becs_close (thr->peer_res_frame);
+		thr->peer_res_frame = HIO_NULL;
+	}
+
 	if (thr->peer)
 	{
 		thr_peer_xtn_t* pxtn = hio_dev_thr_getxtn(thr->peer);
@@ -859,6 +1063,7 @@ int hio_svc_htts_dothr (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* r
 
 	thr = (thr_t*)hio_svc_htts_task_make(htts, HIO_SIZEOF(*thr), thr_on_kill, req, csck);
 	if (HIO_UNLIKELY(!thr)) goto oops;
+	HIO_SVC_HTTS_STAT_INC (htts, task_thr);
 	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)thr);
 
 	thr->options = options;
@@ -866,7 +1071,12 @@ int hio_svc_htts_dothr (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* r
 	bind_task_to_client (thr, csck);
 	bound_to_client = 1;
 
-	if (bind_task_to_peer(thr, csck, req, func, ctx) <= -1) goto oops;
+	if (bind_task_to_peer(thr, csck, req, func, ctx) <= -1)
+	{
+		/* all pooled workers are busy and the queue is full */
+		if (hio_geterrnum(hio) == HIO_EBUSY) status_code = HIO_HTTP_STATUS_SERVICE_UNAVAILABLE;
+		goto oops;
+	}
 	bound_to_peer = 1;
 
 	if (hio_svc_htts_task_handleexpect100((hio_svc_htts_task_t*)thr, 0) <= -1) goto oops;
@@ -895,3 +1105,109 @@ oops:
 	}
 	return -1;
 }
+
+/* ----------------------------------------------------------------------- */
+
+const hio_bch_t* hio_svc_htts_thr_getreqheader (const hio_svc_htts_thr_func_info_t* tfi, const hio_bch_t* key)
+{
+	hio_oow_t i;
+	for (i = 0; i < tfi->req_nhdrs; i++)
+	{
+		if (hio_comp_bcstr(tfi->req_hdrs[i].key, key, 1) == 0) return tfi->req_hdrs[i].value;
+	}
+	return HIO_NULL;
+}
+
+const hio_bch_t* hio_svc_htts_thr_getrouteparam (const hio_svc_htts_thr_func_info_t* tfi, const hio_bch_t* name)
+{
+	return hio_svc_htts_findrouteparam(tfi->route_params, tfi->route_nparams, name);
+}
+
+/* the following functions get called in the thread function.
+ * don't use the hio functions that allocate memory or touch the hio object */
+static int write_all_to_fd (hio_syshnd_t fd, const hio_uint8_t* ptr, hio_oow_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, ptr, len);
+		if (n <= -1)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		ptr += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int put_frame_bytes (hio_syshnd_t fd, hio_uint8_t* buf, hio_oow_t* blen, hio_oow_t bcapa, const void* data, hio_oow_t dlen)
+{
+	const hio_uint8_t* ptr = (const hio_uint8_t*)data;
+
+	while (dlen > 0)
+	{
+		hio_oow_t n;
+
+		if (*blen >= bcapa)
+		{
+			if (write_all_to_fd(fd, buf, *blen) <= -1) return -1;
+			*blen = 0;
+		}
+
+		n = bcapa - *blen;
+		if (n > dlen) n = dlen;
+		HIO_MEMCPY (&buf[*blen], ptr, n);
+		*blen += n;
+		ptr += n;
+		dlen -= n;
+	}
+
+	return 0;
+}
+
+static int put_frame_string (hio_syshnd_t fd, hio_uint8_t* buf, hio_oow_t* blen, hio_oow_t bcapa, const hio_bch_t* str, hio_oow_t len)
+{
+	hio_uint8_t lb[2];
+	lb[0] = (len >> 8) & 0xFF;
+	lb[1] = len & 0xFF;
+	/* the terminating '\0' is written as part of the string */
+	if (put_frame_bytes(fd, buf, blen, bcapa, lb, 2) <= -1 ||
+	    put_frame_bytes(fd, buf, blen, bcapa, str, len + 1) <= -1) return -1;
+	return 0;
+}
+
+int hio_svc_htts_thr_writereshdr (hio_dev_thr_iopair_t* iop, int status_code, const hio_svc_htts_thr_hdr_t* hdrs, hio_oow_t nhdrs)
+{
+	hio_uint8_t buf[512];
+	hio_oow_t blen, flen, i;
+
+	if (status_code < 100 || status_code > 599) return -1;
+
+	flen = 2;
+	for (i = 0; i < nhdrs; i++)
+	{
+		hio_oow_t klen = hio_count_bcstr(hdrs[i].key);
+		hio_oow_t vlen = hio_count_bcstr(hdrs[i].value);
+		if (klen > 0xFFFF || vlen > 0xFFFF) return -1;
+		flen += klen + vlen + 6;
+	}
+	if (flen > THR_RES_FRAME_MAX) return -1;
+
+	buf[0] = THR_RES_FRAME_MARKER;
+	buf[1] = (flen >> 24) & 0xFF;
+	buf[2] = (flen >> 16) & 0xFF;
+	buf[3] = (flen >> 8) & 0xFF;
+	buf[4] = flen & 0xFF;
+	buf[5] = (status_code >> 8) & 0xFF;
+	buf[6] = status_code & 0xFF;
+	blen = THR_RES_FRAME_HDR_LEN + 2;
+
+	for (i = 0; i < nhdrs; i++)
+	{
+		if (put_frame_string(iop->wfd, buf, &blen, HIO_SIZEOF(buf), hdrs[i].key, hio_count_bcstr(hdrs[i].key)) <= -1 ||
+		    put_frame_string(iop->wfd, buf, &blen, HIO_SIZEOF(buf), hdrs[i].value, hio_count_bcstr(hdrs[i].value)) <= -1) return -1;
+	}
+
+	return write_all_to_fd(iop->wfd, buf, blen);
+}
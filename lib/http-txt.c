@@ -351,6 +351,7 @@ int hio_svc_htts_dotxt (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* r
 
 	txt = (txt_t*)hio_svc_htts_task_make(htts, HIO_SIZEOF(*txt), txt_on_kill, req, csck);
 	if (HIO_UNLIKELY(!txt)) goto oops;
+	HIO_SVC_HTTS_STAT_INC (htts, task_txt);
 	HIO_SVC_HTTS_TASK_RCUP ((hio_svc_htts_task_t*)txt);
 
 	txt->options = options;
@@ -358,7 +359,7 @@ int hio_svc_htts_dotxt (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* r
 	bind_task_to_client (txt, csck);
 	bound_to_client = 1;
 
-	if (hio_svc_htts_task_handleexpect100((hio_svc_htts_task_t*)txt, 1) <= -1) goto oops;
+	if (hio_svc_htts_task_handleexpect100((hio_svc_htts_task_t*)txt, HIO_SVC_HTTS_TASK_EXPECT100_NO_CONTINUE) <= -1) goto oops;
 	if (setup_for_content_length(txt, req) <= -1) goto oops;
 
 	/* TODO: store current input watching state and use it when destroying the txt data */
@@ -208,16 +208,154 @@ hio_http_method_t hio_bchars_to_http_method (const hio_bch_t* nameptr, hio_oow_t
 	return HIO_HTTP_OTHER;
 }
 
-int hio_parse_http_range_bcstr (const hio_bch_t* str, hio_http_range_t* range)
+static const hio_bch_t* hdr_names[] =
 {
-	/* NOTE: this function does not support a range set
-	 *       like bytes=1-20,30-50 */
+	/* keep this table in the same order as hio_http_hdr_t enumerators */
+	"OTHER",
+
+	"Accept",
+	"Accept-Charset",
+	"Accept-Encoding",
+	"Accept-Language",
+	"Accept-Ranges",
+	"Access-Control-Allow-Credentials",
+	"Access-Control-Allow-Headers",
+	"Access-Control-Allow-Methods",
+	"Access-Control-Allow-Origin",
+	"Access-Control-Expose-Headers",
+	"Access-Control-Max-Age",
+	"Access-Control-Request-Headers",
+	"Access-Control-Request-Method",
+	"Age",
+	"Allow",
+	"Authorization",
+	"Cache-Control",
+	"Connection",
+	"Content-Disposition",
+	"Content-Encoding",
+	"Content-Language",
+	"Content-Length",
+	"Content-Location",
+	"Content-Range",
+	"Content-Security-Policy",
+	"Content-Type",
+	"Cookie",
+	"Date",
+	"ETag",
+	"Expect",
+	"Expires",
+	"Forwarded",
+	"From",
+	"Host",
+	"If-Match",
+	"If-Modified-Since",
+	"If-None-Match",
+	"If-Range",
+	"If-Unmodified-Since",
+	"Keep-Alive",
+	"Last-Modified",
+	"Link",
+	"Location",
+	"Max-Forwards",
+	"Origin",
+	"Pragma",
+	"Proxy-Authenticate",
+	"Proxy-Authorization",
+	"Proxy-Connection",
+	"Range",
+	"Referer",
+	"Retry-After",
+	"Server",
+	"Set-Cookie",
+	"Status",
+	"Strict-Transport-Security",
+	"TE",
+	"Trailer",
+	"Transfer-Encoding",
+	"Upgrade",
+	"User-Agent",
+	"Vary",
+	"Via",
+	"WWW-Authenticate",
+	"X-Forwarded-For",
+	"X-Forwarded-Host",
+	"X-Forwarded-Proto",
+	"X-HTTP-Method-Override",
+	"X-Real-IP",
+	"X-Requested-With",
+};
+
+const hio_bch_t* hio_http_hdr_to_bcstr (hio_http_hdr_t id)
+{
+	return (id < 0 || id >= HIO_COUNTOF(hdr_names))? HIO_NULL: hdr_names[id];
+}
+
+/* the association values and the slot table below form a perfect hash
+ * of the names in hdr_names. the values were found by a search so that
+ * the sum over a few folded characters and the length gives a distinct
+ * slot to every name. search them again when a name is added. */
+#define HDR_NAME_LEN_MIN 2
+#define HDR_NAME_LEN_MAX 32
+#define HDR_SLOT_MASK 127
+
+static HIO_INLINE hio_oow_t hash_hdr_name (const hio_bch_t* ptr, hio_oow_t len)
+{
+	static hio_uint8_t asso[256] =
+	{
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  11,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,  16,   0,  65, 110, 126, 124, 120,  47,  53,   0,   4, 124,  37, 106,   7,
+		101,   0, 114,  43,  59,  46,  49, 104,   8,  83,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+	};
+	hio_oow_t h;
+
+	/* ORing 0x20 folds the case of letters */
+	#define ASSO(c) (asso[(hio_uint8_t)((c) | 0x20)])
+	h = len + ASSO(ptr[0]) + ASSO(ptr[len - 1]) + ASSO(ptr[len / 2]);
+	if (len >= 3) h += ASSO(ptr[2]) + ASSO(ptr[len - 3]);
+	#undef ASSO
+	return h & HDR_SLOT_MASK;
+}
 
+hio_http_hdr_t hio_bchars_to_http_hdr (const hio_bch_t* nameptr, hio_oow_t namelen)
+{
+	static hio_uint8_t slots[HDR_SLOT_MASK + 1] =
+	{
+		 0,  0,  0, 69,  0, 49,  2, 68,  0,  0, 12,  3,  5, 42,  1,  0,
+		 0, 67, 19,  0, 59, 18, 13, 14,  0,  0,  0,  0, 45,  0,  0, 43,
+		30,  7, 10, 56,  0, 33,  0,  0,  6, 70,  8,  0, 16, 60,  0,  0,
+		 0,  0,  0, 50,  0, 37,  0, 39,  0, 57, 63, 47, 31,  0, 17,  0,
+		38,  0, 35, 26, 66, 21,  0,  0, 44,  0,  9, 34,  0, 48,  0, 40,
+		 0,  0,  0,  0, 27, 29, 23, 51,  0,  0,  0, 24,  0,  0, 41,  0,
+		 0,  0, 55, 32,  0,  0, 20, 11,  0,  0,  4, 22, 64,  0, 36,  0,
+		52, 15,  0, 65,  0, 58, 28, 53, 25, 54,  0, 46, 62,  0,  0, 61,
+	};
+	hio_http_hdr_t id;
+
+	if (namelen < HDR_NAME_LEN_MIN || namelen > HDR_NAME_LEN_MAX) return HIO_HTTP_HDR_OTHER;
+
+	id = (hio_http_hdr_t)slots[hash_hdr_name(nameptr, namelen)];
+	return (id != HIO_HTTP_HDR_OTHER && hio_comp_bchars_bcstr(nameptr, namelen, hdr_names[id], 1) == 0)? id: HIO_HTTP_HDR_OTHER;
+}
+
+static const hio_bch_t* parse_http_range_spec (const hio_bch_t* str, hio_http_range_t* range)
+{
 	hio_foff_t from, to;
 	int type = HIO_HTTP_RANGE_PROPER;
 
-	if (str[0] != 'b' || str[1] != 'y' || str[2] != 't' || str[3] != 'e' || str[4] != 's' || str[5] != '=') return -1;
-	str += 6;
+	while (hio_is_bch_space(*str)) str++;
 
 	from = to = 0;
 	if (hio_is_bch_digit(*str))
@@ -231,7 +369,7 @@ int hio_parse_http_range_bcstr (const hio_bch_t* str, hio_http_range_t* range)
 	}
 	else type = HIO_HTTP_RANGE_SUFFIX;
 
-	if (*str != '-') return -1;
+	if (*str != '-') return HIO_NULL;
 	str++;
 
 	if (hio_is_bch_digit(*str))
@@ -244,19 +382,59 @@ int hio_parse_http_range_bcstr (const hio_bch_t* str, hio_http_range_t* range)
 		}
 		while (hio_is_bch_digit(*str));
 
-		if (from > to) return -1;
+		if (from > to) return HIO_NULL;
+	}
+	else
+	{
+		if (type == HIO_HTTP_RANGE_SUFFIX) return HIO_NULL; /* - alone */
+		type = HIO_HTTP_RANGE_PREFIX;
 	}
-	else type = HIO_HTTP_RANGE_PREFIX;
 
 	while (hio_is_bch_space(*str)) str++;
-	if (*str != '\0') return -1;
 
 	range->type = type;
 	range->from = from;
 	range->to = to;
+	return str;
+}
+
+int hio_parse_http_range_bcstr (const hio_bch_t* str, hio_http_range_t* range)
+{
+	/* NOTE: this function does not support a range set
+	 *       like bytes=1-20,30-50. use hio_parse_http_ranges_bcstr() for it */
+
+	if (str[0] != 'b' || str[1] != 'y' || str[2] != 't' || str[3] != 'e' || str[4] != 's' || str[5] != '=') return -1;
+
+	str = parse_http_range_spec(str + 6, range);
+	if (!str || *str != '\0') return -1;
 	return 0;
 }
 
+int hio_parse_http_ranges_bcstr (const hio_bch_t* str, hio_http_range_t* ranges, hio_oow_t capa)
+{
+	hio_oow_t count = 0;
+
+	if (str[0] != 'b' || str[1] != 'y' || str[2] != 't' || str[3] != 'e' || str[4] != 's' || str[5] != '=') return -1;
+	str += 6;
+
+	while (1)
+	{
+		hio_http_range_t range;
+
+		str = parse_http_range_spec(str, &range);
+		if (!str) return -1;
+
+		if (count < capa) ranges[count] = range;
+		count++;
+
+		if (*str == '\0') break;
+		if (*str != ',') return -1;
+		str++;
+	}
+
+	return (int)count;
+}
+
 typedef struct mname_t mname_t;
 struct mname_t
 {
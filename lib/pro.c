@@ -23,6 +23,7 @@
  */
 
 #include <hio-pro.h>
+#include <hio-ecs.h>
 #include "hio-prv.h"
 
 #include <unistd.h>
@@ -31,6 +32,19 @@
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/socket.h>
+
+/* posix_spawn() is used only if the file actions can close the inherited
+ * descriptors as hio_closesyshndsfrom() does in the forked child */
+#if defined(HAVE_POSIX_SPAWN) && defined(HAVE_SPAWN_H) && defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP)
+#	include <spawn.h>
+#	define USE_POSIX_SPAWN
+extern char** environ;
+#endif
+
+#if !defined(HIO_LIBEXECDIR)
+#	define HIO_LIBEXECDIR "/usr/local/libexec"
+#endif
 
 /* ========================================================================= */
 
@@ -136,9 +150,86 @@ oops:
 	return -1;
 }
 
-static pid_t standard_fork_and_exec (hio_dev_pro_t* dev, int pfds[], hio_dev_pro_make_t* mi, param_t* param)
+static int setup_child_io (int flags, hio_syshnd_t pfds[], hio_syshnd_t* devnull)
+{
+	/* this function is called in the child process after fork() */
+
+	if (flags & HIO_DEV_PRO_WRITEIN)
+	{
+		/* slave should read */
+		close (pfds[1]);
+		pfds[1] = HIO_SYSHND_INVALID;
+
+		/* let the pipe be standard input */
+		if (dup2(pfds[0], 0) <= -1) return -1;
+
+		close (pfds[0]);
+		pfds[0] = HIO_SYSHND_INVALID;
+	}
+
+	if (flags & HIO_DEV_PRO_READOUT)
+	{
+		/* slave should write */
+		close (pfds[2]);
+		pfds[2] = HIO_SYSHND_INVALID;
+
+		if (dup2(pfds[3], 1) == -1) return -1;
+
+		if (flags & HIO_DEV_PRO_ERRTOOUT)
+		{
+			if (dup2(pfds[3], 2) == -1) return -1;
+		}
+
+		close (pfds[3]);
+		pfds[3] = HIO_SYSHND_INVALID;
+	}
+
+	if (flags & HIO_DEV_PRO_READERR)
+	{
+		close (pfds[4]);
+		pfds[4] = HIO_SYSHND_INVALID;
+
+		if (dup2(pfds[5], 2) == -1) return -1;
+
+		if (flags & HIO_DEV_PRO_OUTTOERR)
+		{
+			if (dup2(pfds[5], 1) == -1) return -1;
+		}
+
+		close (pfds[5]);
+		pfds[5] = HIO_SYSHND_INVALID;
+	}
+
+	if ((flags & HIO_DEV_PRO_INTONUL) ||
+	    (flags & HIO_DEV_PRO_OUTTONUL) ||
+	    (flags & HIO_DEV_PRO_ERRTONUL))
+	{
+	#if defined(O_LARGEFILE)
+		*devnull = open("/dev/null", O_RDWR | O_LARGEFILE, 0);
+	#else
+		*devnull = open("/dev/null", O_RDWR, 0);
+	#endif
+		if (*devnull == HIO_SYSHND_INVALID) return -1;
+
+		if ((flags & HIO_DEV_PRO_INTONUL) && dup2(*devnull, 0) == -1) return -1;
+		if ((flags & HIO_DEV_PRO_OUTTONUL) && dup2(*devnull, 1) == -1) return -1;
+		if ((flags & HIO_DEV_PRO_ERRTONUL) && dup2(*devnull, 2) == -1) return -1;
+
+		close (*devnull);
+		*devnull = HIO_SYSHND_INVALID;
+	}
+
+	if (flags & HIO_DEV_PRO_DROPIN) close (0);
+	if (flags & HIO_DEV_PRO_DROPOUT) close (1);
+	if (flags & HIO_DEV_PRO_DROPERR) close (2);
+
+	return 0;
+}
+
+/* if ctlfd is valid, the child gets it as descriptor 3. it is used to start
+ * a standby helper of a pool. dev may be HIO_NULL if mi->on_fork is not set */
+static pid_t standard_fork_and_exec (hio_t* hio, hio_dev_pro_t* dev, int pfds[], hio_dev_pro_make_t* mi, param_t* param, hio_syshnd_t ctlfd)
 {
-	hio_t* hio = dev->hio;
 	pid_t pid;
 
 	pid = fork();
@@ -154,92 +245,433 @@ static pid_t standard_fork_and_exec (hio_dev_pro_t* dev, int pfds[], hio_dev_pro
 
 		hio_syshnd_t devnull = HIO_SYSHND_INVALID;
 
-/* TODO: close all uneeded fds */
 		if (mi->on_fork) mi->on_fork (dev, mi->fork_ctx);
 
-		if (mi->flags & HIO_DEV_PRO_WRITEIN)
+		if (setup_child_io(mi->flags, pfds, &devnull) <= -1) goto slave_oops;
+		if (ctlfd != HIO_SYSHND_INVALID)
+		{
+			/* ctlfd is above 3. dup2() clears close-on-exec of the copy */
+			if (dup2(ctlfd, 3) == -1) goto slave_oops;
+			hio_closesyshndsfrom (4);
+		}
+		else
 		{
-			/* slave should read */
-			close (pfds[1]);
-			pfds[1] = HIO_SYSHND_INVALID;
+			hio_closesyshndsfrom (3);
+		}
 
-			/* let the pipe be standard input */
-			if (dup2(pfds[0], 0) <= -1) goto slave_oops;
+		if (mi->env) execve (param->argv[0], param->argv, mi->env);
+		else execv (param->argv[0], param->argv);
 
-			close (pfds[0]);
-			pfds[0] = HIO_SYSHND_INVALID;
+		/* if exec fails, free 'param' parameter which is an inherited pointer */
+		free_param (hio, param);
+
+	slave_oops:
+		if (devnull != HIO_SYSHND_INVALID) close(devnull);
+		_exit (128);
+	}
+
+	/* parent process */
+	return pid;
+}
+
+#if defined(USE_POSIX_SPAWN)
+static pid_t posix_spawn_and_exec (hio_t* hio, hio_dev_pro_t* dev, int pfds[], hio_dev_pro_make_t* mi, param_t* param, hio_syshnd_t ctlfd)
+{
+	/* posix_spawn() doesn't copy the page tables of the parent process.
+	 * the file actions below do the same as setup_child_io() */
+	posix_spawn_file_actions_t fa;
+	int flags = mi->flags;
+	pid_t pid;
+	int x;
+
+	x = posix_spawn_file_actions_init(&fa);
+	if (x != 0)
+	{
+		hio_seterrwithsyserr (hio, 0, x);
+		return -1;
+	}
+
+	if (flags & HIO_DEV_PRO_WRITEIN)
+	{
+		if ((x = posix_spawn_file_actions_addclose(&fa, pfds[1])) != 0 ||
+		    (x = posix_spawn_file_actions_adddup2(&fa, pfds[0], 0)) != 0 ||
+		    (x = posix_spawn_file_actions_addclose(&fa, pfds[0])) != 0) goto oops;
+	}
+
+	if (flags & HIO_DEV_PRO_READOUT)
+	{
+		if ((x = posix_spawn_file_actions_addclose(&fa, pfds[2])) != 0 ||
+		    (x = posix_spawn_file_actions_adddup2(&fa, pfds[3], 1)) != 0 ||
+		    ((flags & HIO_DEV_PRO_ERRTOOUT) && (x = posix_spawn_file_actions_adddup2(&fa, pfds[3], 2)) != 0) ||
+		    (x = posix_spawn_file_actions_addclose(&fa, pfds[3])) != 0) goto oops;
+	}
+
+	if (flags & HIO_DEV_PRO_READERR)
+	{
+		if ((x = posix_spawn_file_actions_addclose(&fa, pfds[4])) != 0 ||
+		    (x = posix_spawn_file_actions_adddup2(&fa, pfds[5], 2)) != 0 ||
+		    ((flags & HIO_DEV_PRO_OUTTOERR) && (x = posix_spawn_file_actions_adddup2(&fa, pfds[5], 1)) != 0) ||
+		    (x = posix_spawn_file_actions_addclose(&fa, pfds[5])) != 0) goto oops;
+	}
+
+	if (((flags & HIO_DEV_PRO_INTONUL) && (x = posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDWR, 0)) != 0) ||
+	    ((flags & HIO_DEV_PRO_OUTTONUL) && (x = posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_RDWR, 0)) != 0) ||
+	    ((flags & HIO_DEV_PRO_ERRTONUL) && (x = posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_RDWR, 0)) != 0)) goto oops;
+
+	if (((flags & HIO_DEV_PRO_DROPIN) && (x = posix_spawn_file_actions_addclose(&fa, 0)) != 0) ||
+	    ((flags & HIO_DEV_PRO_DROPOUT) && (x = posix_spawn_file_actions_addclose(&fa, 1)) != 0) ||
+	    ((flags & HIO_DEV_PRO_DROPERR) && (x = posix_spawn_file_actions_addclose(&fa, 2)) != 0)) goto oops;
+
+	if (ctlfd != HIO_SYSHND_INVALID)
+	{
+		if ((x = posix_spawn_file_actions_adddup2(&fa, ctlfd, 3)) != 0 ||
+		    (x = posix_spawn_file_actions_addclosefrom_np(&fa, 4)) != 0) goto oops;
+	}
+	else if ((x = posix_spawn_file_actions_addclosefrom_np(&fa, 3)) != 0) goto oops;
+
+	x = posix_spawn(&pid, param->argv[0], &fa, HIO_NULL, param->argv, (mi->env? mi->env: environ));
+	posix_spawn_file_actions_destroy (&fa);
+
+	/* a command that can't be executed must produce a child exiting with 128
+	 * as it does with fork(). posix_spawn() reports the failure instead.
+	 * a standby helper that can't be executed is an error of the pool */
+	if (x != 0)
+	{
+		if (ctlfd == HIO_SYSHND_INVALID) return standard_fork_and_exec(hio, dev, pfds, mi, param, ctlfd);
+		hio_seterrwithsyserr (hio, 0, x);
+		return -1;
+	}
+	return pid;
+
+oops:
+	hio_seterrwithsyserr (hio, 0, x);
+	posix_spawn_file_actions_destroy (&fa);
+	return -1;
+}
+#endif
+
+/* ========================================================================= */
+
+static pid_t spawn_child (hio_t* hio, hio_dev_pro_t* dev, int pfds[], hio_dev_pro_make_t* mi, param_t* param, hio_syshnd_t ctlfd)
+{
+#if defined(USE_POSIX_SPAWN)
+	/* on_fork() needs a forked child. fall back to fork() if it's set */
+	if (!mi->on_fork) return posix_spawn_and_exec(hio, dev, pfds, mi, param, ctlfd);
+#endif
+	return standard_fork_and_exec(hio, dev, pfds, mi, param, ctlfd);
+}
+
+/* ========================================================================= */
+
+/* the io flags that a standby helper must have been started with
+ * to run a command requested with hio_dev_pro_make() */
+#define POOL_IO_FLAGS \
+	(HIO_DEV_PRO_WRITEIN | HIO_DEV_PRO_READOUT | HIO_DEV_PRO_READERR | \
+	 HIO_DEV_PRO_ERRTOOUT | HIO_DEV_PRO_OUTTOERR | \
+	 HIO_DEV_PRO_INTONUL | HIO_DEV_PRO_OUTTONUL | HIO_DEV_PRO_ERRTONUL | \
+	 HIO_DEV_PRO_DROPIN | HIO_DEV_PRO_DROPOUT | HIO_DEV_PRO_DROPERR)
+
+struct pro_standby_t
+{
+	pid_t pid;
+	hio_syshnd_t ctlfd; /* the command to run is sent here */
+	hio_syshnd_t pfd[3]; /* parent side of the pipes: input, output, error */
+};
+typedef struct pro_standby_t pro_standby_t;
+
+struct hio_dev_pro_pool_t
+{
+	hio_t* hio;
+	int flags;
+	hio_bch_t* helper;
+	hio_oow_t max_standby;
+	hio_oow_t nstandby;
+	pro_standby_t* standby;
+	hio_tmridx_t refill_tmridx;
+	hio_oow_t nhits;
+	hio_oow_t nmisses;
+};
+
+static void close_standby (pro_standby_t* sb)
+{
+	int i;
+
+	if (sb->ctlfd != HIO_SYSHND_INVALID) close (sb->ctlfd);
+	for (i = 0; i < HIO_COUNTOF(sb->pfd); i++)
+	{
+		if (sb->pfd[i] != HIO_SYSHND_INVALID) close (sb->pfd[i]);
+	}
+
+	/* the helper is blocked reading the control socket. it is not running anything useful */
+	kill (sb->pid, SIGKILL);
+	while (waitpid(sb->pid, HIO_NULL, 0) == -1 && errno == EINTR) /* nothing */;
+}
+
+static int send_all_to_fd (hio_syshnd_t fd, const void* buf, hio_oow_t len)
+{
+	const hio_uint8_t* ptr = (const hio_uint8_t*)buf;
+	int flags = 0;
+
+#if defined(MSG_NOSIGNAL)
+	/* a dead helper must not raise SIGPIPE */
+	flags |= MSG_NOSIGNAL;
+#endif
+
+	while (len > 0)
+	{
+		ssize_t n = send(fd, ptr, len, flags);
+		if (n <= -1)
+		{
+			if (errno == EINTR) continue;
+			return -1;
 		}
+		ptr += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int spawn_standby (hio_dev_pro_pool_t* pool)
+{
+	/* the helper is a separate program started the same way as a command.
+	 * nothing runs in a copy of this process except what the normal
+	 * process device does before exec() */
+	hio_t* hio = pool->hio;
+	hio_syshnd_t pfds[6] = { HIO_SYSHND_INVALID, HIO_SYSHND_INVALID, HIO_SYSHND_INVALID, HIO_SYSHND_INVALID, HIO_SYSHND_INVALID, HIO_SYSHND_INVALID };
+	hio_syshnd_t cfds[2] = { HIO_SYSHND_INVALID, HIO_SYSHND_INVALID };
+	hio_dev_pro_make_t mi;
+	param_t param;
+	pro_standby_t* sb;
+	pid_t pid;
+	int i;
+
+	if (((pool->flags & HIO_DEV_PRO_WRITEIN) && pipe(&pfds[0]) == -1) ||
+	    ((pool->flags & HIO_DEV_PRO_READOUT) && pipe(&pfds[2]) == -1) ||
+	    ((pool->flags & HIO_DEV_PRO_READERR) && pipe(&pfds[4]) == -1) ||
+	    socketpair(AF_UNIX, SOCK_STREAM, 0, cfds) == -1)
+	{
+		hio_seterrwithsyserr (hio, 0, errno);
+		goto oops;
+	}
 
-		if (mi->flags & HIO_DEV_PRO_READOUT)
+	if (cfds[0] <= 3)
+	{
+		/* the helper gets its end as descriptor 3. move it out of the way */
+		hio_syshnd_t tmp = fcntl(cfds[0], F_DUPFD, 4);
+		if (tmp == HIO_SYSHND_INVALID)
 		{
-			/* slave should write */
-			close (pfds[2]);
-			pfds[2] = HIO_SYSHND_INVALID;
+			hio_seterrwithsyserr (hio, 0, errno);
+			goto oops;
+		}
+		close (cfds[0]);
+		cfds[0] = tmp;
+	}
 
-			if (dup2(pfds[3], 1) == -1) goto slave_oops;
+	/* the helper inherits the environment and takes no arguments.
+	 * the command and its environment come over the control socket */
+	HIO_MEMSET (&mi, 0, HIO_SIZEOF(mi));
+	mi.flags = pool->flags;
+	HIO_MEMSET (&param, 0, HIO_SIZEOF(param));
+	param.argv = param.fixed_argv;
+	param.argv[0] = pool->helper;
+	param.argv[1] = HIO_NULL;
 
-			if (mi->flags & HIO_DEV_PRO_ERRTOOUT)
-			{
-				if (dup2(pfds[3], 2) == -1) goto slave_oops;
-			}
+	pid = spawn_child(hio, HIO_NULL, pfds, &mi, &param, cfds[0]);
+	if (pid <= -1) goto oops;
 
-			close (pfds[3]);
-			pfds[3] = HIO_SYSHND_INVALID;
+	/* close the child side. 0 is the reading end of the input pipe.
+	 * 3 and 5 are the writing ends of the output pipes */
+	close (cfds[0]);
+	cfds[0] = HIO_SYSHND_INVALID;
+	for (i = 0; i < 6; i++)
+	{
+		if ((i == 0 || i == 3 || i == 5) && pfds[i] != HIO_SYSHND_INVALID)
+		{
+			close (pfds[i]);
+			pfds[i] = HIO_SYSHND_INVALID;
 		}
+	}
 
-		if (mi->flags & HIO_DEV_PRO_READERR)
+	sb = &pool->standby[pool->nstandby++];
+	sb->pid = pid;
+	sb->ctlfd = cfds[1];
+	sb->pfd[HIO_DEV_PRO_IN] = pfds[1];
+	sb->pfd[HIO_DEV_PRO_OUT] = pfds[2];
+	sb->pfd[HIO_DEV_PRO_ERR] = pfds[4];
+
+	/* don't let the processes started later inherit these */
+	hio_makesyshndcloexec (hio, sb->ctlfd);
+	for (i = 0; i < HIO_COUNTOF(sb->pfd); i++)
+	{
+		if (sb->pfd[i] != HIO_SYSHND_INVALID) hio_makesyshndcloexec (hio, sb->pfd[i]);
+	}
+
+	return 0;
+
+oops:
+	for (i = 0; i < 6; i++)
+	{
+		if (pfds[i] != HIO_SYSHND_INVALID) close (pfds[i]);
+	}
+	if (cfds[0] != HIO_SYSHND_INVALID) close (cfds[0]);
+	if (cfds[1] != HIO_SYSHND_INVALID) close (cfds[1]);
+	return -1;
+}
+
+static void refill_pool (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	hio_dev_pro_pool_t* pool = (hio_dev_pro_pool_t*)job->ctx;
+
+	while (pool->nstandby < pool->max_standby)
+	{
+		if (spawn_standby(pool) <= -1)
 		{
-			close (pfds[4]);
-			pfds[4] = HIO_SYSHND_INVALID;
+			HIO_DEBUG1 (hio, "PRO - unable to start a standby helper - %js\n", hio_geterrmsg(hio));
+			break;
+		}
+	}
+}
 
-			if (dup2(pfds[5], 2) == -1) goto slave_oops;
+static void schedule_refill (hio_dev_pro_pool_t* pool)
+{
+	if (pool->refill_tmridx == HIO_TMRIDX_INVALID && pool->nstandby < pool->max_standby)
+	{
+		/* refill outside the current request */
+		hio_ntime_t t;
+		HIO_INIT_NTIME (&t, 0, 0);
+		hio_schedtmrjobafter (pool->hio, &t, refill_pool, &pool->refill_tmridx, pool);
+	}
+}
 
-			if (mi->flags & HIO_DEV_PRO_OUTTOERR)
-			{
-				if (dup2(pfds[5], 1) == -1) goto slave_oops;
-			}
+/* a command is sent to a standby helper as follows:
+ *   length(4, BE), env-mode('E' or 'I'), argv strings, '\0', env strings, '\0'
+ * each string is terminated by '\0'. 'I' tells the helper to keep the inherited
+ * environment and no env strings follow. see bin/standby.c */
+static pid_t take_standby (hio_dev_pro_pool_t* pool, hio_dev_pro_make_t* mi, param_t* param, hio_syshnd_t pfds[])
+{
+	hio_t* hio = pool->hio;
+	hio_becs_t msg;
+	hio_oow_t i, len;
 
-			close (pfds[5]);
-			pfds[5] = HIO_SYSHND_INVALID;
+	/* the helper can't run on_fork() as it is not a copy of this process */
+	if ((mi->flags & POOL_IO_FLAGS) != pool->flags || mi->on_fork) goto miss;
+
+	if (hio_becs_init(&msg, hio, 256) <= -1) return -1;
+
+	if (hio_becs_ncat(&msg, "\0\0\0\0", 4) == (hio_oow_t)-1 ||
+	    hio_becs_ccat(&msg, (mi->env? 'E': 'I')) == (hio_oow_t)-1) goto oops;
+	for (i = 0; param->argv[i]; i++)
+	{
+		if (hio_becs_ncat(&msg, param->argv[i], hio_count_bcstr(param->argv[i]) + 1) == (hio_oow_t)-1) goto oops;
+	}
+	if (hio_becs_ccat(&msg, '\0') == (hio_oow_t)-1) goto oops;
+	if (mi->env)
+	{
+		for (i = 0; mi->env[i]; i++)
+		{
+			if (hio_becs_ncat(&msg, mi->env[i], hio_count_bcstr(mi->env[i]) + 1) == (hio_oow_t)-1) goto oops;
 		}
+	}
+	if (hio_becs_ccat(&msg, '\0') == (hio_oow_t)-1) goto oops;
+
+	len = HIO_BECS_LEN(&msg) - 4;
+	HIO_BECS_PTR(&msg)[0] = (len >> 24) & 0xFF;
+	HIO_BECS_PTR(&msg)[1] = (len >> 16) & 0xFF;
+	HIO_BECS_PTR(&msg)[2] = (len >> 8) & 0xFF;
+	HIO_BECS_PTR(&msg)[3] = len & 0xFF;
+
+	while (pool->nstandby > 0)
+	{
+		pro_standby_t sb = pool->standby[--pool->nstandby];
 
-		if ((mi->flags & HIO_DEV_PRO_INTONUL) ||
-		    (mi->flags & HIO_DEV_PRO_OUTTONUL) ||
-		    (mi->flags & HIO_DEV_PRO_ERRTONUL))
+		if (send_all_to_fd(sb.ctlfd, HIO_BECS_PTR(&msg), HIO_BECS_LEN(&msg)) <= -1)
 		{
-		#if defined(O_LARGEFILE)
-			devnull = open("/dev/null", O_RDWR | O_LARGEFILE, 0);
-		#else
-			devnull = open("/dev/null", O_RDWR, 0);
-		#endif
-			if (devnull == HIO_SYSHND_INVALID) goto slave_oops;
-
-			if ((mi->flags & HIO_DEV_PRO_INTONUL) && dup2(devnull, 0) == -1) goto slave_oops;
-			if ((mi->flags & HIO_DEV_PRO_OUTTONUL) && dup2(devnull, 1) == -1) goto slave_oops;
-			if ((mi->flags & HIO_DEV_PRO_ERRTONUL) && dup2(devnull, 2) == -1) goto slave_oops;
-
-			close (devnull);
-			devnull = HIO_SYSHND_INVALID;
+			/* the helper must have died. try another */
+			close_standby (&sb);
+			continue;
 		}
 
-		if (mi->flags & HIO_DEV_PRO_DROPIN) close (0);
-		if (mi->flags & HIO_DEV_PRO_DROPOUT) close (1);
-		if (mi->flags & HIO_DEV_PRO_DROPERR) close (2);
+		/* the helper runs the command once it sees the end of the message */
+		close (sb.ctlfd);
+		hio_becs_fini (&msg);
 
-		execv (param->argv[0], param->argv);
+		pfds[1] = sb.pfd[HIO_DEV_PRO_IN];
+		pfds[2] = sb.pfd[HIO_DEV_PRO_OUT];
+		pfds[4] = sb.pfd[HIO_DEV_PRO_ERR];
 
-		/* if exec fails, free 'param' parameter which is an inherited pointer */
-		free_param (hio, param);
+		pool->nhits++;
+		schedule_refill (pool);
+		return sb.pid;
+	}
 
-	slave_oops:
-		if (devnull != HIO_SYSHND_INVALID) close(devnull);
-		_exit (128);
+oops:
+	hio_becs_fini (&msg);
+miss:
+	pool->nmisses++;
+	schedule_refill (pool);
+	return -1;
+}
+
+hio_dev_pro_pool_t* hio_dev_pro_openpool (hio_t* hio, const hio_bch_t* helper, int flags, hio_oow_t max_standby)
+{
+	hio_dev_pro_pool_t* pool;
+	hio_oow_t len;
+
+	if (max_standby <= 0 || (flags & ~POOL_IO_FLAGS) || !(flags & (HIO_DEV_PRO_WRITEIN | HIO_DEV_PRO_READOUT | HIO_DEV_PRO_READERR)))
+	{
+		hio_seterrnum (hio, HIO_EINVAL);
+		return HIO_NULL;
 	}
 
-	/* parent process */
-	return pid;
+	if (!helper) helper = HIO_LIBEXECDIR "/hio-standby";
+	if (access(helper, X_OK) == -1)
+	{
+		/* fail early rather than starting helpers that exit at once */
+		hio_seterrbfmtwithsyserr (hio, 0, errno, "unable to execute %hs", helper);
+		return HIO_NULL;
+	}
+
+	len = hio_count_bcstr(helper);
+	pool = (hio_dev_pro_pool_t*)hio_callocmem(hio, HIO_SIZEOF(*pool) + HIO_SIZEOF(*pool->standby) * max_standby + len + 1);
+	if (HIO_UNLIKELY(!pool)) return HIO_NULL;
+
+	pool->hio = hio;
+	pool->flags = flags;
+	pool->max_standby = max_standby;
+	pool->standby = (pro_standby_t*)(pool + 1);
+	pool->helper = (hio_bch_t*)(pool->standby + max_standby);
+	HIO_MEMCPY (pool->helper, helper, len + 1);
+	pool->refill_tmridx = HIO_TMRIDX_INVALID;
+
+	/* the helpers are started on the next loop iteration */
+	schedule_refill (pool);
+	return pool;
+}
+
+void hio_dev_pro_closepool (hio_dev_pro_pool_t* pool)
+{
+	hio_t* hio = pool->hio;
+
+	if (pool->refill_tmridx != HIO_TMRIDX_INVALID)
+	{
+		hio_deltmrjob (hio, pool->refill_tmridx);
+		pool->refill_tmridx = HIO_TMRIDX_INVALID;
+	}
+
+	while (pool->nstandby > 0) close_standby (&pool->standby[--pool->nstandby]);
+	hio_freemem (hio, pool);
+}
+
+void hio_dev_pro_getpoolstat (hio_dev_pro_pool_t* pool, hio_dev_pro_poolstat_t* stat)
+{
+	stat->nstandby = pool->nstandby;
+	stat->nhits = pool->nhits;
+	stat->nmisses = pool->nmisses;
 }
 
+/* ========================================================================= */
+
 static int dev_pro_make_master (hio_dev_t* dev, void* ctx)
 {
 	hio_t* hio = dev->hio;
@@ -250,6 +682,19 @@ static int dev_pro_make_master (hio_dev_t* dev, void* ctx)
 	param_t param;
 	pid_t pid;
 
+	if (info->pool)
+	{
+		/* run the command on a standby helper if available */
+		if (make_param(hio, info->cmd, info->flags, &param) <= -1) goto oops;
+		pid = take_standby(info->pool, info, &param, pfds);
+		free_param (hio, &param);
+		if (pid >= 0)
+		{
+			minidx = 0; maxidx = 5;
+			goto spawned;
+		}
+	}
+
 	if (info->flags & HIO_DEV_PRO_WRITEIN)
 	{
 		if (pipe(&pfds[0]) == -1)
@@ -289,11 +734,11 @@ static int dev_pro_make_master (hio_dev_t* dev, void* ctx)
 	}
 
 	if (make_param(hio, info->cmd, info->flags, &param) <= -1) goto oops;
-/* TODO: more advanced fork and exec .. */
-	pid = standard_fork_and_exec(rdev, pfds, info, &param);
+	pid = spawn_child(hio, rdev, pfds, info, &param, HIO_SYSHND_INVALID);
 	free_param (hio, &param);
 	if (pid <= -1) goto oops;
 
+spawned:
 	rdev->child_pid = pid;
 
 	/* this is the parent process */
@@ -305,8 +750,11 @@ static int dev_pro_make_master (hio_dev_t* dev, void* ctx)
 		 * X
 		 * WRITE => 1
 		 */
-		close (pfds[0]);
-		pfds[0] = HIO_SYSHND_INVALID;
+		if (pfds[0] != HIO_SYSHND_INVALID)
+		{
+			close (pfds[0]);
+			pfds[0] = HIO_SYSHND_INVALID;
+		}
 
 		if (hio_makesyshndasync(hio, pfds[1]) <= -1) goto oops;
 	}
@@ -319,8 +767,11 @@ static int dev_pro_make_master (hio_dev_t* dev, void* ctx)
 		 *    X
 		 * READ => 2
 		 */
-		close (pfds[3]);
-		pfds[3] = HIO_SYSHND_INVALID;
+		if (pfds[3] != HIO_SYSHND_INVALID)
+		{
+			close (pfds[3]);
+			pfds[3] = HIO_SYSHND_INVALID;
+		}
 
 		if (hio_makesyshndasync(hio, pfds[2]) <= -1) goto oops;
 	}
@@ -333,8 +784,11 @@ static int dev_pro_make_master (hio_dev_t* dev, void* ctx)
 		 *      X
 		 * READ => 4
 		 */
-		close (pfds[5]);
-		pfds[5] = HIO_SYSHND_INVALID;
+		if (pfds[5] != HIO_SYSHND_INVALID)
+		{
+			close (pfds[5]);
+			pfds[5] = HIO_SYSHND_INVALID;
+		}
 
 		if (hio_makesyshndasync(hio, pfds[4]) <= -1) goto oops;
 	}
@@ -46,6 +46,16 @@
 #	define _PATH_DEV "/dev/"
 #endif
 
+/* opening the slave after setsid() makes it the controlling terminal on linux
+ * while it takes TIOCSCTTY elsewhere, which the file actions can't express.
+ * the file actions must be able to close the inherited descriptors as well */
+#if defined(HAVE_POSIX_SPAWN) && defined(HAVE_SPAWN_H) && defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP) && defined(__linux__)
+#	include <spawn.h>
+#	if defined(POSIX_SPAWN_SETSID)
+#		define USE_POSIX_SPAWN
+#	endif
+#endif
+
 /* ========================================================================= */
 
 struct param_t
@@ -161,7 +171,6 @@ static pid_t standard_fork_and_exec (hio_dev_pty_t* dev, int pfds[], hio_dev_pty
 		close (pfds[0]);  /* close the pty master */
 		pfds[0] = HIO_SYSHND_INVALID;
 
-/*TODO: close all open file descriptors */
 		if (mi->on_fork) mi->on_fork (dev, mi->fork_ctx);
 
 		setsid (); /* TODO: error check? */
@@ -173,6 +182,7 @@ static pid_t standard_fork_and_exec (hio_dev_pty_t* dev, int pfds[], hio_dev_pty
 		close (pfds[1]);
 		pfds[1] = HIO_SYSHND_INVALID;
 
+		hio_closesyshndsfrom (3);
 		execve (param->argv[0], param->argv, param->fixed_env);
 
 		/* if exec fails, free 'param' parameter which is an inherited pointer */
@@ -187,6 +197,63 @@ static pid_t standard_fork_and_exec (hio_dev_pty_t* dev, int pfds[], hio_dev_pty
 	return pid;
 }
 
+#if defined(USE_POSIX_SPAWN)
+static pid_t posix_spawn_and_exec (hio_dev_pty_t* dev, int pfds[], hio_dev_pty_make_t* mi, param_t* param)
+{
+	hio_t* hio = dev->hio;
+	posix_spawn_file_actions_t fa;
+	posix_spawnattr_t sa;
+	char pts_name[128];
+	pid_t pid;
+	int x;
+
+	/* the slave is opened again by name in the new session */
+	x = ttyname_r(pfds[1], pts_name, HIO_COUNTOF(pts_name));
+	if (x != 0)
+	{
+		hio_seterrwithsyserr (hio, 0, x);
+		return -1;
+	}
+
+	x = posix_spawnattr_init(&sa);
+	if (x != 0)
+	{
+		hio_seterrwithsyserr (hio, 0, x);
+		return -1;
+	}
+
+	x = posix_spawn_file_actions_init(&fa);
+	if (x != 0)
+	{
+		hio_seterrwithsyserr (hio, 0, x);
+		posix_spawnattr_destroy (&sa);
+		return -1;
+	}
+
+	/* the pty master and slave are close-on-exec. no need to close them here */
+	if ((x = posix_spawnattr_setflags(&sa, POSIX_SPAWN_SETSID)) != 0 ||
+	    (x = posix_spawn_file_actions_addopen(&fa, 0, pts_name, O_RDWR, 0)) != 0 ||
+	    (x = posix_spawn_file_actions_adddup2(&fa, 0, 1)) != 0 ||
+	    (x = posix_spawn_file_actions_adddup2(&fa, 0, 2)) != 0) goto oops;
+	if ((x = posix_spawn_file_actions_addclosefrom_np(&fa, 3)) != 0) goto oops;
+
+	x = posix_spawn(&pid, param->argv[0], &fa, &sa, param->argv, param->fixed_env);
+	posix_spawn_file_actions_destroy (&fa);
+	posix_spawnattr_destroy (&sa);
+
+	/* a command that can't be executed must produce a child exiting with 128
+	 * as it does with fork(). posix_spawn() reports the failure instead */
+	if (x != 0) return standard_fork_and_exec(dev, pfds, mi, param);
+	return pid;
+
+oops:
+	hio_seterrwithsyserr (hio, 0, x);
+	posix_spawn_file_actions_destroy (&fa);
+	posix_spawnattr_destroy (&sa);
+	return -1;
+}
+#endif
+
 
 static int dev_pty_make (hio_dev_t* dev, void* ctx)
 {
@@ -275,7 +342,12 @@ static int dev_pty_make (hio_dev_t* dev, void* ctx)
 	    hio_makesyshndcloexec(hio, pfds[1]) <= -1) goto oops;
 
 	if (make_param(hio, info->cmd, info->flags, &param) <= -1) goto oops;
+#if defined(USE_POSIX_SPAWN)
+	/* on_fork() needs a forked child. fall back to fork() if it's set */
+	pid = info->on_fork? standard_fork_and_exec(rdev, pfds, info, &param): posix_spawn_and_exec(rdev, pfds, info, &param);
+#else
 	pid = standard_fork_and_exec(rdev, pfds, info, &param);
+#endif
 	free_param (hio, &param);
 	if (pid <= -1) goto oops;
 
@@ -1843,6 +1843,8 @@ static int make_accepted_client_connection (hio_dev_sck_t* rdev, hio_syshnd_t cl
 		return -1;
 	}
 
+	hio->stat.c.accepts++;
+
 	clidev->type = clisck_type;
 	HIO_ASSERT (hio, clidev->hnd == clisck);
 
@@ -2020,7 +2022,15 @@ static int dev_evcb_sck_ready_stream (hio_dev_t* dev, int events)
 	switch (HIO_DEV_SCK_GET_PROGRESS(rdev))
 	{
 		case HIO_DEV_SCK_CONNECTING:
-			if (events & HIO_DEV_EVENT_HUP)
+			if (events & HIO_DEV_EVENT_OUT)
+			{
+				/* when connected, the socket becomes writable. a fast peer may have
+				 * replied to the data written early or even closed its side already.
+				 * SO_ERROR tells if the connection is made. the input and the hang-up
+				 * are handled in the next round */
+				return harvest_outgoing_connection(rdev);
+			}
+			else if (events & HIO_DEV_EVENT_HUP)
 			{
 				/* device hang-up */
 				hio_seterrnum (hio, HIO_EDEVHUP);
@@ -2032,11 +2042,6 @@ static int dev_evcb_sck_ready_stream (hio_dev_t* dev, int events)
 				hio_seterrbfmt (hio, HIO_EDEVERR, "device error - invalid event mask");
 				return -1;
 			}
-			else if (events & HIO_DEV_EVENT_OUT)
-			{
-				/* when connected, the socket becomes writable */
-				return harvest_outgoing_connection(rdev);
-			}
 			else
 			{
 				return 0; /* success but don't invoke on_read() */
@@ -38,6 +38,30 @@ static int secure_poll_map_slot_for_hnd (hio_t* hio, hio_syshnd_t hnd);
 static int secure_poll_data_slot_for_insert (hio_t* hio);
 #endif
 
+/* account the time since the last wake-up as busy and the time
+ * spent in the multiplexer as waiting */
+static HIO_INLINE void begin_mux_wait (hio_t* hio, hio_ntime_t* from)
+{
+	hio_sys_gettime (hio, from);
+	if (HIO_IS_POS_NTIME(&hio->stat.mux_woke))
+	{
+		hio_ntime_t t;
+		HIO_SUB_NTIME (&t, from, &hio->stat.mux_woke);
+		HIO_ADD_NTIME (&hio->stat.c.mux_busy, &hio->stat.c.mux_busy, &t);
+	}
+
+	/* the counters don't change until the wait is over */
+	hio_publishstat (hio);
+}
+
+static HIO_INLINE void end_mux_wait (hio_t* hio, const hio_ntime_t* from)
+{
+	hio_ntime_t t;
+	hio_sys_gettime (hio, &hio->stat.mux_woke);
+	HIO_SUB_NTIME (&t, &hio->stat.mux_woke, from);
+	HIO_ADD_NTIME (&hio->stat.c.mux_wait, &hio->stat.c.mux_wait, &t);
+}
+
 int hio_sys_initmux (hio_t* hio)
 {
 	hio_sys_mux_t* mux = &hio->sysdep->mux;
@@ -775,8 +799,11 @@ int hio_sys_waitmux (hio_t* hio, const hio_ntime_t* tmout, hio_sys_mux_evtcb_t e
 #if defined(USE_POLL)
 	hio_sys_mux_t* mux = &hio->sysdep->mux;
 	int nentries, i;
+	hio_ntime_t wfrom;
 
+	begin_mux_wait (hio, &wfrom);
 	nentries = poll(mux->pd.pfd, mux->pd.size, HIO_SECNSEC_TO_MSEC(tmout->sec, tmout->nsec));
+	end_mux_wait (hio, &wfrom);
 	if (nentries == -1)
 	{
 		if (errno == EINTR) return 0;
@@ -816,6 +843,7 @@ int hio_sys_waitmux (hio_t* hio, const hio_ntime_t* tmout, hio_sys_mux_evtcb_t e
 	hio_sys_mux_t* mux = &hio->sysdep->mux;
 	struct timeval tv;
 	int n;
+	hio_ntime_t wfrom;
 
 	tv.tv_sec = tmout->sec;
 	tv.tv_usec = tmout->nsec / HIO_NSECS_PER_USEC;
@@ -824,7 +852,9 @@ int hio_sys_waitmux (hio_t* hio, const hio_ntime_t* tmout, hio_sys_mux_evtcb_t e
 	mux->tmpwset = mux->wset;
 
 /* TODO: call select with exceptset? */
+	begin_mux_wait (hio, &wfrom);
 	n = select(mux->maxhnd + 1, &mux->tmprset, &mux->tmpwset, NULL, &tv);
+	end_mux_wait (hio, &wfrom);
 	if (n <= -1)
 	{
 		if (errno == EINTR) return 0; /* it's actually ok */
@@ -860,11 +890,14 @@ int hio_sys_waitmux (hio_t* hio, const hio_ntime_t* tmout, hio_sys_mux_evtcb_t e
 	hio_sys_mux_t* mux = &hio->sysdep->mux;
 	struct timespec ts;
 	int nentries, i;
+	hio_ntime_t wfrom;
 
 	ts.tv_sec = tmout->sec;
 	ts.tv_nsec = tmout->nsec;
 
+	begin_mux_wait (hio, &wfrom);
 	nentries = kevent(mux->kq, HIO_NULL, 0, mux->revs, HIO_COUNTOF(mux->revs), &ts);
+	end_mux_wait (hio, &wfrom);
 	if (nentries <= -1)
 	{
 		if (errno == EINTR) return 0; /* it's actually ok */
@@ -906,8 +939,11 @@ int hio_sys_waitmux (hio_t* hio, const hio_ntime_t* tmout, hio_sys_mux_evtcb_t e
 
 	hio_sys_mux_t* mux = &hio->sysdep->mux;
 	int nentries, i;
+	hio_ntime_t wfrom;
 
+	begin_mux_wait (hio, &wfrom);
 	nentries = epoll_wait(mux->hnd, mux->revs, HIO_COUNTOF(mux->revs), HIO_SECNSEC_TO_MSEC(tmout->sec, tmout->nsec));
+	end_mux_wait (hio, &wfrom);
 	if (nentries == -1)
 	{
 		if (errno == EINTR) return 0; /* it's actually ok */
@@ -76,6 +76,7 @@ void hio_sys_fini (hio_t* hio)
 /* TODO: migrate these functions */
 #include <fcntl.h>
 #include <errno.h>
+#include <unistd.h>
 
 int hio_makesyshndasync (hio_t* hio, hio_syshnd_t hnd)
 {
@@ -114,3 +115,19 @@ int hio_makesyshndcloexec (hio_t* hio, hio_syshnd_t hnd)
 	return -1;
 #endif
 }
+
+void hio_closesyshndsfrom (hio_syshnd_t lowhnd)
+{
+	/* this function is called in a child process before exec().
+	 * it must not allocate memory or take a lock */
+	long i, max;
+
+#if defined(HAVE_CLOSE_RANGE)
+	if (close_range(lowhnd, ~0U, 0) == 0) return;
+	/* the kernel may not support it. fall back to the loop */
+#endif
+
+	max = sysconf(_SC_OPEN_MAX);
+	if (max <= 0) max = 1024;
+	for (i = lowhnd; i < max; i++) close (i);
+}
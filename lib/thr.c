@@ -27,12 +27,36 @@
 
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/uio.h>
 #include <pthread.h>
 
 #include <stdio.h>
+
+/* thr_done is set by the thread running the function and read by the hio thread.
+ * the release store orders the resource cleanup before the flag */
+#if defined(HIO_HAVE_BUILTIN_ATOMIC_LOAD_N)
+#	define SET_THR_DONE(ti) __atomic_store_n(&(ti)->thr_done, 1, __ATOMIC_RELEASE)
+#	define GET_THR_DONE(ti) __atomic_load_n(&(ti)->thr_done, __ATOMIC_ACQUIRE)
+#else
+#	define SET_THR_DONE(ti) ((ti)->thr_done = 1)
+#	define GET_THR_DONE(ti) ((ti)->thr_done)
+#endif
+
 /* ========================================================================= */
 
+/* the pipes of a pool job. they go back to the pool when the job is over
+ * and get reused by the next job instead of being created every time */
+typedef struct thr_chan_t thr_chan_t;
+struct thr_chan_t
+{
+	/* [0] read by the function, [1] written by the IN slave,
+	 * [2] read by the OUT slave, [3] written by the function */
+	hio_syshnd_t pfd[4];
+	thr_chan_t* next;
+};
+
 struct hio_dev_thr_info_t
 {
 	HIO_CFMB_HEADER;
@@ -42,6 +66,45 @@ struct hio_dev_thr_info_t
 	void* thr_ctx;
 	pthread_t thr_hnd;
 	int thr_done;
+
+	hio_dev_thr_pool_t* pool; /* not null if the function runs on a pool worker */
+	hio_dev_thr_info_t* q_next; /* next job in the pool queue */
+
+	/* the fields below are used for a pool job only */
+	thr_chan_t* chan;
+	hio_syshnd_t in_null; /* given to the function as rfd if IN ended before the job started */
+	int started; /* protected by pool->mtx */
+	int in_written;
+	int out_marked; /* EOF marker byte written to the OUT pipe */
+	int out_over;
+	int detached; /* the device is gone */
+};
+
+struct hio_dev_thr_pool_t
+{
+	hio_t* hio;
+	pthread_mutex_t mtx;
+	pthread_cond_t cnd;
+
+	hio_oow_t max_workers;
+	hio_oow_t max_queued;
+
+	/* the fields below are protected by mtx */
+	int stop;
+	hio_oow_t nidle; /* number of workers waiting for a job */
+	hio_oow_t nqueued; /* number of jobs not picked up by a worker yet */
+	hio_dev_thr_info_t* q_head;
+	hio_dev_thr_info_t* q_tail;
+
+	/* the worker handles are touched by the hio thread only */
+	pthread_t* workers;
+	hio_oow_t nworkers;
+	hio_oow_t workers_capa;
+
+	/* touched by the hio thread only */
+	hio_syshnd_t nullfd; /* read end of a pipe without the write end. always at EOF */
+	thr_chan_t* free_chans;
+	hio_oow_t nfree_chans;
 };
 
 struct slave_info_t
@@ -58,6 +121,139 @@ static hio_dev_thr_slave_t* make_slave (hio_t* hio, slave_info_t* si);
 
 /* ========================================================================= */
 
+static int open_thr_pipe (hio_t* hio, hio_syshnd_t* p, int hio_side)
+{
+	/* the end on the thread side is left blocking */
+#if defined(HAVE_PIPE2) && defined(O_CLOEXEC)
+	if (pipe2(p, O_CLOEXEC) == -1)
+	{
+		if (errno != ENOSYS || pipe(p) == -1) goto oops;
+		if (hio_makesyshndcloexec(hio, p[0]) <= -1 ||
+		    hio_makesyshndcloexec(hio, p[1]) <= -1) goto oops_close;
+	}
+#else
+	if (pipe(p) == -1) goto oops;
+	if (hio_makesyshndcloexec(hio, p[0]) <= -1 ||
+	    hio_makesyshndcloexec(hio, p[1]) <= -1) goto oops_close;
+#endif
+
+	if (hio_makesyshndasync(hio, p[hio_side]) <= -1) goto oops_close;
+	return 0;
+
+oops:
+	hio_seterrwithsyserr (hio, 0, errno);
+	return -1;
+
+oops_close:
+	close (p[0]);
+	close (p[1]);
+	p[0] = HIO_SYSHND_INVALID;
+	p[1] = HIO_SYSHND_INVALID;
+	return -1;
+}
+
+static int is_pipe_empty (hio_syshnd_t fd)
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return poll(&pfd, 1, 0) == 0;
+}
+
+static void close_thr_chan (thr_chan_t* chan)
+{
+	int i;
+	for (i = 0; i < HIO_COUNTOF(chan->pfd); i++)
+	{
+		if (chan->pfd[i] != HIO_SYSHND_INVALID)
+		{
+			close (chan->pfd[i]);
+			chan->pfd[i] = HIO_SYSHND_INVALID;
+		}
+	}
+}
+
+static thr_chan_t* get_thr_chan (hio_dev_thr_pool_t* pool)
+{
+	hio_t* hio = pool->hio;
+	thr_chan_t* chan;
+
+	if (pool->free_chans)
+	{
+		chan = pool->free_chans;
+		pool->free_chans = chan->next;
+		pool->nfree_chans--;
+	}
+	else
+	{
+		chan = (thr_chan_t*)hio_allocmem(hio, HIO_SIZEOF(*chan));
+		if (HIO_UNLIKELY(!chan)) return HIO_NULL;
+		chan->pfd[0] = HIO_SYSHND_INVALID;
+		chan->pfd[1] = HIO_SYSHND_INVALID;
+		chan->pfd[2] = HIO_SYSHND_INVALID;
+		chan->pfd[3] = HIO_SYSHND_INVALID;
+	}
+	chan->next = HIO_NULL;
+
+	/* a pipe broken by the previous job is put back as invalid. open a new one */
+	if ((chan->pfd[0] == HIO_SYSHND_INVALID && open_thr_pipe(hio, &chan->pfd[0], 1) <= -1) ||
+	    (chan->pfd[2] == HIO_SYSHND_INVALID && open_thr_pipe(hio, &chan->pfd[2], 0) <= -1))
+	{
+		close_thr_chan (chan);
+		hio_freemem (hio, chan);
+		return HIO_NULL;
+	}
+
+	return chan;
+}
+
+static void put_thr_chan (hio_dev_thr_pool_t* pool, thr_chan_t* chan)
+{
+	int i;
+
+	/* a pipe is reusable if both ends are still open and nothing is left in it */
+	for (i = 0; i < HIO_COUNTOF(chan->pfd); i += 2)
+	{
+		if (chan->pfd[i] == HIO_SYSHND_INVALID || chan->pfd[i + 1] == HIO_SYSHND_INVALID || !is_pipe_empty(chan->pfd[i]))
+		{
+			if (chan->pfd[i] != HIO_SYSHND_INVALID) close (chan->pfd[i]);
+			if (chan->pfd[i + 1] != HIO_SYSHND_INVALID) close (chan->pfd[i + 1]);
+			chan->pfd[i] = HIO_SYSHND_INVALID;
+			chan->pfd[i + 1] = HIO_SYSHND_INVALID;
+		}
+	}
+
+	if ((chan->pfd[0] == HIO_SYSHND_INVALID && chan->pfd[2] == HIO_SYSHND_INVALID) || pool->nfree_chans >= pool->max_workers)
+	{
+		close_thr_chan (chan);
+		hio_freemem (pool->hio, chan);
+		return;
+	}
+
+	chan->next = pool->free_chans;
+	pool->free_chans = chan;
+	pool->nfree_chans++;
+}
+
+static void release_thr_iop (hio_dev_thr_info_t* ti)
+{
+	/* called by the worker when the function of a pool job returns.
+	 * the pipe ends closed by the function can't be reused */
+	thr_chan_t* chan = ti->chan;
+
+	if (ti->in_null != HIO_SYSHND_INVALID)
+	{
+		if (ti->thr_iop.rfd != HIO_SYSHND_INVALID) close (ti->thr_iop.rfd);
+		ti->in_null = HIO_SYSHND_INVALID;
+	}
+	else if (ti->thr_iop.rfd == HIO_SYSHND_INVALID) chan->pfd[0] = HIO_SYSHND_INVALID;
+
+	if (ti->thr_iop.wfd == HIO_SYSHND_INVALID) chan->pfd[3] = HIO_SYSHND_INVALID;
+
+	ti->thr_iop.rfd = HIO_SYSHND_INVALID;
+	ti->thr_iop.wfd = HIO_SYSHND_INVALID;
+}
 
 static void free_thr_info_resources (hio_t* hio, hio_dev_thr_info_t* ti)
 {
@@ -81,6 +277,127 @@ static void free_thr_info_resources (hio_t* hio, hio_dev_thr_info_t* ti)
 	}
 }
 
+static int is_thr_done (hio_dev_thr_info_t* ti)
+{
+#if defined(HIO_HAVE_BUILTIN_ATOMIC_LOAD_N)
+	/* ti->pool can't be used for locking. a closed pool may be gone already */
+	return GET_THR_DONE(ti);
+#else
+	int done;
+
+	/* a pool closed guarantees that all of its jobs are done. so ti->pool is
+	 * not accessed once the flag is found set even if the pool is gone */
+	if (ti->thr_done || !ti->pool) return ti->thr_done;
+
+	pthread_mutex_lock (&ti->pool->mtx);
+	done = ti->thr_done;
+	pthread_mutex_unlock (&ti->pool->mtx);
+	return done;
+#endif
+}
+
+static void mark_thr_out_eof (hio_dev_thr_info_t* ti)
+{
+	thr_chan_t* chan = ti->chan;
+
+	/* the write end of the OUT pipe stays open after a pool job is done.
+	 * put a byte in the drained pipe to wake up the OUT slave. the read
+	 * method turns the byte into EOF */
+	if (ti->out_over || ti->out_marked ||
+	    chan->pfd[2] == HIO_SYSHND_INVALID || chan->pfd[3] == HIO_SYSHND_INVALID ||
+	    !is_pipe_empty(chan->pfd[2])) return;
+
+	if (write(chan->pfd[3], "", 1) == 1) ti->out_marked = 1;
+}
+
+static int check_thr_chan_job (hio_t* hio, hio_cfmb_t* cfmb)
+{
+	hio_dev_thr_info_t* ti = (hio_dev_thr_info_t*)cfmb;
+
+	/* a pool job stays on the cfmb list from the start. the worker wakes up
+	 * the multiplexer when the job is done so that this gets called */
+	if (!is_thr_done(ti)) return 0;
+
+	if (ti->detached)
+	{
+		/* the device got killed before the job was done. the pipes have been
+		 * closed on the hio side and the pool may be gone already */
+		if (ti->chan)
+		{
+			close_thr_chan (ti->chan);
+			hio_freemem (hio, ti->chan);
+			ti->chan = HIO_NULL;
+		}
+		return 1;
+	}
+
+	mark_thr_out_eof (ti);
+	return 0;
+}
+
+static int keep_thr_chan_input (hio_dev_thr_info_t* ti)
+{
+	hio_dev_thr_pool_t* pool = ti->pool;
+	hio_syshnd_t fd;
+	int kept = 0;
+
+	/* the function is gone. leftover data, if any, is checked in put_thr_chan() */
+	if (is_thr_done(ti)) return 1;
+
+	/* the IN pipe must be closed for the running function to see EOF. if the job
+	 * hasn't started with nothing written, the function gets a descriptor at EOF
+	 * instead and the pipe is kept */
+	if (ti->in_written) return 0;
+
+	fd = fcntl(pool->nullfd, F_DUPFD_CLOEXEC, 0);
+	if (fd <= -1) return 0;
+
+	pthread_mutex_lock (&pool->mtx);
+	if (!ti->started)
+	{
+		ti->in_null = fd;
+		kept = 1;
+	}
+	pthread_mutex_unlock (&pool->mtx);
+
+	if (!kept) close (fd);
+	return kept;
+}
+
+static void close_slave_pfd (hio_dev_thr_slave_t* thr, hio_dev_thr_t* master)
+{
+	hio_dev_thr_info_t* ti = master? master->thr_info: HIO_NULL;
+
+	if (thr->pfd == HIO_SYSHND_INVALID) return;
+
+	if (ti && ti->chan)
+	{
+		/* the descriptor belongs to the pool channel */
+		int keep;
+
+		if (thr->id == HIO_DEV_THR_IN)
+		{
+			keep = keep_thr_chan_input(ti);
+			if (!keep) ti->chan->pfd[1] = HIO_SYSHND_INVALID;
+		}
+		else
+		{
+			/* close it while the job is running for the function to get EPIPE */
+			keep = is_thr_done(ti);
+			if (!keep) ti->chan->pfd[2] = HIO_SYSHND_INVALID;
+			ti->out_over = 1;
+		}
+
+		if (!keep) close (thr->pfd);
+	}
+	else
+	{
+		close (thr->pfd);
+	}
+
+	thr->pfd = HIO_SYSHND_INVALID;
+}
+
 static int ready_to_free_thr_info (hio_t* hio, hio_cfmb_t* cfmb)
 {
 	hio_dev_thr_info_t* ti = (hio_dev_thr_info_t*)cfmb;
@@ -94,7 +411,7 @@ static int ready_to_free_thr_info (hio_t* hio, hio_cfmb_t* cfmb)
 	}
 #endif
 
-	if (ti->thr_done)
+	if (is_thr_done(ti))
 	{
 		free_thr_info_resources (hio, ti);
 #if defined(HAVE_PTHREAD_TRYJOIN_NP)
@@ -110,7 +427,7 @@ static int ready_to_free_thr_info (hio_t* hio, hio_cfmb_t* cfmb)
 static void mark_thr_done (void* ctx)
 {
 	hio_dev_thr_info_t* ti = (hio_dev_thr_info_t*)ctx;
-	ti->thr_done = 1;
+	SET_THR_DONE (ti);
 }
 
 static void* run_thr_func (void* ctx)
@@ -133,44 +450,141 @@ static void* run_thr_func (void* ctx)
 	return HIO_NULL;
 }
 
+/* ========================================================================= */
+
+static void* run_pool_worker (void* ctx)
+{
+	hio_dev_thr_pool_t* pool = (hio_dev_thr_pool_t*)ctx;
+
+	pthread_mutex_lock (&pool->mtx);
+	while (1)
+	{
+		hio_dev_thr_info_t* ti;
+
+		while (!pool->q_head && !pool->stop)
+		{
+			pool->nidle++;
+			pthread_cond_wait (&pool->cnd, &pool->mtx);
+			pool->nidle--;
+		}
+
+		/* jobs accepted are run even when the pool is stopping. the pipes
+		 * to the hio side are closed by then and they tend to end quickly */
+		if (!pool->q_head) break;
+
+		ti = pool->q_head;
+		pool->q_head = ti->q_next;
+		if (!pool->q_head) pool->q_tail = HIO_NULL;
+		pool->nqueued--;
+		ti->started = 1;
+		if (ti->in_null != HIO_SYSHND_INVALID) ti->thr_iop.rfd = ti->in_null;
+		pthread_mutex_unlock (&pool->mtx);
+
+		ti->thr_func (ti->hio, &ti->thr_iop, ti->thr_ctx);
+		release_thr_iop (ti);
+
+		pthread_mutex_lock (&pool->mtx);
+		SET_THR_DONE (ti); /* ti must not be touched after this as the hio thread may free it */
+
+		/* the pipes are left open. let check_thr_chan_job() see the job done */
+		hio_sys_intrmux (pool->hio);
+	}
+	pthread_mutex_unlock (&pool->mtx);
+
+	return HIO_NULL;
+}
+
+static int grow_pool_workers (hio_dev_thr_pool_t* pool, hio_oow_t capa)
+{
+	pthread_t* tmp;
+
+	if (capa <= pool->workers_capa) return 0;
+
+	tmp = (pthread_t*)hio_reallocmem(pool->hio, pool->workers, HIO_SIZEOF(*tmp) * capa);
+	if (HIO_UNLIKELY(!tmp)) return -1;
+
+	pool->workers = tmp;
+	pool->workers_capa = capa;
+	return 0;
+}
+
+static int submit_to_pool (hio_dev_thr_pool_t* pool, hio_dev_thr_info_t* ti)
+{
+	hio_t* hio = pool->hio;
+
+	pthread_mutex_lock (&pool->mtx);
+
+	if (pool->nqueued >= pool->nidle)
+	{
+		/* no idle worker to pick up the job right away */
+		int spawned = 0;
+
+		if (pool->nworkers < pool->max_workers)
+		{
+			int n;
+
+			/* the capacity is adjusted in hio_dev_thr_openpool() and hio_dev_thr_setpoollimit() */
+			HIO_ASSERT (hio, pool->nworkers < pool->workers_capa);
+			n = pthread_create(&pool->workers[pool->nworkers], HIO_NULL, run_pool_worker, pool);
+			if (n == 0)
+			{
+				pool->nworkers++;
+				spawned = 1;
+			}
+			else if (pool->nworkers <= 0)
+			{
+				pthread_mutex_unlock (&pool->mtx);
+				hio_seterrwithsyserr (hio, 0, n);
+				return -1;
+			}
+		}
+
+		if (!spawned && pool->nqueued - pool->nidle >= pool->max_queued)
+		{
+			pthread_mutex_unlock (&pool->mtx);
+			hio_seterrbfmt (hio, HIO_EBUSY, "thread pool queue full - %zu jobs waiting", pool->max_queued);
+			return -1;
+		}
+	}
+
+	ti->pool = pool;
+	ti->q_next = HIO_NULL;
+	if (pool->q_tail) pool->q_tail->q_next = ti;
+	else pool->q_head = ti;
+	pool->q_tail = ti;
+	pool->nqueued++;
+
+	pthread_cond_signal (&pool->cnd);
+	pthread_mutex_unlock (&pool->mtx);
+	return 0;
+}
+
+/* ========================================================================= */
+
 static int dev_thr_make_master (hio_dev_t* dev, void* ctx)
 {
 	hio_t* hio = dev->hio;
 	hio_dev_thr_t* rdev = (hio_dev_thr_t*)dev;
 	hio_dev_thr_make_t* info = (hio_dev_thr_make_t*)ctx;
 	hio_syshnd_t pfds[4] = { HIO_SYSHND_INVALID, HIO_SYSHND_INVALID, HIO_SYSHND_INVALID, HIO_SYSHND_INVALID };
+	thr_chan_t* chan = HIO_NULL;
 	slave_info_t si;
 	int i;
 
-#if defined(HAVE_PIPE2) && defined(O_CLOEXEC) && defined(O_NONBLOCK)
-	if (pipe2(&pfds[0], O_CLOEXEC | O_NONBLOCK) == -1 ||
-	    pipe2(&pfds[2], O_CLOEXEC | O_NONBLOCK) == -1)
+	if (info->pool)
 	{
-		if (errno != ENOSYS) goto pipe_error;
+		/* the pipes of a pool job are reused. until the job is submitted,
+		 * they are handled like new pipes and closed on failure */
+		chan = get_thr_chan(info->pool);
+		if (!chan) goto oops;
+		for (i = 0; i < HIO_COUNTOF(pfds); i++) pfds[i] = chan->pfd[i];
 	}
-	else goto pipe_done;
-#endif
-
-	if (pipe(&pfds[0]) == -1 || pipe(&pfds[2]) == -1)
+	else
 	{
-#if defined(HAVE_PIPE2) && defined(O_CLOEXEC) && defined(O_NONBLOCK)
-	pipe_error:
-#endif
-		hio_seterrwithsyserr (hio, 0, errno);
-		goto oops;
+		if (open_thr_pipe(hio, &pfds[0], 1) <= -1 ||
+		    open_thr_pipe(hio, &pfds[2], 0) <= -1) goto oops;
 	}
 
-	if (hio_makesyshndasync(hio, pfds[1]) <= -1 ||
-	    hio_makesyshndasync(hio, pfds[2]) <= -1) goto oops;
-
-	if (hio_makesyshndcloexec(hio, pfds[0]) <= -1 ||
-	    hio_makesyshndcloexec(hio, pfds[1]) <= -1 ||
-	    hio_makesyshndcloexec(hio, pfds[2]) <= -1 ||
-	    hio_makesyshndcloexec(hio, pfds[1]) <= -1) goto oops;
-
-#if defined(HAVE_PIPE2) && defined(O_CLOEXEC) && defined(O_NONBLOCK)
-pipe_done:
-#endif
 	si.mi = info;
 	si.pfd = pfds[1];
 	si.dev_cap = HIO_DEV_CAP_OUT | HIO_DEV_CAP_STREAM;
@@ -218,9 +632,20 @@ pipe_done:
 		ti->thr_iop.wfd = pfds[3];
 		ti->thr_func = info->thr_func;
 		ti->thr_ctx = info->thr_ctx;
+		ti->chan = chan;
+		ti->in_null = HIO_SYSHND_INVALID;
 
 		rdev->thr_info = ti;
-		n = pthread_create(&ti->thr_hnd, HIO_NULL, run_thr_func, ti);
+		if (info->pool)
+		{
+			n = submit_to_pool(info->pool, ti);
+			if (n == 0) hio_addcfmb (hio, (hio_cfmb_t*)ti, check_thr_chan_job, HIO_NULL);
+		}
+		else
+		{
+			n = pthread_create(&ti->thr_hnd, HIO_NULL, run_thr_func, ti);
+			if (n != 0) hio_seterrwithsyserr (hio, 0, n);
+		}
 		if (n != 0)
 		{
 			rdev->thr_info = HIO_NULL;
@@ -238,6 +663,9 @@ pipe_done:
 	return 0;
 
 oops:
+	/* the descriptors in the channel are closed below like new ones */
+	if (chan) hio_freemem (hio, chan);
+
 	for (i = 0; i < HIO_COUNTOF(pfds); i++)
 	{
 		if (pfds[i] != HIO_SYSHND_INVALID)
@@ -307,9 +735,34 @@ static int dev_thr_kill_master (hio_dev_t* dev, int force)
 	}
 
 	rdev->thr_info = HIO_NULL;
-	if (ti->thr_done)
+	if (ti->chan)
+	{
+		/* the job stays on the cfmb list until it's done. see check_thr_chan_job() */
+		ti->detached = 1;
+		if (is_thr_done(ti))
+		{
+			put_thr_chan (ti->pool, ti->chan);
+			ti->chan = HIO_NULL;
+		}
+		else
+		{
+			/* let the running function see EOF and EPIPE */
+			if (ti->chan->pfd[1] != HIO_SYSHND_INVALID)
+			{
+				close (ti->chan->pfd[1]);
+				ti->chan->pfd[1] = HIO_SYSHND_INVALID;
+			}
+			if (ti->chan->pfd[2] != HIO_SYSHND_INVALID)
+			{
+				close (ti->chan->pfd[2]);
+				ti->chan->pfd[2] = HIO_SYSHND_INVALID;
+			}
+		}
+	}
+	else if (is_thr_done(ti))
 	{
-		pthread_detach (ti->thr_hnd); /* pthread_join() may be blocking. detach the thread instead */
+		/* pthread_join() may be blocking. detach the thread instead */
+		pthread_detach (ti->thr_hnd);
 		free_thr_info_resources (hio, ti);
 		hio_freemem (hio, ti);
 	}
@@ -341,6 +794,9 @@ static int dev_thr_kill_slave (hio_dev_t* dev, int force)
 		hio_dev_thr_t* master;
 
 		master = rdev->master;
+
+		/* the master is still alive with the thread information */
+		close_slave_pfd (rdev, master);
 		rdev->master = HIO_NULL;
 
 		/* indicate EOF */
@@ -369,12 +825,7 @@ static int dev_thr_kill_slave (hio_dev_t* dev, int force)
 		}
 	}
 
-	if (rdev->pfd != HIO_SYSHND_INVALID)
-	{
-		close (rdev->pfd);
-		rdev->pfd = HIO_SYSHND_INVALID;
-	}
-
+	close_slave_pfd (rdev, HIO_NULL);
 	return 0;
 }
 
@@ -389,6 +840,8 @@ static void dev_thr_fail_before_make_slave (void* ctx)
 static int dev_thr_read_slave (hio_dev_t* dev, void* buf, hio_iolen_t* len, hio_devaddr_t* srcaddr)
 {
 	hio_dev_thr_slave_t* thr = (hio_dev_thr_slave_t*)dev;
+	hio_dev_thr_info_t* ti = thr->master? thr->master->thr_info: HIO_NULL;
+	int done = 0;
 	ssize_t x;
 
 	/* the read and write operation happens on different slave devices.
@@ -400,17 +853,46 @@ static int dev_thr_read_slave (hio_dev_t* dev, void* buf, hio_iolen_t* len, hio_
 	}*/
 	HIO_ASSERT (thr->hio, thr->pfd != HIO_SYSHND_INVALID); /* use this assertion to check if my claim above is right */
 
+	if (ti && ti->chan)
+	{
+		if (ti->out_marked)
+		{
+			/* the only byte left is the one written by mark_thr_out_eof() */
+			read (thr->pfd, buf, 1);
+			goto eof;
+		}
+
+		/* check it before reading. the data written before the job is done is read first */
+		done = is_thr_done(ti);
+	}
+
 	x = read(thr->pfd, buf, *len);
 	if (x <= -1)
 	{
-		if (errno == EINPROGRESS || errno == EWOULDBLOCK || errno == EAGAIN) return 0;  /* no data available */
+		if (errno == EINPROGRESS || errno == EWOULDBLOCK || errno == EAGAIN)
+		{
+			/* no data available. the pipe of a pool job is not closed by the other side */
+			if (done) goto eof;
+			return 0;
+		}
 		if (errno == EINTR) return 0;
 		hio_seterrwithsyserr (thr->hio, 0, errno);
 		return -1;
 	}
 
+	if (ti && ti->chan)
+	{
+		if (x == 0) ti->out_over = 1;
+		else if (done) mark_thr_out_eof (ti);
+	}
+
 	*len = x;
 	return 1;
+
+eof:
+	ti->out_over = 1;
+	*len = 0;
+	return 1;
 }
 
 static int dev_thr_write_slave (hio_dev_t* dev, const void* data, hio_iolen_t* len, const hio_devaddr_t* dstaddr)
@@ -436,8 +918,7 @@ static int dev_thr_write_slave (hio_dev_t* dev, const void* data, hio_iolen_t* l
 		if (HIO_LIKELY(thr->pfd != HIO_SYSHND_INVALID))
 		{
 			hio_dev_watch (dev, HIO_DEV_WATCH_STOP, 0);
-			close (thr->pfd);
-			thr->pfd = HIO_SYSHND_INVALID;
+			close_slave_pfd (thr, thr->master);
 		}
 		return 1; /* indicate that the operation got successful. the core will execute on_write() with the write length of 0. */
 	}
@@ -451,6 +932,7 @@ static int dev_thr_write_slave (hio_dev_t* dev, const void* data, hio_iolen_t* l
 		return -1;
 	}
 
+	if (thr->master && thr->master->thr_info) thr->master->thr_info->in_written = 1;
 	*len = x;
 	return 1;
 }
@@ -478,8 +960,7 @@ static int dev_thr_writev_slave (hio_dev_t* dev, const hio_iovec_t* iov, hio_iol
 		if (HIO_LIKELY(thr->pfd != HIO_SYSHND_INVALID))
 		{
 			hio_dev_watch (dev, HIO_DEV_WATCH_STOP, 0);
-			close (thr->pfd);
-			thr->pfd = HIO_SYSHND_INVALID;
+			close_slave_pfd (thr, thr->master);
 		}
 		return 1; /* indicate that the operation got successful. the core will execute on_write() with 0. */
 	}
@@ -493,6 +974,8 @@ static int dev_thr_writev_slave (hio_dev_t* dev, const hio_iovec_t* iov, hio_iol
 		return -1;
 	}
 
+	if (thr->master && thr->master->thr_info) thr->master->thr_info->in_written = 1;
+
 	*iovcnt = x;
 	return 1;
 }
@@ -766,6 +1249,103 @@ int hio_dev_thr_timedwrite (hio_dev_thr_t* dev, const void* data, hio_iolen_t dl
 	}
 }
 
+hio_dev_thr_pool_t* hio_dev_thr_openpool (hio_t* hio, hio_oow_t max_workers, hio_oow_t max_queued)
+{
+	hio_dev_thr_pool_t* pool;
+	hio_syshnd_t pfd[2];
+
+	if (HIO_UNLIKELY(max_workers <= 0))
+	{
+		hio_seterrbfmt (hio, HIO_EINVAL, "zero workers for thread pool");
+		return HIO_NULL;
+	}
+
+	pool = (hio_dev_thr_pool_t*)hio_callocmem(hio, HIO_SIZEOF(*pool));
+	if (HIO_UNLIKELY(!pool)) return HIO_NULL;
+
+	pool->hio = hio;
+	pool->max_workers = max_workers;
+	pool->max_queued = max_queued;
+
+	if (open_thr_pipe(hio, pfd, 0) <= -1)
+	{
+		hio_freemem (hio, pool);
+		return HIO_NULL;
+	}
+	close (pfd[1]);
+	pool->nullfd = pfd[0];
+
+	if (grow_pool_workers(pool, max_workers) <= -1)
+	{
+		close (pool->nullfd);
+		hio_freemem (hio, pool);
+		return HIO_NULL;
+	}
+
+	pthread_mutex_init (&pool->mtx, HIO_NULL);
+	pthread_cond_init (&pool->cnd, HIO_NULL);
+
+	/* workers are spawned on demand by submit_to_pool() */
+	return pool;
+}
+
+void hio_dev_thr_closepool (hio_dev_thr_pool_t* pool)
+{
+	hio_t* hio = pool->hio;
+	hio_oow_t i;
+
+	pthread_mutex_lock (&pool->mtx);
+	pool->stop = 1;
+	pthread_cond_broadcast (&pool->cnd);
+	pthread_mutex_unlock (&pool->mtx);
+
+	/* BAD. blocking in a non-blocking library. but it's like waiting for the
+	 * dedicated threads in hio_fini() and the job functions can't be stopped */
+	for (i = 0; i < pool->nworkers; i++) pthread_join (pool->workers[i], HIO_NULL);
+	HIO_ASSERT (hio, pool->q_head == HIO_NULL);
+
+	while (pool->free_chans)
+	{
+		thr_chan_t* chan = pool->free_chans;
+		pool->free_chans = chan->next;
+		close_thr_chan (chan);
+		hio_freemem (hio, chan);
+	}
+	close (pool->nullfd);
+
+	pthread_cond_destroy (&pool->cnd);
+	pthread_mutex_destroy (&pool->mtx);
+	if (pool->workers) hio_freemem (hio, pool->workers);
+	hio_freemem (hio, pool);
+}
+
+int hio_dev_thr_setpoollimit (hio_dev_thr_pool_t* pool, hio_oow_t max_workers, hio_oow_t max_queued)
+{
+	if (HIO_UNLIKELY(max_workers <= 0))
+	{
+		hio_seterrbfmt (pool->hio, HIO_EINVAL, "zero workers for thread pool");
+		return -1;
+	}
+
+	/* the existing workers stay alive even if max_workers gets lower */
+	if (grow_pool_workers(pool, max_workers) <= -1) return -1;
+
+	pthread_mutex_lock (&pool->mtx);
+	pool->max_workers = max_workers;
+	pool->max_queued = max_queued;
+	pthread_mutex_unlock (&pool->mtx);
+	return 0;
+}
+
+void hio_dev_thr_getpoolstat (hio_dev_thr_pool_t* pool, hio_dev_thr_poolstat_t* stat)
+{
+	pthread_mutex_lock (&pool->mtx);
+	stat->nworkers = pool->nworkers;
+	stat->nidle = pool->nidle;
+	stat->nqueued = pool->nqueued;
+	pthread_mutex_unlock (&pool->mtx);
+}
+
 int hio_dev_thr_close (hio_dev_thr_t* dev, hio_dev_thr_sid_t sid)
 {
 	return hio_dev_ioctl((hio_dev_t*)dev, HIO_DEV_THR_CLOSE, &sid);
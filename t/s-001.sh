@@ -71,8 +71,8 @@ test_cgi()
 	cp -pf "${srcdir}/t-cgi.sh" "${tmpdir}/t.cgi"
 	chmod ugo+x "${tmpdir}/t.cgi"
 
-	## check directory listing against an empty directory
-	../bin/hio-webs "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	## run the scripts on standby helpers
+	../bin/hio-webs --cgi-prefork 2 --cgi-prefork-helper ../bin/hio-standby "${srvaddr}" "${tmpdir}" 2>/dev/null &
 	local jid=$!
 	sleep 0.5
 
@@ -107,6 +107,23 @@ echo "--------------------"
 	tap_ensure "$request_uri", "/t.cgi", "$msg - request_uri"
 	tap_ensure "$query_string", "abc=def", "$msg - query_string"
 
+	## more requests than the standby helpers kept by hio-webs
+	local i qs=""
+	for i in 1 2 3 4 5 6
+	do
+		curl -s -o "${tmpdir}/t.out" "http://${srvaddr}/t.cgi?n=${i}"
+		qs="${qs}$(grep -E "^QUERY_STRING:" "${tmpdir}/t.out" | cut -d: -f2) "
+	done
+	tap_ensure "$qs" "n=1 n=2 n=3 n=4 n=5 n=6 " "$msg - repeated requests"
+
+	## the helpers used up are replaced
+	sleep 0.2
+	if ps -o args= --ppid ${jid} >/dev/null 2>&1
+	then
+		local nsb=$(ps -o args= --ppid ${jid} | grep -c "hio-standby")
+		tap_ensure "$nsb" "2" "$msg - standby helpers"
+	fi
+
 ## TODO: write more...
 	rm -rf "${tmpdir}"
 
@@ -114,8 +131,648 @@ echo "--------------------"
 	wait ${jid}
 }
 
+test_conditional_get()
+{
+	local msg="hio-webs conditional get"
+	local srvaddr=127.0.0.1:54321
+	local tmpdir="/tmp/s-001.$$"
+
+	mkdir -p "${tmpdir}"
+	echo "hello world" > "${tmpdir}/t.txt"
+	## on a wednesday for the If-Range date below
+	touch -d "2015-10-21 07:28:00 UTC" "${tmpdir}/t.txt"
+
+	../bin/hio-webs "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	local etag=$(curl -s -D - -o /dev/null "http://${srvaddr}/t.txt" | grep -i "^ETag:" | cut -d' ' -f2 | tr -d '\r')
+	local lastmod=$(curl -s -D - -o /dev/null "http://${srvaddr}/t.txt" | grep -i "^Last-Modified:" | cut -d' ' -f2- | tr -d '\r')
+
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null -H "If-None-Match: ${etag}" "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "304" "$msg - If-None-Match - got $hc"
+
+	## 304 carries the validators and Vary that 200 would
+	local hdrs=$(curl -s -D - -o /dev/null -H "If-None-Match: ${etag}" "http://${srvaddr}/t.txt" | tr -d '\r')
+	local val=$(echo "${hdrs}" | grep -i "^ETag:" | cut -d' ' -f2)
+	tap_ensure "$val" "${etag}" "$msg - 304 etag - got $val"
+	local val=$(echo "${hdrs}" | grep -i "^Last-Modified:" | cut -d' ' -f2-)
+	tap_ensure "$val" "${lastmod}" "$msg - 304 last-modified - got $val"
+	local val=$(echo "${hdrs}" | grep -i "^Vary:" | cut -d' ' -f2)
+	tap_ensure "$val" "Accept-Encoding" "$msg - 304 vary - got $val"
+
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null -H "If-None-Match: \"nomatch\"" "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "200" "$msg - If-None-Match mismatch - got $hc"
+
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null -H "If-Modified-Since: ${lastmod}" "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "304" "$msg - If-Modified-Since - got $hc"
+
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null -r 0-4 -H "If-Range: ${etag}" "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "206" "$msg - If-Range - got $hc"
+
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null -r 0-4 -H "If-Range: \"old\"" "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "200" "$msg - If-Range mismatch - got $hc"
+
+	## the date starting with 'W' is not a weak entity tag
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null -r 0-4 -H "If-Range: ${lastmod}" "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "206" "$msg - If-Range with Last-Modified - got $hc"
+
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null -r 0-4 -H "If-Range: Wed, 14 Oct 2015 07:28:00 GMT" "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "200" "$msg - If-Range with an old date - got $hc"
+
+	local val=$(curl -s -D - -o /dev/null -r 6-10 "http://${srvaddr}/t.txt" | grep -i "^Content-Range:" | cut -d' ' -f2- | tr -d '\r')
+	tap_ensure "$val" "bytes 6-10/12" "$msg - Content-Range - got $val"
+
+	local val=$(curl -s -r 0-1,6-10 "http://${srvaddr}/t.txt" | grep -i "^Content-Range:" | cut -d' ' -f2- | tr -d '\r' | tr '\n' ',')
+	tap_ensure "$val" "bytes 0-1/12,bytes 6-10/12," "$msg - multipart Content-Range - got $val"
+
+	rm -rf "${tmpdir}"
+
+	kill -TERM ${jid}
+	wait ${jid}
+}
+
+test_file_cache()
+{
+	local msg="hio-webs open file cache"
+	local srvaddr=127.0.0.1:54321
+	local tmpdir="/tmp/s-001.$$"
+
+	mkdir -p "${tmpdir}"
+	echo "hello world" > "${tmpdir}/t.txt"
+
+	../bin/hio-webs "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	local body=$(curl -s "http://${srvaddr}/t.txt")
+	tap_ensure "$body" "hello world" "$msg - first request - got $body"
+
+	## a file replaced under the same name keeps being served from the
+	## cached descriptor until the path is checked again a second later
+	echo "hello again" > "${tmpdir}/t.txt.new"
+	mv -f "${tmpdir}/t.txt.new" "${tmpdir}/t.txt"
+	local body=$(curl -s "http://${srvaddr}/t.txt")
+	tap_ensure "$body" "hello world" "$msg - cached descriptor - got $body"
+
+	sleep 1.2
+	local body=$(curl -s "http://${srvaddr}/t.txt")
+	tap_ensure "$body" "hello again" "$msg - replaced file after revalidation - got $body"
+
+	rm -rf "${tmpdir}"
+
+	kill -TERM ${jid}
+	wait ${jid}
+}
+
+test_file_memcache()
+{
+	local msg="hio-webs memory cache"
+	local srvaddr=127.0.0.1:54321
+	local tmpdir="/tmp/s-001.$$"
+
+	mkdir -p "${tmpdir}"
+	echo "hello world" > "${tmpdir}/t.txt"
+
+	../bin/hio-webs "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	## the second request is answered from the contents cached in memory
+	curl -s -o /dev/null "http://${srvaddr}/t.txt"
+	local res=$(curl -s -D - "http://${srvaddr}/t.txt" | tr -d '\r')
+	local len=$(echo "${res}" | grep -i "^Content-Length:" | cut -d' ' -f2)
+	tap_ensure "$len" "12" "$msg - content length - got $len"
+	local body=$(echo "${res}" | tail -n 1)
+	tap_ensure "$body" "hello world" "$msg - contents - got $body"
+
+	## a file modified in place is refreshed without waiting for revalidation
+	echo "hello world, again" > "${tmpdir}/t.txt"
+	local res=$(curl -s -D - "http://${srvaddr}/t.txt" | tr -d '\r')
+	local len=$(echo "${res}" | grep -i "^Content-Length:" | cut -d' ' -f2)
+	tap_ensure "$len" "19" "$msg - content length after modification - got $len"
+	local body=$(echo "${res}" | tail -n 1)
+	tap_ensure "$body" "hello world, again" "$msg - contents after modification - got $body"
+
+	rm -rf "${tmpdir}"
+
+	kill -TERM ${jid}
+	wait ${jid}
+}
+
+test_compression()
+{
+	local msg="hio-webs compression"
+	local srvaddr=127.0.0.1:54321
+	local tmpdir="/tmp/s-001.$$"
+
+	mkdir -p "${tmpdir}"
+	awk 'BEGIN { for (i = 0; i < 200; i++) printf "line %d of the text file\n", i }' > "${tmpdir}/t.txt"
+	gzip -c "${tmpdir}/t.txt" > "${tmpdir}/t.txt.gz"
+	cat > "${tmpdir}/z.cgi" <<EOF
+#!/bin/sh
+printf 'Content-Type: text/plain\\r\\nETag: "z1"\\r\\n\\r\\n'
+awk 'BEGIN { for (i = 0; i < 200; i++) printf "line %d of the cgi output\\n", i }'
+EOF
+	chmod ugo+x "${tmpdir}/z.cgi"
+
+	../bin/hio-webs "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	## the precompressed file is chosen for a client accepting gzip
+	local hdrs=$(curl -s -D - -o "${tmpdir}/t.out" -H "Accept-Encoding: gzip" "http://${srvaddr}/t.txt" | tr -d '\r')
+	local val=$(echo "${hdrs}" | grep -i "^Content-Encoding:" | cut -d' ' -f2)
+	tap_ensure "$val" "gzip" "$msg - precompressed file - got $val"
+	local val=$(echo "${hdrs}" | grep -i "^Vary:" | cut -d' ' -f2)
+	tap_ensure "$val" "Accept-Encoding" "$msg - precompressed file varies - got $val"
+	cmp -s "${tmpdir}/t.out" "${tmpdir}/t.txt.gz" && val=same || val=different
+	tap_ensure "$val" "same" "$msg - precompressed file contents - got $val"
+
+	## the identity variant tells caches that it varies as well
+	local hdrs=$(curl -s -D - -o "${tmpdir}/t.out" "http://${srvaddr}/t.txt" | tr -d '\r')
+	local val=$(echo "${hdrs}" | grep -i "^Content-Encoding:" | cut -d' ' -f2)
+	tap_ensure "$val" "" "$msg - identity file - got $val"
+	local val=$(echo "${hdrs}" | grep -i "^Vary:" | cut -d' ' -f2)
+	tap_ensure "$val" "Accept-Encoding" "$msg - identity file varies - got $val"
+	cmp -s "${tmpdir}/t.out" "${tmpdir}/t.txt" && val=same || val=different
+	tap_ensure "$val" "same" "$msg - identity file contents - got $val"
+
+	## the cgi output is compressed on the fly with the entity tag weakened
+	local hdrs=$(curl -s -D - -o "${tmpdir}/t.out" -H "Accept-Encoding: gzip" "http://${srvaddr}/z.cgi" | tr -d '\r')
+	local val=$(echo "${hdrs}" | grep -i "^Content-Encoding:" | cut -d' ' -f2)
+	tap_ensure "$val" "gzip" "$msg - dynamic gzip - got $val"
+	local val=$(echo "${hdrs}" | grep -i "^Vary:" | cut -d' ' -f2)
+	tap_ensure "$val" "Accept-Encoding" "$msg - dynamic gzip varies - got $val"
+	local val=$(echo "${hdrs}" | grep -i "^ETag:" | cut -d' ' -f2)
+	tap_ensure "$val" "W/\"z1\"" "$msg - dynamic gzip etag - got $val"
+	local val=$(gzip -dc <"${tmpdir}/t.out" | sed -n '200p')
+	tap_ensure "$val" "line 199 of the cgi output" "$msg - dynamic gzip contents - got $val"
+
+	local hdrs=$(curl -s -D - -o "${tmpdir}/t.out" "http://${srvaddr}/z.cgi" | tr -d '\r')
+	local val=$(echo "${hdrs}" | grep -i "^Vary:" | cut -d' ' -f2)
+	tap_ensure "$val" "Accept-Encoding" "$msg - dynamic identity varies - got $val"
+	local val=$(echo "${hdrs}" | grep -i "^ETag:" | cut -d' ' -f2)
+	tap_ensure "$val" "\"z1\"" "$msg - dynamic identity etag - got $val"
+
+	rm -rf "${tmpdir}"
+
+	kill -TERM ${jid}
+	wait ${jid}
+}
+
+test_proxy()
+{
+	local msg="hio-webs proxy"
+	local srvaddr=127.0.0.1:54321
+	local upsaddr=127.0.0.1:54322
+	local tmpdir="/tmp/s-001.$$"
+
+	if ! command -v python3 >/dev/null 2>&1
+	then
+		tap_skip "$msg - python3 not found"
+		return
+	fi
+
+	mkdir -p "${tmpdir}"
+	cat > "${tmpdir}/ups.py" <<EOF
+import sys, socket, threading, http.server, socketserver
+drop = [False]
+class H(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    def log_message(self, *a): pass
+    def setup(self):
+        super().setup()
+        self.nreqs = 0
+    def begin(self):
+        self.nreqs += 1
+        if drop[0] and self.nreqs > 1:
+            ## pretend that the connection has been closed just before the request arrived
+            drop[0] = False
+            print("port=%d dropped" % self.client_address[1], flush=True)
+            self.close_connection = True
+            return False
+        print("port=%d %s %s" % (self.client_address[1], self.command, self.path), flush=True)
+        return True
+    def respond(self, body):
+        self.send_response(200)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+    def do_GET(self):
+        if not self.begin(): return
+        if self.path == "/drop-next": drop[0] = True
+        self.respond(("hello %s\n" % self.path).encode())
+        if self.path == "/close-idle":
+            threading.Timer(0.2, self.connection.shutdown, [socket.SHUT_RDWR]).start()
+    def do_POST(self):
+        if not self.begin(): return
+        if self.headers.get("Transfer-Encoding", "").lower() == "chunked":
+            body = b""
+            while True:
+                n = int(self.rfile.readline().strip(), 16)
+                if n == 0:
+                    self.rfile.readline()
+                    break
+                body += self.rfile.read(n)
+                self.rfile.readline()
+        else:
+            body = self.rfile.read(int(self.headers.get("Content-Length", "0")))
+        self.respond(body)
+class S(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+S(("127.0.0.1", int(sys.argv[1])), H).serve_forever()
+EOF
+	awk 'BEGIN { for (i = 0; i < 5000; i++) printf "line %d of the request body\n", i }' > "${tmpdir}/body.txt"
+
+	python3 "${tmpdir}/ups.py" "${upsaddr##*:}" > "${tmpdir}/ups.log" 2>/dev/null &
+	local ujid=$!
+	../bin/hio-webs --proxy "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	## the connection to the upstream is kept for the next request
+	local val=$(curl -s -x "http://${srvaddr}" "http://${upsaddr}/a")
+	tap_ensure "$val" "hello /a" "$msg - first request - got $val"
+	local val=$(curl -s -x "http://${srvaddr}" "http://${upsaddr}/b")
+	tap_ensure "$val" "hello /b" "$msg - second request - got $val"
+	local val=$(cut -d' ' -f1 "${tmpdir}/ups.log" | sort -u | wc -l | tr -d ' ')
+	tap_ensure "$val" "1" "$msg - connection reused - got $val"
+
+	## the request is retried on a new connection if the reused one is found closed
+	curl -s -o /dev/null -x "http://${srvaddr}" "http://${upsaddr}/drop-next"
+	local val=$(curl -s -x "http://${srvaddr}" "http://${upsaddr}/c")
+	tap_ensure "$val" "hello /c" "$msg - retried request - got $val"
+	local val=$(grep -c "dropped" "${tmpdir}/ups.log")
+	tap_ensure "$val" "1" "$msg - request dropped by upstream - got $val"
+
+	## a request that isn't idempotent is not retried. the upstream may have processed it
+	curl -s -o /dev/null -x "http://${srvaddr}" "http://${upsaddr}/drop-next"
+	local val=$(curl -s -o /dev/null -w "%{http_code}" -x "http://${srvaddr}" -X POST "http://${upsaddr}/post")
+	tap_ensure "$val" "502" "$msg - POST on dropped connection - got $val"
+	local val=$(grep -c "dropped" "${tmpdir}/ups.log")
+	tap_ensure "$val" "2" "$msg - POST dropped by upstream - got $val"
+	local val=$(grep -c " POST /post$" "${tmpdir}/ups.log")
+	tap_ensure "$val" "0" "$msg - POST not sent again - got $val"
+
+	## an idle connection closed by the upstream is not reused
+	curl -s -o /dev/null -x "http://${srvaddr}" "http://${upsaddr}/close-idle"
+	sleep 0.5
+	local val=$(curl -s -x "http://${srvaddr}" "http://${upsaddr}/d")
+	tap_ensure "$val" "hello /d" "$msg - request after idle close - got $val"
+	local port1=$(grep " /close-idle$" "${tmpdir}/ups.log" | cut -d' ' -f1)
+	local port2=$(grep " /d$" "${tmpdir}/ups.log" | cut -d' ' -f1)
+	[ -n "${port1}" -a "${port1}" != "${port2}" ] && val=new || val=same
+	tap_ensure "$val" "new" "$msg - new connection after idle close - got $val"
+
+	## a chunked request body is relayed in chunks
+	curl -s -o "${tmpdir}/body.out" -x "http://${srvaddr}" -H "Transfer-Encoding: chunked" --data-binary "@${tmpdir}/body.txt" "http://${upsaddr}/echo"
+	cmp -s "${tmpdir}/body.out" "${tmpdir}/body.txt" && val=same || val=different
+	tap_ensure "$val" "same" "$msg - chunked request body - got $val"
+
+	## nothing listens on the port of the web server plus 2
+	local val=$(curl -s -o /dev/null -w "%{http_code}" -x "http://${srvaddr}" "http://127.0.0.1:54323/e")
+	tap_ensure "$val" "502" "$msg - upstream down - got $val"
+
+	kill -TERM ${jid}
+	wait ${jid}
+	kill -TERM ${ujid}
+	wait ${ujid} 2>/dev/null
+
+	rm -rf "${tmpdir}"
+}
+
+test_proxy_dns()
+{
+	local msg="hio-webs proxy dns"
+	local srvaddr=127.0.0.1:54321
+	local upsport=54322
+	local dnsaddr=127.0.0.1:54323
+	local tmpdir="/tmp/s-001.$$"
+
+	if ! command -v python3 >/dev/null 2>&1
+	then
+		tap_skip "$msg - python3 not found"
+		return
+	fi
+
+	mkdir -p "${tmpdir}"
+	echo "hello world" > "${tmpdir}/t.txt"
+	cat > "${tmpdir}/dns.py" <<EOF
+import sys, socket, struct, threading, time
+## name: (ttl, ipv4 address or None, ipv6 address or None, delay)
+zone = {
+    "short.test": (1, "127.0.0.1", None, 0),
+    "long.test": (3600, "127.0.0.1", None, 0),
+    "slow.test": (3600, "127.0.0.1", None, 0.5),
+    "v6.test": (3600, None, "::1", 0),
+    "e1.test": (3600, "127.0.0.1", None, 0),
+    "e2.test": (3600, "127.0.0.1", None, 0),
+    "e3.test": (3600, "127.0.0.1", None, 0),
+}
+s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+s.bind(("127.0.0.1", int(sys.argv[1])))
+def reply(req, addr):
+    (qid, flags) = struct.unpack("!HH", req[:4])
+    pos, labels = 12, []
+    while req[pos] != 0:
+        labels.append(req[pos + 1:pos + 1 + req[pos]].decode())
+        pos += 1 + req[pos]
+    (qtype,) = struct.unpack("!H", req[pos + 1:pos + 3])
+    question = req[12:pos + 5]
+    name = ".".join(labels)
+    print("%s %s" % ("AAAA" if qtype == 28 else "A", name), flush=True)
+    ent = zone.get(name)
+    an = b""
+    if ent:
+        time.sleep(ent[3])
+        if qtype == 1 and ent[1]: an = struct.pack("!HHHIH", 0xC00C, 1, 1, ent[0], 4) + socket.inet_pton(socket.AF_INET, ent[1])
+        if qtype == 28 and ent[2]: an = struct.pack("!HHHIH", 0xC00C, 28, 1, ent[0], 16) + socket.inet_pton(socket.AF_INET6, ent[2])
+    rcode = 0 if ent else 3
+    s.sendto(struct.pack("!HHHHHH", qid, 0x8180 | rcode, 1, 1 if an else 0, 0, 0) + question + an, addr)
+while True:
+    (req, addr) = s.recvfrom(512)
+    threading.Thread(target=reply, args=(req, addr), daemon=True).start()
+EOF
+
+	python3 "${tmpdir}/dns.py" "${dnsaddr##*:}" > "${tmpdir}/dns.log" 2>/dev/null &
+	local djid=$!
+	## the upstream is another instance serving the same directory on both ipv4 and ipv6
+	../bin/hio-webs "127.0.0.1:${upsport},[::1]:${upsport}" "${tmpdir}" 2>/dev/null &
+	local ujid=$!
+	../bin/hio-webs --proxy --proxy-dns "${dnsaddr}" --proxy-dns-ttl-max 2 "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	local val=$(curl -s -x "http://${srvaddr}" "http://short.test:${upsport}/t.txt")
+	tap_ensure "$val" "hello world" "$msg - host name upstream - got $val"
+	curl -s -o /dev/null -x "http://${srvaddr}" "http://long.test:${upsport}/t.txt"
+	curl -s -o /dev/null -x "http://${srvaddr}" "http://short.test:${upsport}/t.txt"
+	curl -s -o /dev/null -x "http://${srvaddr}" "http://long.test:${upsport}/t.txt"
+	local val=$(grep -c "^A short.test$" "${tmpdir}/dns.log")
+	tap_ensure "$val" "1" "$msg - cached name - got $val"
+
+	## short.test expires after its ttl of 1 second.
+	## long.test is kept for 2 seconds only despite its ttl of 3600 seconds
+	sleep 1.2
+	curl -s -o /dev/null -x "http://${srvaddr}" "http://short.test:${upsport}/t.txt"
+	curl -s -o /dev/null -x "http://${srvaddr}" "http://long.test:${upsport}/t.txt"
+	local val=$(grep -c "^A short.test$" "${tmpdir}/dns.log")
+	tap_ensure "$val" "2" "$msg - expired name - got $val"
+	local val=$(grep -c "^A long.test$" "${tmpdir}/dns.log")
+	tap_ensure "$val" "1" "$msg - name within ttl cap - got $val"
+	sleep 1.0
+	curl -s -o /dev/null -x "http://${srvaddr}" "http://long.test:${upsport}/t.txt"
+	local val=$(grep -c "^A long.test$" "${tmpdir}/dns.log")
+	tap_ensure "$val" "2" "$msg - name beyond ttl cap - got $val"
+
+	## a name without an ipv4 address is looked up for an ipv6 address
+	local val=$(curl -s -x "http://${srvaddr}" "http://v6.test:${upsport}/t.txt")
+	tap_ensure "$val" "hello world" "$msg - ipv6 upstream - got $val"
+	local val=$(grep -c "^AAAA v6.test$" "${tmpdir}/dns.log")
+	tap_ensure "$val" "1" "$msg - ipv6 fallback - got $val"
+
+	## the second request joins the slow lookup in progress
+	curl -s -o "${tmpdir}/slow.1" -x "http://${srvaddr}" "http://slow.test:${upsport}/t.txt" &
+	local cjid=$!
+	sleep 0.1
+	local val=$(curl -s -x "http://${srvaddr}" "http://slow.test:${upsport}/t.txt")
+	wait ${cjid}
+	tap_ensure "$val" "hello world" "$msg - waiting request - got $val"
+	local val=$(cat "${tmpdir}/slow.1")
+	tap_ensure "$val" "hello world" "$msg - first waiting request - got $val"
+	local val=$(grep -c "^A slow.test$" "${tmpdir}/dns.log")
+	tap_ensure "$val" "1" "$msg - shared lookup - got $val"
+
+	local val=$(curl -s -o /dev/null -w "%{http_code}" -x "http://${srvaddr}" "http://nx.test:${upsport}/t.txt")
+	tap_ensure "$val" "502" "$msg - unknown name - got $val"
+
+	kill -TERM ${jid}
+	wait ${jid}
+
+	## a name resolved over the cache limit is not kept
+	../bin/hio-webs --proxy --proxy-dns "${dnsaddr}" --proxy-dns-cache-max 2 "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	for n in e1 e2 e3 e3 e1
+	do
+		curl -s -o /dev/null -x "http://${srvaddr}" "http://${n}.test:${upsport}/t.txt"
+	done
+	local val=$(grep -c "^A e3.test$" "${tmpdir}/dns.log")
+	tap_ensure "$val" "2" "$msg - name over cache limit - got $val"
+	local val=$(grep -c "^A e1.test$" "${tmpdir}/dns.log")
+	tap_ensure "$val" "1" "$msg - name within cache limit - got $val"
+
+	kill -TERM ${jid}
+	wait ${jid}
+	kill -TERM ${ujid}
+	wait ${ujid}
+	kill -TERM ${djid}
+	wait ${djid} 2>/dev/null
+
+	rm -rf "${tmpdir}"
+}
+
+test_options()
+{
+	local msg="hio-webs options"
+	local srvaddr=127.0.0.1:54321
+	local tmpdir="/tmp/s-001.$$"
+
+	mkdir -p "${tmpdir}"
+
+	../bin/hio-webs "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	## the OPTIONS request is handled by a function on the loop thread
+	local acao=$(curl -s -D - -o /dev/null -X OPTIONS "http://${srvaddr}/" | grep -i "^Access-Control-Allow-Origin:" | cut -d' ' -f2 | tr -d '\r')
+	tap_ensure "$acao" "*" "$msg - Access-Control-Allow-Origin - got $acao"
+
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null -X OPTIONS --data-binary "hello" "http://${srvaddr}/")
+	tap_ensure "$hc" "200" "$msg - with content - got $hc"
+
+	local hc=$(curl -s -0 -w '%{http_code}\n' -o /dev/null -X OPTIONS "http://${srvaddr}/")
+	tap_ensure "$hc" "200" "$msg - HTTP/1.0 - got $hc"
+
+	rm -rf "${tmpdir}"
+
+	kill -TERM ${jid}
+	wait ${jid}
+}
+
+test_request_limits()
+{
+	local msg="hio-webs request limits"
+	local srvaddr=127.0.0.1:54321
+	local tmpdir="/tmp/s-001.$$"
+
+	mkdir -p "${tmpdir}"
+	echo "hello world" > "${tmpdir}/t.txt"
+
+	../bin/hio-webs "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	## the connection is closed without a response beyond a limit
+	local qs=$(head -c 9000 /dev/zero | tr '\0' 'a')
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null "http://${srvaddr}/t.txt?${qs}")
+	tap_ensure "$hc" "000" "$msg - long request line - got $hc"
+
+	local hv=$(head -c 70000 /dev/zero | tr '\0' 'a')
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null -H "X-Large: ${hv}" "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "000" "$msg - large header - got $hc"
+
+	local hdrs=$(awk 'BEGIN { for (i = 0; i < 120; i++) printf "-H X-H%d:v ", i }')
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null ${hdrs} "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "000" "$msg - too many headers - got $hc"
+
+	local hdrs=$(awk 'BEGIN { for (i = 0; i < 50; i++) printf "-H X-H%d:v ", i }')
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null ${hdrs} "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "200" "$msg - headers within the limit - got $hc"
+
+	rm -rf "${tmpdir}"
+
+	kill -TERM ${jid}
+	wait ${jid}
+}
+
+test_client_limits()
+{
+	local msg="hio-webs client limits"
+	local srvaddr=127.0.0.1:54321
+	local tmpdir="/tmp/s-001.$$"
+
+	mkdir -p "${tmpdir}"
+	echo "hello world" > "${tmpdir}/t.txt"
+
+	## two requests at once and one more per second on average
+	../bin/hio-webs --client-req-rate 1 --client-req-burst 2 "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null -o /dev/null "http://${srvaddr}/t.txt" "http://${srvaddr}/t.txt" | tr '\n' ' ')
+	tap_ensure "$hc" "200 200 " "$msg - requests within the burst - got $hc"
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "429" "$msg - request over the rate - got $hc"
+	sleep 1.2
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "200" "$msg - request after refill - got $hc"
+
+	kill -TERM ${jid}
+	wait ${jid}
+
+	if ! command -v python3 >/dev/null 2>&1
+	then
+		tap_skip "$msg - python3 not found"
+		rm -rf "${tmpdir}"
+		return
+	fi
+
+	../bin/hio-webs --client-conn-max 1 "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	## hold a connection open to reach the cap
+	python3 -c 'import socket, time; s = socket.create_connection(("127.0.0.1", 54321)); time.sleep(10)' &
+	local pid=$!
+	sleep 0.3
+
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "000" "$msg - connection over the cap refused - got $hc"
+
+	kill -TERM ${pid}
+	wait ${pid} 2>/dev/null
+	sleep 0.3
+
+	local hc=$(curl -s -w '%{http_code}\n' -o /dev/null "http://${srvaddr}/t.txt")
+	tap_ensure "$hc" "200" "$msg - connection after the other closed - got $hc"
+
+	rm -rf "${tmpdir}"
+
+	kill -TERM ${jid}
+	wait ${jid}
+}
+
+test_access_log()
+{
+	local msg="hio-webs access log"
+	local srvaddr=127.0.0.1:54321
+	local tmpdir="/tmp/s-001.$$"
+	local alog="/tmp/s-001.$$.log"
+
+	mkdir -p "${tmpdir}"
+	echo "hello world" > "${tmpdir}/t.txt"
+
+	../bin/hio-webs --access-log "${alog}" "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	curl -s -o /dev/null "http://${srvaddr}/t.txt"
+	curl -s -o /dev/null "http://${srvaddr}/no%22such%0a.txt"
+	sleep 0.5
+
+	## the records are written by a background thread
+	local rec=$(sed -n 1p "${alog}" | cut -d' ' -f6-9)
+	tap_ensure "$rec" "\"GET /t.txt HTTP/1.1\" 200" "$msg - success - got $rec"
+
+	local rec=$(sed -n 2p "${alog}" | cut -d' ' -f6-9)
+	tap_ensure "$rec" "\"GET /no\\x22such\\x0A.txt HTTP/1.1\" 404" "$msg - escaped path - got $rec"
+
+	## a failed request gets a single response. the connection stays usable
+	local val=$(curl -s -o /dev/null -o /dev/null -w "%{http_code} " "http://${srvaddr}/none.txt" "http://${srvaddr}/t.txt")
+	tap_ensure "$val" "404 200 " "$msg - request after 404 on the same connection - got $val"
+
+	rm -rf "${tmpdir}" "${alog}"
+
+	kill -TERM ${jid}
+	wait ${jid}
+}
+
+test_metrics()
+{
+	local msg="hio-webs metrics"
+	local srvaddr=127.0.0.1:54321
+	local tmpdir="/tmp/s-001.$$"
+
+	mkdir -p "${tmpdir}"
+	echo "hello world" > "${tmpdir}/t.txt"
+
+	../bin/hio-webs --metrics /metrics "${srvaddr}" "${tmpdir}" 2>/dev/null &
+	local jid=$!
+	sleep 0.5
+
+	curl -s -o /dev/null "http://${srvaddr}/t.txt"
+	curl -s -o /dev/null "http://${srvaddr}/t.txt"
+	local metrics=$(curl -s "http://${srvaddr}/metrics")
+
+	local val=$(echo "${metrics}" | grep '^hio_htts_tasks_total{type="file"}' | cut -d' ' -f2)
+	tap_ensure "$val" "2" "$msg - file tasks - got $val"
+
+	local val=$(echo "${metrics}" | grep '^hio_accepts_total' | cut -d' ' -f2)
+	tap_ensure "$val" "3" "$msg - accepts - got $val"
+
+	rm -rf "${tmpdir}"
+
+	kill -TERM ${jid}
+	wait ${jid}
+}
+
 test_default_index
 test_file_list_dir
 test_cgi
+test_conditional_get
+test_file_cache
+test_file_memcache
+test_compression
+test_proxy
+test_proxy_dns
+test_options
+test_request_limits
+test_client_limits
+test_access_log
+test_metrics
 
 tap_end
@@ -1,7 +1,12 @@
 #include <hio-http.h>
+#include <hio-htrd.h>
 #include <string.h>
 #include "tap.h"
 
+static hio_bch_t peeked_name[128];
+static hio_bch_t peeked_value[128];
+static int npeeks;
+
 static int test_perenc(void)
 {
 	hio_bch_t tmp[100];	
@@ -70,10 +75,299 @@ oops:
 	return -1;
 }
 
+static int test_parse_range(void)
+{
+	hio_http_range_t r[3];
+	int n;
+
+	OK (hio_parse_http_range_bcstr("bytes=10-20", &r[0]) == 0 && r[0].type == HIO_HTTP_RANGE_PROPER && r[0].from == 10 && r[0].to == 20, "hio_parse_http_range_bcstr() with a proper range");
+	OK (hio_parse_http_range_bcstr("bytes=10-", &r[0]) == 0 && r[0].type == HIO_HTTP_RANGE_PREFIX && r[0].from == 10, "hio_parse_http_range_bcstr() with a prefix range");
+	OK (hio_parse_http_range_bcstr("bytes=-20", &r[0]) == 0 && r[0].type == HIO_HTTP_RANGE_SUFFIX && r[0].to == 20, "hio_parse_http_range_bcstr() with a suffix range");
+	OK (hio_parse_http_range_bcstr("bytes=10-20,30-40", &r[0]) <= -1, "hio_parse_http_range_bcstr() with a range set");
+	OK (hio_parse_http_range_bcstr("bytes=20-10", &r[0]) <= -1, "hio_parse_http_range_bcstr() with a reversed range");
+
+	n = hio_parse_http_ranges_bcstr("bytes=0-9, 20-, -5", r, HIO_COUNTOF(r));
+	OK (n == 3, "hio_parse_http_ranges_bcstr() with a range set");
+	OK (r[0].type == HIO_HTTP_RANGE_PROPER && r[0].from == 0 && r[0].to == 9, "hio_parse_http_ranges_bcstr() - first range");
+	OK (r[1].type == HIO_HTTP_RANGE_PREFIX && r[1].from == 20, "hio_parse_http_ranges_bcstr() - second range");
+	OK (r[2].type == HIO_HTTP_RANGE_SUFFIX && r[2].to == 5, "hio_parse_http_ranges_bcstr() - third range");
+
+	n = hio_parse_http_ranges_bcstr("bytes=0-1,2-3,4-5,6-7", r, HIO_COUNTOF(r));
+	OK (n == 4, "hio_parse_http_ranges_bcstr() with more ranges than capacity");
+
+	OK (hio_parse_http_ranges_bcstr("bytes=0-1,", r, HIO_COUNTOF(r)) <= -1, "hio_parse_http_ranges_bcstr() with a trailing comma");
+	OK (hio_parse_http_ranges_bcstr("bytes=-", r, HIO_COUNTOF(r)) <= -1, "hio_parse_http_ranges_bcstr() with an empty range");
+	OK (hio_parse_http_ranges_bcstr("items=0-1", r, HIO_COUNTOF(r)) <= -1, "hio_parse_http_ranges_bcstr() with a wrong unit");
+
+	return 0;
+
+oops:
+	return -1;
+}
+
+static int test_http_hdr(void)
+{
+	int i, bad = 0;
+
+	for (i = HIO_HTTP_HDR_OTHER + 1; i < HIO_HTTP_HDR_COUNT; i++)
+	{
+		const hio_bch_t* name = hio_http_hdr_to_bcstr(i);
+		if (!name || hio_bchars_to_http_hdr(name, strlen(name)) != i) bad++;
+	}
+	OK (bad == 0, "hio_bchars_to_http_hdr() with all well-known names");
+
+	OK (hio_bchars_to_http_hdr("content-length", 14) == HIO_HTTP_HDR_CONTENT_LENGTH, "hio_bchars_to_http_hdr() with a lower-case name");
+	OK (hio_bchars_to_http_hdr("CONTENT-TYPE", 12) == HIO_HTTP_HDR_CONTENT_TYPE, "hio_bchars_to_http_hdr() with an upper-case name");
+	OK (hio_bchars_to_http_hdr("Content-Lengt", 13) == HIO_HTTP_HDR_OTHER, "hio_bchars_to_http_hdr() with a truncated name");
+	OK (hio_bchars_to_http_hdr("X-Custom-Header", 15) == HIO_HTTP_HDR_OTHER, "hio_bchars_to_http_hdr() with an unknown name");
+	OK (hio_bchars_to_http_hdr("T", 1) == HIO_HTTP_HDR_OTHER, "hio_bchars_to_http_hdr() with a short name");
+
+	return 0;
+
+oops:
+	return -1;
+}
+
+static int peek_request (hio_htrd_t* htrd, hio_htre_t* re)
+{
+	const hio_htre_hdrval_t* val;
+
+	npeeks++;
+	peeked_value[0] = '\0';
+	val = hio_htre_getheaderval(re, peeked_name);
+	if (val && val->len < HIO_COUNTOF(peeked_value)) memcpy (peeked_value, val->ptr, val->len + 1);
+	return 0;
+}
+
+static int feed_request (hio_htrd_t* htrd, const hio_bch_t* req, hio_oow_t len, hio_oow_t step)
+{
+	/* feed the request step octets at a time. all at once if step is 0 */
+	hio_oow_t pos = 0;
+
+	hio_htrd_clear (htrd);
+	npeeks = 0;
+	if (step <= 0) step = len;
+	while (pos < len)
+	{
+		hio_oow_t n = (len - pos < step)? (len - pos): step;
+		if (hio_htrd_feed(htrd, &req[pos], n, HIO_NULL) <= -1) return -1;
+		pos += n;
+	}
+	return 0;
+}
+
+static hio_oow_t make_request (hio_bch_t* buf, hio_oow_t nlen, hio_oow_t vlen)
+{
+	/* a header with a name of nlen octets and a value of vlen octets. the lengths
+	 * shift the colon and the line ending across the 16 and 32 octet blocks scanned */
+	hio_oow_t len, i;
+
+	len = sprintf(buf, "GET / HTTP/1.1\r\nHost: a\r\n");
+	for (i = 0; i < nlen; i++) peeked_name[i] = 'A' + (i % 26);
+	peeked_name[nlen] = '\0';
+	len += sprintf(&buf[len], "%s: ", peeked_name);
+	for (i = 0; i < vlen; i++) buf[len++] = 'a' + (i % 26);
+	len += sprintf(&buf[len], "\r\nX-Last: z\r\n\r\n");
+	return len;
+}
+
+static int is_peeked_value (hio_oow_t vlen)
+{
+	hio_oow_t i;
+
+	if (npeeks != 1 || strlen(peeked_value) != vlen) return 0;
+	for (i = 0; i < vlen; i++)
+	{
+		if (peeked_value[i] != 'a' + (i % 26)) return 0;
+	}
+	return 1;
+}
+
+static int test_htrd_scan (hio_t* hio)
+{
+	static hio_htrd_recbs_t recbs = { peek_request, HIO_NULL, HIO_NULL };
+	hio_htrd_t* htrd;
+	hio_bch_t buf[256];
+	hio_oow_t nlen, vlen, len, i;
+	int bad, badbyte;
+
+	htrd = hio_htrd_open(hio, 0);
+	if (!htrd) return -1;
+	hio_htrd_setoption (htrd, HIO_HTRD_REQUEST);
+	hio_htrd_setrecbs (htrd, &recbs);
+
+	/* the name and the value of lengths around 16 and 32 place the
+	 * delimiters on either side of a block boundary at every offset */
+	bad = 0;
+	badbyte = 0;
+	for (nlen = 1; nlen <= 40; nlen++)
+	{
+		for (vlen = 0; vlen <= 70; vlen++)
+		{
+			len = make_request(buf, nlen, vlen);
+			if (feed_request(htrd, buf, len, 0) <= -1 || !is_peeked_value(vlen)) bad++;
+			if (nlen % 8 == 1 && (feed_request(htrd, buf, len, 1) <= -1 || !is_peeked_value(vlen))) badbyte++;
+		}
+	}
+	OK (bad == 0, "hio_htrd_feed() with delimiters around block boundaries");
+	OK (badbyte == 0, "hio_htrd_feed() with octets fed one at a time");
+
+	/* a request split at every position gives the same header */
+	len = make_request(buf, 20, 40);
+	bad = 0;
+	for (i = 2; i < len; i++)
+	{
+		if (feed_request(htrd, buf, len, i) <= -1 || !is_peeked_value(40)) bad++;
+	}
+	OK (bad == 0, "hio_htrd_feed() with octets fed in every chunk size");
+
+	/* a null octet in a header is rejected wherever it is */
+	bad = 0;
+	for (i = 25; i < 25 + 20 + 2 + 40; i++)
+	{
+		len = make_request(buf, 20, 40);
+		buf[i] = '\0'; /* from the start of the name at 25 to the end of the value */
+		if (feed_request(htrd, buf, len, 0) >= 0 || hio_htrd_geterrnum(htrd) != HIO_HTRD_EBADRE || npeeks != 0) bad++;
+		if (feed_request(htrd, buf, len, 1) >= 0 || hio_htrd_geterrnum(htrd) != HIO_HTRD_EBADRE || npeeks != 0) bad++;
+	}
+	OK (bad == 0, "hio_htrd_feed() with a null octet in a header");
+
+	hio_htrd_close (htrd);
+	return 0;
+}
+
+static hio_bch_t hdr_names[100][16];
+static hio_bch_t hdr_values[100][8];
+
+static int is_value_chain (const hio_htre_hdrval_t* val, hio_oow_t first, hio_oow_t step, hio_oow_t count)
+{
+	/* the values must be v<first>, v<first + step>, ... in the order added */
+	hio_oow_t i;
+
+	for (i = 0; i < count; i++, val = val->next)
+	{
+		if (!val || strcmp(val->ptr, hdr_values[first + i * step]) != 0) return 0;
+	}
+	return val == HIO_NULL;
+}
+
+struct walk_ctx_t
+{
+	hio_oow_t count;
+	int bad;
+};
+typedef struct walk_ctx_t walk_ctx_t;
+
+static int walk_header (hio_htre_t* re, const hio_bch_t* key, const hio_htre_hdrval_t* val, void* ctx)
+{
+	walk_ctx_t* wc = (walk_ctx_t*)ctx;
+
+	/* the names are visited in the order of their first appearance */
+	if (wc->count >= 10 || strcmp(key, hdr_names[wc->count]) != 0 || !is_value_chain(val, wc->count, 10, 4)) wc->bad++;
+	wc->count++;
+	return 0;
+}
+
+static int test_htre_hdrtab (hio_t* hio)
+{
+	hio_htre_t re;
+	const hio_htre_hdrval_t* val;
+	walk_ctx_t wc;
+	hio_oow_t i;
+	int bad;
+
+	for (i = 0; i < HIO_COUNTOF(hdr_values); i++) sprintf (hdr_values[i], "v%d", (int)i);
+	hio_htre_init (&re, hio);
+
+	/* 40 fields of 10 names take the entries out of the embedded storage.
+	 * the value chains built before it must be rebased to the new entries */
+	bad = 0;
+	for (i = 0; i < 40; i++)
+	{
+		sprintf (hdr_names[i], "X-Name-%d", (int)(i % 10));
+		if (!hio_htre_addheader(&re, hdr_names[i], strlen(hdr_names[i]), hdr_values[i], strlen(hdr_values[i]))) bad++;
+	}
+	OK (bad == 0 && re.hdrtab.count == 40 && re.hdrtab.ent != re.hdrent, "hio_htre_addheader() beyond the embedded entries");
+
+	bad = 0;
+	for (i = 0; i < 10; i++)
+	{
+		val = hio_htre_getheaderval(&re, hdr_names[i]);
+		if (!val || !is_value_chain(val, i, 10, 4)) bad++;
+	}
+	OK (bad == 0, "hio_htre_getheaderval() with duplicate names in order");
+
+	wc.count = 0;
+	wc.bad = 0;
+	OK (hio_htre_walkheaders(&re, walk_header, &wc) == 0 && wc.count == 10 && wc.bad == 0, "hio_htre_walkheaders() with duplicate names");
+
+	/* a well-known name repeated before and after the growth */
+	hio_htre_clear (&re);
+	OK (hio_htre_getheaderval(&re, hdr_names[0]) == HIO_NULL, "hio_htre_clear() forgets the names");
+	/* start over with the embedded entries as clearing keeps the grown ones */
+	hio_htre_fini (&re);
+	hio_htre_init (&re, hio);
+	bad = 0;
+	for (i = 0; i < 30; i++)
+	{
+		const hio_bch_t* name = (i % 10 == 0)? "Set-Cookie": hdr_names[i % 10];
+		if (!hio_htre_addheader(&re, name, strlen(name), hdr_values[i], strlen(hdr_values[i]))) bad++;
+	}
+	val = hio_htre_getheaderbyid(&re, HIO_HTTP_HDR_SET_COOKIE);
+	OK (bad == 0 && re.hdrtab.ent != re.hdrent && val && is_value_chain(val, 0, 10, 3), "hio_htre_getheaderbyid() with a name repeated across the growth");
+
+	/* 100 distinct names grow the index beyond the embedded one */
+	hio_htre_clear (&re);
+	bad = 0;
+	for (i = 0; i < 100; i++)
+	{
+		sprintf (hdr_names[i], "X-Distinct-%d", (int)i);
+		if (!hio_htre_addheader(&re, hdr_names[i], strlen(hdr_names[i]), hdr_values[i], strlen(hdr_values[i]))) bad++;
+	}
+	OK (bad == 0 && re.hdrtab.idxcapa > HIO_HTRE_HDR_INLINE_IDXCAPA, "hio_htre_addheader() beyond the embedded index");
+
+	bad = 0;
+	for (i = 0; i < 100; i++)
+	{
+		val = hio_htre_getheaderval(&re, hdr_names[i]);
+		if (!val || !is_value_chain(val, i, 1, 1)) bad++;
+	}
+	OK (bad == 0, "hio_htre_getheaderval() with all distinct names");
+	OK (hio_htre_getheaderval(&re, "X-Distinct-100") == HIO_NULL, "hio_htre_getheaderval() with an absent name");
+
+	/* names are compared case-insensitively both when added and when looked up */
+	val = hio_htre_getheaderval(&re, "x-distinct-42");
+	OK (val && strcmp(val->ptr, "v42") == 0, "hio_htre_getheaderval() with a lower-case name");
+	val = hio_htre_getheaderval(&re, "X-DISTINCT-42");
+	OK (val && strcmp(val->ptr, "v42") == 0, "hio_htre_getheaderval() with an upper-case name");
+
+	hio_htre_addheader (&re, "x-distinct-7", 12, hdr_values[99], strlen(hdr_values[99]));
+	val = hio_htre_getheaderval(&re, "X-Distinct-7");
+	OK (val && strcmp(val->ptr, "v7") == 0 && val->next && strcmp(val->next->ptr, "v99") == 0 && !val->next->next, "hio_htre_addheader() with a name in another case");
+
+	hio_htre_addheader (&re, "content-length", 14, hdr_values[5], strlen(hdr_values[5]));
+	val = hio_htre_getheaderval(&re, "Content-Length");
+	OK (val && val == hio_htre_getheaderbyid(&re, HIO_HTTP_HDR_CONTENT_LENGTH) && strcmp(val->ptr, "v5") == 0, "hio_htre_getheaderval() with a well-known name in another case");
+
+	hio_htre_fini (&re);
+	return 0;
+}
+
 int main()
 {
+	hio_t* hio;
+
 	no_plan ();
 	if (test_perenc() <= -1) return -1;
 	if (test_escape_html() <= -1) return -1;
+	if (test_parse_range() <= -1) return -1;
+	if (test_http_hdr() <= -1) return -1;
+
+	hio = hio_open(HIO_NULL, 0, HIO_NULL, HIO_FEATURE_ALL, 512, HIO_NULL);
+	if (!hio) return -1;
+	if (test_htrd_scan(hio) <= -1) return -1;
+	if (test_htre_hdrtab(hio) <= -1) return -1;
+	hio_close (hio);
+
 	return exit_status();
 }
@@ -0,0 +1,153 @@
+#include <hio-http.h>
+#include <hio-sck.h>
+#include <string.h>
+#include <stdio.h>
+#include "tap.h"
+
+static int proc_req (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* req)
+{
+	return -1;
+}
+
+static int add_txt_route (hio_svc_htts_t* htts, hio_bitmask_t methods, const hio_bch_t* path, const hio_bch_t* text)
+{
+	hio_svc_htts_route_t route;
+
+	memset (&route, 0, sizeof(route));
+	route.type = HIO_SVC_HTTS_ROUTE_TXT;
+	route.u.txt.status_code = HIO_HTTP_STATUS_OK;
+	route.u.txt.content_type = "text/plain";
+	route.u.txt.content_text = text;
+	return hio_svc_htts_addroute(htts, methods, path, &route);
+}
+
+static const hio_bch_t* match (hio_svc_htts_t* htts, hio_http_method_t mth, const hio_bch_t* path, hio_svc_htts_route_param_t* params, hio_oow_t* nparams)
+{
+	const hio_svc_htts_route_t* route;
+	route = hio_svc_htts_matchroute(htts, mth, path, params, nparams);
+	return route? route->u.txt.content_text: HIO_NULL;
+}
+
+static int test_route (hio_svc_htts_t* htts)
+{
+	hio_svc_htts_route_param_t params[4];
+	hio_oow_t np;
+	const hio_bch_t* r;
+	hio_bch_t text[100];
+	int i, bad;
+	hio_bch_t buf[32];
+	hio_oow_t len;
+
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_ALL_METHODS, "/", "root") == 0, "hio_svc_htts_addroute() with /");
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), "/users", "users") == 0, "hio_svc_htts_addroute() with /users");
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), "/users/:id", "user") == 0, "hio_svc_htts_addroute() with a parameter");
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), "/users/me", "me") == 0, "hio_svc_htts_addroute() with a static segment beside a parameter");
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), "/users/:id/posts/:pid", "post") == 0, "hio_svc_htts_addroute() with two parameters");
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET) | HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_HEAD), "/static/*path", "static") == 0, "hio_svc_htts_addroute() with a wildcard");
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_POST), "/users", "newuser") == 0, "hio_svc_htts_addroute() with another method");
+
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), "/users", "dup") <= -1, "hio_svc_htts_addroute() with a duplicate route");
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), "/users/:uid/x", "x") <= -1, "hio_svc_htts_addroute() with a conflicting parameter name");
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), "/a/*x/y", "x") <= -1, "hio_svc_htts_addroute() with a wildcard in the middle");
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), "nope", "x") <= -1, "hio_svc_htts_addroute() without a leading slash");
+	for (i = 0, len = 5, strcpy(text, "/many"); i < HIO_SVC_HTTS_ROUTE_PARAMS_MAX; i++) len += snprintf(&text[len], sizeof(text) - len, "/:p%d", i);
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), text, "x") == 0, "hio_svc_htts_addroute() with as many parameters as allowed");
+	strcat (text, "/*rest");
+	OK (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), text, "x") <= -1, "hio_svc_htts_addroute() with too many parameters");
+
+	r = match(htts, HIO_HTTP_GET, "/", HIO_NULL, HIO_NULL);
+	OK (r && strcmp(r, "root") == 0, "hio_svc_htts_matchroute() with /");
+
+	r = match(htts, HIO_HTTP_GET, "/users", HIO_NULL, HIO_NULL);
+	OK (r && strcmp(r, "users") == 0, "hio_svc_htts_matchroute() with /users");
+
+	r = match(htts, HIO_HTTP_POST, "/users", HIO_NULL, HIO_NULL);
+	OK (r && strcmp(r, "newuser") == 0, "hio_svc_htts_matchroute() with /users and POST");
+
+	np = HIO_COUNTOF(params);
+	r = match(htts, HIO_HTTP_DELETE, "/users", params, &np);
+	OK (!r && np == HIO_TYPE_MAX(hio_oow_t), "hio_svc_htts_matchroute() with a method not allowed");
+
+	np = HIO_COUNTOF(params);
+	r = match(htts, HIO_HTTP_GET, "/users/me", params, &np);
+	OK (r && strcmp(r, "me") == 0 && np == 0, "hio_svc_htts_matchroute() prefers a static segment");
+
+	np = HIO_COUNTOF(params);
+	r = match(htts, HIO_HTTP_GET, "/users/mex", params, &np);
+	OK (r && strcmp(r, "user") == 0 && np == 1 && params[0].vlen == 3 && memcmp(params[0].value, "mex", 3) == 0, "hio_svc_htts_matchroute() backtracks to a parameter");
+
+	np = HIO_COUNTOF(params);
+	r = match(htts, HIO_HTTP_GET, "/users/10/posts/20", params, &np);
+	OK (r && strcmp(r, "post") == 0 && np == 2, "hio_svc_htts_matchroute() with two parameters");
+	OK (np == 2 && params[0].nlen == 2 && memcmp(params[0].name, "id", 2) == 0 && params[0].vlen == 2 && memcmp(params[0].value, "10", 2) == 0, "hio_svc_htts_matchroute() with two parameters - first");
+	OK (np == 2 && params[1].nlen == 3 && memcmp(params[1].name, "pid", 3) == 0 && params[1].vlen == 2 && memcmp(params[1].value, "20", 2) == 0, "hio_svc_htts_matchroute() with two parameters - second");
+
+	np = 1;
+	r = match(htts, HIO_HTTP_GET, "/users/10/posts/20", params, &np);
+	OK (r && np == 1, "hio_svc_htts_matchroute() with a small parameter buffer");
+
+	np = HIO_COUNTOF(params);
+	r = match(htts, HIO_HTTP_GET, "/static/css/a.css", params, &np);
+	OK (r && strcmp(r, "static") == 0 && np == 1 && params[0].vlen == 9 && memcmp(params[0].value, "css/a.css", 9) == 0, "hio_svc_htts_matchroute() with a wildcard");
+
+	np = HIO_COUNTOF(params);
+	r = match(htts, HIO_HTTP_HEAD, "/static/", params, &np);
+	OK (r && strcmp(r, "static") == 0 && np == 1 && params[0].vlen == 0, "hio_svc_htts_matchroute() with an empty wildcard");
+
+	OK (match(htts, HIO_HTTP_GET, "/users/10/posts", HIO_NULL, HIO_NULL) == HIO_NULL, "hio_svc_htts_matchroute() with a partial path");
+	OK (match(htts, HIO_HTTP_GET, "/user", HIO_NULL, HIO_NULL) == HIO_NULL, "hio_svc_htts_matchroute() with a prefix of a static segment");
+	OK (match(htts, HIO_HTTP_GET, "/users/", HIO_NULL, HIO_NULL) == HIO_NULL, "hio_svc_htts_matchroute() with an empty parameter");
+
+	/* many routes sharing prefixes */
+	for (i = 0, bad = 0; i < 500; i++)
+	{
+		snprintf (buf, sizeof(buf), "/api/v%d/item%d/:id", i % 7, i);
+		snprintf (text, sizeof(text), "%d", i);
+		if (add_txt_route(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), buf, text) <= -1) bad++;
+	}
+	OK (bad == 0, "hio_svc_htts_addroute() with many routes");
+
+	for (i = 0, bad = 0; i < 500; i++)
+	{
+		snprintf (buf, sizeof(buf), "/api/v%d/item%d/x", i % 7, i);
+		snprintf (text, sizeof(text), "%d", i);
+		r = match(htts, HIO_HTTP_GET, buf, HIO_NULL, HIO_NULL);
+		if (!r || strcmp(r, text) != 0) bad++;
+	}
+	OK (bad == 0, "hio_svc_htts_matchroute() with many routes");
+
+	hio_svc_htts_clearroutes (htts);
+	OK (match(htts, HIO_HTTP_GET, "/", HIO_NULL, HIO_NULL) == HIO_NULL, "hio_svc_htts_clearroutes()");
+
+	return 0;
+}
+
+int main()
+{
+	hio_t* hio;
+	hio_svc_htts_t* htts;
+	hio_dev_sck_bind_t bi;
+	int n;
+
+	no_plan ();
+
+	hio = hio_open(HIO_NULL, 0, HIO_NULL, HIO_FEATURE_ALL, 512, HIO_NULL);
+	if (!hio) return -1;
+
+	memset (&bi, 0, sizeof(bi));
+	hio_bcstrtoskad (hio, "127.0.0.1:0", &bi.localaddr);
+	htts = hio_svc_htts_start(hio, 0, &bi, 1, proc_req);
+	if (!htts)
+	{
+		hio_close (hio);
+		return -1;
+	}
+
+	n = test_route(htts);
+
+	hio_svc_htts_stop (htts);
+	hio_close (hio);
+
+	if (n <= -1) return -1;
+	return exit_status();
+}
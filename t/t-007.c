@@ -0,0 +1,411 @@
+#include <hio-http.h>
+#include <hio-sck.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "tap.h"
+
+static hio_svc_httc_t* httc;
+static hio_skad_t srvaddr;
+static int step = 0;
+
+struct res_t
+{
+	int status_code;
+	hio_errnum_t status;
+	char body[64];
+	hio_oow_t len;
+	char allow[32];
+	int done;
+};
+typedef struct res_t res_t;
+
+static res_t res[3];
+static int done_order[3];
+static int ndone;
+static hio_oow_t accepts_base;
+static int ndrops;
+
+/* beyond HIO_SVC_HTTS_TASK_REQ_BODY_MEM_MAX set in main() */
+#define BIG_BODY_LEN 300000
+static hio_uint8_t big_body[BIG_BODY_LEN];
+
+struct body_check_t
+{
+	hio_oow_t len;
+	int bad;
+};
+typedef struct body_check_t body_check_t;
+
+static void check_body (body_check_t* bc, const void* data, hio_oow_t dlen)
+{
+	if (bc->len + dlen > BIG_BODY_LEN || memcmp(&big_body[bc->len], data, dlen) != 0) bc->bad = 1;
+	bc->len += dlen;
+}
+
+static int send_text (hio_svc_htts_task_t* task, const hio_bch_t* text)
+{
+	if (hio_svc_htts_task_startreshdr(task, HIO_HTTP_STATUS_OK, HIO_NULL, 0) <= -1 ||
+	    hio_svc_htts_task_addreshdrfmt(task, "Content-Length", "%zu", strlen(text)) <= -1 ||
+	    hio_svc_htts_task_endreshdr(task) <= -1 ||
+	    hio_svc_htts_task_addresbody(task, text, strlen(text)) <= -1 ||
+	    hio_svc_htts_task_endbody(task) <= -1) return -1;
+	return 0;
+}
+
+static int fun_chunk (hio_svc_htts_t* htts, hio_svc_htts_task_t* task, hio_htre_t* req, void* ctx)
+{
+	if (hio_svc_htts_task_startreshdr(task, HIO_HTTP_STATUS_OK, HIO_NULL, 1) <= -1 ||
+	    hio_svc_htts_task_endreshdr(task) <= -1 ||
+	    hio_svc_htts_task_addresbody(task, "abc", 3) <= -1 ||
+	    hio_svc_htts_task_addresbody(task, "def", 3) <= -1 ||
+	    hio_svc_htts_task_endbody(task) <= -1) return -1;
+	return 0;
+}
+
+static int fun_slow (hio_svc_htts_t* htts, hio_svc_htts_task_t* task, hio_htre_t* req, void* ctx)
+{
+	/* never respond */
+	return 0;
+}
+
+static int fun_body (hio_svc_htts_t* htts, hio_svc_htts_task_t* task, hio_htre_t* req, void* ctx)
+{
+	body_check_t bc;
+	hio_uint8_t buf[4096];
+	ssize_t n;
+	int fd;
+
+	/* the body has been moved to a temporary file */
+	fd = hio_svc_htts_task_getreqbodyfd(task);
+	if (fd <= -1 || hio_htre_getcontentlen(req) > 0) return send_text(task, "in memory");
+
+	memset (&bc, 0, sizeof(bc));
+	while ((n = read(fd, buf, sizeof(buf))) > 0) check_body (&bc, buf, n);
+	return send_text(task, (!bc.bad && bc.len == BIG_BODY_LEN && task->task_req_body_len == BIG_BODY_LEN)? "intact": "corrupt");
+}
+
+static int stream_body (hio_htre_t* req, const hio_bch_t* ptr, hio_oow_t len, void* ctx)
+{
+	hio_svc_htts_task_t* task = (hio_svc_htts_task_t*)ctx;
+	static body_check_t bc;
+
+	if (ptr)
+	{
+		check_body (&bc, ptr, len);
+		return 0;
+	}
+
+	/* end of the body */
+	len = bc.len;
+	memset (&bc, 0, sizeof(bc));
+	return send_text(task, (!bc.bad && len == BIG_BODY_LEN)? "streamed": "corrupt");
+}
+
+static int fun_stream (hio_svc_htts_t* htts, hio_svc_htts_task_t* task, hio_htre_t* req, void* ctx)
+{
+	/* called before the body arrives */
+	if (hio_htre_getcontentlen(req) > 0) return -1;
+	hio_htre_setconcb (req, stream_body, task);
+	return 0;
+}
+
+static int fun_route (hio_svc_htts_t* htts, hio_svc_htts_task_t* task, hio_htre_t* req, void* ctx)
+{
+	const hio_bch_t* id = hio_svc_htts_task_getrouteparam(task, "id");
+	const hio_bch_t* pid = hio_svc_htts_task_getrouteparam(task, "pid");
+	char buf[64];
+
+	if (!id || !pid || hio_svc_htts_task_getrouteparam(task, "none")) return send_text(task, "missing");
+	snprintf (buf, sizeof(buf), "id=%s pid=%s", id, pid);
+	return send_text(task, buf);
+}
+
+static int proc_req (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* req)
+{
+	const hio_bch_t* qpath = hio_htre_getqpath(req);
+	int x;
+
+	x = hio_svc_htts_doroute(htts, csck, req);
+	if (x != 0) return (x <= -1)? -1: 0;
+
+	if (strcmp(qpath, "/drop") == 0)
+	{
+		/* close the connection without a response */
+		ndrops++;
+		hio_dev_sck_halt (csck);
+		return 0;
+	}
+	if (strcmp(qpath, "/chunk") == 0) return hio_svc_htts_dofun(htts, csck, req, fun_chunk, HIO_NULL, 0, HIO_NULL);
+	if (strcmp(qpath, "/slow") == 0) return hio_svc_htts_dofun(htts, csck, req, fun_slow, HIO_NULL, 0, HIO_NULL);
+	if (strcmp(qpath, "/body") == 0) return hio_svc_htts_dofun(htts, csck, req, fun_body, HIO_NULL, 0, HIO_NULL);
+	if (strcmp(qpath, "/stream") == 0) return hio_svc_htts_dofun(htts, csck, req, fun_stream, HIO_NULL, HIO_SVC_HTTS_FUN_STREAM_REQ_BODY, HIO_NULL);
+	return hio_svc_htts_dotxt(htts, csck, req, HIO_HTTP_STATUS_OK, "text/plain", "hello", 0, HIO_NULL);
+}
+
+static hio_oow_t get_accepts (hio_t* hio)
+{
+	hio_stat_t stat;
+	hio_getstat (hio, &stat);
+	return stat.accepts;
+}
+
+static int on_header (hio_svc_httc_req_t* req, hio_htre_t* r, void* ctx)
+{
+	res_t* rs = (res_t*)ctx;
+	const hio_htre_hdrval_t* hv;
+
+	rs->status_code = hio_htre_getscodeval(r);
+	hv = hio_htre_getheaderval(r, "Allow");
+	if (hv && hv->len < sizeof(rs->allow)) memcpy (rs->allow, hv->ptr, hv->len);
+	return 0;
+}
+
+static int on_body (hio_svc_httc_req_t* req, const void* data, hio_oow_t dlen, void* ctx)
+{
+	res_t* rs = (res_t*)ctx;
+	if (rs->len + dlen >= sizeof(rs->body)) return -1;
+	memcpy (&rs->body[rs->len], data, dlen);
+	rs->len += dlen;
+	return 0;
+}
+
+static void next_step (hio_t* hio);
+
+static void on_done (hio_svc_httc_req_t* req, hio_errnum_t status, void* ctx)
+{
+	res_t* rs = (res_t*)ctx;
+	rs->status = status;
+	rs->done = 1;
+}
+
+static void on_done_step (hio_svc_httc_req_t* req, hio_errnum_t status, void* ctx)
+{
+	on_done (req, status, ctx);
+	next_step (hio_svc_httc_gethio(httc));
+}
+
+static void on_done_queued (hio_svc_httc_req_t* req, hio_errnum_t status, void* ctx)
+{
+	on_done (req, status, ctx);
+	done_order[ndone++] = (res_t*)ctx - res;
+	if (ndone == 3) next_step (hio_svc_httc_gethio(httc));
+}
+
+static int send_req (hio_http_method_t method, const hio_bch_t* path, const hio_bch_t* headers, const void* body, hio_oow_t body_len, hio_svc_httc_on_done_t done, res_t* rs)
+{
+	hio_svc_httc_reqinfo_t ri;
+	hio_svc_httc_cbs_t cbs;
+
+	memset (rs, 0, sizeof(*rs));
+	memset (&ri, 0, sizeof(ri));
+	ri.addr = srvaddr;
+	ri.method = method;
+	ri.path = path;
+	ri.headers = headers;
+	ri.content = body;
+	ri.content_len = body_len;
+
+	cbs.on_header = on_header;
+	cbs.on_body = on_body;
+	cbs.on_done = done;
+	return hio_svc_httc_sendreq(httc, &ri, &cbs, rs)? 0: -1;
+}
+
+static int send (const hio_bch_t* path, const hio_bch_t* headers, hio_svc_httc_on_done_t done, res_t* rs)
+{
+	return send_req(HIO_HTTP_GET, path, headers, HIO_NULL, 0, done, rs);
+}
+
+static int is_ok (res_t* rs, const char* body)
+{
+	return rs->done && rs->status == HIO_ENOERR && rs->status_code == 200 &&
+	       rs->len == strlen(body) && memcmp(rs->body, body, rs->len) == 0;
+}
+
+static void next_step (hio_t* hio)
+{
+	int n = 0;
+
+	switch (step++)
+	{
+		case 0:
+			accepts_base = get_accepts(hio);
+			n = send("/txt", HIO_NULL, on_done_step, &res[0]);
+			break;
+
+		case 1:
+			OK (is_ok(&res[0], "hello"), "first request");
+			n = send("/txt", HIO_NULL, on_done_step, &res[0]);
+			break;
+
+		case 2:
+			OK (is_ok(&res[0], "hello"), "second request");
+			OK (get_accepts(hio) - accepts_base == 1, "keep-alive connection reused");
+			n = send("/chunk", HIO_NULL, on_done_step, &res[0]);
+			break;
+
+		case 3:
+		{
+			hio_oow_t one = 1;
+
+			OK (is_ok(&res[0], "abcdef"), "chunked response decoded");
+
+			/* htts doesn't serve pipelined requests. with a single connection
+			 * allowed and no pipelining, the requests wait for their turn */
+			hio_svc_httc_setoption (httc, HIO_SVC_HTTC_CONN_MAX, &one);
+			hio_svc_httc_setoption (httc, HIO_SVC_HTTC_PIPELINE_MAX, &one);
+			ndone = 0;
+			n = send("/txt?1", HIO_NULL, on_done_queued, &res[0]);
+			if (n >= 0) n = send("/chunk", HIO_NULL, on_done_queued, &res[1]);
+			if (n >= 0) n = send("/txt?3", HIO_NULL, on_done_queued, &res[2]);
+			break;
+		}
+
+		case 4:
+			OK (is_ok(&res[0], "hello") && is_ok(&res[1], "abcdef") && is_ok(&res[2], "hello"), "queued requests");
+			OK (done_order[0] == 0 && done_order[1] == 1 && done_order[2] == 2, "queued responses in order");
+			OK (get_accepts(hio) - accepts_base == 1, "queued on the same connection");
+			n = send("/txt", "Connection: close\r\n", on_done_step, &res[0]);
+			break;
+
+		case 5:
+			OK (is_ok(&res[0], "hello"), "request closing connection");
+			n = send("/txt", HIO_NULL, on_done_step, &res[0]);
+			break;
+
+		case 6:
+			OK (is_ok(&res[0], "hello"), "request after connection closed");
+			OK (get_accepts(hio) - accepts_base == 2, "new connection made");
+			n = send_req(HIO_HTTP_POST, "/body", HIO_NULL, big_body, BIG_BODY_LEN, on_done_step, &res[0]);
+			break;
+
+		case 7:
+			OK (is_ok(&res[0], "intact"), "request body spilled to file intact");
+			n = send_req(HIO_HTTP_POST, "/stream", HIO_NULL, big_body, BIG_BODY_LEN, on_done_step, &res[0]);
+			break;
+
+		case 8:
+			OK (is_ok(&res[0], "streamed"), "request body streamed to function");
+			n = send("/body", HIO_NULL, on_done_step, &res[0]);
+			break;
+
+		case 9:
+			OK (is_ok(&res[0], "in memory"), "request after spilled body on the same connection");
+			n = send_req(HIO_HTTP_DELETE, "/routed", HIO_NULL, HIO_NULL, 0, on_done_step, &res[0]);
+			break;
+
+		case 10:
+			OK (res[0].done && res[0].status_code == HIO_HTTP_STATUS_METHOD_NOT_ALLOWED, "405 for a method not routed");
+			OK (strcmp(res[0].allow, "GET, POST") == 0, "Allow header with the methods routed");
+			n = send_req(HIO_HTTP_PUT, "/routed", HIO_NULL, "ignored", 7, on_done_step, &res[0]);
+			break;
+
+		case 11:
+			OK (res[0].done && res[0].status_code == HIO_HTTP_STATUS_METHOD_NOT_ALLOWED, "405 with a request body");
+			n = send("/routed", HIO_NULL, on_done_step, &res[0]);
+			break;
+
+		case 12:
+			OK (is_ok(&res[0], "routed"), "request routed after 405 on the same connection");
+			n = send("/users/10/posts/20", HIO_NULL, on_done_step, &res[0]);
+			break;
+
+		case 13:
+			OK (is_ok(&res[0], "id=10 pid=20"), "route parameters passed to the function");
+			/* the connection has served requests. a lost request would be retried on it */
+			n = send_req(HIO_HTTP_POST, "/drop", HIO_NULL, "once", 4, on_done_step, &res[0]);
+			break;
+
+		case 14:
+			OK (res[0].done && res[0].status != HIO_ENOERR, "POST failed on connection closed");
+			OK (ndrops == 1, "POST not sent again");
+			n = send("/txt", HIO_NULL, on_done_step, &res[0]);
+			break;
+
+		case 15:
+			OK (is_ok(&res[0], "hello"), "request after POST failed");
+			ndrops = 0;
+			n = send("/drop", HIO_NULL, on_done_step, &res[0]);
+			break;
+
+		case 16:
+			OK (res[0].done && res[0].status != HIO_ENOERR, "GET failed on connection closed");
+			OK (ndrops == 2, "GET sent again");
+			n = send("/slow", HIO_NULL, on_done_step, &res[0]);
+			break;
+
+		case 17:
+			OK (res[0].done && res[0].status == HIO_ETMOUT, "response timed out");
+			hio_stop (hio, HIO_STOPREQ_TERMINATION);
+			break;
+	}
+
+	if (n <= -1)
+	{
+		OK (0, "send request");
+		hio_stop (hio, HIO_STOPREQ_TERMINATION);
+	}
+}
+
+static void on_guard_timeout (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	OK (0, "test finished in time");
+	hio_stop (hio, HIO_STOPREQ_TERMINATION);
+}
+
+int main()
+{
+	hio_t* hio;
+	hio_svc_htts_t* htts;
+	hio_dev_sck_bind_t bi;
+	hio_svc_httc_tmout_t tmout;
+	hio_ntime_t t;
+	hio_oow_t ov, i;
+	hio_svc_htts_route_t route;
+
+	no_plan ();
+
+	for (i = 0; i < BIG_BODY_LEN; i++) big_body[i] = (hio_uint8_t)(i % 251);
+
+	hio = hio_open(HIO_NULL, 0, HIO_NULL, HIO_FEATURE_ALL, 512, HIO_NULL);
+	if (!hio) return -1;
+
+	memset (&bi, 0, sizeof(bi));
+	hio_bcstrtoskad (hio, "127.0.0.1:0", &bi.localaddr);
+	htts = hio_svc_htts_start(hio, 0, &bi, 1, proc_req);
+	if (!htts || hio_svc_htts_getsockaddr(htts, 0, &srvaddr) <= -1) return -1;
+
+	ov = 4096;
+	hio_svc_htts_setoption (htts, HIO_SVC_HTTS_TASK_REQ_BODY_MEM_MAX, &ov);
+
+	memset (&route, 0, sizeof(route));
+	route.type = HIO_SVC_HTTS_ROUTE_TXT;
+	route.u.txt.status_code = HIO_HTTP_STATUS_OK;
+	route.u.txt.content_type = "text/plain";
+	route.u.txt.content_text = "routed";
+	if (hio_svc_htts_addroute(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET) | HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_POST), "/routed", &route) <= -1) return -1;
+
+	memset (&route, 0, sizeof(route));
+	route.type = HIO_SVC_HTTS_ROUTE_FUN;
+	route.u.fun.func = fun_route;
+	if (hio_svc_htts_addroute(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), "/users/:id/posts/:pid", &route) <= -1) return -1;
+
+	HIO_INIT_NTIME (&tmout.c, 3, 0);
+	HIO_INIT_NTIME (&tmout.r, 1, 0);
+	HIO_INIT_NTIME (&tmout.i, 10, 0);
+	httc = hio_svc_httc_start(hio, &tmout);
+	if (!httc) return -1;
+
+	HIO_INIT_NTIME (&t, 10, 0);
+	hio_schedtmrjobafter (hio, &t, on_guard_timeout, HIO_NULL, HIO_NULL);
+
+	next_step (hio);
+	hio_loop (hio);
+
+	hio_svc_httc_stop (httc);
+	hio_svc_htts_stop (htts);
+	hio_close (hio);
+
+	return exit_status();
+}
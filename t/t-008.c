@@ -0,0 +1,315 @@
+#include <hio-http.h>
+#include <hio-sck.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include "tap.h"
+
+static hio_svc_httc_t* httc;
+static hio_skad_t srvaddr;
+static int step = 0;
+static int release_pipe[2];
+
+struct res_t
+{
+	int status_code;
+	hio_errnum_t status;
+	char body[64];
+	hio_oow_t len;
+	int nbodies;
+	int done;
+};
+typedef struct res_t res_t;
+
+static res_t res[3];
+static int ndone;
+static int nwait;
+static volatile int bad_status_rejected;
+static ino_t pipe_ino[2];
+static int npipe_jobs;
+
+static void thr_block (hio_svc_htts_t* htts, hio_dev_thr_iopair_t* iop, hio_svc_htts_thr_func_info_t* tfi, void* ctx)
+{
+	static hio_svc_htts_thr_hdr_t hdrs[] =
+	{
+		{ "Content-Type", "text/plain" }
+	};
+	char c;
+
+	/* the header tells the client that the job is running on the worker */
+	if (hio_svc_htts_thr_writereshdr(iop, HIO_HTTP_STATUS_OK, hdrs, HIO_COUNTOF(hdrs)) <= -1) return;
+	if (read(release_pipe[0], &c, 1) <= 0) return;
+	write (iop->wfd, "released", 8);
+}
+
+static void thr_stream (hio_svc_htts_t* htts, hio_dev_thr_iopair_t* iop, hio_svc_htts_thr_func_info_t* tfi, void* ctx)
+{
+	static hio_svc_htts_thr_hdr_t hdrs[] =
+	{
+		{ "Content-Type", "text/plain" },
+		{ "X-Thread", "yes" }
+	};
+	int i;
+
+	/* no Content-Length. the body is relayed to the client as it's written */
+	if (hio_svc_htts_thr_writereshdr(iop, HIO_HTTP_STATUS_OK, hdrs, HIO_COUNTOF(hdrs)) <= -1) return;
+	for (i = 1; i <= 3; i++)
+	{
+		char buf[8];
+		usleep (100000);
+		snprintf (buf, sizeof(buf), "part%d", i);
+		write (iop->wfd, buf, 5);
+	}
+}
+
+static void thr_bad_status (hio_svc_htts_t* htts, hio_dev_thr_iopair_t* iop, hio_svc_htts_thr_func_info_t* tfi, void* ctx)
+{
+	/* a frame with the status code 999 made without hio_svc_htts_thr_writereshdr() */
+	static const hio_uint8_t frame[] = { 0, 0, 0, 0, 2, 0x03, 0xE7 };
+
+	bad_status_rejected = hio_svc_htts_thr_writereshdr(iop, 999, HIO_NULL, 0) <= -1;
+	write (iop->wfd, frame, sizeof(frame));
+}
+
+static void thr_pipe (hio_svc_htts_t* htts, hio_dev_thr_iopair_t* iop, hio_svc_htts_thr_func_info_t* tfi, void* ctx)
+{
+	struct stat st;
+
+	/* remember the output pipe to tell if the next job gets the same one */
+	if (npipe_jobs < 2 && fstat(iop->wfd, &st) == 0) pipe_ino[npipe_jobs++] = st.st_ino;
+	if (hio_svc_htts_thr_writereshdr(iop, HIO_HTTP_STATUS_OK, HIO_NULL, 0) <= -1) return;
+	write (iop->wfd, "pipe", 4);
+}
+
+static void thr_route (hio_svc_htts_t* htts, hio_dev_thr_iopair_t* iop, hio_svc_htts_thr_func_info_t* tfi, void* ctx)
+{
+	const hio_bch_t* name = hio_svc_htts_thr_getrouteparam(tfi, "name");
+	const hio_bch_t* rest = hio_svc_htts_thr_getrouteparam(tfi, "rest");
+	char buf[64];
+
+	if (hio_svc_htts_thr_writereshdr(iop, HIO_HTTP_STATUS_OK, HIO_NULL, 0) <= -1) return;
+	snprintf (buf, sizeof(buf), "%s %s %d", (name? name: "-"), (rest? rest: "-"), (int)tfi->route_nparams);
+	write (iop->wfd, buf, strlen(buf));
+}
+
+static int proc_req (hio_svc_htts_t* htts, hio_dev_sck_t* csck, hio_htre_t* req)
+{
+	const hio_bch_t* qpath = hio_htre_getqpath(req);
+	int x;
+
+	x = hio_svc_htts_doroute(htts, csck, req);
+	if (x != 0) return (x <= -1)? -1: 0;
+
+	if (strcmp(qpath, "/stream") == 0) return hio_svc_htts_dothr(htts, csck, req, thr_stream, HIO_NULL, 0, HIO_NULL);
+	if (strcmp(qpath, "/pipe") == 0) return hio_svc_htts_dothr(htts, csck, req, thr_pipe, HIO_NULL, 0, HIO_NULL);
+	if (strcmp(qpath, "/badstatus") == 0) return hio_svc_htts_dothr(htts, csck, req, thr_bad_status, HIO_NULL, 0, HIO_NULL);
+	return hio_svc_htts_dothr(htts, csck, req, thr_block, HIO_NULL, 0, HIO_NULL);
+}
+
+static void release_workers (int count)
+{
+	while (count-- > 0) write (release_pipe[1], "x", 1);
+}
+
+static int on_header (hio_svc_httc_req_t* req, hio_htre_t* r, void* ctx)
+{
+	res_t* rs = (res_t*)ctx;
+	rs->status_code = hio_htre_getscodeval(r);
+	return 0;
+}
+
+static int on_body (hio_svc_httc_req_t* req, const void* data, hio_oow_t dlen, void* ctx)
+{
+	res_t* rs = (res_t*)ctx;
+	if (rs->len + dlen >= sizeof(rs->body)) return -1;
+	memcpy (&rs->body[rs->len], data, dlen);
+	rs->len += dlen;
+	rs->nbodies++;
+	return 0;
+}
+
+static void next_step (hio_t* hio);
+
+static void on_done (hio_svc_httc_req_t* req, hio_errnum_t status, void* ctx)
+{
+	res_t* rs = (res_t*)ctx;
+	rs->status = status;
+	rs->done = 1;
+	ndone++;
+
+	/* the rejected one completes while the others are held by the workers */
+	if (rs->status_code == HIO_HTTP_STATUS_SERVICE_UNAVAILABLE) release_workers (2);
+	if (ndone == nwait) next_step (hio_svc_httc_gethio(httc));
+}
+
+static int send (const hio_bch_t* path, res_t* rs, hio_svc_httc_on_header_t hdr)
+{
+	hio_svc_httc_reqinfo_t ri;
+	hio_svc_httc_cbs_t cbs;
+
+	memset (rs, 0, sizeof(*rs));
+	memset (&ri, 0, sizeof(ri));
+	ri.addr = srvaddr;
+	ri.method = HIO_HTTP_GET;
+	ri.path = path;
+
+	cbs.on_header = hdr;
+	cbs.on_body = on_body;
+	cbs.on_done = on_done;
+	return hio_svc_httc_sendreq(httc, &ri, &cbs, rs)? 0: -1;
+}
+
+static int on_header_first (hio_svc_httc_req_t* req, hio_htre_t* r, void* ctx)
+{
+	on_header (req, r, ctx);
+
+	/* the only worker is busy with the first job. the second job waits
+	 * in the queue and the third is rejected as the queue is full */
+	if (send("/block?2", &res[1], on_header) <= -1 || send("/block?3", &res[2], on_header) <= -1)
+	{
+		OK (0, "send request");
+		release_workers (3);
+	}
+	return 0;
+}
+
+static int is_released (res_t* rs)
+{
+	return rs->done && rs->status == HIO_ENOERR && rs->status_code == HIO_HTTP_STATUS_OK &&
+	       rs->len == 8 && memcmp(rs->body, "released", 8) == 0;
+}
+
+static void next_step (hio_t* hio)
+{
+	int n = 0;
+
+	switch (step++)
+	{
+		case 0:
+			ndone = 0;
+			nwait = 3;
+			n = send("/block?1", &res[0], on_header_first);
+			break;
+
+		case 1:
+		{
+			int nok = 0, nbusy = 0, i;
+			for (i = 0; i < 3; i++)
+			{
+				if (is_released(&res[i])) nok++;
+				else if (res[i].done && res[i].status_code == HIO_HTTP_STATUS_SERVICE_UNAVAILABLE) nbusy++;
+			}
+			OK (is_released(&res[0]), "running job completed");
+			OK (nok == 2, "queued job completed");
+			OK (nbusy == 1, "503 beyond the queue limit");
+
+			ndone = 0;
+			nwait = 1;
+			n = send("/stream", &res[0], on_header);
+			break;
+		}
+
+		case 2:
+			OK (res[0].done && res[0].status == HIO_ENOERR && res[0].status_code == HIO_HTTP_STATUS_OK &&
+			    res[0].len == 15 && memcmp(res[0].body, "part1part2part3", 15) == 0, "streamed response");
+			OK (res[0].nbodies >= 2, "body relayed as written");
+
+			ndone = 0;
+			n = send("/badstatus", &res[0], on_header);
+			break;
+
+		case 3:
+			OK (bad_status_rejected, "bad status code rejected by the writer");
+			OK (res[0].done && res[0].status_code == HIO_HTTP_STATUS_BAD_GATEWAY, "bad status code in the frame");
+
+			ndone = 0;
+			n = send("/pipe", &res[0], on_header);
+			break;
+
+		case 4:
+			OK (res[0].done && res[0].status_code == HIO_HTTP_STATUS_OK && res[0].len == 4 && memcmp(res[0].body, "pipe", 4) == 0, "job on a pooled pipe");
+
+			ndone = 0;
+			n = send("/pipe", &res[0], on_header);
+			break;
+
+		case 5:
+			OK (res[0].done && res[0].status_code == HIO_HTTP_STATUS_OK && res[0].len == 4 && memcmp(res[0].body, "pipe", 4) == 0, "job on a reused pipe");
+			OK (npipe_jobs == 2 && pipe_ino[0] == pipe_ino[1], "output pipe reused by the next job");
+
+			ndone = 0;
+			n = send("/thr/abc/x/y.txt", &res[0], on_header);
+			break;
+
+		case 6:
+			OK (res[0].done && res[0].status_code == HIO_HTTP_STATUS_OK && res[0].len == 13 && memcmp(res[0].body, "abc x/y.txt 2", 13) == 0, "route parameters passed to the thread");
+			hio_stop (hio, HIO_STOPREQ_TERMINATION);
+			break;
+	}
+
+	if (n <= -1)
+	{
+		OK (0, "send request");
+		hio_stop (hio, HIO_STOPREQ_TERMINATION);
+	}
+}
+
+static void on_guard_timeout (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	OK (0, "test finished in time");
+	hio_stop (hio, HIO_STOPREQ_TERMINATION);
+}
+
+int main()
+{
+	hio_t* hio;
+	hio_svc_htts_t* htts;
+	hio_dev_sck_bind_t bi;
+	hio_svc_httc_tmout_t tmout;
+	hio_ntime_t t;
+	hio_oow_t ov;
+	hio_svc_htts_route_t route;
+
+	no_plan ();
+
+	if (pipe(release_pipe) <= -1) return -1;
+
+	hio = hio_open(HIO_NULL, 0, HIO_NULL, HIO_FEATURE_ALL, 512, HIO_NULL);
+	if (!hio) return -1;
+
+	memset (&bi, 0, sizeof(bi));
+	hio_bcstrtoskad (hio, "127.0.0.1:0", &bi.localaddr);
+	htts = hio_svc_htts_start(hio, 0, &bi, 1, proc_req);
+	if (!htts || hio_svc_htts_getsockaddr(htts, 0, &srvaddr) <= -1) return -1;
+
+	/* a single worker with a single slot in the queue */
+	ov = 1;
+	hio_svc_htts_setoption (htts, HIO_SVC_HTTS_TASK_THR_MAX, &ov);
+	hio_svc_htts_setoption (htts, HIO_SVC_HTTS_TASK_THR_QUEUE_MAX, &ov);
+
+	memset (&route, 0, sizeof(route));
+	route.type = HIO_SVC_HTTS_ROUTE_THR;
+	route.u.thr.func = thr_route;
+	if (hio_svc_htts_addroute(htts, HIO_SVC_HTTS_ROUTE_METHOD(HIO_HTTP_GET), "/thr/:name/*rest", &route) <= -1) return -1;
+
+	HIO_INIT_NTIME (&tmout.c, 3, 0);
+	HIO_INIT_NTIME (&tmout.r, 5, 0);
+	HIO_INIT_NTIME (&tmout.i, 10, 0);
+	httc = hio_svc_httc_start(hio, &tmout);
+	if (!httc) return -1;
+
+	HIO_INIT_NTIME (&t, 10, 0);
+	hio_schedtmrjobafter (hio, &t, on_guard_timeout, HIO_NULL, HIO_NULL);
+
+	next_step (hio);
+	hio_loop (hio);
+
+	/* let the workers blocked go before the pool is closed */
+	release_workers (3);
+	hio_svc_httc_stop (httc);
+	hio_svc_htts_stop (htts);
+	hio_close (hio);
+
+	return exit_status();
+}
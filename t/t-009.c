@@ -0,0 +1,750 @@
+#include <hio-fcgi.h>
+#include <hio-sck.h>
+#include <string.h>
+#include <stdio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "tap.h"
+
+/* ------------------------------------------------------------------------
+ * a minimal fastcgi responder running on the same loop as the client
+ * ------------------------------------------------------------------------ */
+
+enum rsp_mode_t
+{
+	RSP_ECHO, /* respond as soon as the request is complete */
+	RSP_MPX,  /* respond when three requests are complete, the last first */
+	RSP_NO_MPX, /* reject a request begun while another is in progress */
+	RSP_HOLD, /* don't respond. end the request when aborted */
+	RSP_SPLIT /* send the response in two writes split at rsp_split. a byte at a time if 0 */
+};
+
+#define RSP_PEND_MAX 8
+
+struct rsp_xtn_t
+{
+	hio_oow_t len;
+	hio_uint8_t buf[1024];
+
+	hio_uint16_t pend[RSP_PEND_MAX]; /* requests in progress */
+	int npend;
+	hio_uint16_t done[RSP_PEND_MAX]; /* requests waiting for a response */
+	int ndone;
+	hio_uint16_t rejected;
+
+	hio_uint8_t out[128]; /* response being sent in pieces */
+	hio_oow_t outlen;
+	hio_oow_t outoff;
+};
+typedef struct rsp_xtn_t rsp_xtn_t;
+
+static hio_t* hio;
+static hio_svc_fcgic_t* fcgic;
+static hio_skad_t rspaddr;
+static int rsp_mode = RSP_ECHO;
+static hio_oow_t rsp_accepts;
+static int rsp_max_conc; /* the most requests in progress on a connection */
+static int rsp_naborts;
+static hio_oow_t rsp_split;
+static hio_oow_t rsp_outlen; /* length of the last response */
+static int step = 0;
+
+static void next_step (void);
+
+static hio_oow_t rsp_make_record (hio_uint8_t* rec, int type, hio_uint16_t id, const void* data, hio_uint16_t len, hio_uint8_t padding_len)
+{
+	hio_fcgi_record_header_t* h = (hio_fcgi_record_header_t*)rec;
+
+	h->version = HIO_FCGI_VERSION;
+	h->type = type;
+	h->id = hio_hton16(id);
+	h->content_len = hio_hton16(len);
+	h->padding_len = padding_len;
+	h->reserved = 0;
+	if (len > 0) memcpy (h + 1, data, len);
+	memset (rec + HIO_SIZEOF(*h) + len, 0, padding_len);
+	return HIO_SIZEOF(*h) + len + padding_len;
+}
+
+static hio_oow_t rsp_make_end_request (hio_uint8_t* rec, hio_uint16_t id, int proto_status, hio_uint8_t padding_len)
+{
+	hio_fcgi_end_request_body_t erb;
+
+	memset (&erb, 0, sizeof(erb));
+	erb.proto_status = proto_status;
+	return rsp_make_record(rec, HIO_FCGI_END_REQUEST, id, &erb, sizeof(erb), padding_len);
+}
+
+static void rsp_end_request (hio_dev_sck_t* sck, hio_uint16_t id, int proto_status)
+{
+	hio_uint8_t rec[32];
+	hio_dev_sck_write (sck, rec, rsp_make_end_request(rec, id, proto_status, 0), HIO_NULL, HIO_NULL);
+}
+
+static hio_oow_t rsp_make_response (hio_uint8_t* buf, hio_uint16_t id)
+{
+	/* the output with padding, the end of the output and the end of the request with padding */
+	char out[32];
+	int len;
+	hio_oow_t pos;
+
+	len = snprintf(out, sizeof(out), "id=%u", (unsigned int)id);
+	pos = rsp_make_record(buf, HIO_FCGI_STDOUT, id, out, len, 3);
+	pos += rsp_make_record(&buf[pos], HIO_FCGI_STDOUT, id, HIO_NULL, 0, 0);
+	pos += rsp_make_end_request(&buf[pos], id, HIO_FCGI_REQUEST_COMPLETE, 5);
+	return pos;
+}
+
+static void rsp_respond (hio_dev_sck_t* sck, hio_uint16_t id)
+{
+	hio_uint8_t buf[128];
+	hio_dev_sck_write (sck, buf, rsp_make_response(buf, id), HIO_NULL, HIO_NULL);
+}
+
+static void on_send_rest (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	hio_dev_sck_t* sck = (hio_dev_sck_t*)job->ctx;
+	rsp_xtn_t* rx = (rsp_xtn_t*)hio_dev_sck_getxtn(sck);
+	hio_oow_t len;
+
+	len = (rsp_split == 0)? 1: (rx->outlen - rx->outoff);
+	hio_dev_sck_write (sck, &rx->out[rx->outoff], len, HIO_NULL, HIO_NULL);
+	rx->outoff += len;
+
+	if (rx->outoff < rx->outlen)
+	{
+		hio_ntime_t t;
+		HIO_INIT_NTIME (&t, 0, 2000000);
+		hio_schedtmrjobafter (hio, &t, on_send_rest, HIO_NULL, sck);
+	}
+}
+
+static void rsp_respond_split (hio_dev_sck_t* sck, hio_uint16_t id)
+{
+	/* the client gets the first piece alone as the rest follows later */
+	rsp_xtn_t* rx = (rsp_xtn_t*)hio_dev_sck_getxtn(sck);
+	hio_ntime_t t;
+
+	rx->outlen = rsp_make_response(rx->out, id);
+	rx->outoff = (rsp_split == 0)? 1: rsp_split;
+	rsp_outlen = rx->outlen;
+	hio_dev_sck_write (sck, rx->out, rx->outoff, HIO_NULL, HIO_NULL);
+
+	HIO_INIT_NTIME (&t, 0, 10000000);
+	hio_schedtmrjobafter (hio, &t, on_send_rest, HIO_NULL, sck);
+}
+
+static int rsp_remove (hio_uint16_t* ids, int* count, hio_uint16_t id)
+{
+	int i;
+	for (i = 0; i < *count; i++)
+	{
+		if (ids[i] == id)
+		{
+			ids[i] = ids[--*count];
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void on_aborted (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	next_step ();
+}
+
+static void on_respond_later (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	hio_dev_sck_t* sck = (hio_dev_sck_t*)job->ctx;
+	rsp_xtn_t* rx = (rsp_xtn_t*)hio_dev_sck_getxtn(sck);
+
+	while (rx->ndone > 0)
+	{
+		hio_uint16_t id = rx->done[--rx->ndone];
+		rsp_remove (rx->pend, &rx->npend, id);
+		rsp_respond (sck, id);
+	}
+}
+
+static void rsp_handle_record (hio_dev_sck_t* sck, const hio_fcgi_record_header_t* h)
+{
+	rsp_xtn_t* rx = (rsp_xtn_t*)hio_dev_sck_getxtn(sck);
+	hio_uint16_t id = hio_ntoh16(h->id);
+
+	switch (h->type)
+	{
+		case HIO_FCGI_BEGIN_REQUEST:
+			if (rsp_mode == RSP_NO_MPX && rx->npend > 0)
+			{
+				rx->rejected = id;
+				rsp_end_request (sck, id, HIO_FCGI_CANT_MPX_CONN);
+				break;
+			}
+			if (rx->npend < RSP_PEND_MAX) rx->pend[rx->npend++] = id;
+			if (rx->npend > rsp_max_conc) rsp_max_conc = rx->npend;
+			break;
+
+		case HIO_FCGI_STDIN:
+			if (h->content_len != 0 || id == rx->rejected) break;
+
+			/* the request is complete */
+			if (rsp_mode == RSP_MPX)
+			{
+				rx->done[rx->ndone++] = id;
+				if (rx->ndone == 3)
+				{
+					while (rx->ndone > 0)
+					{
+						id = rx->done[--rx->ndone];
+						rsp_remove (rx->pend, &rx->npend, id);
+						rsp_respond (sck, id);
+					}
+				}
+			}
+			else if (rsp_mode == RSP_NO_MPX)
+			{
+				/* respond a bit later so that the next request can begin in the meantime */
+				hio_ntime_t t;
+
+				rx->done[rx->ndone++] = id;
+				HIO_INIT_NTIME (&t, 0, 50000000);
+				hio_schedtmrjobafter (hio, &t, on_respond_later, HIO_NULL, sck);
+			}
+			else if (rsp_mode == RSP_HOLD)
+			{
+				next_step ();
+			}
+			else if (rsp_mode == RSP_SPLIT)
+			{
+				rsp_remove (rx->pend, &rx->npend, id);
+				rsp_respond_split (sck, id);
+			}
+			else
+			{
+				rsp_remove (rx->pend, &rx->npend, id);
+				rsp_respond (sck, id);
+			}
+			break;
+
+		case HIO_FCGI_ABORT_REQUEST:
+			if (rsp_remove(rx->pend, &rx->npend, id))
+			{
+				hio_ntime_t t;
+
+				rsp_naborts++;
+				rsp_end_request (sck, id, HIO_FCGI_REQUEST_COMPLETE);
+
+				/* give the client time to see the end of the aborted request */
+				HIO_INIT_NTIME (&t, 0, 100000000);
+				hio_schedtmrjobafter (hio, &t, on_aborted, HIO_NULL, HIO_NULL);
+			}
+			break;
+	}
+}
+
+static int rsp_on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t dlen, const hio_skad_t* srcaddr)
+{
+	rsp_xtn_t* rx = (rsp_xtn_t*)hio_dev_sck_getxtn(sck);
+
+	if (dlen <= 0)
+	{
+		hio_dev_sck_halt (sck);
+		return 0;
+	}
+
+	if (rx->len + dlen > sizeof(rx->buf))
+	{
+		OK (0, "responder buffer large enough");
+		hio_dev_sck_halt (sck);
+		return 0;
+	}
+	memcpy (&rx->buf[rx->len], data, dlen);
+	rx->len += dlen;
+
+	while (rx->len >= HIO_SIZEOF(hio_fcgi_record_header_t))
+	{
+		hio_fcgi_record_header_t h;
+		hio_oow_t reclen;
+
+		memcpy (&h, rx->buf, HIO_SIZEOF(h));
+		reclen = HIO_SIZEOF(h) + hio_ntoh16(h.content_len) + h.padding_len;
+		if (rx->len < reclen) break;
+
+		rsp_handle_record (sck, (hio_fcgi_record_header_t*)rx->buf);
+		memmove (rx->buf, &rx->buf[reclen], rx->len - reclen);
+		rx->len -= reclen;
+	}
+
+	return 0;
+}
+
+static int rsp_on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrctx, const hio_skad_t* dstaddr)
+{
+	return 0;
+}
+
+static void rsp_on_connect (hio_dev_sck_t* sck)
+{
+	if (sck->state & HIO_DEV_SCK_ACCEPTED)
+	{
+		int on = 1;
+
+		/* the extension area came from the listening socket */
+		memset (hio_dev_sck_getxtn(sck), 0, sizeof(rsp_xtn_t));
+		rsp_accepts++;
+
+		/* send small pieces as they are written */
+		setsockopt (sck->hnd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	}
+}
+
+static void rsp_on_disconnect (hio_dev_sck_t* sck)
+{
+}
+
+static hio_dev_sck_t* start_responder (const hio_skad_t* bindaddr, hio_skad_t* addr)
+{
+	hio_dev_sck_make_t mi;
+	hio_dev_sck_bind_t bi;
+	hio_dev_sck_listen_t li;
+	hio_dev_sck_t* sck;
+
+	memset (&mi, 0, sizeof(mi));
+	mi.type = HIO_DEV_SCK_TCP4;
+	mi.options = HIO_DEV_SCK_MAKE_LENIENT;
+	mi.on_write = rsp_on_write;
+	mi.on_read = rsp_on_read;
+	mi.on_connect = rsp_on_connect;
+	mi.on_disconnect = rsp_on_disconnect;
+	sck = hio_dev_sck_make(hio, sizeof(rsp_xtn_t), &mi);
+	if (!sck) return HIO_NULL;
+
+	memset (&bi, 0, sizeof(bi));
+	if (bindaddr) bi.localaddr = *bindaddr;
+	else hio_bcstrtoskad (hio, "127.0.0.1:0", &bi.localaddr);
+	memset (&li, 0, sizeof(li));
+	li.backlogs = 16;
+	if (hio_dev_sck_bind(sck, &bi) <= -1 || hio_dev_sck_listen(sck, &li) <= -1 ||
+	    hio_dev_sck_getsockaddr(sck, addr) <= -1)
+	{
+		hio_dev_sck_kill (sck);
+		return HIO_NULL;
+	}
+
+	return sck;
+}
+
+/* ------------------------------------------------------------------------
+ * client
+ * ------------------------------------------------------------------------ */
+
+struct req_t
+{
+	hio_svc_fcgic_sess_t* sess;
+	hio_oow_t sid;
+	char out[64];
+	hio_oow_t len;
+	int ended;
+	int proto_status;
+};
+typedef struct req_t req_t;
+
+static req_t req[8];
+static int nwait;
+
+static hio_svc_fcgic_server_t srv[2];
+static hio_svc_fcgic_upstream_t* ups;
+static hio_oow_t ups_nreqs[2];
+
+static int on_read (hio_svc_fcgic_sess_t* sess, const void* data, hio_iolen_t dlen, void* ctx)
+{
+	req_t* rq = (req_t*)ctx;
+
+	if (dlen > 0)
+	{
+		if (rq->len + dlen > sizeof(rq->out)) return -1;
+		memcpy (&rq->out[rq->len], data, dlen);
+		rq->len += dlen;
+		return 0;
+	}
+
+	/* the end of the request */
+	rq->proto_status = ((const hio_fcgi_end_request_body_t*)data)->proto_status;
+	rq->ended = 1;
+	rq->sess = HIO_NULL;
+	hio_svc_fcgic_untie (sess);
+
+	if (--nwait == 0) next_step ();
+	return 0;
+}
+
+static int on_write (hio_svc_fcgic_sess_t* sess, hio_fcgi_req_type_t rqtype, hio_iolen_t wrlen, void* ctx)
+{
+	return 0;
+}
+
+static void on_untie (hio_svc_fcgic_sess_t* sess, void* ctx)
+{
+	((req_t*)ctx)->sess = HIO_NULL;
+}
+
+static int tie (req_t* rq)
+{
+	memset (rq, 0, sizeof(*rq));
+	rq->sess = ups? hio_svc_fcgic_tieupstream(ups, on_read, on_write, on_untie, rq):
+	                hio_svc_fcgic_tie(fcgic, &rspaddr, on_read, on_write, on_untie, rq);
+	if (!rq->sess) return -1;
+	rq->sid = rq->sess->sid;
+	return 0;
+}
+
+static int tied_server (void)
+{
+	/* tell the server chosen for the last session from the request counts */
+	hio_svc_fcgic_server_stat_t st;
+	int i, idx = -1;
+
+	for (i = 0; i < 2; i++)
+	{
+		hio_svc_fcgic_getupstreamstat (ups, i, &st);
+		if (st.nreqs != ups_nreqs[i]) idx = i;
+		ups_nreqs[i] = st.nreqs;
+	}
+	return idx;
+}
+
+static int tie_many (int count, char* order, int keep)
+{
+	/* tie sessions via the upstream and record the servers chosen as A and B */
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (tie(&req[i]) <= -1) return -1;
+		order[i] = 'A' + tied_server();
+		if (!keep) hio_svc_fcgic_untie (req[i].sess);
+	}
+	order[i] = '\0';
+	return 0;
+}
+
+static hio_svc_fcgic_upstream_t* open_upstream (hio_svc_fcgic_lb_t lb, hio_oow_t wa, hio_oow_t wb)
+{
+	hio_svc_fcgic_upstream_cfg_t cfg;
+
+	if (ups) hio_svc_fcgic_closeupstream (ups);
+	memset (&cfg, 0, sizeof(cfg));
+	cfg.lb = lb;
+	srv[0].weight = wa;
+	srv[1].weight = wb;
+	ups = hio_svc_fcgic_openupstream(fcgic, srv, 2, &cfg);
+	ups_nreqs[0] = ups_nreqs[1] = 0;
+	return ups;
+}
+
+static hio_oow_t get_nreqs (int idx)
+{
+	hio_svc_fcgic_server_stat_t st;
+	return (hio_svc_fcgic_getupstreamstat(ups, idx, &st) >= 0)? st.nreqs: 0;
+}
+
+static int is_down (int idx)
+{
+	hio_svc_fcgic_server_stat_t st;
+	return hio_svc_fcgic_getupstreamstat(ups, idx, &st) >= 0 && st.down;
+}
+
+static hio_oow_t get_nfails (int idx)
+{
+	hio_svc_fcgic_server_stat_t st;
+	return (hio_svc_fcgic_getupstreamstat(ups, idx, &st) >= 0)? st.nfails: (hio_oow_t)-1;
+}
+
+static void on_wait_done (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	next_step ();
+}
+
+static int wait_ms (int ms)
+{
+	hio_ntime_t t;
+	HIO_INIT_NTIME (&t, ms / 1000, (ms % 1000) * 1000000);
+	return hio_schedtmrjobafter(hio, &t, on_wait_done, HIO_NULL, HIO_NULL);
+}
+
+static int send_request (req_t* rq)
+{
+	if (tie(rq) <= -1) return -1;
+	if (hio_svc_fcgic_beginrequest(rq->sess) <= -1 ||
+	    hio_svc_fcgic_writeparam(rq->sess, "SCRIPT_NAME", 11, "/t", 2) <= -1 ||
+	    hio_svc_fcgic_writeparam(rq->sess, HIO_NULL, 0, HIO_NULL, 0) <= -1 ||
+	    hio_svc_fcgic_writestdin(rq->sess, HIO_NULL, 0) <= -1) return -1;
+	nwait++;
+	return 0;
+}
+
+static int is_ok (req_t* rq)
+{
+	char out[32];
+	int len;
+
+	len = snprintf(out, sizeof(out), "id=%u", (unsigned int)(rq->sid + 1));
+	return rq->ended && rq->proto_status == HIO_FCGI_REQUEST_COMPLETE && rq->len == len && memcmp(rq->out, out, len) == 0;
+}
+
+static void set_conn_max (hio_oow_t v)
+{
+	hio_svc_fcgic_setoption (fcgic, HIO_SVC_FCGIC_CONN_MAX, &v);
+}
+
+static void next_step (void)
+{
+	static hio_oow_t nsplit_ok;
+	int n = 0;
+
+	switch (step++)
+	{
+		case 0:
+			/* three requests over a single connection answered out of order */
+			set_conn_max (1);
+			rsp_mode = RSP_MPX;
+			n = send_request(&req[0]);
+			if (n >= 0) n = send_request(&req[1]);
+			if (n >= 0) n = send_request(&req[2]);
+			break;
+
+		case 1:
+			OK (is_ok(&req[0]) && is_ok(&req[1]) && is_ok(&req[2]), "multiplexed requests");
+			OK (req[0].sid != req[1].sid && req[1].sid != req[2].sid && req[0].sid != req[2].sid, "distinct request ids");
+			OK (rsp_accepts == 1 && rsp_max_conc == 3, "requests multiplexed over a connection");
+
+			/* the responder holds the request until it's aborted */
+			rsp_mode = RSP_HOLD;
+			n = send_request(&req[0]);
+			break;
+
+		case 2:
+			/* the responder got the whole request */
+			hio_svc_fcgic_untie (req[0].sess);
+			nwait--;
+
+			/* the id of the aborted request can't be reused until the responder ends it */
+			n = tie(&req[1]);
+			if (n >= 0)
+			{
+				OK (req[1].sid != req[0].sid, "aborted request id not reused before its end");
+				hio_svc_fcgic_untie (req[1].sess);
+			}
+			break;
+
+		case 3:
+			/* the responder ended the aborted request */
+			OK (rsp_naborts == 1, "request aborted");
+			n = tie(&req[1]);
+			if (n >= 0)
+			{
+				OK (req[1].sid == req[0].sid, "aborted request id reused after its end");
+				hio_svc_fcgic_untie (req[1].sess);
+			}
+			OK (rsp_accepts == 1, "connection kept after abort");
+
+			/* the responder can't multiplex. the second request is rejected */
+			rsp_mode = RSP_NO_MPX;
+			n = send_request(&req[0]);
+			if (n >= 0) n = send_request(&req[1]);
+			break;
+
+		case 4:
+			OK (is_ok(&req[0]), "first request on a connection not multiplexing");
+			OK (req[1].ended && req[1].proto_status == HIO_FCGI_CANT_MPX_CONN, "second request rejected");
+
+			/* a single request goes over a connection from now on. the limit
+			 * of one connection leaves no room for the second request */
+			n = send_request(&req[0]);
+			if (n >= 0)
+			{
+				OK (send_request(&req[1]) <= -1, "no multiplexing after rejection");
+				set_conn_max (2);
+				n = send_request(&req[1]);
+			}
+			break;
+
+		case 5:
+		{
+			char order[16];
+
+			OK (is_ok(&req[0]) && is_ok(&req[1]), "requests over separate connections");
+			OK (rsp_accepts == 2, "new connection made for the second request");
+
+			rsp_mode = RSP_ECHO;
+			if (!start_responder(HIO_NULL, &srv[0].addr) || !start_responder(HIO_NULL, &srv[1].addr) ||
+			    !open_upstream(HIO_SVC_FCGIC_LB_ROUND_ROBIN, 3, 1))
+			{
+				n = -1;
+				break;
+			}
+
+			/* smooth weighted round robin spreads the heavier server out */
+			n = tie_many(8, order, 0);
+			if (n <= -1) break;
+			OK (strcmp(order, "AABAAABA") == 0, "weighted round robin order");
+
+			/* the fewest outstanding requests relative to the weight */
+			if (!open_upstream(HIO_SVC_FCGIC_LB_LEAST_OUTSTANDING, 2, 1))
+			{
+				n = -1;
+				break;
+			}
+			n = tie_many(6, order, 1);
+			if (n <= -1) break;
+			OK (strcmp(order, "ABAABA") == 0, "least outstanding order");
+
+			/* the server with the sessions gone gets the next one */
+			hio_svc_fcgic_untie (req[0].sess);
+			hio_svc_fcgic_untie (req[2].sess);
+			hio_svc_fcgic_untie (req[3].sess);
+			hio_svc_fcgic_untie (req[5].sess);
+			n = tie_many(1, order, 0);
+			if (n <= -1) break;
+			OK (order[0] == 'A', "least outstanding after completion");
+			hio_svc_fcgic_untie (req[1].sess);
+			hio_svc_fcgic_untie (req[4].sess);
+
+			/* replace the first server with an address nothing listens on */
+			{
+				hio_dev_sck_t* lsck;
+				hio_ntime_t t;
+
+				lsck = start_responder(HIO_NULL, &srv[0].addr);
+				if (!lsck)
+				{
+					n = -1;
+					break;
+				}
+				hio_dev_sck_kill (lsck);
+
+				HIO_INIT_NTIME (&t, 0, 500000000);
+				hio_svc_fcgic_setoption (fcgic, HIO_SVC_FCGIC_FAIL_TIMEOUT, &t);
+			}
+			if (!open_upstream(HIO_SVC_FCGIC_LB_ROUND_ROBIN, 1, 1))
+			{
+				n = -1;
+				break;
+			}
+
+			/* the session goes away when the connection fails. if connect()
+			 * fails at once, the session is tied to the other server instead */
+			n = tie(&req[0]);
+			if (n <= -1) break;
+			if (tied_server() == 1) hio_svc_fcgic_untie (req[0].sess);
+			n = wait_ms(100);
+			break;
+		}
+
+		case 6:
+		{
+			char order[16];
+
+			OK (req[0].sess == HIO_NULL, "session gone with the failed connection");
+			OK (is_down(0) && get_nfails(0) == 1, "server marked down");
+
+			n = tie_many(3, order, 0);
+			if (n <= -1) break;
+			OK (strcmp(order, "BBB") == 0, "server down skipped");
+
+			/* the server comes back. it's tried again after the fail timeout */
+			if (!start_responder(&srv[0].addr, &srv[0].addr))
+			{
+				n = -1;
+				break;
+			}
+			n = wait_ms(600);
+			break;
+		}
+
+		case 7:
+			OK (!is_down(0) && get_nfails(0) == 1, "server up after the fail timeout");
+			ups_nreqs[0] = get_nreqs(0);
+			ups_nreqs[1] = get_nreqs(1);
+			n = send_request(&req[0]);
+			if (n >= 0) n = send_request(&req[1]);
+			break;
+
+		case 8:
+			OK (is_ok(&req[0]) && is_ok(&req[1]), "requests after recovery");
+			OK (get_nreqs(0) == ups_nreqs[0] + 1 && get_nreqs(1) == ups_nreqs[1] + 1, "recovered server chosen again");
+			OK (get_nfails(0) == 0, "failure count reset by a completed request");
+
+			/* the response split at every position including the inside
+			 * of a record header and of the padding */
+			hio_svc_fcgic_closeupstream (ups);
+			ups = HIO_NULL;
+			rsp_mode = RSP_SPLIT;
+			rsp_split = 1;
+			nsplit_ok = 0;
+			n = send_request(&req[0]);
+			break;
+
+		case 9:
+			if (is_ok(&req[0])) nsplit_ok++;
+			if (rsp_split + 1 < rsp_outlen)
+			{
+				rsp_split++;
+				step--;
+				n = send_request(&req[0]);
+				break;
+			}
+			OK (nsplit_ok == rsp_outlen - 1, "response split at every byte");
+
+			rsp_split = 0;
+			n = send_request(&req[0]);
+			break;
+
+		case 10:
+			OK (is_ok(&req[0]), "response sent a byte at a time");
+			hio_stop (hio, HIO_STOPREQ_TERMINATION);
+			break;
+	}
+
+	if (n <= -1)
+	{
+		OK (0, "send request");
+		hio_stop (hio, HIO_STOPREQ_TERMINATION);
+	}
+}
+
+static void on_guard_timeout (hio_t* hio, const hio_ntime_t* now, hio_tmrjob_t* job)
+{
+	OK (0, "test finished in time");
+	hio_stop (hio, HIO_STOPREQ_TERMINATION);
+}
+
+int main()
+{
+	hio_svc_fcgic_tmout_t tmout;
+	hio_ntime_t t;
+
+	no_plan ();
+
+	hio = hio_open(HIO_NULL, 0, HIO_NULL, HIO_FEATURE_ALL, 512, HIO_NULL);
+	if (!hio) return -1;
+
+	if (!start_responder(HIO_NULL, &rspaddr)) return -1;
+
+	HIO_INIT_NTIME (&tmout.c, 3, 0);
+	HIO_INIT_NTIME (&tmout.r, 5, 0);
+	HIO_INIT_NTIME (&tmout.w, 5, 0);
+	fcgic = hio_svc_fcgic_start(hio, &tmout);
+	if (!fcgic) return -1;
+
+	HIO_INIT_NTIME (&t, 10, 0);
+	hio_schedtmrjobafter (hio, &t, on_guard_timeout, HIO_NULL, HIO_NULL);
+
+	next_step ();
+	hio_loop (hio);
+
+	hio_svc_fcgic_stop (fcgic);
+	hio_close (hio);
+
+	return exit_status();
+}
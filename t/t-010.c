@@ -0,0 +1,103 @@
+#include <hio-pro.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "tap.h"
+
+struct out_t
+{
+	char buf[1024];
+	hio_oow_t len;
+	int eof;
+};
+typedef struct out_t out_t;
+
+static out_t out;
+
+static int pro_on_read (hio_dev_pro_t* dev, hio_dev_pro_sid_t sid, const void* data, hio_iolen_t dlen)
+{
+	if (dlen <= 0)
+	{
+		hio_dev_pro_kill (dev);
+		return 0;
+	}
+
+	if (out.len + dlen < sizeof(out.buf))
+	{
+		memcpy (&out.buf[out.len], data, dlen);
+		out.len += dlen;
+	}
+	return 0;
+}
+
+static int pro_on_write (hio_dev_pro_t* dev, hio_iolen_t wrlen, void* wrctx)
+{
+	return 0;
+}
+
+static void pro_on_close (hio_dev_pro_t* dev, hio_dev_pro_sid_t sid)
+{
+	/* the output may end with a hangup without a read of zero bytes */
+	if (sid == HIO_DEV_PRO_OUT) out.eof = 1;
+	else if (sid == HIO_DEV_PRO_MASTER) hio_stop (hio_dev_pro_gethio(dev), HIO_STOPREQ_TERMINATION);
+}
+
+static hio_dev_pro_t* run (hio_t* hio, const char* cmd, int flags)
+{
+	hio_dev_pro_make_t mi;
+
+	memset (&out, 0, sizeof(out));
+	memset (&mi, 0, sizeof(mi));
+	mi.flags = HIO_DEV_PRO_READOUT | HIO_DEV_PRO_INTONUL | HIO_DEV_PRO_ERRTONUL | flags;
+	mi.cmd = cmd;
+	mi.on_read = pro_on_read;
+	mi.on_write = pro_on_write;
+	mi.on_close = pro_on_close;
+	return hio_dev_pro_make(hio, 0, &mi);
+}
+
+int main()
+{
+	hio_t* hio;
+	hio_dev_pro_t* pro;
+	char fdname[32];
+	int fd, status;
+	pid_t pid;
+
+	no_plan ();
+
+	hio = hio_open(HIO_NULL, 0, HIO_NULL, HIO_FEATURE_ALL, 512, HIO_NULL);
+	if (!hio) return -1;
+
+	/* a descriptor without close-on-exec must not reach the child */
+	fd = open("/dev/null", O_RDONLY);
+	if (fd <= -1 || dup2(fd, 100) <= -1) return -1;
+	close (fd);
+	snprintf (fdname, sizeof(fdname), "\n%d\n", 100);
+
+	pro = run(hio, "/bin/echo hello", 0);
+	OK (pro != HIO_NULL, "process started");
+	if (pro) hio_loop (hio);
+	OK (out.eof && out.len == 6 && memcmp(out.buf, "hello\n", 6) == 0, "output of the child read");
+
+	pro = run(hio, "ls -1 /proc/self/fd", HIO_DEV_PRO_SHELL);
+	if (pro) hio_loop (hio);
+	out.buf[out.len] = '\0';
+	OK (out.eof && out.len > 0 && !strstr(out.buf, fdname), "inherited descriptor closed in the child");
+
+	/* the device doesn't reap the child with HIO_DEV_PRO_FORGET_CHILD */
+	pro = run(hio, "/nonexistent/command", HIO_DEV_PRO_FORGET_CHILD);
+	OK (pro != HIO_NULL, "process made for a command that can't be executed");
+	if (pro)
+	{
+		pid = pro->child_pid;
+		hio_loop (hio);
+		OK (waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 128, "child exited with 128");
+	}
+
+	close (100);
+	hio_close (hio);
+	return exit_status();
+}
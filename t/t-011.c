@@ -0,0 +1,134 @@
+#include <hio-sck.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "tap.h"
+
+struct conn_t
+{
+	int connected;
+	int eof;
+	char in[64];
+	hio_oow_t inlen;
+	hio_oow_t want; /* halt when this many bytes are read. 0 to wait for EOF */
+};
+typedef struct conn_t conn_t;
+
+static conn_t conn;
+
+static int on_read (hio_dev_sck_t* sck, const void* data, hio_iolen_t dlen, const hio_skad_t* srcaddr)
+{
+	if (dlen <= 0)
+	{
+		if (dlen == 0) conn.eof = 1;
+		hio_dev_sck_halt (sck);
+		return 0;
+	}
+
+	if (conn.inlen + dlen < sizeof(conn.in))
+	{
+		memcpy (&conn.in[conn.inlen], data, dlen);
+		conn.inlen += dlen;
+	}
+	if (conn.want > 0 && conn.inlen >= conn.want) hio_dev_sck_halt (sck);
+	return 0;
+}
+
+static int on_write (hio_dev_sck_t* sck, hio_iolen_t wrlen, void* wrctx, const hio_skad_t* dstaddr)
+{
+	return 0;
+}
+
+static void on_connect (hio_dev_sck_t* sck)
+{
+	conn.connected = 1;
+}
+
+static void on_disconnect (hio_dev_sck_t* sck)
+{
+	hio_stop (hio_dev_sck_gethio(sck), HIO_STOPREQ_TERMINATION);
+}
+
+/* connect to the listener and let the accepted peer write a greeting before
+ * the loop polls the connecting socket for the first time. the first poll
+ * reports the socket readable and writable together. with close_peer, the
+ * peer also closes its side and the poll reports a hang-up as well */
+static int run (hio_t* hio, int lfd, const struct sockaddr_in* sin, int close_peer)
+{
+	hio_dev_sck_make_t mi;
+	hio_dev_sck_connect_t ci;
+	hio_dev_sck_t* sck;
+	int fd;
+
+	memset (&conn, 0, sizeof(conn));
+	conn.want = close_peer? 0: 5;
+
+	memset (&mi, 0, sizeof(mi));
+	mi.type = HIO_DEV_SCK_TCP4;
+	mi.on_write = on_write;
+	mi.on_read = on_read;
+	mi.on_connect = on_connect;
+	mi.on_disconnect = on_disconnect;
+	sck = hio_dev_sck_make(hio, 0, &mi);
+	if (!sck) return -1;
+
+	memset (&ci, 0, sizeof(ci));
+	hio_skad_init_for_ip4 (&ci.remoteaddr, ntohs(sin->sin_port), (hio_ip4ad_t*)&sin->sin_addr);
+	HIO_INIT_NTIME (&ci.connect_tmout, 5, 0);
+	if (hio_dev_sck_connect(sck, &ci) <= -1)
+	{
+		hio_dev_sck_kill (sck);
+		return -1;
+	}
+
+	/* the handshake on loopback completes in the kernel without the loop */
+	fd = accept(lfd, HIO_NULL, HIO_NULL);
+	if (fd <= -1)
+	{
+		hio_dev_sck_kill (sck);
+		return -1;
+	}
+	write (fd, "hello", 5);
+	if (close_peer) shutdown (fd, SHUT_WR);
+
+	hio_loop (hio);
+	close (fd);
+	return 0;
+}
+
+int main()
+{
+	hio_t* hio;
+	struct sockaddr_in sin;
+	socklen_t sl;
+	int lfd;
+
+	no_plan ();
+
+	hio = hio_open(HIO_NULL, 0, HIO_NULL, HIO_FEATURE_ALL, 512, HIO_NULL);
+	if (!hio) return -1;
+
+	/* a plain listener outside the loop */
+	memset (&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sl = sizeof(sin);
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd <= -1 || bind(lfd, (struct sockaddr*)&sin, sl) <= -1 ||
+	    listen(lfd, 1) <= -1 || getsockname(lfd, (struct sockaddr*)&sin, &sl) <= -1) return -1;
+
+	OK (run(hio, lfd, &sin, 0) == 0, "connection started");
+	OK (conn.connected, "connected with input pending");
+	OK (conn.inlen == 5 && memcmp(conn.in, "hello", 5) == 0, "pending input read after the connection");
+
+	OK (run(hio, lfd, &sin, 1) == 0, "connection started to a peer closing early");
+	OK (conn.connected, "connected with input and hang-up pending");
+	OK (conn.inlen == 5 && memcmp(conn.in, "hello", 5) == 0 && conn.eof, "pending input read before EOF");
+
+	close (lfd);
+	hio_close (hio);
+	return exit_status();
+}
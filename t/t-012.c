@@ -0,0 +1,133 @@
+#include <hio-pro.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "tap.h"
+
+#define POOL_FLAGS (HIO_DEV_PRO_READOUT | HIO_DEV_PRO_INTONUL | HIO_DEV_PRO_ERRTONUL)
+
+struct out_t
+{
+	char buf[1024];
+	hio_oow_t len;
+	int eof;
+	pid_t pid;
+};
+typedef struct out_t out_t;
+
+static out_t out;
+
+static int pro_on_read (hio_dev_pro_t* dev, hio_dev_pro_sid_t sid, const void* data, hio_iolen_t dlen)
+{
+	if (dlen <= 0)
+	{
+		hio_dev_pro_kill (dev);
+		return 0;
+	}
+
+	if (out.len + dlen < sizeof(out.buf))
+	{
+		memcpy (&out.buf[out.len], data, dlen);
+		out.len += dlen;
+	}
+	return 0;
+}
+
+static int pro_on_write (hio_dev_pro_t* dev, hio_iolen_t wrlen, void* wrctx)
+{
+	return 0;
+}
+
+static void pro_on_close (hio_dev_pro_t* dev, hio_dev_pro_sid_t sid)
+{
+	if (sid == HIO_DEV_PRO_OUT) out.eof = 1;
+	else if (sid == HIO_DEV_PRO_MASTER) hio_stop (hio_dev_pro_gethio(dev), HIO_STOPREQ_TERMINATION);
+}
+
+static int run (hio_t* hio, hio_dev_pro_pool_t* pool, const char* cmd, int flags, hio_bch_t** env)
+{
+	hio_dev_pro_make_t mi;
+	hio_dev_pro_t* pro;
+
+	memset (&out, 0, sizeof(out));
+	memset (&mi, 0, sizeof(mi));
+	mi.flags = flags;
+	mi.cmd = cmd;
+	mi.env = env;
+	mi.pool = pool;
+	mi.on_read = pro_on_read;
+	mi.on_write = pro_on_write;
+	mi.on_close = pro_on_close;
+	pro = hio_dev_pro_make(hio, 0, &mi);
+	if (pro)
+	{
+		out.pid = pro->child_pid;
+		hio_loop (hio);
+	}
+	out.buf[out.len] = '\0';
+	return pro? 0: -1;
+}
+
+int main()
+{
+	hio_t* hio;
+	hio_dev_pro_pool_t* pool;
+	hio_dev_pro_poolstat_t st;
+	hio_bch_t* env[] = { "HIO_T012=abc def", HIO_NULL };
+	char fdname[32];
+	int fd, status, x;
+	no_plan ();
+
+	hio = hio_open(HIO_NULL, 0, HIO_NULL, HIO_FEATURE_ALL, 512, HIO_NULL);
+	if (!hio) return -1;
+
+	/* a descriptor without close-on-exec must not reach the helpers */
+	fd = open("/dev/null", O_RDONLY);
+	if (fd <= -1 || dup2(fd, 100) <= -1) return -1;
+	close (fd);
+	snprintf (fdname, sizeof(fdname), "\n%d\n", 100);
+
+	OK (hio_dev_pro_openpool(hio, "/nonexistent/hio-standby", POOL_FLAGS, 2) == HIO_NULL, "pool not opened with a helper that can't be executed");
+
+	pool = hio_dev_pro_openpool(hio, STANDBY_HELPER, POOL_FLAGS, 2);
+	OK (pool != HIO_NULL, "pool opened");
+	if (!pool) return exit_status();
+
+	/* the helpers are started on a loop iteration. the first command runs on a new process */
+	x = run(hio, pool, "/bin/echo first", POOL_FLAGS, HIO_NULL);
+	hio_dev_pro_getpoolstat (pool, &st);
+	OK (x == 0 && strcmp(out.buf, "first\n") == 0, "command run without a helper");
+	OK (st.nstandby == 2 && st.nhits == 0 && st.nmisses == 1, "pool filled after the first command");
+
+	x = run(hio, pool, "/bin/echo hello \"big world\"", POOL_FLAGS, HIO_NULL);
+	hio_dev_pro_getpoolstat (pool, &st);
+	OK (x == 0 && strcmp(out.buf, "hello big world\n") == 0, "arguments given to a helper");
+	OK (st.nhits == 1 && st.nmisses == 1, "command run on a helper");
+
+	x = run(hio, pool, "echo \"$HIO_T012\" $HOME", POOL_FLAGS | HIO_DEV_PRO_SHELL, env);
+	OK (x == 0 && strcmp(out.buf, "abc def\n") == 0, "environment given to a helper");
+
+	x = run(hio, pool, "ls -1 /proc/self/fd", POOL_FLAGS | HIO_DEV_PRO_SHELL, HIO_NULL);
+	OK (x == 0 && out.len > 0 && !strstr(out.buf, fdname), "inherited descriptor closed in a helper");
+
+	x = run(hio, pool, "/nonexistent/command", POOL_FLAGS | HIO_DEV_PRO_FORGET_CHILD, HIO_NULL);
+	OK (x == 0, "process made for a command that can't be executed");
+	OK (x == 0 && waitpid(out.pid, &status, 0) == out.pid && WIFEXITED(status) && WEXITSTATUS(status) == 128, "helper exited with 128");
+
+	/* a command with different io flags can't take a helper */
+	x = run(hio, pool, "/bin/echo other", HIO_DEV_PRO_READOUT | HIO_DEV_PRO_INTONUL, HIO_NULL);
+	hio_dev_pro_getpoolstat (pool, &st);
+	OK (x == 0 && strcmp(out.buf, "other\n") == 0, "command with other io flags run");
+	OK (st.nhits == 4 && st.nmisses == 2, "command with other io flags run without a helper");
+	OK (st.nstandby == 2, "pool refilled");
+
+	hio_dev_pro_closepool (pool);
+	OK (waitpid(-1, &status, WNOHANG) == -1 && errno == ECHILD, "waiting helpers reaped on close");
+
+	close (100);
+	hio_close (hio);
+	return exit_status();
+}